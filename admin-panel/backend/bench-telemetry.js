@@ -0,0 +1,125 @@
+// Telemetry encoding benchmark: JSON vs binary (schema v1) vs batched
+// high-rate frames
+// Bytes per sample (payload and on the wire) and encode / decode time on
+// this machine. The car-side encode cost is printed by the firmware when
+// built with -DTELEMETRY_BENCH.
+//
+//   npm run bench-telemetry [-- samples]
+import {
+  encodeTelemetryBin, decodeTelemetryBin, encodeTelemetryHr, decodeTelemetryHr,
+} from './src/telemetryCodec.js';
+
+const N = parseInt(process.argv[2] || '200000');
+const DEVICE_ID = 'esp32_car_7E7C3C';
+const TOPIC_JSON = `car/${DEVICE_ID}/telemetry`;
+const TOPIC_BIN = `car/${DEVICE_ID}/telemetry/bin`;
+const TOPIC_HR = `car/${DEVICE_ID}/telemetry/hr`;
+
+function sample(i) {
+  return {
+    device_id: DEVICE_ID,
+    mode: 'line',
+    motion: 'line_follow',
+    speed_linear: 150 + (i % 60),
+    speed_rot: (i % 80) - 40,
+    distance_cm: 20 + (i % 500) / 10,
+    obstacle: false,
+    line: [false, (i & 1) === 1, true, (i & 2) === 2, false],
+    wifi_rssi: -55 - (i % 20),
+    uptime_ms: 1000000 + i * 20,
+  };
+}
+
+// MQTT 3.1.1 PUBLISH, QoS 0: fixed header + topic length + topic + payload
+function wireBytes(topic, payloadLen) {
+  const remaining = 2 + Buffer.byteLength(topic) + payloadLen;
+  return 1 + (remaining < 128 ? 1 : remaining < 16384 ? 2 : 3) + remaining;
+}
+
+function bench(name, fn, unit = 'sample') {
+  for (let i = 0; i < 1000; i++) fn(i); // warm-up
+  const t0 = process.hrtime.bigint();
+  let sink = 0;
+  for (let i = 0; i < N; i++) sink += fn(i) ? 1 : 0;
+  const ns = Number(process.hrtime.bigint() - t0) / N;
+  console.log(`  ${name.padEnd(14)} ${(ns / 1000).toFixed(3)} us/${unit}`);
+  return sink;
+}
+
+const samples = Array.from({ length: 1024 }, (_, i) => sample(i));
+const jsonPayloads = samples.map((s) => Buffer.from(JSON.stringify(s)));
+const binPayloads = samples.map((s, i) => encodeTelemetryBin(s, i));
+
+const jsonLen = jsonPayloads.reduce((a, b) => a + b.length, 0) / samples.length;
+const binLen = binPayloads.reduce((a, b) => a + b.length, 0) / samples.length;
+
+console.log(`Telemetry encoding, ${N} samples\n`);
+console.log('Bytes per sample (payload / MQTT wire):');
+console.log(`  json  ${jsonLen.toFixed(1).padStart(6)} / ${wireBytes(TOPIC_JSON, Math.round(jsonLen))}`);
+console.log(`  bin   ${binLen.toFixed(1).padStart(6)} / ${wireBytes(TOPIC_BIN, binLen)}`);
+console.log(`  ratio ${(jsonLen / binLen).toFixed(1)}x payload`);
+for (const hz of [5, 20, 50]) {
+  const j = wireBytes(TOPIC_JSON, Math.round(jsonLen)) * hz;
+  const b = wireBytes(TOPIC_BIN, binLen) * hz;
+  console.log(`  @${String(hz).padStart(2)} Hz  json ${j} B/s  bin ${b} B/s`);
+}
+
+console.log('\nEncode:');
+bench('json', (i) => Buffer.from(JSON.stringify(samples[i & 1023])).length);
+bench('bin', (i) => encodeTelemetryBin(samples[i & 1023], i).length);
+
+console.log('Decode:');
+bench('json', (i) => JSON.parse(jsonPayloads[i & 1023].toString()).uptime_ms);
+bench('bin', (i) => decodeTelemetryBin(binPayloads[i & 1023]).uptime_ms);
+
+// Round trip sanity check
+for (let i = 0; i < samples.length; i++) {
+  const d = decodeTelemetryBin(binPayloads[i]);
+  const s = samples[i];
+  if (d.uptime_ms !== s.uptime_ms || d.speed_rot !== s.speed_rot ||
+      Math.abs(d.distance_cm - s.distance_cm) > 0.05 ||
+      d.line.some((v, k) => v !== s.line[k])) {
+    console.error('Round trip mismatch at sample', i, s, d);
+    process.exit(1);
+  }
+}
+console.log('\nRound trip OK');
+
+// ---- 50 Hz controller history: one publish per sample vs batched frames ----
+const HR_HZ = 50;
+const HR_FLUSH_MS = 500;
+const HR_MAX_PAYLOAD = 512;
+const perFrame = HR_HZ * HR_FLUSH_MS / 1000;
+const hrSamples = Array.from({ length: perFrame * 20 }, (_, i) => ({
+  t_ms: 1000000 + i * 20 + (i % 7 === 0 ? 1 : 0),
+  distance_mm: 600 + Math.round(40 * Math.sin(i / 50)),
+  line: [4, 6, 4, 12, 4][Math.floor(i / 9) % 5],
+  flags: 0,
+  ticks_l: 3 + (i % 3 === 0 ? 1 : 0),
+  ticks_r: 3 + (i % 4 === 0 ? 1 : 0),
+  pwm_l: 140 + Math.round(15 * Math.sin(i / 5)),
+  pwm_r: 140 - Math.round(15 * Math.sin(i / 5)),
+}));
+const frames = [];
+for (let i = 0; i < hrSamples.length; i += perFrame) {
+  frames.push(encodeTelemetryHr(hrSamples.slice(i, i + perFrame), { seq: frames.length }));
+}
+const hrPayload = frames.reduce((a, f) => a + f.length, 0);
+const hrWire = frames.reduce((a, f) => a + wireBytes(TOPIC_HR, f.length), 0);
+const frameMax = Math.max(...frames.map((f) => f.length));
+
+console.log(`\n${HR_HZ} Hz history, ${HR_FLUSH_MS} ms flush (${perFrame} samples/frame, largest ${frameMax} B of ${HR_MAX_PAYLOAD}):`);
+console.log(`  hr frames  ${(hrPayload / hrSamples.length).toFixed(1).padStart(6)} B/sample payload, ` +
+            `${(hrWire / hrSamples.length * HR_HZ).toFixed(0)} wire B/s, ${1000 / HR_FLUSH_MS} msg/s`);
+console.log(`  bin each   ${binLen.toFixed(1).padStart(6)} B/sample payload, ` +
+            `${wireBytes(TOPIC_BIN, binLen) * HR_HZ} wire B/s, ${HR_HZ} msg/s`);
+console.log(`  json each  ${jsonLen.toFixed(1).padStart(6)} B/sample payload, ` +
+            `${wireBytes(TOPIC_JSON, Math.round(jsonLen)) * HR_HZ} wire B/s, ${HR_HZ} msg/s`);
+
+let decoded = 0;
+for (const f of frames) decoded += decodeTelemetryHr(f).samples.length;
+if (decoded !== hrSamples.length) {
+  console.error('HR round trip lost samples', decoded, hrSamples.length);
+  process.exit(1);
+}
+bench('hr decode', (i) => decodeTelemetryHr(frames[i % frames.length]).samples.length, 'frame');
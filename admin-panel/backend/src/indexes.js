@@ -1,6 +1,9 @@
 import { getDb } from './mongo.js';
 import { ObjectId } from 'mongodb';
 
+// High-rate samples expire after this many hours (TTL index on ts)
+const TELEMETRY_HR_RETENTION_H = parseFloat(process.env.TELEMETRY_HR_RETENTION_H || '24');
+
 export async function ensureIndexes() {
   const db = getDb();
 
@@ -11,6 +14,13 @@ export async function ensureIndexes() {
       { name: 'device_id_ts_idx' }
     );
 
+    // High-rate telemetry (one document per sample)
+    await db.collection('telemetry_hr').createIndex(
+      { device_id: 1, ts: -1 },
+      { name: 'device_id_ts_idx' }
+    );
+    await ensureTtlIndex(db, 'telemetry_hr', Math.round(TELEMETRY_HR_RETENTION_H * 3600));
+
     // Events indexes
     await db.collection('events').createIndex(
       { device_id: 1, ts: -1 },
@@ -40,3 +50,20 @@ export async function ensureIndexes() {
   }
 }
 
+// TTL index on ts; a changed retention is applied with collMod instead of
+// failing on the existing index
+async function ensureTtlIndex(db, collection, expireAfterSeconds) {
+  try {
+    await db.collection(collection).createIndex(
+      { ts: 1 },
+      { name: 'ts_ttl_idx', expireAfterSeconds }
+    );
+  } catch (error) {
+    if (error.codeName !== 'IndexOptionsConflict') throw error;
+    await db.command({
+      collMod: collection,
+      index: { name: 'ts_ttl_idx', expireAfterSeconds },
+    });
+    console.log(`[Indexes] ${collection} retention set to ${expireAfterSeconds} s`);
+  }
+}
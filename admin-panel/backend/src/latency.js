@@ -0,0 +1,115 @@
+import { performance } from 'perf_hooks';
+
+// Publish → ingest latency per device and message type.
+// Cars stamp JSON telemetry, binary telemetry (v2), events and status with
+// ts_us (epoch µs, SNTP) and sync_err_us once their clock is synced;
+// latency = arrival - ts_us.
+// The backend host must be NTP-synced too. Messages whose sync error is
+// above LATENCY_MAX_SYNC_ERR_US are counted as unsynced but not binned.
+
+const LATENCY_MAX_SYNC_ERR_US = parseInt(process.env.LATENCY_MAX_SYNC_ERR_US || '20000');
+
+// Upper bounds (ms) of the histogram buckets; the last bucket is +Inf
+export const LATENCY_BUCKETS_MS = [1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000];
+
+const histograms = new Map(); // `${device_id}|${type}` -> histogram
+
+// Wall clock in µs with sub-millisecond resolution
+export function nowUs() {
+  return Math.round((performance.timeOrigin + performance.now()) * 1000);
+}
+
+function getHistogram(deviceId, type) {
+  const key = `${deviceId}|${type}`;
+  let h = histograms.get(key);
+  if (!h) {
+    h = {
+      device_id: deviceId,
+      type,
+      buckets: new Array(LATENCY_BUCKETS_MS.length + 1).fill(0),
+      count: 0,
+      sum_ms: 0,
+      min_ms: Infinity,
+      max_ms: -Infinity,
+      negative: 0,       // clock error larger than the latency itself
+      unsynced: 0,
+      sync_err_us_max: 0,
+      since: new Date(),
+    };
+    histograms.set(key, h);
+  }
+  return h;
+}
+
+// Record one message. Returns the latency in ms, or null when the message
+// carries no usable timestamp.
+export function recordLatency(deviceId, type, payload, arrivalUs) {
+  if (typeof payload.ts_us !== 'number') return null;
+  const h = getHistogram(deviceId, type);
+  const syncErrUs = typeof payload.sync_err_us === 'number' ? payload.sync_err_us : Infinity;
+  if (syncErrUs > LATENCY_MAX_SYNC_ERR_US) {
+    h.unsynced++;
+    return null;
+  }
+
+  const latencyMs = (arrivalUs - payload.ts_us) / 1000;
+  let i = LATENCY_BUCKETS_MS.findIndex((le) => latencyMs <= le);
+  if (i < 0) i = LATENCY_BUCKETS_MS.length;
+  h.buckets[i]++;
+  h.count++;
+  h.sum_ms += latencyMs;
+  if (latencyMs < h.min_ms) h.min_ms = latencyMs;
+  if (latencyMs > h.max_ms) h.max_ms = latencyMs;
+  if (latencyMs < 0) h.negative++;
+  if (syncErrUs > h.sync_err_us_max) h.sync_err_us_max = syncErrUs;
+  return latencyMs;
+}
+
+// Upper bound of the bucket holding the p-th percentile
+function percentile(h, p) {
+  if (h.count === 0) return null;
+  const target = Math.ceil((p / 100) * h.count);
+  let cum = 0;
+  for (let i = 0; i < h.buckets.length; i++) {
+    cum += h.buckets[i];
+    if (cum >= target) {
+      return i < LATENCY_BUCKETS_MS.length ? LATENCY_BUCKETS_MS[i] : h.max_ms;
+    }
+  }
+  return h.max_ms;
+}
+
+const round3 = (v) => Math.round(v * 1000) / 1000;
+
+export function getLatency(deviceId) {
+  const out = [];
+  for (const h of histograms.values()) {
+    if (deviceId && h.device_id !== deviceId) continue;
+    out.push({
+      device_id: h.device_id,
+      type: h.type,
+      count: h.count,
+      unsynced: h.unsynced,
+      negative: h.negative,
+      mean_ms: h.count ? round3(h.sum_ms / h.count) : null,
+      min_ms: h.count ? round3(h.min_ms) : null,
+      max_ms: h.count ? round3(h.max_ms) : null,
+      p50_ms: percentile(h, 50),
+      p90_ms: percentile(h, 90),
+      p99_ms: percentile(h, 99),
+      sync_err_us_max: h.sync_err_us_max,
+      since: h.since,
+      buckets: h.buckets.map((count, i) => ({
+        le_ms: i < LATENCY_BUCKETS_MS.length ? LATENCY_BUCKETS_MS[i] : '+Inf',
+        count,
+      })),
+    });
+  }
+  return out;
+}
+
+export function resetLatency(deviceId) {
+  for (const [key, h] of histograms) {
+    if (!deviceId || h.device_id === deviceId) histograms.delete(key);
+  }
+}
@@ -1,6 +1,10 @@
 import mqtt from 'mqtt';
 import dotenv from 'dotenv';
 import { getDb } from './mongo.js';
+import {
+  decodeTelemetryBin, decodeTelemetryHr, decodeSpoolReplay, SPOOL_TELEMETRY, SPOOL_EVENT,
+} from './telemetryCodec.js';
+import { nowUs, recordLatency } from './latency.js';
 
 dotenv.config();
 
@@ -9,6 +13,16 @@ let deviceLastSeen = new Map(); // Track last seen time for each device
 let offlineCheckInterval = null;
 const OFFLINE_TIMEOUT_MS = parseInt(process.env.OFFLINE_TIMEOUT_MS || '25000'); // Default 25 seconds (2.5x ESP32 interval)
 
+// Telemetry format requested from cars that advertise binary support
+// ('bin' or 'json') and the binary sample rate
+const TELEMETRY_FORMAT = process.env.TELEMETRY_FORMAT || 'bin';
+const TELEMETRY_HZ = parseInt(process.env.TELEMETRY_HZ || '20');
+// High-rate batched frames (car/<id>/telemetry/hr): sample rate, 0 = off.
+// Opt-in: one telemetry_hr document per sample (50 Hz ≈ 4.3 M docs/car/day,
+// kept TELEMETRY_HR_RETENTION_H hours, see indexes.js)
+const TELEMETRY_HR_HZ = parseInt(process.env.TELEMETRY_HR_HZ || '0');
+const TELEMETRY_HR_FLUSH_MS = parseInt(process.env.TELEMETRY_HR_FLUSH_MS || '500');
+
 export function startMqtt(io) {
   const mqttUrl = process.env.MQTT_URL || 'mqtt://192.168.0.107:1883';
 
@@ -31,6 +45,39 @@ export function startMqtt(io) {
       }
     });
 
+    mqttClient.subscribe('car/+/telemetry/bin', (err) => {
+      if (err) {
+        console.error('[MQTT] Subscribe error (telemetry/bin):', err);
+      } else {
+        console.log('[MQTT] Subscribed to car/+/telemetry/bin');
+      }
+    });
+
+    mqttClient.subscribe('car/+/telemetry/hr', (err) => {
+      if (err) {
+        console.error('[MQTT] Subscribe error (telemetry/hr):', err);
+      } else {
+        console.log('[MQTT] Subscribed to car/+/telemetry/hr');
+      }
+    });
+
+    mqttClient.subscribe('car/+/telemetry/format', (err) => {
+      if (err) {
+        console.error('[MQTT] Subscribe error (telemetry/format):', err);
+      } else {
+        console.log('[MQTT] Subscribed to car/+/telemetry/format');
+      }
+    });
+
+    // QoS 1: the car deletes a spooled record once the broker acks it
+    mqttClient.subscribe('car/+/spool', { qos: 1 }, (err) => {
+      if (err) {
+        console.error('[MQTT] Subscribe error (spool):', err);
+      } else {
+        console.log('[MQTT] Subscribed to car/+/spool');
+      }
+    });
+
     mqttClient.subscribe('car/+/event', (err) => {
       if (err) {
         console.error('[MQTT] Subscribe error (event):', err);
@@ -49,8 +96,23 @@ export function startMqtt(io) {
   });
 
   mqttClient.on('message', async (topic, message) => {
+    const arrivalUs = nowUs(); // before any await, for the latency histograms
+    if (topic.endsWith('/telemetry/format')) {
+      negotiateTelemetryFormat(topic, message);
+      return;
+    }
+    if (topic.endsWith('/telemetry/hr')) {
+      await ingestHrFrame(topic, message, io);
+      return;
+    }
+    if (topic.endsWith('/spool')) {
+      await ingestSpoolRecord(topic, message);
+      return;
+    }
+
+    const binary = topic.endsWith('/telemetry/bin');
     try {
-      const payload = JSON.parse(message.toString());
+      const payload = binary ? decodeTelemetryBin(message) : JSON.parse(message.toString());
       const db = getDb();
       const ts = new Date();
 
@@ -93,6 +155,10 @@ export function startMqtt(io) {
       }
 
       if (collectionName) {
+        // Publish → ingest latency (ts_us from the car's SNTP clock)
+        const latencyMs = recordLatency(deviceId, collectionName, payload, arrivalUs);
+        if (latencyMs !== null) doc.latency_ms = latencyMs;
+
         // Update last seen time for device
         deviceLastSeen.set(deviceId, ts);
 
@@ -137,8 +203,8 @@ export function startMqtt(io) {
         }
       }
     } catch (parseError) {
-      console.error('[MQTT] JSON parse error:', parseError);
-      console.error('[MQTT] Raw message:', message.toString());
+      console.error(`[MQTT] ${binary ? 'Binary decode' : 'JSON parse'} error:`, parseError);
+      console.error('[MQTT] Raw message:', binary ? message.toString('hex') : message.toString());
     }
   });
 
@@ -164,6 +230,121 @@ export function startMqtt(io) {
   return mqttClient;
 }
 
+// Answer a car's telemetry format offer (retained on car/<id>/telemetry/format)
+// with the format we want, retained on car/<id>/telemetry/format/set so the
+// car gets it again on every reconnect.
+function negotiateTelemetryFormat(topic, message) {
+  if (message.length === 0) {
+    return; // retained offer cleared
+  }
+
+  let offer;
+  try {
+    offer = JSON.parse(message.toString());
+  } catch (err) {
+    console.error('[MQTT] Bad telemetry format offer:', message.toString());
+    return;
+  }
+
+  const formats = Array.isArray(offer.formats) ? offer.formats : ['json'];
+  // v1 samples carry no timestamp: still accepted, latency is then JSON-only
+  const useBin = TELEMETRY_FORMAT === 'bin' && formats.includes('bin') && [1, 2].includes(offer.version);
+  const choice = useBin
+    ? { format: 'bin', hz: Math.min(TELEMETRY_HZ, offer.max_hz || TELEMETRY_HZ) }
+    : { format: 'json' };
+  if (offer.hr && offer.hr.version === 1 && TELEMETRY_HR_HZ > 0) {
+    choice.hr_hz = Math.min(TELEMETRY_HR_HZ, offer.hr.max_hz || TELEMETRY_HR_HZ);
+    choice.hr_flush_ms = TELEMETRY_HR_FLUSH_MS;
+  }
+
+  mqttClient.publish(`${topic}/set`, JSON.stringify(choice), { retain: true, qos: 1 });
+  console.log(`[MQTT] Telemetry format for ${topic.split('/')[1]}: ${choice.format}${useBin ? ` @ ${choice.hz} Hz` : ''}${choice.hr_hz ? `, hr ${choice.hr_hz} Hz` : ''}`);
+}
+
+// Expand one high-rate frame into per-sample documents (telemetry_hr).
+// Server time of each sample = receive time minus its age within the frame.
+async function ingestHrFrame(topic, message, io) {
+  const deviceId = topic.split('/')[1];
+  let frame;
+  try {
+    frame = decodeTelemetryHr(message);
+  } catch (err) {
+    console.error(`[MQTT] HR frame decode error (${deviceId}):`, err.message);
+    console.error('[MQTT] Raw message:', message.toString('hex'));
+    return;
+  }
+  if (frame.samples.length === 0) {
+    return;
+  }
+
+  const now = Date.now();
+  const lastMs = frame.samples[frame.samples.length - 1].uptime_ms;
+  const docs = frame.samples.map((s) => ({
+    ...s,
+    device_id: deviceId,
+    ts: new Date(now - (lastMs - s.uptime_ms)),
+    frame_seq: frame.seq,
+  }));
+
+  deviceLastSeen.set(deviceId, new Date(now));
+  try {
+    await getDb().collection('telemetry_hr').insertMany(docs, { ordered: false });
+    if (io) {
+      io.emit('telemetry_hr', { device_id: deviceId, seq: frame.seq, samples: frame.samples });
+    }
+  } catch (dbError) {
+    console.error('[MQTT] DB insert error (telemetry_hr):', dbError);
+  }
+}
+
+// Store one record replayed from a car's offline spool into telemetry /
+// events with replayed: true. ts is reconstructed from the car's uptime when
+// the record is from the current boot, else receive time with ts_approx.
+// Replay is at-least-once (QoS 1, the car resends a record until it gets the
+// PUBACK): a duplicate has the same device_id + boot + spool_seq.
+async function ingestSpoolRecord(topic, message) {
+  const deviceId = topic.split('/')[1];
+  let rec;
+  let payload;
+  try {
+    rec = decodeSpoolReplay(message);
+    if (rec.type === SPOOL_TELEMETRY) {
+      payload = decodeTelemetryBin(rec.payload);
+    } else if (rec.type === SPOOL_EVENT) {
+      payload = JSON.parse(rec.payload.toString());
+    } else {
+      throw new Error(`Unknown spool record type ${rec.type}`);
+    }
+  } catch (err) {
+    console.error(`[MQTT] Spool record decode error (${deviceId}):`, err.message);
+    console.error('[MQTT] Raw message:', message.toString('hex'));
+    return;
+  }
+
+  const now = Date.now();
+  const sameBoot = rec.boot === rec.now_boot;
+  const doc = {
+    ...payload,
+    device_id: deviceId,
+    ts: new Date(sameBoot ? now - (rec.now_ms - rec.t_ms) : now),
+    topic: `car/${deviceId}/${rec.type === SPOOL_TELEMETRY ? 'telemetry' : 'event'}`,
+    replayed: true,
+    spool_seq: rec.seq,
+    boot: rec.boot,
+  };
+  if (!sameBoot) {
+    doc.ts_approx = true;
+  }
+
+  deviceLastSeen.set(deviceId, new Date(now));
+  const collectionName = rec.type === SPOOL_TELEMETRY ? 'telemetry' : 'events';
+  try {
+    await getDb().collection(collectionName).insertOne(doc);
+  } catch (dbError) {
+    console.error(`[MQTT] DB insert error (${collectionName}, replayed):`, dbError);
+  }
+}
+
 // Check for offline devices periodically
 async function checkOfflineDevices(io) {
   const now = new Date();
@@ -4,6 +4,7 @@ import { getDb } from './mongo.js';
 import { parseDateRange } from './utils.js';
 import { hashPassword, comparePassword, generateToken } from './auth.js';
 import { authenticateToken, requireAdmin } from './authMiddleware.js';
+import { getLatency, resetLatency, LATENCY_BUCKETS_MS } from './latency.js';
 
 const router = express.Router();
 
@@ -528,6 +529,55 @@ router.get('/telemetry', async (req, res) => {
   }
 });
 
+// Publish → ingest latency histograms per device and message type
+// (telemetry / events / status), in-memory since start or the last reset
+router.get('/latency', (req, res) => {
+  const { device_id } = req.query;
+  res.json({ buckets_ms: LATENCY_BUCKETS_MS, histograms: getLatency(device_id) });
+});
+
+router.delete('/latency', authenticateToken, requireAdmin, (req, res) => {
+  resetLatency(req.query.device_id);
+  res.json({ message: 'Latency histograms reset' });
+});
+
+// Get high-rate telemetry samples (expanded from car/<id>/telemetry/hr frames)
+router.get('/telemetry/hr', async (req, res) => {
+  try {
+    const { device_id, limit = 1000, from, to } = req.query;
+
+    if (!device_id) {
+      return res.status(400).json({ error: 'device_id is required' });
+    }
+
+    const db = getDb();
+    const query = { device_id };
+
+    try {
+      const { fromDate, toDate } = parseDateRange(from, to);
+      if (fromDate || toDate) {
+        query.ts = {};
+        if (fromDate) query.ts.$gte = fromDate;
+        if (toDate) query.ts.$lte = toDate;
+      }
+    } catch (dateError) {
+      return res.status(400).json({ error: dateError.message });
+    }
+
+    const docs = await db
+      .collection('telemetry_hr')
+      .find(query)
+      .sort({ ts: -1 })
+      .limit(parseInt(limit))
+      .toArray();
+
+    res.json(docs);
+  } catch (error) {
+    console.error('[API] /telemetry/hr error:', error);
+    res.status(500).json({ error: error.message });
+  }
+});
+
 // Get events history
 router.get('/events', async (req, res) => {
   try {
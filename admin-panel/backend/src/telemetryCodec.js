@@ -0,0 +1,282 @@
+// Binary telemetry codec (car/<id>/telemetry/bin)
+// Mirror of esp32_car/include/telemetry_codec.h - keep the layout in sync.
+//
+//  off size field
+//    0  u8  schema        0x54 ('T')
+//    1  u8  version       1 or 2
+//    2  u16 seq
+//    4  u32 uptime_ms
+//    8  u8  mode          index into MODES
+//    9  u8  motion        index into MOTIONS
+//   10  i16 speed_linear
+//   12  i16 speed_rot
+//   14  u16 distance_mm   cm x 10, 0xFFFF = no reading
+//   16  u8  line          bit0 = L2 ... bit4 = R2
+//   17  u8  flags         bit0 = obstacle
+//   18  i8  wifi_rssi
+//  v2 only (live samples; the offline spool stays v1):
+//   19  i64 ts_us         epoch µs from the car's SNTP clock, 0 = not synced
+//   27  u32 sync_err_us
+// All multi-byte fields are little-endian.
+
+export const TELEMETRY_SCHEMA_ID = 0x54;
+export const TELEMETRY_SCHEMA_VERSION = 2;
+export const TELEMETRY_CONTENT_TYPE = 'application/x-car-telemetry;v=2';
+export const TELEMETRY_BIN_V1_SIZE = 19;
+export const TELEMETRY_BIN_V2_SIZE = 31;
+const BIN_SIZE = { 1: TELEMETRY_BIN_V1_SIZE, 2: TELEMETRY_BIN_V2_SIZE };
+
+const DIST_NONE = 0xffff;
+const CODE_NONE = 0xff;
+const FLAG_OBSTACLE = 0x01;
+
+export const MODES = ['manual', 'line'];
+export const MOTIONS = [
+  'stop', 'forward', 'backward', 'left', 'right',
+  'fwd_left', 'fwd_right', 'back_left', 'back_right', 'line_follow',
+  'velocity',
+];
+
+// Decode one binary sample into the same shape as the JSON telemetry
+// (plus seq and format; ts_us / sync_err_us when the car's clock was
+// synced). Throws on unknown schema / version / size.
+export function decodeTelemetryBin(buf) {
+  if (!Buffer.isBuffer(buf)) {
+    buf = Buffer.from(buf);
+  }
+  if (buf.length < 2 || buf[0] !== TELEMETRY_SCHEMA_ID) {
+    throw new Error('Not a telemetry sample');
+  }
+  const version = buf[1];
+  if (!BIN_SIZE[version]) {
+    throw new Error(`Unsupported telemetry schema version ${version}`);
+  }
+  if (buf.length !== BIN_SIZE[version]) {
+    throw new Error(`Bad telemetry v${version} size ${buf.length}`);
+  }
+
+  const distanceMm = buf.readUInt16LE(14);
+  const line = buf[16];
+  const modeCode = buf[8];
+  const motionCode = buf[9];
+
+  const out = {
+    seq: buf.readUInt16LE(2),
+    uptime_ms: buf.readUInt32LE(4),
+    mode: modeCode === CODE_NONE ? null : (MODES[modeCode] ?? `mode_${modeCode}`),
+    motion: motionCode === CODE_NONE ? null : (MOTIONS[motionCode] ?? `motion_${motionCode}`),
+    speed_linear: buf.readInt16LE(10),
+    speed_rot: buf.readInt16LE(12),
+    distance_cm: distanceMm === DIST_NONE ? -1 : distanceMm / 10,
+    obstacle: (buf[17] & FLAG_OBSTACLE) !== 0,
+    line: [0, 1, 2, 3, 4].map((i) => (line & (1 << i)) !== 0),
+    wifi_rssi: buf.readInt8(18),
+    format: 'bin',
+  };
+  if (version >= 2) {
+    const tsUs = Number(buf.readBigInt64LE(19));
+    if (tsUs !== 0) {
+      out.ts_us = tsUs;
+      out.sync_err_us = buf.readUInt32LE(27);
+    }
+  }
+  return out;
+}
+
+// Encoder (v2), used by the benchmark (bench-telemetry.js) to simulate a car
+export function encodeTelemetryBin(sample, seq = 0) {
+  const buf = Buffer.alloc(TELEMETRY_BIN_V2_SIZE);
+  const mode = MODES.indexOf(sample.mode);
+  const motion = MOTIONS.indexOf(sample.motion);
+  const dist = sample.distance_cm > 0 ? Math.round(sample.distance_cm * 10) : DIST_NONE;
+
+  buf[0] = TELEMETRY_SCHEMA_ID;
+  buf[1] = TELEMETRY_SCHEMA_VERSION;
+  buf.writeUInt16LE(seq & 0xffff, 2);
+  buf.writeUInt32LE((sample.uptime_ms ?? 0) >>> 0, 4);
+  buf[8] = mode < 0 ? CODE_NONE : mode;
+  buf[9] = motion < 0 ? CODE_NONE : motion;
+  buf.writeInt16LE(clamp(sample.speed_linear ?? 0, -32768, 32767), 10);
+  buf.writeInt16LE(clamp(sample.speed_rot ?? 0, -32768, 32767), 12);
+  buf.writeUInt16LE(Math.min(dist, DIST_NONE), 14);
+  buf[16] = (sample.line || []).reduce((m, on, i) => (on ? m | (1 << i) : m), 0);
+  buf[17] = sample.obstacle ? FLAG_OBSTACLE : 0;
+  buf.writeInt8(clamp(sample.wifi_rssi ?? 0, -128, 127), 18);
+  buf.writeBigInt64LE(BigInt(Math.trunc(sample.ts_us ?? 0)), 19);
+  buf.writeUInt32LE((sample.sync_err_us ?? 0) >>> 0, 27);
+  return buf;
+}
+
+function clamp(v, lo, hi) {
+  return Math.max(lo, Math.min(hi, Math.trunc(v)));
+}
+
+// ================= High-rate frames (car/<id>/telemetry/hr) =================
+// Mirror of esp32_car/include/telemetry_hr.h
+//
+//  header (14 bytes): u8 schema 0x48 ('H'), u8 version 1, u16 seq, u8 flags
+//  (bit0 = more parts follow), u8 count, u16 period_ms, u16 mm_per_tick_q8,
+//  u32 base_ms; then per sample: varint dt_ms, zigzag d distance_mm,
+//  u8 (line | flags << 5) XOR previous, zigzag d ticks_l / ticks_r / pwm_l / pwm_r.
+//  "previous" starts at zero in every frame.
+
+export const TELEMETRY_HR_SCHEMA_ID = 0x48;
+export const TELEMETRY_HR_HEADER_SIZE = 14;
+
+const HR_FLAG_RECOVERING = 0x01;
+const HR_FLAG_OBSTACLE = 0x02;
+const HR_MORE = 0x01;
+
+function readVarint(buf, pos) {
+  let v = 0;
+  let shift = 0;
+  for (;;) {
+    if (pos.o >= buf.length) {
+      throw new Error('Truncated HR frame');
+    }
+    const b = buf[pos.o++];
+    v += (b & 0x7f) * 2 ** shift;
+    if ((b & 0x80) === 0) return v;
+    shift += 7;
+    if (shift > 35) throw new Error('Bad varint in HR frame');
+  }
+}
+
+function readZigzag(buf, pos) {
+  const v = readVarint(buf, pos);
+  return v % 2 === 0 ? v / 2 : -(v + 1) / 2;
+}
+
+function writeVarint(out, v) {
+  while (v >= 0x80) {
+    out.push((v & 0x7f) | 0x80);
+    v = Math.floor(v / 128);
+  }
+  out.push(v);
+}
+
+function writeZigzag(out, v) {
+  writeVarint(out, v >= 0 ? v * 2 : -v * 2 - 1);
+}
+
+// Decode one frame and expand it into per-sample records. Wheel speeds are
+// derived from the tick deltas and the actual sample spacing.
+export function decodeTelemetryHr(buf) {
+  if (!Buffer.isBuffer(buf)) {
+    buf = Buffer.from(buf);
+  }
+  if (buf.length < TELEMETRY_HR_HEADER_SIZE || buf[0] !== TELEMETRY_HR_SCHEMA_ID) {
+    throw new Error('Not a high-rate telemetry frame');
+  }
+  if (buf[1] !== 1) {
+    throw new Error(`Unsupported HR telemetry version ${buf[1]}`);
+  }
+
+  const seq = buf.readUInt16LE(2);
+  const flags = buf[4];
+  const count = buf[5];
+  const periodMs = buf.readUInt16LE(6);
+  const mmPerTick = buf.readUInt16LE(8) / 256;
+  const baseMs = buf.readUInt32LE(10);
+
+  const pos = { o: TELEMETRY_HR_HEADER_SIZE };
+  const prev = { t: baseMs, dist: 0, state: 0, tl: 0, tr: 0, pl: 0, pr: 0 };
+  const samples = [];
+  for (let i = 0; i < count; i++) {
+    const dt = readVarint(buf, pos);
+    const t = prev.t + dt;
+    const dist = prev.dist + readZigzag(buf, pos);
+    if (pos.o >= buf.length) throw new Error('Truncated HR frame');
+    const state = buf[pos.o++] ^ prev.state;
+    const tl = prev.tl + readZigzag(buf, pos);
+    const tr = prev.tr + readZigzag(buf, pos);
+    const pl = prev.pl + readZigzag(buf, pos);
+    const pr = prev.pr + readZigzag(buf, pos);
+
+    // ticks are counted since the previous sample (also across frames),
+    // use the nominal period for the first sample of a frame
+    const spanS = (i === 0 ? periodMs : dt) / 1000;
+    const line = state & 0x1f;
+    const sflags = state >> 5;
+    samples.push({
+      uptime_ms: t,
+      distance_cm: dist === 0 ? -1 : dist / 10,
+      line: [0, 1, 2, 3, 4].map((k) => (line & (1 << k)) !== 0),
+      recovering: (sflags & HR_FLAG_RECOVERING) !== 0,
+      obstacle: (sflags & HR_FLAG_OBSTACLE) !== 0,
+      ticks_l: tl,
+      ticks_r: tr,
+      v_l: spanS > 0 ? (tl * mmPerTick) / 1000 / spanS : null,
+      v_r: spanS > 0 ? (tr * mmPerTick) / 1000 / spanS : null,
+      pwm_l: pl,
+      pwm_r: pr,
+    });
+    Object.assign(prev, { t, dist, state: state, tl, tr, pl, pr });
+  }
+  if (pos.o !== buf.length) {
+    throw new Error(`HR frame has ${buf.length - pos.o} trailing bytes`);
+  }
+
+  return { seq, more: (flags & HR_MORE) !== 0, period_ms: periodMs, base_ms: baseMs, samples };
+}
+
+// Encoder, used by the benchmark to simulate a car
+// samples: [{ t_ms, distance_mm, line (mask), flags, ticks_l, ticks_r, pwm_l, pwm_r }]
+export function encodeTelemetryHr(samples, { seq = 0, more = false, periodMs = 20, mmPerTickQ8 = 1307 } = {}) {
+  const out = [];
+  const prev = { t_ms: samples[0].t_ms, distance_mm: 0, state: 0, ticks_l: 0, ticks_r: 0, pwm_l: 0, pwm_r: 0 };
+  for (const s of samples) {
+    const state = (s.line | (s.flags << 5)) & 0xff;
+    writeVarint(out, s.t_ms - prev.t_ms);
+    writeZigzag(out, s.distance_mm - prev.distance_mm);
+    out.push(state ^ prev.state);
+    writeZigzag(out, s.ticks_l - prev.ticks_l);
+    writeZigzag(out, s.ticks_r - prev.ticks_r);
+    writeZigzag(out, s.pwm_l - prev.pwm_l);
+    writeZigzag(out, s.pwm_r - prev.pwm_r);
+    Object.assign(prev, s, { state });
+  }
+
+  const buf = Buffer.alloc(TELEMETRY_HR_HEADER_SIZE + out.length);
+  buf[0] = TELEMETRY_HR_SCHEMA_ID;
+  buf[1] = 1;
+  buf.writeUInt16LE(seq & 0xffff, 2);
+  buf[4] = more ? HR_MORE : 0;
+  buf[5] = samples.length;
+  buf.writeUInt16LE(periodMs, 6);
+  buf.writeUInt16LE(mmPerTickQ8, 8);
+  buf.writeUInt32LE(samples[0].t_ms >>> 0, 10);
+  Buffer.from(out).copy(buf, TELEMETRY_HR_HEADER_SIZE);
+  return buf;
+}
+
+// ================= Spool replay (car/<id>/spool) =================
+// Mirror of SpoolReplayHeader in esp32_car/include/telemetry_spool.h
+//
+//  header (18 bytes): u8 schema 0x53 ('S'), u8 type (1 = telemetry bin v1,
+//  2 = event JSON), u16 boot, u16 now_boot, u32 t_ms, u32 now_ms, u32 seq;
+//  then the original payload. t_ms / now_ms are car uptimes, only comparable
+//  when boot === now_boot.
+
+export const SPOOL_REPLAY_SCHEMA_ID = 0x53;
+export const SPOOL_REPLAY_HEADER_SIZE = 18;
+export const SPOOL_TELEMETRY = 1;
+export const SPOOL_EVENT = 2;
+
+export function decodeSpoolReplay(buf) {
+  if (!Buffer.isBuffer(buf)) {
+    buf = Buffer.from(buf);
+  }
+  if (buf.length < SPOOL_REPLAY_HEADER_SIZE || buf[0] !== SPOOL_REPLAY_SCHEMA_ID) {
+    throw new Error('Not a spool replay record');
+  }
+  return {
+    type: buf[1],
+    boot: buf.readUInt16LE(2),
+    now_boot: buf.readUInt16LE(4),
+    t_ms: buf.readUInt32LE(6),
+    now_ms: buf.readUInt32LE(10),
+    seq: buf.readUInt32LE(14),
+    payload: buf.subarray(SPOOL_REPLAY_HEADER_SIZE),
+  };
+}
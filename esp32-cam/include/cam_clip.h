@@ -0,0 +1,36 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_http_server.h"
+
+// ================= Event Clip Recorder API =================
+// Keeps the last few seconds of JPEG frames (reduced rate) in a PSRAM ring.
+// A trigger (HTTP or the car's obstacle event over MQTT) keeps recording for
+// the post-trigger window and then freezes the ring until it is re-armed,
+// so the clip around the event can be downloaded.
+//
+//   GET /clip               state + frame index (JSON)
+//   GET /clip/trigger       ?reason=<text>
+//   GET /clip/arm           drop the frozen clip and start a new pre-roll
+//   GET /clip/download      frozen clip as MJPEG (multipart, per-frame timestamps)
+
+enum CamClipState {
+  CLIP_DISABLED = 0,   // no PSRAM arena
+  CLIP_ARMED,          // pre-roll ring running
+  CLIP_TRIGGERED,      // recording post-trigger frames
+  CLIP_FROZEN          // clip complete, waiting for download / re-arm
+};
+
+// Allocate the arena and start the recorder task (call after cam_pipeline_begin)
+bool cam_clip_begin();
+
+// Freeze the ring around "now". Safe from any task. Returns false if a clip is
+// already being recorded/held or the recorder is disabled. The reason is kept
+// to [A-Za-z0-9 _-], other characters become '_'.
+bool cam_clip_trigger(const char* reason);
+
+CamClipState cam_clip_state();
+
+esp_err_t cam_clip_status_handler(httpd_req_t *req);
+esp_err_t cam_clip_trigger_handler(httpd_req_t *req);
+esp_err_t cam_clip_arm_handler(httpd_req_t *req);
+esp_err_t cam_clip_download_handler(httpd_req_t *req);
@@ -0,0 +1,48 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "esp_http_server.h"
+
+// ================= Camera Configuration API =================
+// Camera operating point, persisted in NVS (Preferences namespace "cam")
+// and changeable at runtime through GET /control?var=<name>&val=<value>
+
+#define CAM_SETTINGS_VERSION 2
+
+struct CamSettings {
+  uint8_t version;
+  uint8_t framesize;   // framesize_t
+  uint8_t quality;     // JPEG quality 4..63 (lower = better)
+  uint8_t fb_count;    // 1..3 frame buffers
+  uint8_t xclk_mhz;    // sensor clock, 8..20 MHz
+  int8_t brightness;   // -2..2
+  int8_t contrast;     // -2..2
+  int8_t saturation;   // -2..2
+  uint8_t hmirror;
+  uint8_t vflip;
+  uint8_t awb;         // auto white balance
+  uint8_t aec;         // auto exposure
+  uint8_t agc;         // auto gain
+  uint8_t still_framesize; // framesize_t for /capture stills; > framesize enables dual-stream mode
+};
+
+// Default operating point: QVGA stream, 2 buffers when PSRAM is present,
+// dual-stream off (still_framesize = framesize)
+void cam_config_defaults(CamSettings* s);
+
+// Load settings from NVS (falls back to defaults if missing or outdated)
+void cam_config_load(CamSettings* s);
+
+// Persist settings to NVS
+bool cam_config_save(const CamSettings& s);
+
+// Clamp every field into its valid range (also used on values read from NVS)
+void cam_config_sanitize(CamSettings* s);
+
+// GET /control?var=<name>&val=<value>
+// Sensor settings apply immediately; framesize growth, fb_count and xclk
+// re-initialise the camera between frames.
+esp_err_t cam_config_control_handler(httpd_req_t *req);
+
+// GET /status: active settings + boot timing as JSON
+esp_err_t cam_config_status_handler(httpd_req_t *req);
@@ -0,0 +1,68 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "esp_http_server.h"
+
+// ================= Camera Metrics API =================
+// Per-frame instrumentation of the MJPEG stream, served on GET /metrics (port 80)
+
+enum CamDropReason {
+  CAM_DROP_CAPTURE = 0,  // esp_camera_fb_get() returned NULL
+  CAM_DROP_ENCODE,       // frame2jpg() failed
+  CAM_DROP_SEND,         // client socket write failed mid-frame
+  CAM_DROP_SIZE          // frame not at the preview size (still switch, framesize change)
+};
+
+// Reset all counters (call once in setup, before the servers start)
+void cam_metrics_init();
+
+// Next frame sequence number (shared by all stream clients, starts at 1)
+uint32_t cam_metrics_nextSeq();
+
+// Capture time of a frame in µs.
+// Epoch µs once SNTP has synced (time_sync.h), µs since boot otherwise.
+int64_t cam_metrics_frameTimestampUs(const camera_fb_t* fb);
+
+// Record one frame delivered to a stream client
+void cam_metrics_recordFrame(uint32_t capture_us, size_t jpeg_len, uint32_t send_us);
+
+// Record a frame that never reached the client
+void cam_metrics_recordDrop(CamDropReason reason);
+
+// Boot timing: duration of esp_camera_init() and µs since boot of the first frame
+void cam_metrics_recordCameraInit(uint32_t init_us);
+void cam_metrics_recordFirstFrame(int64_t boot_us); // only the first call counts
+void cam_metrics_bootTiming(uint32_t* init_us, int64_t* first_frame_us);
+
+// Runtime camera re-initialisation (see cam_pipeline_apply)
+void cam_metrics_recordReconfig(uint32_t took_us);
+
+// Line vision: DC thumbnail decode and detector time per processed frame
+void cam_metrics_recordVision(uint32_t decode_us, uint32_t detect_us, bool ok);
+
+// Motion gate: signature time per decoded frame, and frames a gated client
+// skipped (bytes saved = JPEG bytes that were not sent)
+void cam_metrics_recordGateSignature(uint32_t sig_us);
+void cam_metrics_recordGated(size_t jpeg_len);
+
+// Dual-stream stills: time from request to still (incl. sensor switch), frames
+// discarded while switching, and the preview gap around the still
+void cam_metrics_recordStill(uint32_t took_us, uint32_t discarded, bool ok);
+void cam_metrics_recordStillPreviewGap(uint32_t gap_us);
+
+// RTP/JPEG stream: per frame packets, bytes, send time and capture → last
+// packet latency; frames dropped as too old (late) or refused by the network
+// stack; the client's latest RTCP receiver report
+void cam_metrics_rtpSession(bool active);
+void cam_metrics_recordRtpFrame(uint32_t packets, size_t bytes, uint32_t send_us, uint32_t latency_us);
+void cam_metrics_recordRtpDrop(bool late);
+void cam_metrics_recordRtpReport(uint8_t fraction_lost, int32_t cumulative_lost,
+                                 uint32_t jitter_us, uint32_t rtt_us);
+
+// Track number of open /stream clients
+void cam_metrics_streamOpened();
+void cam_metrics_streamClosed();
+
+// GET /metrics: JSON by default, Prometheus text with ?format=prometheus
+// (or an Accept header asking for text/plain)
+esp_err_t cam_metrics_handler(httpd_req_t *req);
@@ -0,0 +1,12 @@
+#pragma once
+#include <Arduino.h>
+
+// ================= Camera MQTT API =================
+// Listens to the cars' event topics (car/+/event) so an obstacle event
+// triggers the event clip recorder (see cam_clip.h).
+
+// Configure the client (call once in setup, after WiFi)
+void cam_mqtt_init();
+
+// Keep the connection alive and process messages (call in loop, non-blocking)
+void cam_mqtt_loop();
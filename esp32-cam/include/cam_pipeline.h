@@ -0,0 +1,59 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "cam_config.h"
+
+// ================= Camera Pipeline API =================
+// A single capture task owns the camera driver and its frame buffers.
+// Consumers (stream clients, /capture) lease the latest frame; a frame buffer
+// goes back to the driver once the last lease is released. Because nobody else
+// touches the driver, it can be re-initialised safely while streams are open.
+
+struct CamFrame {
+  camera_fb_t* fb;
+  uint32_t seq;         // camera frame sequence (gaps = frames this consumer skipped)
+  int64_t ts_us;        // capture time, see cam_metrics_frameTimestampUs()
+  uint32_t capture_us;  // time spent in esp_camera_fb_get()
+  int8_t slot;          // internal
+};
+
+// Full-resolution still, copied out of the driver so the preview keeps both
+// frame buffers. Free with cam_still_release().
+struct CamStill {
+  uint8_t* buf;
+  size_t len;
+  uint16_t width;
+  uint16_t height;
+  int64_t ts_us;
+};
+
+// Initialise the camera at the given operating point and start the capture task
+esp_err_t cam_pipeline_begin(const CamSettings& s);
+
+// Lease the newest frame with seq > after_seq (blocks up to timeout_ms)
+bool cam_frame_acquire(CamFrame* out, uint32_t after_seq, uint32_t timeout_ms);
+
+// Return a leased frame
+void cam_frame_release(CamFrame* f);
+
+// Dual-stream mode: buffers are sized for still_framesize and the sensor runs
+// at the preview framesize. A still request switches the sensor for one
+// frame between two preview frames; frames of the wrong size are dropped,
+// so lease consumers only ever see preview frames.
+bool cam_pipeline_dualMode();
+
+// Grab one still at still_framesize (blocks up to timeout_ms). Requests are
+// serialised and spaced at least STILL_MIN_INTERVAL_MS apart to bound the
+// preview frame-rate drop.
+bool cam_still_capture(CamStill* out, uint32_t timeout_ms);
+void cam_still_release(CamStill* s);
+
+// Apply new settings (blocks until the capture task has applied them).
+// Sensor-only changes are written between two frames without stopping the
+// stream; anything that changes buffer size/count or XCLK re-initialises the
+// driver once all leased frames have been released. *reinit reports which
+// path was taken.
+esp_err_t cam_pipeline_apply(const CamSettings& s, bool* reinit);
+
+// Settings currently active in the driver
+void cam_pipeline_settings(CamSettings* out);
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ================= JPEG DC thumbnail =================
+// Extracts a 1/8-scale grayscale image from a baseline JPEG by decoding only
+// the luma DC coefficients: Huffman symbols are walked (AC values skipped),
+// but there is no dequantisation of AC terms, no IDCT and no colour
+// conversion. One output byte = average luma of one 8x8 Y block.
+//
+// Plain C++ (no Arduino / IDF dependencies) so it also builds on a host.
+
+enum JpegDcResult {
+  JPEG_DC_OK = 0,
+  JPEG_DC_BAD_MARKER,      // not a JPEG / truncated header
+  JPEG_DC_UNSUPPORTED,     // progressive, 12-bit, arithmetic coding...
+  JPEG_DC_TOO_LARGE,       // thumbnail does not fit the output buffer
+  JPEG_DC_CORRUPT          // entropy-coded data ended early / bad code
+};
+
+// Decoder workspace (~8 KB). One per task: a decoder must not be shared by
+// tasks that decode concurrently.
+struct JpegDcDecoder;
+JpegDcDecoder* jpeg_dc_decoder_new();
+
+// Decode the DC thumbnail of jpg[0..len) into out (row-major, *out_w x *out_h).
+// out_cap is the size of out in bytes; (W/8) x (H/8) rounded up is required.
+JpegDcResult jpeg_dc_thumbnail(JpegDcDecoder* dec, const uint8_t* jpg, size_t len,
+                               uint8_t* out, size_t out_cap,
+                               uint16_t* out_w, uint16_t* out_h);
+
+// ================= JPEG layout =================
+// Header walk only (no entropy decoding): what an RTP/JPEG (RFC 2435)
+// packetiser needs to send a frame without its headers.
+struct JpegLayout {
+  uint16_t width, height;
+  uint8_t ncomp;
+  uint8_t y_h, y_v;             // luma sampling factors (chroma assumed 1x1)
+  uint16_t restart_interval;    // 0 = no DRI
+  const uint8_t* qtable[2];     // 8-bit tables, zig-zag order as in DQT (NULL if absent)
+  const uint8_t* scan;          // entropy-coded data after the SOS header
+  size_t scan_len;              // up to, not including, EOI
+};
+
+// Parse a baseline JPEG's headers. Pointers in *out point into jpg.
+JpegDcResult jpeg_parse_layout(const uint8_t* jpg, size_t len, JpegLayout* out);
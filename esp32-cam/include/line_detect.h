@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+
+// ================= Line detector =================
+// Finds a dark line on a light floor in a small grayscale image (the JPEG DC
+// thumbnail, 40x30 for QVGA). The image is split into horizontal row bands;
+// band 0 is the bottom band (closest to the car), higher bands look further
+// ahead. Integer-only, rows are scanned in memory order.
+//
+// Plain C++ (no Arduino / IDF dependencies) so it also builds on a host.
+
+#define LINE_MAX_BANDS 6
+
+// LineBand.flags
+#define LINE_FOUND    0x01  // a line was detected in this band
+#define LINE_JUNCTION 0x02  // dark run much wider than a line (cross / T)
+
+struct LineBand {
+  int16_t offset_pm;     // line centre vs image centre, per-mille of half width (+ = right)
+  int16_t heading_cdeg;  // line direction vs straight ahead, centi-degrees (+ = bends right)
+  uint8_t width_px;      // width of the dark run (thumbnail pixels)
+  uint8_t contrast;      // floor luma - line luma
+  uint8_t flags;
+  uint8_t row;           // band centre row (0 = top of image)
+};
+
+struct LineDetectConfig {
+  uint8_t n_bands;            // 1..LINE_MAX_BANDS
+  uint8_t min_contrast;       // below this the band is "no line"
+  uint8_t junction_width_pct; // dark run wider than this % of the image = junction
+};
+
+struct LineDetectResult {
+  uint8_t n_bands;
+  LineBand band[LINE_MAX_BANDS];  // band[0] = nearest
+};
+
+void line_detect_defaults(LineDetectConfig* cfg);
+
+// img is row-major w x h (w <= 255)
+void line_detect(const uint8_t* img, uint16_t w, uint16_t h,
+                 const LineDetectConfig& cfg, LineDetectResult* out);
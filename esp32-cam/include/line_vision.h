@@ -0,0 +1,32 @@
+#pragma once
+#include <Arduino.h>
+#include "line_detect.h"
+
+// ================= Line Vision API =================
+// Runs the line detector on every camera frame (JPEG DC thumbnail, no full
+// decode) and sends the per-band result to the car over UDP.
+//
+// The car subscribes by sending LINE_VISION_SUBSCRIBE to LINE_VISION_PORT on
+// the camera every couple of seconds; results go back to the sender's
+// address. Without a fresh subscription nothing is decoded or sent.
+
+#define LINE_VISION_PORT 4210
+#define LINE_VISION_MAGIC 0x564C   // "LV" little-endian
+#define LINE_VISION_VERSION 1
+#define LINE_VISION_SUBSCRIBE "LVSUB"
+
+// Wire format, little-endian. Keep in sync with esp32_car/include/line_vision_rx.h
+struct __attribute__((packed)) LineVisionPacket {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t n_bands;
+  uint32_t frame_seq;
+  int64_t frame_ts_us;     // capture time (camera clock, see cam_metrics_frameTimestampUs)
+  uint32_t latency_us;     // capture → send, measured on the camera
+  uint8_t img_w;           // thumbnail size the bands refer to
+  uint8_t img_h;
+  LineBand band[LINE_MAX_BANDS];
+};
+
+// Start the UDP listener and the vision task (call after WiFi is up)
+void line_vision_begin();
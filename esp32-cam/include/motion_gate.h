@@ -0,0 +1,45 @@
+#pragma once
+#include <Arduino.h>
+#include "esp_http_server.h"
+#include "cam_pipeline.h"
+
+// ================= Motion Gate API =================
+// Cheap change detector for the MJPEG stream. Each frame gets a 16 x 12 luma
+// signature built from the JPEG DC thumbnail (see jpeg_dc.h); a stream client
+// with the gate enabled only sends a frame when it differs enough from the
+// last frame it sent, plus a keep-alive frame at a minimum rate.
+//
+// Enabled per client: /stream?gate=1[&keepalive_ms=1000][&thresh=10][&cells=3]
+
+#define MOTION_GRID_W 16
+#define MOTION_GRID_H 12
+#define MOTION_CELLS (MOTION_GRID_W * MOTION_GRID_H)
+
+struct MotionSig {
+  uint32_t seq;                 // frame the signature belongs to
+  uint8_t mean;                 // average of all cells
+  uint8_t cell[MOTION_CELLS];   // average luma per grid cell
+};
+
+struct MotionGateConfig {
+  bool enabled;
+  uint32_t keepalive_ms;   // send at least one frame this often
+  uint8_t cell_thresh;     // luma change (after global brightness shift) for a cell to count
+  uint8_t min_cells;       // changed cells needed to send the frame
+};
+
+// Allocate the shared signature cache (call once in setup)
+void motion_gate_begin();
+
+void motion_gate_defaults(MotionGateConfig* cfg);
+
+// Read gate / keepalive_ms / thresh / cells from the request query string
+void motion_gate_parse_query(httpd_req_t *req, MotionGateConfig* cfg);
+
+// Signature of a leased JPEG frame. Computed once per frame and shared by all
+// clients (cached by seq). Returns false if the frame could not be decoded.
+bool motion_gate_signature(const CamFrame* frame, MotionSig* out);
+
+// Number of grid cells that changed between two signatures. A uniform
+// brightness shift (auto exposure) is removed first.
+int motion_gate_changed_cells(const MotionSig& a, const MotionSig& b, uint8_t cell_thresh);
@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+
+// ================= RTP/JPEG Stream API =================
+// Low-latency alternative to the HTTP MJPEG stream: RFC 2435 JPEG over
+// RTP/UDP with a minimal RTSP server (one client, UDP unicast only).
+// Frames are split to the MTU and never retransmitted; a frame that is
+// already too old when it reaches the sender is dropped instead of sent.
+//
+//   ffplay -fflags nobuffer -flags low_delay -rtsp_transport udp rtsp://<cam>:8554/mjpeg
+//   gst-launch-1.0 rtspsrc location=rtsp://<cam>:8554/mjpeg latency=0 ! rtpjpegdepay ! jpegdec ! autovideosink
+//
+// Packet loss, jitter and RTT come from the client's RTCP receiver reports
+// and are exported in /metrics (rtp section).
+
+#define RTSP_PORT 8554
+#define RTP_SERVER_PORT 5004   // RTCP on RTP_SERVER_PORT + 1
+
+// Start the RTSP listener and the sender task (call after WiFi is up)
+void rtp_stream_begin();
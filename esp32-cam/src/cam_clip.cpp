@@ -0,0 +1,369 @@
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include <sys/time.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "cam_clip.h"
+#include "cam_pipeline.h"
+#include "time_sync.h"
+
+// ================= Configuration =================
+const uint32_t CLIP_PRE_MS = 5000;     // pre-roll kept before the trigger
+const uint32_t CLIP_POST_MS = 2000;    // recorded after the trigger
+const uint32_t CLIP_FPS = 5;           // reduced rate, the live stream keeps full rate
+const size_t CLIP_ARENA_MAX = 1536 * 1024;
+#define CLIP_MAX_FRAMES 128
+const uint32_t CLIP_TASK_STACK = 3072;
+const UBaseType_t CLIP_TASK_PRIO = 2;  // below capture (5) and vision (3)
+
+#define CLIP_BOUNDARY "clipframe7d3a91c4e2b0"
+static const char* _CLIP_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" CLIP_BOUNDARY;
+static const char* _CLIP_BOUNDARY = "\r\n--" CLIP_BOUNDARY "\r\n";
+static const char* _CLIP_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp-Us: %lld\r\nX-Frame-Seq: %u\r\nX-Offset-Ms: %d\r\n\r\n";
+
+// ================= State =================
+struct ClipRec {
+  uint32_t off;
+  uint32_t len;
+  uint32_t seq;
+  int64_t ts_us;     // export timestamp (epoch µs once SNTP is set)
+  int64_t boot_us;   // driver timestamp, used for the pre/post windows
+};
+
+static uint8_t* arena = NULL;
+static size_t arena_size = 0;
+static uint32_t write_pos = 0;
+
+static ClipRec recs[CLIP_MAX_FRAMES];
+static int rec_tail = 0;     // oldest
+static int rec_count = 0;
+
+static CamClipState state = CLIP_DISABLED;
+static int64_t trigger_boot_us = 0;
+static int64_t trigger_wall_us = 0;
+static char trigger_reason[32] = "";
+static uint32_t clips_recorded = 0;
+static uint32_t triggers_ignored = 0;
+static uint32_t truncated = 0;   // pre-roll frames overwritten after the trigger
+static int readers = 0;          // downloads in progress
+
+static TaskHandle_t clip_task_handle = NULL;
+static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+static const char* state_name(CamClipState s) {
+  switch (s) {
+    case CLIP_ARMED: return "armed";
+    case CLIP_TRIGGERED: return "triggered";
+    case CLIP_FROZEN: return "frozen";
+    default: return "disabled";
+  }
+}
+
+// ================= Ring helpers (call with mux held) =================
+static inline ClipRec& rec_at(int i) {
+  return recs[(rec_tail + i) % CLIP_MAX_FRAMES];
+}
+
+static void drop_oldest() {
+  rec_tail = (rec_tail + 1) % CLIP_MAX_FRAMES;
+  rec_count--;
+  if (state == CLIP_TRIGGERED) truncated++;
+}
+
+static bool overlaps_live(uint32_t off, uint32_t len) {
+  for (int i = 0; i < rec_count; i++) {
+    const ClipRec& r = rec_at(i);
+    if (off < r.off + r.len && r.off < off + len) return true;
+  }
+  return false;
+}
+
+// Chỗ cho 1 frame mới: ghi vòng, bỏ frame cũ nhất nếu bị đè
+static bool reserve(uint32_t len, uint32_t* off) {
+  if (len == 0 || len > arena_size) return false;
+  uint32_t start = write_pos;
+  if (start + len > arena_size) start = 0;
+  if (rec_count == CLIP_MAX_FRAMES) drop_oldest();
+  while (rec_count > 0 && overlaps_live(start, len)) drop_oldest();
+  write_pos = start + len;
+  *off = start;
+  return true;
+}
+
+static void reset_ring() {
+  rec_tail = 0;
+  rec_count = 0;
+  write_pos = 0;
+  truncated = 0;
+}
+
+// ================= Recorder task =================
+static void clip_task(void*) {
+  uint32_t last_seq = 0;
+  const int64_t interval_us = 1000000LL / CLIP_FPS;
+
+  for (;;) {
+    CamClipState st;
+    portENTER_CRITICAL(&mux);
+    st = state;
+    portEXIT_CRITICAL(&mux);
+    if (st != CLIP_ARMED && st != CLIP_TRIGGERED) {
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(500));
+      continue;
+    }
+
+    int64_t t_start = esp_timer_get_time();
+    CamFrame frame;
+    if (cam_frame_acquire(&frame, last_seq, 1000)) {
+      last_seq = frame.seq;
+      int64_t boot_us = (int64_t)frame.fb->timestamp.tv_sec * 1000000LL + frame.fb->timestamp.tv_usec;
+      uint32_t len = frame.fb->len;
+      uint32_t off = 0;
+
+      portENTER_CRITICAL(&mux);
+      bool ok = frame.fb->format == PIXFORMAT_JPEG && reserve(len, &off);
+      portEXIT_CRITICAL(&mux);
+
+      // Một lần copy sang PSRAM rồi trả frame ngay, stream không phải chờ
+      if (ok) memcpy(arena + off, frame.fb->buf, len);
+      cam_frame_release(&frame);
+
+      if (ok) {
+        portENTER_CRITICAL(&mux);
+        ClipRec& r = recs[(rec_tail + rec_count) % CLIP_MAX_FRAMES];
+        r.off = off;
+        r.len = len;
+        r.seq = frame.seq;
+        r.ts_us = frame.ts_us;
+        r.boot_us = boot_us;
+        rec_count++;
+        if (state == CLIP_ARMED) {
+          // Pre-roll: chỉ giữ CLIP_PRE_MS gần nhất
+          while (rec_count > 1 && boot_us - rec_at(0).boot_us > (int64_t)CLIP_PRE_MS * 1000) {
+            drop_oldest();
+          }
+        }
+        portEXIT_CRITICAL(&mux);
+      }
+    }
+
+    // Freeze on time, even if the camera stopped delivering frames
+    bool froze = false;
+    portENTER_CRITICAL(&mux);
+    if (state == CLIP_TRIGGERED &&
+        esp_timer_get_time() - trigger_boot_us >= (int64_t)CLIP_POST_MS * 1000) {
+      state = CLIP_FROZEN;
+      clips_recorded++;
+      froze = true;
+    }
+    portEXIT_CRITICAL(&mux);
+    if (froze) {
+      Serial.printf("[CLIP] Frozen: %d frames, reason=%s\n", rec_count, trigger_reason);
+    }
+
+    int64_t elapsed = esp_timer_get_time() - t_start;
+    if (elapsed < interval_us) {
+      vTaskDelay(pdMS_TO_TICKS((interval_us - elapsed) / 1000));
+    }
+  }
+}
+
+// ================= Public API =================
+bool cam_clip_begin() {
+  if (!psramFound()) {
+    Serial.println("[CLIP] No PSRAM, event clips disabled");
+    return false;
+  }
+  // Chừa một nửa PSRAM cho frame buffer khi đổi framesize lúc chạy
+  size_t size = heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM) / 2;
+  if (size > CLIP_ARENA_MAX) size = CLIP_ARENA_MAX;
+  arena = (uint8_t*)heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+  if (!arena) {
+    Serial.println("[CLIP] Arena allocation failed, event clips disabled");
+    return false;
+  }
+  arena_size = size;
+  reset_ring();
+  state = CLIP_ARMED;
+  xTaskCreatePinnedToCore(clip_task, "cam_clip", CLIP_TASK_STACK, NULL,
+                          CLIP_TASK_PRIO, &clip_task_handle, 1);
+  Serial.printf("[CLIP] Armed: %u KB arena, %us pre / %us post @ %u fps\n",
+                (unsigned)(arena_size / 1024), CLIP_PRE_MS / 1000, CLIP_POST_MS / 1000, CLIP_FPS);
+  return true;
+}
+
+// Reason comes from ?reason= / MQTT and is printed verbatim into the /clip
+// JSON: keep [A-Za-z0-9 _-], anything else becomes '_'
+static void sanitizeReason(const char* in, char* out, size_t cap) {
+  size_t n = 0;
+  for (; in && *in && n + 1 < cap; in++) {
+    char c = *in;
+    bool ok = isalnum((unsigned char)c) || c == ' ' || c == '_' || c == '-';
+    out[n++] = ok ? c : '_';
+  }
+  out[n] = '\0';
+}
+
+bool cam_clip_trigger(const char* reason) {
+  char clean[sizeof(trigger_reason)];
+  sanitizeReason(reason, clean, sizeof(clean));
+
+  // Same clock as the frame timestamps (cam_metrics_frameTimestampUs)
+  int64_t now_us = esp_timer_get_time();
+  int64_t wall_us = time_sync_toEpochUs(now_us);
+  if (wall_us == 0) wall_us = now_us;
+
+  bool accepted = false;
+  portENTER_CRITICAL(&mux);
+  if (state == CLIP_ARMED) {
+    state = CLIP_TRIGGERED;
+    trigger_boot_us = now_us;
+    trigger_wall_us = wall_us;
+    memcpy(trigger_reason, clean, sizeof(trigger_reason));
+    truncated = 0;
+    accepted = true;
+  } else if (state != CLIP_DISABLED) {
+    triggers_ignored++;
+  }
+  portEXIT_CRITICAL(&mux);
+  if (accepted) {
+    Serial.printf("[CLIP] Triggered: %s\n", trigger_reason);
+  }
+  return accepted;
+}
+
+CamClipState cam_clip_state() {
+  portENTER_CRITICAL(&mux);
+  CamClipState s = state;
+  portEXIT_CRITICAL(&mux);
+  return s;
+}
+
+// ================= HTTP handlers =================
+static esp_err_t send_json_status(httpd_req_t *req, bool ok) {
+  char resp[64];
+  int len = snprintf(resp, sizeof(resp), "{\"ok\":%s,\"state\":\"%s\"}",
+                     ok ? "true" : "false", state_name(cam_clip_state()));
+  if (!ok) httpd_resp_set_status(req, "409 Conflict");
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, resp, len);
+}
+
+esp_err_t cam_clip_trigger_handler(httpd_req_t *req) {
+  char query[64];
+  char reason[32] = "http";
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    httpd_query_key_value(query, "reason", reason, sizeof(reason));
+  }
+  return send_json_status(req, cam_clip_trigger(reason));
+}
+
+esp_err_t cam_clip_arm_handler(httpd_req_t *req) {
+  bool ok = false;
+  portENTER_CRITICAL(&mux);
+  if (state != CLIP_DISABLED && readers == 0) {
+    reset_ring();
+    state = CLIP_ARMED;
+    trigger_reason[0] = '\0';
+    ok = true;
+  }
+  portEXIT_CRITICAL(&mux);
+  if (ok && clip_task_handle) xTaskNotifyGive(clip_task_handle);
+  return send_json_status(req, ok);
+}
+
+esp_err_t cam_clip_status_handler(httpd_req_t *req) {
+  char buf[256];
+  portENTER_CRITICAL(&mux);
+  CamClipState st = state;
+  int n = rec_count;
+  uint32_t used = 0;
+  for (int i = 0; i < n; i++) used += rec_at(i).len;
+  int len = snprintf(buf, sizeof(buf),
+    "{\"state\":\"%s\",\"reason\":\"%s\",\"trigger_ts_us\":%lld,"
+    "\"pre_ms\":%u,\"post_ms\":%u,\"fps\":%u,"
+    "\"arena_bytes\":%u,\"used_bytes\":%u,"
+    "\"clips\":%u,\"triggers_ignored\":%u,\"truncated\":%u,"
+    "\"frames\":[",
+    state_name(st), trigger_reason,
+    (long long)(st == CLIP_ARMED ? 0 : trigger_wall_us),
+    CLIP_PRE_MS, CLIP_POST_MS, CLIP_FPS,
+    (unsigned)arena_size, used,
+    clips_recorded, triggers_ignored, truncated);
+  portEXIT_CRITICAL(&mux);
+
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  esp_err_t res = httpd_resp_send_chunk(req, buf, len);
+
+  // Frame index, offset_ms relative to the trigger (negative = pre-roll)
+  for (int i = 0; i < n && res == ESP_OK; i++) {
+    portENTER_CRITICAL(&mux);
+    bool valid = i < rec_count;
+    ClipRec r = valid ? rec_at(i) : ClipRec();
+    int64_t trig = trigger_boot_us;
+    portEXIT_CRITICAL(&mux);
+    if (!valid) break;
+    int offset_ms = st == CLIP_ARMED ? 0 : (int)((r.boot_us - trig) / 1000);
+    len = snprintf(buf, sizeof(buf), "%s{\"seq\":%u,\"ts_us\":%lld,\"offset_ms\":%d,\"len\":%u}",
+                   i ? "," : "", r.seq, (long long)r.ts_us, offset_ms, r.len);
+    res = httpd_resp_send_chunk(req, buf, len);
+  }
+  if (res == ESP_OK) res = httpd_resp_send_chunk(req, "]}", 2);
+  if (res == ESP_OK) res = httpd_resp_send_chunk(req, NULL, 0);
+  return res;
+}
+
+// GET /clip/download: multipart MJPEG with per-frame headers (same layout as
+// /stream), or ?format=raw for plain concatenated JPEGs (ffmpeg -f mjpeg).
+esp_err_t cam_clip_download_handler(httpd_req_t *req) {
+  char query[32];
+  char format[8] = "";
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+    httpd_query_key_value(query, "format", format, sizeof(format));
+  }
+  bool raw = strcmp(format, "raw") == 0;
+
+  // Khóa clip: không cho re-arm khi đang tải
+  portENTER_CRITICAL(&mux);
+  bool ok = state == CLIP_FROZEN;
+  if (ok) readers++;
+  int n = rec_count;
+  int64_t trig = trigger_boot_us;
+  portEXIT_CRITICAL(&mux);
+  if (!ok) {
+    return send_json_status(req, false);
+  }
+
+  char hdr[160];
+  snprintf(hdr, sizeof(hdr), "attachment; filename=clip_%lld.mjpeg", (long long)(trigger_wall_us / 1000));
+  httpd_resp_set_type(req, raw ? "video/x-motion-jpeg" : _CLIP_CONTENT_TYPE);
+  httpd_resp_set_hdr(req, "Content-Disposition", hdr);
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+  esp_err_t res = ESP_OK;
+  for (int i = 0; i < n && res == ESP_OK; i++) {
+    // Frozen: the recorder does not touch the arena or the index
+    const ClipRec& r = rec_at(i);
+    if (!raw) {
+      int len = snprintf(hdr, sizeof(hdr), _CLIP_PART, r.len, (long long)r.ts_us, r.seq,
+                         (int)((r.boot_us - trig) / 1000));
+      res = httpd_resp_send_chunk(req, _CLIP_BOUNDARY, strlen(_CLIP_BOUNDARY));
+      if (res == ESP_OK) res = httpd_resp_send_chunk(req, hdr, len);
+    }
+    if (res == ESP_OK) res = httpd_resp_send_chunk(req, (const char*)arena + r.off, r.len);
+  }
+  if (res == ESP_OK && !raw && n > 0) {
+    static const char* _CLIP_END = "\r\n--" CLIP_BOUNDARY "--\r\n";
+    res = httpd_resp_send_chunk(req, _CLIP_END, strlen(_CLIP_END));
+  }
+  if (res == ESP_OK) res = httpd_resp_send_chunk(req, NULL, 0);
+
+  portENTER_CRITICAL(&mux);
+  readers--;
+  portEXIT_CRITICAL(&mux);
+  return res;
+}
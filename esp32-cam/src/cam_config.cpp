@@ -0,0 +1,204 @@
+#include <Arduino.h>
+#include <Preferences.h>
+#include "esp_timer.h"
+#include "cam_config.h"
+#include "cam_pipeline.h"
+#include "cam_metrics.h"
+
+// ================= NVS =================
+static const char* NVS_NAMESPACE = "cam";
+static const char* NVS_KEY = "settings";
+
+// Frame size names accepted by /control (numeric framesize_t values work too)
+struct FramesizeName {
+  const char* name;
+  framesize_t size;
+};
+
+static const FramesizeName FRAMESIZE_NAMES[] = {
+  { "qqvga", FRAMESIZE_QQVGA },
+  { "qcif",  FRAMESIZE_QCIF },
+  { "hqvga", FRAMESIZE_HQVGA },
+  { "qvga",  FRAMESIZE_QVGA },
+  { "cif",   FRAMESIZE_CIF },
+  { "vga",   FRAMESIZE_VGA },
+  { "svga",  FRAMESIZE_SVGA },
+  { "xga",   FRAMESIZE_XGA },
+  { "sxga",  FRAMESIZE_SXGA },
+  { "uxga",  FRAMESIZE_UXGA },
+};
+
+// ================= Defaults / validation =================
+void cam_config_defaults(CamSettings* s) {
+  memset(s, 0, sizeof(*s));
+  s->version = CAM_SETTINGS_VERSION;
+  s->framesize = FRAMESIZE_QVGA;
+  s->quality = psramFound() ? 10 : 12;
+  s->fb_count = psramFound() ? 2 : 1;
+  s->xclk_mhz = 20;
+  s->awb = 1;
+  s->aec = 1;
+  s->agc = 1;
+  // Dual-stream tắt: buffer chỉ cỡ QVGA. Bật qua /control?var=still_framesize
+  // (cần PSRAM), khi đó mọi buffer được cấp phát theo cỡ ảnh chụp
+  s->still_framesize = s->framesize;
+}
+
+static inline int clampi(int v, int lo, int hi) {
+  return v < lo ? lo : (v > hi ? hi : v);
+}
+
+void cam_config_sanitize(CamSettings* s) {
+  // Không có PSRAM: 1 buffer trong DRAM, tối đa SVGA
+  int max_fs = psramFound() ? FRAMESIZE_UXGA : FRAMESIZE_SVGA;
+  int max_fb = psramFound() ? 3 : 1;
+
+  s->version = CAM_SETTINGS_VERSION;
+  s->framesize = clampi(s->framesize, FRAMESIZE_QQVGA, max_fs);
+  s->quality = clampi(s->quality, 4, 63);
+  s->fb_count = clampi(s->fb_count, 1, max_fb);
+  s->xclk_mhz = clampi(s->xclk_mhz, 8, 20);
+  s->brightness = clampi(s->brightness, -2, 2);
+  s->contrast = clampi(s->contrast, -2, 2);
+  s->saturation = clampi(s->saturation, -2, 2);
+  s->hmirror = s->hmirror ? 1 : 0;
+  s->vflip = s->vflip ? 1 : 0;
+  s->awb = s->awb ? 1 : 0;
+  s->aec = s->aec ? 1 : 0;
+  s->agc = s->agc ? 1 : 0;
+  s->still_framesize = clampi(s->still_framesize, s->framesize, max_fs);
+}
+
+void cam_config_load(CamSettings* s) {
+  cam_config_defaults(s);
+
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, true)) {
+    return;
+  }
+  CamSettings stored;
+  size_t len = prefs.getBytes(NVS_KEY, &stored, sizeof(stored));
+  prefs.end();
+
+  if (len == sizeof(stored) && stored.version == CAM_SETTINGS_VERSION) {
+    *s = stored;
+    cam_config_sanitize(s);
+  }
+}
+
+bool cam_config_save(const CamSettings& s) {
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, false)) {
+    return false;
+  }
+  size_t written = prefs.putBytes(NVS_KEY, &s, sizeof(s));
+  prefs.end();
+  return written == sizeof(s);
+}
+
+// ================= HTTP handlers =================
+static bool parse_framesize(const char* val, int* out) {
+  for (size_t i = 0; i < sizeof(FRAMESIZE_NAMES) / sizeof(FRAMESIZE_NAMES[0]); i++) {
+    if (strcasecmp(val, FRAMESIZE_NAMES[i].name) == 0) {
+      *out = FRAMESIZE_NAMES[i].size;
+      return true;
+    }
+  }
+  char* end;
+  long v = strtol(val, &end, 10);
+  if (*end != '\0') return false;
+  *out = (int)v;
+  return true;
+}
+
+// Update one field by name; returns false for unknown variables
+static bool set_variable(CamSettings* s, const char* var, const char* val) {
+  int v = atoi(val);
+  if (!strcmp(var, "framesize")) {
+    if (!parse_framesize(val, &v)) return false;
+    s->framesize = v;
+  }
+  else if (!strcmp(var, "still_framesize")) {
+    if (!parse_framesize(val, &v)) return false;
+    s->still_framesize = v;
+  }
+  else if (!strcmp(var, "quality")) s->quality = v;
+  else if (!strcmp(var, "fb_count")) s->fb_count = v;
+  else if (!strcmp(var, "xclk")) s->xclk_mhz = v;
+  else if (!strcmp(var, "brightness")) s->brightness = v;
+  else if (!strcmp(var, "contrast")) s->contrast = v;
+  else if (!strcmp(var, "saturation")) s->saturation = v;
+  else if (!strcmp(var, "hmirror")) s->hmirror = v;
+  else if (!strcmp(var, "vflip")) s->vflip = v;
+  else if (!strcmp(var, "awb")) s->awb = v;
+  else if (!strcmp(var, "aec")) s->aec = v;
+  else if (!strcmp(var, "agc")) s->agc = v;
+  else return false;
+  return true;
+}
+
+esp_err_t cam_config_control_handler(httpd_req_t *req) {
+  char query[96];
+  char var[32];
+  char val[32];
+
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK ||
+      httpd_query_key_value(query, "var", var, sizeof(var)) != ESP_OK ||
+      httpd_query_key_value(query, "val", val, sizeof(val)) != ESP_OK) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "usage: /control?var=<name>&val=<value>");
+    return ESP_FAIL;
+  }
+
+  CamSettings s;
+  cam_pipeline_settings(&s);
+  if (!set_variable(&s, var, val)) {
+    httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "unknown variable");
+    return ESP_FAIL;
+  }
+  cam_config_sanitize(&s);
+
+  int64_t t0 = esp_timer_get_time();
+  bool reinit = false;
+  esp_err_t err = cam_pipeline_apply(s, &reinit);
+  uint32_t took_ms = (uint32_t)((esp_timer_get_time() - t0) / 1000);
+  if (err != ESP_OK) {
+    Serial.printf("[CAM] /control %s=%s failed: 0x%x\n", var, val, err);
+    httpd_resp_send_500(req);
+    return ESP_FAIL;
+  }
+  bool saved = cam_config_save(s);
+
+  char resp[128];
+  int len = snprintf(resp, sizeof(resp),
+                     "{\"ok\":true,\"var\":\"%s\",\"reinit\":%s,\"took_ms\":%u,\"saved\":%s}",
+                     var, reinit ? "true" : "false", took_ms, saved ? "true" : "false");
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, resp, len);
+}
+
+esp_err_t cam_config_status_handler(httpd_req_t *req) {
+  CamSettings s;
+  cam_pipeline_settings(&s);
+  uint32_t init_us;
+  int64_t first_frame_us;
+  cam_metrics_bootTiming(&init_us, &first_frame_us);
+
+  char resp[384];
+  int len = snprintf(resp, sizeof(resp),
+    "{"
+    "\"framesize\":%u,\"still_framesize\":%u,\"quality\":%u,\"fb_count\":%u,\"xclk\":%u,"
+    "\"brightness\":%d,\"contrast\":%d,\"saturation\":%d,"
+    "\"hmirror\":%u,\"vflip\":%u,\"awb\":%u,\"aec\":%u,\"agc\":%u,"
+    "\"psram\":%s,"
+    "\"camera_init_us\":%u,\"boot_to_first_frame_us\":%lld"
+    "}",
+    s.framesize, s.still_framesize, s.quality, s.fb_count, s.xclk_mhz,
+    s.brightness, s.contrast, s.saturation,
+    s.hmirror, s.vflip, s.awb, s.aec, s.agc,
+    psramFound() ? "true" : "false",
+    init_us, (long long)first_frame_us);
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, resp, len);
+}
@@ -0,0 +1,496 @@
+#include <Arduino.h>
+#include <sys/time.h>
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+#include "cam_metrics.h"
+#include "time_sync.h"
+
+// ================= Configuration =================
+// FPS is computed over a fixed window instead of per frame to smooth out jitter
+const int64_t FPS_WINDOW_US = 1000000;
+
+// ================= Stat helpers =================
+// last / EWMA (alpha = 1/8) / max, integer only so it is cheap per frame
+struct TimingStat {
+  uint32_t last;
+  uint32_t avg;
+  uint32_t max;
+};
+
+static inline void stat_add(TimingStat &s, uint32_t v) {
+  s.last = v;
+  s.avg = (s.avg == 0) ? v : (s.avg * 7 + v) / 8;
+  if (v > s.max) s.max = v;
+}
+
+// ================= Metrics state =================
+struct CamMetrics {
+  uint32_t seq;
+  uint32_t frames_total;
+  uint64_t bytes_total;
+  uint32_t drops[4];
+  TimingStat capture_us;
+  TimingStat send_us;
+  TimingStat jpeg_bytes;
+  uint32_t fps_x100;
+  uint32_t win_frames;
+  int64_t win_start_us;
+  int streams_active;
+  uint32_t camera_init_us;
+  int64_t first_frame_us;
+  uint32_t reconfig_count;
+  uint32_t reconfig_last_us;
+  uint32_t vision_frames;
+  uint32_t vision_errors;
+  TimingStat vision_decode_us;
+  TimingStat vision_detect_us;
+  uint32_t gate_skipped;
+  uint64_t gate_bytes_saved;
+  TimingStat gate_sig_us;
+  uint32_t still_count;
+  uint32_t still_failed;
+  uint32_t still_discarded;
+  TimingStat still_us;
+  TimingStat still_gap_us;
+  int rtp_sessions;
+  uint32_t rtp_frames;
+  uint32_t rtp_packets;
+  uint64_t rtp_bytes;
+  uint32_t rtp_dropped_late;
+  uint32_t rtp_dropped_send;
+  TimingStat rtp_send_us;
+  TimingStat rtp_latency_us;
+  uint32_t rtp_rr_count;
+  uint8_t rtp_fraction_lost;   // /256, from the last receiver report
+  int32_t rtp_cumulative_lost;
+  uint32_t rtp_jitter_us;
+  uint32_t rtp_rtt_us;
+};
+
+static CamMetrics m;
+static portMUX_TYPE m_mux = portMUX_INITIALIZER_UNLOCKED;
+
+// Output buffer for /metrics (port 80 server runs a single httpd task)
+static char out_buf[6144];
+
+// ================= Recording =================
+void cam_metrics_init() {
+  portENTER_CRITICAL(&m_mux);
+  memset(&m, 0, sizeof(m));
+  m.win_start_us = esp_timer_get_time();
+  portEXIT_CRITICAL(&m_mux);
+}
+
+uint32_t cam_metrics_nextSeq() {
+  portENTER_CRITICAL(&m_mux);
+  uint32_t s = ++m.seq;
+  portEXIT_CRITICAL(&m_mux);
+  return s;
+}
+
+int64_t cam_metrics_frameTimestampUs(const camera_fb_t* fb) {
+  // fb->timestamp is taken from esp_timer by the driver (µs since boot)
+  int64_t boot_us = (int64_t)fb->timestamp.tv_sec * 1000000LL + fb->timestamp.tv_usec;
+
+  // Drift-corrected boot → epoch mapping once SNTP has synced
+  int64_t epoch_us = time_sync_toEpochUs(boot_us);
+  return epoch_us != 0 ? epoch_us : boot_us;
+}
+
+void cam_metrics_recordFrame(uint32_t capture_us, size_t jpeg_len, uint32_t send_us) {
+  int64_t now = esp_timer_get_time();
+
+  portENTER_CRITICAL(&m_mux);
+  m.frames_total++;
+  m.bytes_total += jpeg_len;
+  stat_add(m.capture_us, capture_us);
+  stat_add(m.send_us, send_us);
+  stat_add(m.jpeg_bytes, (uint32_t)jpeg_len);
+
+  m.win_frames++;
+  int64_t win = now - m.win_start_us;
+  if (win >= FPS_WINDOW_US) {
+    m.fps_x100 = (uint32_t)((int64_t)m.win_frames * 100 * 1000000LL / win);
+    m.win_frames = 0;
+    m.win_start_us = now;
+  }
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_recordDrop(CamDropReason reason) {
+  portENTER_CRITICAL(&m_mux);
+  m.drops[reason]++;
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_recordCameraInit(uint32_t init_us) {
+  portENTER_CRITICAL(&m_mux);
+  m.camera_init_us = init_us;
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_recordFirstFrame(int64_t boot_us) {
+  if (m.first_frame_us != 0) return;
+  portENTER_CRITICAL(&m_mux);
+  m.first_frame_us = boot_us;
+  portEXIT_CRITICAL(&m_mux);
+  Serial.printf("[CAM] Boot to first frame: %lld ms (camera init %u ms)\n",
+                (long long)(boot_us / 1000), m.camera_init_us / 1000);
+}
+
+void cam_metrics_bootTiming(uint32_t* init_us, int64_t* first_frame_us) {
+  portENTER_CRITICAL(&m_mux);
+  *init_us = m.camera_init_us;
+  *first_frame_us = m.first_frame_us;
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_recordReconfig(uint32_t took_us) {
+  portENTER_CRITICAL(&m_mux);
+  m.reconfig_count++;
+  m.reconfig_last_us = took_us;
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_recordVision(uint32_t decode_us, uint32_t detect_us, bool ok) {
+  portENTER_CRITICAL(&m_mux);
+  if (ok) {
+    m.vision_frames++;
+    stat_add(m.vision_decode_us, decode_us);
+    stat_add(m.vision_detect_us, detect_us);
+  } else {
+    m.vision_errors++;
+  }
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_recordGateSignature(uint32_t sig_us) {
+  portENTER_CRITICAL(&m_mux);
+  stat_add(m.gate_sig_us, sig_us);
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_recordGated(size_t jpeg_len) {
+  portENTER_CRITICAL(&m_mux);
+  m.gate_skipped++;
+  m.gate_bytes_saved += jpeg_len;
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_recordStill(uint32_t took_us, uint32_t discarded, bool ok) {
+  portENTER_CRITICAL(&m_mux);
+  if (ok) {
+    m.still_count++;
+    stat_add(m.still_us, took_us);
+  } else {
+    m.still_failed++;
+  }
+  m.still_discarded += discarded;
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_recordStillPreviewGap(uint32_t gap_us) {
+  portENTER_CRITICAL(&m_mux);
+  stat_add(m.still_gap_us, gap_us);
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_rtpSession(bool active) {
+  portENTER_CRITICAL(&m_mux);
+  m.rtp_sessions = active ? 1 : 0;
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_recordRtpFrame(uint32_t packets, size_t bytes, uint32_t send_us, uint32_t latency_us) {
+  portENTER_CRITICAL(&m_mux);
+  m.rtp_frames++;
+  m.rtp_packets += packets;
+  m.rtp_bytes += bytes;
+  stat_add(m.rtp_send_us, send_us);
+  stat_add(m.rtp_latency_us, latency_us);
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_recordRtpDrop(bool late) {
+  portENTER_CRITICAL(&m_mux);
+  if (late) m.rtp_dropped_late++;
+  else m.rtp_dropped_send++;
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_recordRtpReport(uint8_t fraction_lost, int32_t cumulative_lost,
+                                 uint32_t jitter_us, uint32_t rtt_us) {
+  portENTER_CRITICAL(&m_mux);
+  m.rtp_rr_count++;
+  m.rtp_fraction_lost = fraction_lost;
+  m.rtp_cumulative_lost = cumulative_lost;
+  m.rtp_jitter_us = jitter_us;
+  m.rtp_rtt_us = rtt_us;
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_streamOpened() {
+  portENTER_CRITICAL(&m_mux);
+  m.streams_active++;
+  portEXIT_CRITICAL(&m_mux);
+}
+
+void cam_metrics_streamClosed() {
+  portENTER_CRITICAL(&m_mux);
+  if (m.streams_active > 0) m.streams_active--;
+  // Không còn client → FPS về 0 thay vì giữ giá trị cũ
+  if (m.streams_active == 0) {
+    m.fps_x100 = 0;
+    m.win_frames = 0;
+    m.win_start_us = esp_timer_get_time();
+  }
+  portEXIT_CRITICAL(&m_mux);
+}
+
+// ================= Output =================
+static size_t format_json(const CamMetrics &s, char* buf, size_t len) {
+  TimeSyncQuality tq;
+  time_sync_getQuality(&tq);
+  return snprintf(buf, len,
+    "{"
+    "\"uptime_ms\":%llu,"
+    "\"frames_total\":%u,"
+    "\"bytes_total\":%llu,"
+    "\"fps\":%u.%02u,"
+    "\"streams_active\":%d,"
+    "\"dropped\":{\"capture\":%u,\"encode\":%u,\"send\":%u,\"size\":%u},"
+    "\"capture_us\":{\"last\":%u,\"avg\":%u,\"max\":%u},"
+    "\"send_us\":{\"last\":%u,\"avg\":%u,\"max\":%u},"
+    "\"jpeg_bytes\":{\"last\":%u,\"avg\":%u,\"max\":%u},"
+    "\"heap_free\":%u,"
+    "\"heap_min_free\":%u,"
+    "\"psram_free\":%u,"
+    "\"psram_largest_block\":%u,"
+    "\"camera_init_us\":%u,"
+    "\"boot_to_first_frame_us\":%lld,"
+    "\"reconfig_count\":%u,"
+    "\"reconfig_last_us\":%u,"
+    "\"vision\":{\"frames\":%u,\"errors\":%u,"
+    "\"decode_us\":{\"last\":%u,\"avg\":%u,\"max\":%u},"
+    "\"detect_us\":{\"last\":%u,\"avg\":%u,\"max\":%u}},"
+    "\"gate\":{\"skipped\":%u,\"bytes_saved\":%llu,"
+    "\"sig_us\":{\"last\":%u,\"avg\":%u,\"max\":%u}},"
+    "\"still\":{\"count\":%u,\"failed\":%u,\"discarded\":%u,"
+    "\"took_us\":{\"last\":%u,\"avg\":%u,\"max\":%u},"
+    "\"preview_gap_us\":{\"last\":%u,\"avg\":%u,\"max\":%u}},"
+    "\"rtp\":{\"sessions\":%d,\"frames\":%u,\"packets\":%u,\"bytes\":%llu,"
+    "\"dropped\":{\"late\":%u,\"send\":%u},"
+    "\"send_us\":{\"last\":%u,\"avg\":%u,\"max\":%u},"
+    "\"latency_us\":{\"last\":%u,\"avg\":%u,\"max\":%u},"
+    "\"receiver\":{\"reports\":%u,\"fraction_lost_pct\":%u.%02u,"
+    "\"cumulative_lost\":%d,\"jitter_us\":%u,\"rtt_us\":%u}},"
+    "\"time\":{\"synced\":%s,\"syncs\":%u,\"age_s\":%u,\"drift_ppm\":%.2f,"
+    "\"residual_us\":%d,\"err_us\":%u,\"now_us\":%lld}"
+    "}",
+    (unsigned long long)(esp_timer_get_time() / 1000),
+    s.frames_total,
+    (unsigned long long)s.bytes_total,
+    s.fps_x100 / 100, s.fps_x100 % 100,
+    s.streams_active,
+    s.drops[CAM_DROP_CAPTURE], s.drops[CAM_DROP_ENCODE], s.drops[CAM_DROP_SEND], s.drops[CAM_DROP_SIZE],
+    s.capture_us.last, s.capture_us.avg, s.capture_us.max,
+    s.send_us.last, s.send_us.avg, s.send_us.max,
+    s.jpeg_bytes.last, s.jpeg_bytes.avg, s.jpeg_bytes.max,
+    (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+    (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+    (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+    (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM),
+    s.camera_init_us, (long long)s.first_frame_us,
+    s.reconfig_count, s.reconfig_last_us,
+    s.vision_frames, s.vision_errors,
+    s.vision_decode_us.last, s.vision_decode_us.avg, s.vision_decode_us.max,
+    s.vision_detect_us.last, s.vision_detect_us.avg, s.vision_detect_us.max,
+    s.gate_skipped, (unsigned long long)s.gate_bytes_saved,
+    s.gate_sig_us.last, s.gate_sig_us.avg, s.gate_sig_us.max,
+    s.still_count, s.still_failed, s.still_discarded,
+    s.still_us.last, s.still_us.avg, s.still_us.max,
+    s.still_gap_us.last, s.still_gap_us.avg, s.still_gap_us.max,
+    s.rtp_sessions, s.rtp_frames, s.rtp_packets, (unsigned long long)s.rtp_bytes,
+    s.rtp_dropped_late, s.rtp_dropped_send,
+    s.rtp_send_us.last, s.rtp_send_us.avg, s.rtp_send_us.max,
+    s.rtp_latency_us.last, s.rtp_latency_us.avg, s.rtp_latency_us.max,
+    s.rtp_rr_count, s.rtp_fraction_lost * 100 / 256, (s.rtp_fraction_lost * 10000 / 256) % 100,
+    (int)s.rtp_cumulative_lost, s.rtp_jitter_us, s.rtp_rtt_us,
+    tq.synced ? "true" : "false", tq.syncs, tq.age_s, tq.drift_ppm,
+    (int)tq.last_residual_us, tq.err_us, (long long)time_sync_nowUs());
+}
+
+static size_t format_prometheus(const CamMetrics &s, char* buf, size_t len) {
+  return snprintf(buf, len,
+    "# TYPE cam_uptime_seconds gauge\n"
+    "cam_uptime_seconds %llu\n"
+    "# TYPE cam_frames_total counter\n"
+    "cam_frames_total %u\n"
+    "# TYPE cam_bytes_total counter\n"
+    "cam_bytes_total %llu\n"
+    "# TYPE cam_fps gauge\n"
+    "cam_fps %u.%02u\n"
+    "# TYPE cam_streams_active gauge\n"
+    "cam_streams_active %d\n"
+    "# TYPE cam_frames_dropped_total counter\n"
+    "cam_frames_dropped_total{reason=\"capture\"} %u\n"
+    "cam_frames_dropped_total{reason=\"encode\"} %u\n"
+    "cam_frames_dropped_total{reason=\"send\"} %u\n"
+    "cam_frames_dropped_total{reason=\"size\"} %u\n"
+    "# TYPE cam_capture_us gauge\n"
+    "cam_capture_us{stat=\"last\"} %u\n"
+    "cam_capture_us{stat=\"avg\"} %u\n"
+    "cam_capture_us{stat=\"max\"} %u\n"
+    "# TYPE cam_send_us gauge\n"
+    "cam_send_us{stat=\"last\"} %u\n"
+    "cam_send_us{stat=\"avg\"} %u\n"
+    "cam_send_us{stat=\"max\"} %u\n"
+    "# TYPE cam_jpeg_bytes gauge\n"
+    "cam_jpeg_bytes{stat=\"last\"} %u\n"
+    "cam_jpeg_bytes{stat=\"avg\"} %u\n"
+    "cam_jpeg_bytes{stat=\"max\"} %u\n"
+    "# TYPE cam_heap_free_bytes gauge\n"
+    "cam_heap_free_bytes %u\n"
+    "# TYPE cam_heap_min_free_bytes gauge\n"
+    "cam_heap_min_free_bytes %u\n"
+    "# TYPE cam_psram_free_bytes gauge\n"
+    "cam_psram_free_bytes %u\n"
+    "# TYPE cam_psram_largest_block_bytes gauge\n"
+    "cam_psram_largest_block_bytes %u\n"
+    "# TYPE cam_camera_init_us gauge\n"
+    "cam_camera_init_us %u\n"
+    "# TYPE cam_boot_to_first_frame_us gauge\n"
+    "cam_boot_to_first_frame_us %lld\n"
+    "# TYPE cam_reconfig_total counter\n"
+    "cam_reconfig_total %u\n"
+    "# TYPE cam_reconfig_last_us gauge\n"
+    "cam_reconfig_last_us %u\n"
+    "# TYPE cam_vision_frames_total counter\n"
+    "cam_vision_frames_total %u\n"
+    "# TYPE cam_vision_errors_total counter\n"
+    "cam_vision_errors_total %u\n"
+    "# TYPE cam_vision_decode_us gauge\n"
+    "cam_vision_decode_us{stat=\"last\"} %u\n"
+    "cam_vision_decode_us{stat=\"avg\"} %u\n"
+    "cam_vision_decode_us{stat=\"max\"} %u\n"
+    "# TYPE cam_vision_detect_us gauge\n"
+    "cam_vision_detect_us{stat=\"last\"} %u\n"
+    "cam_vision_detect_us{stat=\"avg\"} %u\n"
+    "cam_vision_detect_us{stat=\"max\"} %u\n"
+    "# TYPE cam_gate_skipped_total counter\n"
+    "cam_gate_skipped_total %u\n"
+    "# TYPE cam_gate_bytes_saved_total counter\n"
+    "cam_gate_bytes_saved_total %llu\n"
+    "# TYPE cam_gate_sig_us gauge\n"
+    "cam_gate_sig_us{stat=\"last\"} %u\n"
+    "cam_gate_sig_us{stat=\"avg\"} %u\n"
+    "cam_gate_sig_us{stat=\"max\"} %u\n"
+    "# TYPE cam_still_total counter\n"
+    "cam_still_total %u\n"
+    "# TYPE cam_still_failed_total counter\n"
+    "cam_still_failed_total %u\n"
+    "# TYPE cam_still_discarded_frames_total counter\n"
+    "cam_still_discarded_frames_total %u\n"
+    "# TYPE cam_still_us gauge\n"
+    "cam_still_us{stat=\"last\"} %u\n"
+    "cam_still_us{stat=\"avg\"} %u\n"
+    "cam_still_us{stat=\"max\"} %u\n"
+    "# TYPE cam_still_preview_gap_us gauge\n"
+    "cam_still_preview_gap_us{stat=\"last\"} %u\n"
+    "cam_still_preview_gap_us{stat=\"avg\"} %u\n"
+    "cam_still_preview_gap_us{stat=\"max\"} %u\n"
+    "# TYPE cam_rtp_sessions gauge\n"
+    "cam_rtp_sessions %d\n"
+    "# TYPE cam_rtp_frames_total counter\n"
+    "cam_rtp_frames_total %u\n"
+    "# TYPE cam_rtp_packets_total counter\n"
+    "cam_rtp_packets_total %u\n"
+    "# TYPE cam_rtp_bytes_total counter\n"
+    "cam_rtp_bytes_total %llu\n"
+    "# TYPE cam_rtp_frames_dropped_total counter\n"
+    "cam_rtp_frames_dropped_total{reason=\"late\"} %u\n"
+    "cam_rtp_frames_dropped_total{reason=\"send\"} %u\n"
+    "# TYPE cam_rtp_send_us gauge\n"
+    "cam_rtp_send_us{stat=\"last\"} %u\n"
+    "cam_rtp_send_us{stat=\"avg\"} %u\n"
+    "cam_rtp_send_us{stat=\"max\"} %u\n"
+    "# TYPE cam_rtp_latency_us gauge\n"
+    "cam_rtp_latency_us{stat=\"last\"} %u\n"
+    "cam_rtp_latency_us{stat=\"avg\"} %u\n"
+    "cam_rtp_latency_us{stat=\"max\"} %u\n"
+    "# TYPE cam_rtp_receiver_reports_total counter\n"
+    "cam_rtp_receiver_reports_total %u\n"
+    "# TYPE cam_rtp_fraction_lost_pct gauge\n"
+    "cam_rtp_fraction_lost_pct %u.%02u\n"
+    "# TYPE cam_rtp_cumulative_lost gauge\n"
+    "cam_rtp_cumulative_lost %d\n"
+    "# TYPE cam_rtp_jitter_us gauge\n"
+    "cam_rtp_jitter_us %u\n"
+    "# TYPE cam_rtp_rtt_us gauge\n"
+    "cam_rtp_rtt_us %u\n",
+    (unsigned long long)(esp_timer_get_time() / 1000000),
+    s.frames_total,
+    (unsigned long long)s.bytes_total,
+    s.fps_x100 / 100, s.fps_x100 % 100,
+    s.streams_active,
+    s.drops[CAM_DROP_CAPTURE], s.drops[CAM_DROP_ENCODE], s.drops[CAM_DROP_SEND], s.drops[CAM_DROP_SIZE],
+    s.capture_us.last, s.capture_us.avg, s.capture_us.max,
+    s.send_us.last, s.send_us.avg, s.send_us.max,
+    s.jpeg_bytes.last, s.jpeg_bytes.avg, s.jpeg_bytes.max,
+    (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+    (unsigned)heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL),
+    (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM),
+    (unsigned)heap_caps_get_largest_free_block(MALLOC_CAP_SPIRAM),
+    s.camera_init_us, (long long)s.first_frame_us,
+    s.reconfig_count, s.reconfig_last_us,
+    s.vision_frames, s.vision_errors,
+    s.vision_decode_us.last, s.vision_decode_us.avg, s.vision_decode_us.max,
+    s.vision_detect_us.last, s.vision_detect_us.avg, s.vision_detect_us.max,
+    s.gate_skipped, (unsigned long long)s.gate_bytes_saved,
+    s.gate_sig_us.last, s.gate_sig_us.avg, s.gate_sig_us.max,
+    s.still_count, s.still_failed, s.still_discarded,
+    s.still_us.last, s.still_us.avg, s.still_us.max,
+    s.still_gap_us.last, s.still_gap_us.avg, s.still_gap_us.max,
+    s.rtp_sessions, s.rtp_frames, s.rtp_packets, (unsigned long long)s.rtp_bytes,
+    s.rtp_dropped_late, s.rtp_dropped_send,
+    s.rtp_send_us.last, s.rtp_send_us.avg, s.rtp_send_us.max,
+    s.rtp_latency_us.last, s.rtp_latency_us.avg, s.rtp_latency_us.max,
+    s.rtp_rr_count, s.rtp_fraction_lost * 100 / 256, (s.rtp_fraction_lost * 10000 / 256) % 100,
+    (int)s.rtp_cumulative_lost, s.rtp_jitter_us, s.rtp_rtt_us);
+}
+
+static bool wants_prometheus(httpd_req_t *req) {
+  char query[32];
+  char val[16];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+      httpd_query_key_value(query, "format", val, sizeof(val)) == ESP_OK) {
+    return strcmp(val, "prometheus") == 0 || strcmp(val, "prom") == 0;
+  }
+
+  char accept[64];
+  if (httpd_req_get_hdr_value_str(req, "Accept", accept, sizeof(accept)) == ESP_OK) {
+    return strstr(accept, "text/plain") != NULL && strstr(accept, "json") == NULL;
+  }
+  return false;
+}
+
+esp_err_t cam_metrics_handler(httpd_req_t *req) {
+  // Snapshot under lock, format outside of it
+  CamMetrics snap;
+  portENTER_CRITICAL(&m_mux);
+  snap = m;
+  portEXIT_CRITICAL(&m_mux);
+
+  size_t len;
+  if (wants_prometheus(req)) {
+    httpd_resp_set_type(req, "text/plain; version=0.0.4");
+    len = format_prometheus(snap, out_buf, sizeof(out_buf));
+  } else {
+    httpd_resp_set_type(req, "application/json");
+    len = format_json(snap, out_buf, sizeof(out_buf));
+  }
+  if (len >= sizeof(out_buf)) len = sizeof(out_buf) - 1;
+
+  httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+  return httpd_resp_send(req, out_buf, len);
+}
@@ -0,0 +1,80 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <PubSubClient.h>
+#include "cam_mqtt.h"
+#include "cam_clip.h"
+
+// ================= MQTT Configuration =================
+// Cùng broker với xe (esp32_car/src/mqtt_client.cpp)
+const char* MQTT_BROKER = "192.168.0.107";
+const int MQTT_PORT = 1883;
+const char* MQTT_USER = "";
+const char* MQTT_PASS = "";
+const char* EVENT_TOPIC = "car/+/event";
+const unsigned long RECONNECT_INTERVAL_MS = 5000;
+
+// ================= MQTT Client =================
+static WiFiClient wifiClient;
+static PubSubClient mqttClient(wifiClient);
+static unsigned long last_reconnect_attempt = 0;
+
+// ================= MQTT Callback =================
+static void mqttCallback(char* topic, byte* payload, unsigned int length) {
+  // Payload nhỏ ({"type":"obstacle",...}), không cần parse JSON đầy đủ
+  char msg[128];
+  unsigned int n = length < sizeof(msg) - 1 ? length : sizeof(msg) - 1;
+  memcpy(msg, payload, n);
+  msg[n] = '\0';
+  if (!strstr(msg, "\"type\":\"obstacle\"")) {
+    return;
+  }
+
+  // topic = car/<id>/event
+  char reason[32];
+  const char* id = topic + 4;
+  const char* end = strchr(id, '/');
+  int id_len = end ? (int)(end - id) : (int)strlen(id);
+  snprintf(reason, sizeof(reason), "obstacle %.*s", id_len, id);
+  cam_clip_trigger(reason);
+}
+
+// ================= MQTT Reconnect =================
+static void mqtt_reconnect() {
+  uint8_t mac[6];
+  WiFi.macAddress(mac);
+  char clientId[32];
+  snprintf(clientId, sizeof(clientId), "ESP32Cam_%02X%02X%02X", mac[3], mac[4], mac[5]);
+
+  bool connected = false;
+  if (strlen(MQTT_USER) > 0) {
+    connected = mqttClient.connect(clientId, MQTT_USER, MQTT_PASS);
+  } else {
+    connected = mqttClient.connect(clientId);
+  }
+
+  if (connected) {
+    mqttClient.subscribe(EVENT_TOPIC);
+    Serial.printf("[MQTT] Connected, subscribed to %s\n", EVENT_TOPIC);
+  } else {
+    Serial.printf("[MQTT] Connect failed, rc=%d\n", mqttClient.state());
+  }
+}
+
+// ================= Public API =================
+void cam_mqtt_init() {
+  mqttClient.setServer(MQTT_BROKER, MQTT_PORT);
+  mqttClient.setCallback(mqttCallback);
+  last_reconnect_attempt = 0;
+}
+
+void cam_mqtt_loop() {
+  if (!mqttClient.connected()) {
+    unsigned long now = millis();
+    if (last_reconnect_attempt == 0 || now - last_reconnect_attempt > RECONNECT_INTERVAL_MS) {
+      last_reconnect_attempt = now;
+      mqtt_reconnect();
+    }
+  } else {
+    mqttClient.loop();
+  }
+}
@@ -0,0 +1,510 @@
+#include <Arduino.h>
+#include "esp_camera.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "cam_pipeline.h"
+#include "cam_metrics.h"
+
+// Định nghĩa chân cho AI-Thinker ESP32-CAM
+#define PWDN_GPIO_NUM     32
+#define RESET_GPIO_NUM    -1
+#define XCLK_GPIO_NUM      0
+#define SIOD_GPIO_NUM     26
+#define SIOC_GPIO_NUM     27
+#define Y9_GPIO_NUM       35
+#define Y8_GPIO_NUM       34
+#define Y7_GPIO_NUM       39
+#define Y6_GPIO_NUM       36
+#define Y5_GPIO_NUM       21
+#define Y4_GPIO_NUM       19
+#define Y3_GPIO_NUM       18
+#define Y2_GPIO_NUM        5
+#define VSYNC_GPIO_NUM    25
+#define HREF_GPIO_NUM     23
+#define PCLK_GPIO_NUM     22
+
+// ================= Configuration =================
+// More slots than frame buffers, so publishing never has to wait for a slot
+#define FRAME_SLOTS 4
+#define MAX_WAITERS 8
+const uint32_t CAPTURE_TASK_STACK = 4096;
+const UBaseType_t CAPTURE_TASK_PRIO = 5;
+// How long a re-init waits for consumers to hand back their frames
+const uint32_t RECONFIG_DRAIN_MS = 2000;
+// Dual-stream: frames read after switching to the still size before giving up
+const int STILL_MAX_FRAMES = 4;
+// Khoảng cách tối thiểu giữa 2 ảnh chụp, giới hạn mức giảm FPS của preview
+const uint32_t STILL_MIN_INTERVAL_MS = 500;
+
+// ================= Frame slots =================
+struct Slot {
+  camera_fb_t* fb;
+  uint32_t seq;
+  int64_t ts_us;
+  uint32_t capture_us;
+  int refs;
+};
+
+static Slot slots[FRAME_SLOTS];
+static int latest = -1;
+static TaskHandle_t waiters[MAX_WAITERS];
+static int n_waiters = 0;
+static portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+// ================= Driver state =================
+// Written only by the capture task (under mux), read elsewhere via a copy
+static CamSettings active;
+static framesize_t alloc_framesize = FRAMESIZE_QVGA; // buffers are sized for this
+static TaskHandle_t capture_task_handle = NULL;
+
+// Settings request handed from an HTTP handler to the capture task, which
+// owns the sensor: SCCB writes never race a still's framesize switch
+static volatile bool reconfig_req = false;
+static bool reconfig_full = false;     // re-init the driver, else sensor registers only
+static CamSettings reconfig_settings;
+static esp_err_t reconfig_result = ESP_OK;
+static SemaphoreHandle_t reconfig_done = NULL;
+
+// Still request handed from an HTTP handler to the capture task
+static volatile bool still_req = false;
+static bool still_waiting = false;     // requester still waiting (guarded by mux)
+static CamStill still_result;
+static bool still_ok = false;
+static SemaphoreHandle_t still_done = NULL;
+static SemaphoreHandle_t still_lock = NULL;
+static int64_t last_still_us = 0;
+// Preview gap: last preview frame before a still → first preview frame after
+static int64_t last_preview_us = 0;
+static int64_t gap_start_us = 0;
+
+// ================= Helpers =================
+static esp_err_t camera_init(const CamSettings& s) {
+  camera_config_t config;
+  config.ledc_channel = LEDC_CHANNEL_0;
+  config.ledc_timer = LEDC_TIMER_0;
+  config.pin_d0 = Y2_GPIO_NUM;
+  config.pin_d1 = Y3_GPIO_NUM;
+  config.pin_d2 = Y4_GPIO_NUM;
+  config.pin_d3 = Y5_GPIO_NUM;
+  config.pin_d4 = Y6_GPIO_NUM;
+  config.pin_d5 = Y7_GPIO_NUM;
+  config.pin_d6 = Y8_GPIO_NUM;
+  config.pin_d7 = Y9_GPIO_NUM;
+  config.pin_xclk = XCLK_GPIO_NUM;
+  config.pin_pclk = PCLK_GPIO_NUM;
+  config.pin_vsync = VSYNC_GPIO_NUM;
+  config.pin_href = HREF_GPIO_NUM;
+  config.pin_sscb_sda = SIOD_GPIO_NUM;
+  config.pin_sscb_scl = SIOC_GPIO_NUM;
+  config.pin_pwdn = PWDN_GPIO_NUM;
+  config.pin_reset = RESET_GPIO_NUM;
+  config.xclk_freq_hz = (int)s.xclk_mhz * 1000000;
+  config.pixel_format = PIXFORMAT_JPEG;
+
+  // Cấp phát buffer đúng kích thước vận hành; ở chế độ dual-stream buffer
+  // phải chứa được ảnh chụp, sensor chạy ở framesize preview (apply_sensor)
+  framesize_t alloc = (framesize_t)(s.still_framesize > s.framesize ? s.still_framesize : s.framesize);
+  config.frame_size = alloc;
+  config.jpeg_quality = s.quality;
+  config.fb_count = s.fb_count;
+  config.fb_location = psramFound() ? CAMERA_FB_IN_PSRAM : CAMERA_FB_IN_DRAM;
+  config.grab_mode = (s.fb_count > 1) ? CAMERA_GRAB_LATEST : CAMERA_GRAB_WHEN_EMPTY;
+
+  esp_err_t err = esp_camera_init(&config);
+  if (err == ESP_OK) {
+    portENTER_CRITICAL(&mux);
+    alloc_framesize = alloc;
+    portEXIT_CRITICAL(&mux);
+  }
+  return err;
+}
+
+static void apply_sensor(const CamSettings& s) {
+  sensor_t * sensor = esp_camera_sensor_get();
+  if (!sensor) return;
+  if (sensor->status.framesize != (framesize_t)s.framesize) {
+    sensor->set_framesize(sensor, (framesize_t)s.framesize);
+  }
+  sensor->set_quality(sensor, s.quality);
+  sensor->set_brightness(sensor, s.brightness);
+  sensor->set_contrast(sensor, s.contrast);
+  sensor->set_saturation(sensor, s.saturation);
+  sensor->set_hmirror(sensor, s.hmirror);
+  sensor->set_vflip(sensor, s.vflip);
+  sensor->set_whitebal(sensor, s.awb);
+  sensor->set_exposure_ctrl(sensor, s.aec);
+  sensor->set_gain_ctrl(sensor, s.agc);
+}
+
+static void notify_waiters() {
+  TaskHandle_t wake[MAX_WAITERS];
+  int n;
+  portENTER_CRITICAL(&mux);
+  n = n_waiters;
+  memcpy(wake, waiters, sizeof(TaskHandle_t) * n);
+  n_waiters = 0;
+  portEXIT_CRITICAL(&mux);
+  for (int i = 0; i < n; i++) {
+    xTaskNotifyGive(wake[i]);
+  }
+}
+
+static void unregister_waiter(TaskHandle_t t) {
+  portENTER_CRITICAL(&mux);
+  for (int i = 0; i < n_waiters; i++) {
+    if (waiters[i] == t) {
+      waiters[i] = waiters[--n_waiters];
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&mux);
+}
+
+// Drop one reference; returns the fb to hand back to the driver (or NULL)
+static camera_fb_t* unref_locked(int slot) {
+  if (--slots[slot].refs > 0) return NULL;
+  camera_fb_t* fb = slots[slot].fb;
+  slots[slot].fb = NULL;
+  return fb;
+}
+
+static void publish(camera_fb_t* fb, uint32_t capture_us) {
+  uint32_t seq = cam_metrics_nextSeq();
+  int64_t ts_us = cam_metrics_frameTimestampUs(fb);
+  camera_fb_t* to_return = NULL;
+
+  portENTER_CRITICAL(&mux);
+  int s = -1;
+  for (int i = 0; i < FRAME_SLOTS; i++) {
+    if (slots[i].fb == NULL) {
+      s = i;
+      break;
+    }
+  }
+  if (s < 0) {
+    to_return = fb; // không thể xảy ra khi FRAME_SLOTS > fb_count
+  } else {
+    slots[s].fb = fb;
+    slots[s].seq = seq;
+    slots[s].ts_us = ts_us;
+    slots[s].capture_us = capture_us;
+    slots[s].refs = 1; // reference held by "latest"
+    if (latest >= 0) {
+      to_return = unref_locked(latest);
+    }
+    latest = s;
+  }
+  portEXIT_CRITICAL(&mux);
+
+  if (to_return) esp_camera_fb_return(to_return);
+  notify_waiters();
+
+  int64_t now = esp_timer_get_time();
+  if (gap_start_us) {
+    cam_metrics_recordStillPreviewGap((uint32_t)(now - gap_start_us));
+    gap_start_us = 0;
+  }
+  last_preview_us = now;
+}
+
+static void drop_latest() {
+  camera_fb_t* to_return = NULL;
+  portENTER_CRITICAL(&mux);
+  if (latest >= 0) {
+    to_return = unref_locked(latest);
+    latest = -1;
+  }
+  portEXIT_CRITICAL(&mux);
+  if (to_return) esp_camera_fb_return(to_return);
+}
+
+static void set_active(const CamSettings& s) {
+  portENTER_CRITICAL(&mux);
+  active = s;
+  portEXIT_CRITICAL(&mux);
+}
+
+static bool all_slots_free() {
+  bool free_all = true;
+  portENTER_CRITICAL(&mux);
+  for (int i = 0; i < FRAME_SLOTS; i++) {
+    if (slots[i].fb != NULL) free_all = false;
+  }
+  portEXIT_CRITICAL(&mux);
+  return free_all;
+}
+
+// Runs on the capture task: the only place the driver is torn down
+static void do_reconfig() {
+  int64_t t0 = esp_timer_get_time();
+  drop_latest();
+
+  // Đợi các client stream trả frame (mỗi client giữ tối đa 1 frame)
+  uint32_t waited = 0;
+  while (!all_slots_free() && waited < RECONFIG_DRAIN_MS) {
+    vTaskDelay(pdMS_TO_TICKS(5));
+    waited += 5;
+  }
+  if (!all_slots_free()) {
+    reconfig_result = ESP_ERR_TIMEOUT;
+    return;
+  }
+
+  esp_camera_deinit();
+  esp_err_t err = camera_init(reconfig_settings);
+  if (err == ESP_OK) {
+    set_active(reconfig_settings);
+  } else {
+    Serial.printf("[CAM] Re-init failed (0x%x), restoring previous settings\n", err);
+    camera_init(active);
+  }
+  apply_sensor(active);
+  cam_metrics_recordReconfig((uint32_t)(esp_timer_get_time() - t0));
+  reconfig_result = err;
+}
+
+// Runs on the capture task: sensor-only change, the stream keeps running
+static void do_sensor_update() {
+  apply_sensor(reconfig_settings);
+  set_active(reconfig_settings);
+  reconfig_result = ESP_OK;
+}
+
+// Runs on the capture task: one frame at the still size between preview frames
+static void do_still() {
+  int64_t t0 = esp_timer_get_time();
+  sensor_t* sensor = esp_camera_sensor_get();
+  framesize_t preview_fs = (framesize_t)active.framesize;
+  framesize_t still_fs = (framesize_t)active.still_framesize;
+  CamStill still = { NULL, 0, 0, 0, 0 };
+  int discarded = 0;
+
+  gap_start_us = last_preview_us;
+  if (sensor) {
+    sensor->set_framesize(sensor, still_fs);
+    // Frame còn trong hàng đợi vẫn là khung preview: nhận diện theo chiều rộng
+    for (int i = 0; i < STILL_MAX_FRAMES && !still.buf; i++) {
+      camera_fb_t* fb = esp_camera_fb_get();
+      if (!fb) continue;
+      bool match = fb->width == resolution[still_fs].width;
+      if (match) {
+        // Copy ra PSRAM để trả buffer ngay, preview không phải chờ client tải ảnh
+        still.buf = (uint8_t*)(psramFound() ? ps_malloc(fb->len) : malloc(fb->len));
+        if (still.buf) {
+          memcpy(still.buf, fb->buf, fb->len);
+          still.len = fb->len;
+          still.width = fb->width;
+          still.height = fb->height;
+          still.ts_us = cam_metrics_frameTimestampUs(fb);
+        }
+      } else {
+        discarded++;
+      }
+      esp_camera_fb_return(fb);
+      if (match) break;
+    }
+    sensor->set_framesize(sensor, preview_fs);
+  }
+  last_still_us = esp_timer_get_time();
+  cam_metrics_recordStill((uint32_t)(last_still_us - t0), discarded, still.buf != NULL);
+
+  bool handed = false;
+  portENTER_CRITICAL(&mux);
+  if (still_waiting) {
+    still_result = still;
+    still_ok = still.buf != NULL;
+    handed = true;
+  }
+  portEXIT_CRITICAL(&mux);
+  if (handed) {
+    xSemaphoreGive(still_done);
+  } else {
+    free(still.buf); // requester timed out
+  }
+}
+
+// ================= Capture task =================
+static void capture_task(void*) {
+  for (;;) {
+    if (reconfig_req) {
+      if (reconfig_full) do_reconfig();
+      else do_sensor_update();
+      reconfig_req = false;
+      xSemaphoreGive(reconfig_done);
+      continue;
+    }
+    if (still_req) {
+      do_still();
+      still_req = false;
+      continue;
+    }
+
+    int64_t t0 = esp_timer_get_time();
+    camera_fb_t* fb = esp_camera_fb_get();
+    uint32_t capture_us = (uint32_t)(esp_timer_get_time() - t0);
+    if (!fb) {
+      Serial.println("Camera capture failed");
+      cam_metrics_recordDrop(CAM_DROP_CAPTURE);
+      vTaskDelay(pdMS_TO_TICKS(10));
+      continue;
+    }
+    cam_metrics_recordFirstFrame(esp_timer_get_time());
+    // Gắn nhãn theo kích thước: khung sau khi đổi framesize (ảnh chụp, /control)
+    // không được lọt vào stream preview
+    if (fb->width != resolution[active.framesize].width) {
+      esp_camera_fb_return(fb);
+      cam_metrics_recordDrop(CAM_DROP_SIZE);
+      continue;
+    }
+    publish(fb, capture_us);
+  }
+}
+
+// ================= Public API =================
+esp_err_t cam_pipeline_begin(const CamSettings& s) {
+  int64_t t0 = esp_timer_get_time();
+  esp_err_t err = camera_init(s);
+  if (err != ESP_OK) {
+    return err;
+  }
+  set_active(s);
+  apply_sensor(s);
+  cam_metrics_recordCameraInit((uint32_t)(esp_timer_get_time() - t0));
+
+  reconfig_done = xSemaphoreCreateBinary();
+  still_done = xSemaphoreCreateBinary();
+  still_lock = xSemaphoreCreateMutex();
+  xTaskCreatePinnedToCore(capture_task, "cam_capture", CAPTURE_TASK_STACK, NULL,
+                          CAPTURE_TASK_PRIO, &capture_task_handle, 1);
+  return ESP_OK;
+}
+
+bool cam_frame_acquire(CamFrame* out, uint32_t after_seq, uint32_t timeout_ms) {
+  TaskHandle_t self = xTaskGetCurrentTaskHandle();
+  TickType_t start = xTaskGetTickCount();
+  TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+
+  for (;;) {
+    bool got = false;
+    portENTER_CRITICAL(&mux);
+    if (latest >= 0 && slots[latest].seq > after_seq) {
+      Slot &sl = slots[latest];
+      sl.refs++;
+      out->fb = sl.fb;
+      out->seq = sl.seq;
+      out->ts_us = sl.ts_us;
+      out->capture_us = sl.capture_us;
+      out->slot = (int8_t)latest;
+      got = true;
+    } else if (n_waiters < MAX_WAITERS) {
+      waiters[n_waiters++] = self;
+    }
+    portEXIT_CRITICAL(&mux);
+    if (got) return true;
+
+    TickType_t elapsed = xTaskGetTickCount() - start;
+    if (elapsed >= timeout || ulTaskNotifyTake(pdTRUE, timeout - elapsed) == 0) {
+      unregister_waiter(self);
+      out->fb = NULL;
+      out->slot = -1;
+      return false;
+    }
+  }
+}
+
+void cam_frame_release(CamFrame* f) {
+  if (!f || f->slot < 0) return;
+  camera_fb_t* to_return;
+  portENTER_CRITICAL(&mux);
+  to_return = unref_locked(f->slot);
+  portEXIT_CRITICAL(&mux);
+  if (to_return) esp_camera_fb_return(to_return);
+  f->fb = NULL;
+  f->slot = -1;
+}
+
+esp_err_t cam_pipeline_apply(const CamSettings& s, bool* reinit) {
+  CamSettings cur;
+  portENTER_CRITICAL(&mux);
+  cur = active;
+  framesize_t alloc = alloc_framesize;
+  portEXIT_CRITICAL(&mux);
+
+  // Frame nhỏ hơn buffer đã cấp phát → đổi trực tiếp trên sensor, không dừng stream
+  bool need_reinit = s.fb_count != cur.fb_count ||
+                     s.xclk_mhz != cur.xclk_mhz ||
+                     s.framesize > alloc ||
+                     s.still_framesize > alloc;
+  if (reinit) *reinit = need_reinit;
+
+  // Cả hai đường đều chạy trên capture task
+  xSemaphoreTake(reconfig_done, 0); // clear a give from an abandoned request
+  reconfig_settings = s;
+  reconfig_full = need_reinit;
+  reconfig_req = true;
+  if (xSemaphoreTake(reconfig_done, pdMS_TO_TICKS(RECONFIG_DRAIN_MS + 3000)) != pdTRUE) {
+    return ESP_ERR_TIMEOUT;
+  }
+  return reconfig_result;
+}
+
+void cam_pipeline_settings(CamSettings* out) {
+  portENTER_CRITICAL(&mux);
+  *out = active;
+  portEXIT_CRITICAL(&mux);
+}
+
+bool cam_pipeline_dualMode() {
+  portENTER_CRITICAL(&mux);
+  bool dual = active.still_framesize > active.framesize;
+  portEXIT_CRITICAL(&mux);
+  return dual;
+}
+
+bool cam_still_capture(CamStill* out, uint32_t timeout_ms) {
+  out->buf = NULL;
+  out->len = 0;
+  if (!cam_pipeline_dualMode() || !still_lock) {
+    return false;
+  }
+  TickType_t start = xTaskGetTickCount();
+  TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+  if (xSemaphoreTake(still_lock, timeout) != pdTRUE) {
+    return false;
+  }
+
+  // Giãn cách các yêu cầu liên tiếp
+  int64_t since = esp_timer_get_time() - last_still_us;
+  if (last_still_us && since < (int64_t)STILL_MIN_INTERVAL_MS * 1000) {
+    vTaskDelay(pdMS_TO_TICKS(STILL_MIN_INTERVAL_MS - since / 1000));
+  }
+
+  xSemaphoreTake(still_done, 0); // clear a give from an abandoned request
+  portENTER_CRITICAL(&mux);
+  still_waiting = true;
+  still_ok = false;
+  portEXIT_CRITICAL(&mux);
+  still_req = true;
+
+  TickType_t elapsed = xTaskGetTickCount() - start;
+  bool got = elapsed < timeout && xSemaphoreTake(still_done, timeout - elapsed) == pdTRUE;
+
+  portENTER_CRITICAL(&mux);
+  still_waiting = false;
+  bool ok = got && still_ok;
+  if (ok) *out = still_result;
+  portEXIT_CRITICAL(&mux);
+  if (got && !ok) free(still_result.buf);
+
+  xSemaphoreGive(still_lock);
+  return ok;
+}
+
+void cam_still_release(CamStill* s) {
+  if (!s) return;
+  free(s->buf);
+  s->buf = NULL;
+  s->len = 0;
+}
@@ -0,0 +1,487 @@
+#include <string.h>
+#include <new>
+#include "jpeg_dc.h"
+
+// ================= Standard Huffman tables (ITU T.81 Annex K.3) =================
+// Used when a frame carries no DHT segment (common for MJPEG sources)
+static const uint8_t STD_DC_LUMA_BITS[16] = { 0,1,5,1,1,1,1,1,1,0,0,0,0,0,0,0 };
+static const uint8_t STD_DC_CHROMA_BITS[16] = { 0,3,1,1,1,1,1,1,1,1,1,0,0,0,0,0 };
+static const uint8_t STD_DC_VALS[12] = { 0,1,2,3,4,5,6,7,8,9,10,11 };
+
+static const uint8_t STD_AC_LUMA_BITS[16] = { 0,2,1,3,3,2,4,3,5,5,4,4,0,0,1,0x7d };
+static const uint8_t STD_AC_LUMA_VALS[162] = {
+  0x01,0x02,0x03,0x00,0x04,0x11,0x05,0x12,0x21,0x31,0x41,0x06,0x13,0x51,0x61,0x07,
+  0x22,0x71,0x14,0x32,0x81,0x91,0xa1,0x08,0x23,0x42,0xb1,0xc1,0x15,0x52,0xd1,0xf0,
+  0x24,0x33,0x62,0x72,0x82,0x09,0x0a,0x16,0x17,0x18,0x19,0x1a,0x25,0x26,0x27,0x28,
+  0x29,0x2a,0x34,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,0x49,
+  0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,0x69,
+  0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x83,0x84,0x85,0x86,0x87,0x88,0x89,
+  0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,0xa6,0xa7,
+  0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,0xc4,0xc5,
+  0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,0xe1,0xe2,
+  0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf1,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,
+  0xf9,0xfa
+};
+
+static const uint8_t STD_AC_CHROMA_BITS[16] = { 0,2,1,2,4,4,3,4,7,5,4,4,0,1,2,0x77 };
+static const uint8_t STD_AC_CHROMA_VALS[162] = {
+  0x00,0x01,0x02,0x03,0x11,0x04,0x05,0x21,0x31,0x06,0x12,0x41,0x51,0x07,0x61,0x71,
+  0x13,0x22,0x32,0x81,0x08,0x14,0x42,0x91,0xa1,0xb1,0xc1,0x09,0x23,0x33,0x52,0xf0,
+  0x15,0x62,0x72,0xd1,0x0a,0x16,0x24,0x34,0xe1,0x25,0xf1,0x17,0x18,0x19,0x1a,0x26,
+  0x27,0x28,0x29,0x2a,0x35,0x36,0x37,0x38,0x39,0x3a,0x43,0x44,0x45,0x46,0x47,0x48,
+  0x49,0x4a,0x53,0x54,0x55,0x56,0x57,0x58,0x59,0x5a,0x63,0x64,0x65,0x66,0x67,0x68,
+  0x69,0x6a,0x73,0x74,0x75,0x76,0x77,0x78,0x79,0x7a,0x82,0x83,0x84,0x85,0x86,0x87,
+  0x88,0x89,0x8a,0x92,0x93,0x94,0x95,0x96,0x97,0x98,0x99,0x9a,0xa2,0xa3,0xa4,0xa5,
+  0xa6,0xa7,0xa8,0xa9,0xaa,0xb2,0xb3,0xb4,0xb5,0xb6,0xb7,0xb8,0xb9,0xba,0xc2,0xc3,
+  0xc4,0xc5,0xc6,0xc7,0xc8,0xc9,0xca,0xd2,0xd3,0xd4,0xd5,0xd6,0xd7,0xd8,0xd9,0xda,
+  0xe2,0xe3,0xe4,0xe5,0xe6,0xe7,0xe8,0xe9,0xea,0xf2,0xf3,0xf4,0xf5,0xf6,0xf7,0xf8,
+  0xf9,0xfa
+};
+
+// ================= Huffman tables =================
+// 8-bit lookahead for short codes, canonical maxcode/valptr walk for the rest
+#define LUT_BITS 8
+
+struct HuffTable {
+  uint8_t lut_len[1 << LUT_BITS];   // 0 = code longer than LUT_BITS
+  uint8_t lut_sym[1 << LUT_BITS];
+  int32_t maxcode[18];
+  int32_t mincode[17];
+  int32_t valptr[17];
+  uint8_t vals[256];
+  bool present;
+};
+
+struct Component {
+  uint8_t id;
+  uint8_t h, v;
+  uint8_t tq;   // quantisation table
+  uint8_t td;   // DC Huffman table
+  uint8_t ta;   // AC Huffman table
+  int pred;     // DC predictor
+};
+
+// Decoder state is large (~8 KB), keep it off the task stack
+struct JpegDcDecoder {
+  HuffTable dc[4];
+  HuffTable ac[4];
+  uint16_t q0[4];          // DC quantiser of each table
+  Component comp[4];
+  int ncomp;
+  uint16_t width, height;
+  uint16_t restart_interval;
+  uint8_t scan_comp[4];    // component indices of the scan
+  int nscan;
+};
+
+static bool build_huff(HuffTable &t, const uint8_t* bits, const uint8_t* vals, int nvals) {
+  if (nvals > 256) return false;
+  memset(t.lut_len, 0, sizeof(t.lut_len));
+  memcpy(t.vals, vals, nvals);
+
+  int code = 0;
+  int k = 0;
+  for (int l = 1; l <= 16; l++) {
+    int n = bits[l - 1];
+    t.valptr[l] = k;
+    t.mincode[l] = code;
+    if (n) {
+      // Codes of length <= LUT_BITS go straight into the lookahead table
+      if (l <= LUT_BITS) {
+        for (int i = 0; i < n; i++) {
+          int base = (code + i) << (LUT_BITS - l);
+          int fill = 1 << (LUT_BITS - l);
+          for (int f = 0; f < fill; f++) {
+            t.lut_len[base + f] = (uint8_t)l;
+            t.lut_sym[base + f] = vals[k + i];
+          }
+        }
+      }
+      code += n;
+      k += n;
+      t.maxcode[l] = code - 1;
+    } else {
+      t.maxcode[l] = -1;
+    }
+    if (k > nvals) return false;
+    code <<= 1;
+  }
+  t.maxcode[17] = 0x7fffffff; // sentinel
+  t.present = true;
+  return true;
+}
+
+static void load_default_tables(JpegDcDecoder &st) {
+  build_huff(st.dc[0], STD_DC_LUMA_BITS, STD_DC_VALS, 12);
+  build_huff(st.dc[1], STD_DC_CHROMA_BITS, STD_DC_VALS, 12);
+  build_huff(st.ac[0], STD_AC_LUMA_BITS, STD_AC_LUMA_VALS, 162);
+  build_huff(st.ac[1], STD_AC_CHROMA_BITS, STD_AC_CHROMA_VALS, 162);
+}
+
+// ================= Bit reader =================
+struct BitReader {
+  const uint8_t* p;
+  const uint8_t* end;
+  uint32_t buf;     // MSB-aligned
+  int bits;
+  int pad;          // zero bytes injected after a marker / end of data
+};
+
+static inline void br_fill(BitReader &br) {
+  while (br.bits <= 24) {
+    uint32_t b = 0;
+    if (br.p < br.end && *br.p != 0xFF) {
+      b = *br.p++;
+    } else if (br.p + 1 < br.end && br.p[1] == 0x00) {
+      b = 0xFF;     // stuffed byte
+      br.p += 2;
+    } else {
+      br.pad++;     // marker or end: feed zeros, leave p on the marker
+    }
+    br.buf |= b << (24 - br.bits);
+    br.bits += 8;
+  }
+}
+
+static inline uint32_t br_get(BitReader &br, int n) {
+  br_fill(br);
+  uint32_t v = br.buf >> (32 - n);
+  br.buf <<= n;
+  br.bits -= n;
+  return v;
+}
+
+static inline int br_decode(BitReader &br, const HuffTable &t) {
+  br_fill(br);
+  uint32_t look = br.buf >> (32 - LUT_BITS);
+  int l = t.lut_len[look];
+  if (l) {
+    br.buf <<= l;
+    br.bits -= l;
+    return t.lut_sym[look];
+  }
+  for (l = LUT_BITS + 1; l <= 16; l++) {
+    int32_t code = (int32_t)(br.buf >> (32 - l));
+    if (code <= t.maxcode[l]) {
+      br.buf <<= l;
+      br.bits -= l;
+      return t.vals[t.valptr[l] + code - t.mincode[l]];
+    }
+  }
+  return -1;
+}
+
+static inline int extend(uint32_t v, int s) {
+  return (v < (1u << (s - 1))) ? (int)v - (1 << s) + 1 : (int)v;
+}
+
+// Skip to just past the next RSTn marker and reset the bit buffer
+static bool br_restart(BitReader &br) {
+  br.buf = 0;
+  br.bits = 0;
+  br.pad = 0;
+  while (br.p + 1 < br.end) {
+    if (br.p[0] == 0xFF && br.p[1] >= 0xD0 && br.p[1] <= 0xD7) {
+      br.p += 2;
+      return true;
+    }
+    br.p++;
+  }
+  return false;
+}
+
+// ================= Header parsing =================
+static inline uint16_t be16(const uint8_t* p) {
+  return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static JpegDcResult parse_dqt(JpegDcDecoder &st, const uint8_t* p, int len) {
+  while (len > 0) {
+    int pq = p[0] >> 4;
+    int tq = p[0] & 0x0F;
+    if (tq > 3) return JPEG_DC_BAD_MARKER;
+    // First entry in zig-zag order is the DC quantiser
+    st.q0[tq] = pq ? be16(p + 1) : p[1];
+    int n = 1 + (pq ? 128 : 64);
+    p += n;
+    len -= n;
+  }
+  return JPEG_DC_OK;
+}
+
+static JpegDcResult parse_dht(JpegDcDecoder &st, const uint8_t* p, int len) {
+  while (len > 17) {
+    int tc = p[0] >> 4;
+    int th = p[0] & 0x0F;
+    if (tc > 1 || th > 3) return JPEG_DC_BAD_MARKER;
+    int n = 0;
+    for (int i = 0; i < 16; i++) n += p[1 + i];
+    if (17 + n > len) return JPEG_DC_BAD_MARKER;
+    HuffTable &t = tc ? st.ac[th] : st.dc[th];
+    if (!build_huff(t, p + 1, p + 17, n)) return JPEG_DC_BAD_MARKER;
+    p += 17 + n;
+    len -= 17 + n;
+  }
+  return JPEG_DC_OK;
+}
+
+static JpegDcResult parse_sof(JpegDcDecoder &st, const uint8_t* p, int len) {
+  if (len < 6 || p[0] != 8) return JPEG_DC_UNSUPPORTED; // 8-bit samples only
+  st.height = be16(p + 1);
+  st.width = be16(p + 3);
+  st.ncomp = p[5];
+  if (st.ncomp < 1 || st.ncomp > 4 || len < 6 + st.ncomp * 3) return JPEG_DC_BAD_MARKER;
+  for (int i = 0; i < st.ncomp; i++) {
+    const uint8_t* c = p + 6 + i * 3;
+    st.comp[i].id = c[0];
+    st.comp[i].h = c[1] >> 4;
+    st.comp[i].v = c[1] & 0x0F;
+    st.comp[i].tq = c[2] & 0x03;
+    if (st.comp[i].h < 1 || st.comp[i].v < 1) return JPEG_DC_BAD_MARKER;
+  }
+  return JPEG_DC_OK;
+}
+
+static JpegDcResult parse_sos(JpegDcDecoder &st, const uint8_t* p, int len) {
+  st.nscan = p[0];
+  if (st.nscan < 1 || st.nscan > 4 || len < 1 + st.nscan * 2) return JPEG_DC_BAD_MARKER;
+  for (int i = 0; i < st.nscan; i++) {
+    uint8_t id = p[1 + i * 2];
+    uint8_t tables = p[2 + i * 2];
+    int idx = -1;
+    for (int c = 0; c < st.ncomp; c++) {
+      if (st.comp[c].id == id) idx = c;
+    }
+    if (idx < 0) return JPEG_DC_BAD_MARKER;
+    st.comp[idx].td = tables >> 4;
+    st.comp[idx].ta = tables & 0x0F;
+    if (st.comp[idx].td > 3 || st.comp[idx].ta > 3) return JPEG_DC_BAD_MARKER;
+    st.scan_comp[i] = (uint8_t)idx;
+  }
+  return JPEG_DC_OK;
+}
+
+// ================= Entropy decoding =================
+// Decode one block: returns the DC difference, AC coefficients are skipped
+static inline bool decode_block(JpegDcDecoder &st, BitReader &br, Component &c) {
+  int s = br_decode(br, st.dc[c.td]);
+  if (s < 0 || s > 11) return false;
+  if (s) c.pred += extend(br_get(br, s), s);
+
+  const HuffTable &ac = st.ac[c.ta];
+  for (int k = 1; k < 64; ) {
+    int rs = br_decode(br, ac);
+    if (rs < 0) return false;
+    int r = rs >> 4;
+    s = rs & 0x0F;
+    if (s == 0) {
+      if (r != 15) break;   // EOB
+      k += 16;
+    } else {
+      k += r + 1;
+      br_get(br, s);        // AC value not needed
+    }
+  }
+  return true;
+}
+
+static inline uint8_t dc_to_pixel(int pred, uint16_t q0) {
+  // DC = 8 x block mean (level-shifted by -128)
+  int v = 128 + (pred * (int)q0) / 8;
+  return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+static JpegDcResult decode_scan(JpegDcDecoder &st, const uint8_t* data, const uint8_t* end,
+                                uint8_t* out, uint16_t tw, uint16_t th) {
+  // Y is always the first component in the frame header
+  const int y_idx = 0;
+  int hmax = 1, vmax = 1;
+  for (int i = 0; i < st.ncomp; i++) {
+    if (st.comp[i].h > hmax) hmax = st.comp[i].h;
+    if (st.comp[i].v > vmax) vmax = st.comp[i].v;
+  }
+  // Non-interleaved scan: one block per MCU
+  bool interleaved = st.nscan > 1;
+  int mcu_w = interleaved ? 8 * hmax : 8;
+  int mcu_h = interleaved ? 8 * vmax : 8;
+  int mcus_x = (st.width + mcu_w - 1) / mcu_w;
+  int mcus_y = (st.height + mcu_h - 1) / mcu_h;
+
+  BitReader br = { data, end, 0, 0, 0 };
+  for (int i = 0; i < st.ncomp; i++) st.comp[i].pred = 0;
+
+  int mcu_count = 0;
+  for (int my = 0; my < mcus_y; my++) {
+    for (int mx = 0; mx < mcus_x; mx++) {
+      if (st.restart_interval && mcu_count > 0 && (mcu_count % st.restart_interval) == 0) {
+        if (!br_restart(br)) return JPEG_DC_CORRUPT;
+        for (int i = 0; i < st.ncomp; i++) st.comp[i].pred = 0;
+      }
+      mcu_count++;
+
+      for (int si = 0; si < st.nscan; si++) {
+        int ci = st.scan_comp[si];
+        Component &c = st.comp[ci];
+        int bh = interleaved ? c.h : 1;
+        int bv = interleaved ? c.v : 1;
+        for (int by = 0; by < bv; by++) {
+          for (int bx = 0; bx < bh; bx++) {
+            if (!decode_block(st, br, c)) return JPEG_DC_CORRUPT;
+            if (ci != y_idx) continue;
+            int px = mx * bh + bx;
+            int py = my * bv + by;
+            if (px < tw && py < th) {
+              out[py * tw + px] = dc_to_pixel(c.pred, st.q0[c.tq]);
+            }
+          }
+        }
+      }
+      // Quá nhiều byte đệm → dữ liệu bị cắt
+      if (br.pad > 8) return JPEG_DC_CORRUPT;
+    }
+  }
+  return JPEG_DC_OK;
+}
+
+// ================= Public API =================
+JpegDcDecoder* jpeg_dc_decoder_new() {
+  return new (std::nothrow) JpegDcDecoder();
+}
+
+JpegDcResult jpeg_dc_thumbnail(JpegDcDecoder* dec, const uint8_t* jpg, size_t len,
+                               uint8_t* out, size_t out_cap,
+                               uint16_t* out_w, uint16_t* out_h) {
+  if (len < 4 || jpg[0] != 0xFF || jpg[1] != 0xD8) return JPEG_DC_BAD_MARKER;
+
+  JpegDcDecoder &st = *dec;
+  memset(&st, 0, sizeof(st));
+  load_default_tables(st);
+
+  const uint8_t* p = jpg + 2;
+  const uint8_t* end = jpg + len;
+  bool have_sof = false;
+
+  while (p + 4 <= end) {
+    if (p[0] != 0xFF) return JPEG_DC_BAD_MARKER;
+    uint8_t marker = p[1];
+    if (marker == 0xFF) { p++; continue; } // fill byte
+    uint16_t seg_len = be16(p + 2);
+    const uint8_t* seg = p + 4;
+    if (seg_len < 2 || seg + seg_len - 2 > end) return JPEG_DC_BAD_MARKER;
+    int body = seg_len - 2;
+    JpegDcResult r = JPEG_DC_OK;
+
+    switch (marker) {
+      case 0xC0: // SOF0 baseline
+      case 0xC1: // SOF1 extended sequential (Huffman)
+        r = parse_sof(st, seg, body);
+        have_sof = true;
+        break;
+      case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+      case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+        return JPEG_DC_UNSUPPORTED;
+      case 0xC4:
+        r = parse_dht(st, seg, body);
+        break;
+      case 0xDB:
+        r = parse_dqt(st, seg, body);
+        break;
+      case 0xDD:
+        if (body >= 2) st.restart_interval = be16(seg);
+        break;
+      case 0xDA: {
+        if (!have_sof) return JPEG_DC_BAD_MARKER;
+        r = parse_sos(st, seg, body);
+        if (r != JPEG_DC_OK) return r;
+
+        int hmax = 1;
+        int vmax = 1;
+        for (int i = 0; i < st.ncomp; i++) {
+          if (st.comp[i].h > hmax) hmax = st.comp[i].h;
+          if (st.comp[i].v > vmax) vmax = st.comp[i].v;
+        }
+        const Component &y = st.comp[0];
+        uint16_t tw = (uint16_t)((st.width * y.h + 8 * hmax - 1) / (8 * hmax));
+        uint16_t th = (uint16_t)((st.height * y.v + 8 * vmax - 1) / (8 * vmax));
+        if ((size_t)tw * th > out_cap) return JPEG_DC_TOO_LARGE;
+
+        r = decode_scan(st, seg + body, end, out, tw, th);
+        if (r == JPEG_DC_OK) {
+          *out_w = tw;
+          *out_h = th;
+        }
+        return r;
+      }
+      default:
+        break; // APPn, COM... ignored
+    }
+    if (r != JPEG_DC_OK) return r;
+    p = seg + body;
+  }
+  return JPEG_DC_BAD_MARKER;
+}
+
+JpegDcResult jpeg_parse_layout(const uint8_t* jpg, size_t len, JpegLayout* out) {
+  if (len < 4 || jpg[0] != 0xFF || jpg[1] != 0xD8) return JPEG_DC_BAD_MARKER;
+  memset(out, 0, sizeof(*out));
+
+  const uint8_t* p = jpg + 2;
+  const uint8_t* end = jpg + len;
+  bool have_sof = false;
+
+  while (p + 4 <= end) {
+    if (p[0] != 0xFF) return JPEG_DC_BAD_MARKER;
+    uint8_t marker = p[1];
+    if (marker == 0xFF) { p++; continue; }
+    uint16_t seg_len = be16(p + 2);
+    const uint8_t* seg = p + 4;
+    if (seg_len < 2 || seg + seg_len - 2 > end) return JPEG_DC_BAD_MARKER;
+    int body = seg_len - 2;
+
+    switch (marker) {
+      case 0xC0: case 0xC1:
+        if (body < 6 || seg[0] != 8) return JPEG_DC_UNSUPPORTED;
+        out->height = be16(seg + 1);
+        out->width = be16(seg + 3);
+        out->ncomp = seg[5];
+        if (out->ncomp < 1 || out->ncomp > 4 || body < 6 + out->ncomp * 3) return JPEG_DC_BAD_MARKER;
+        out->y_h = seg[7] >> 4;
+        out->y_v = seg[7] & 0x0F;
+        have_sof = true;
+        break;
+      case 0xC2: case 0xC3: case 0xC5: case 0xC6: case 0xC7:
+      case 0xC9: case 0xCA: case 0xCB: case 0xCD: case 0xCE: case 0xCF:
+        return JPEG_DC_UNSUPPORTED;
+      case 0xDB: {
+        // Có thể gộp nhiều bảng trong 1 segment
+        const uint8_t* q = seg;
+        int left = body;
+        while (left >= 65) {
+          int pq = q[0] >> 4;
+          int tq = q[0] & 0x0F;
+          if (pq) return JPEG_DC_UNSUPPORTED;   // 16-bit tables
+          if (tq < 2) out->qtable[tq] = q + 1;
+          q += 65;
+          left -= 65;
+        }
+        break;
+      }
+      case 0xDD:
+        if (body >= 2) out->restart_interval = be16(seg);
+        break;
+      case 0xDA: {
+        if (!have_sof) return JPEG_DC_BAD_MARKER;
+        out->scan = seg + body;
+        size_t n = end - out->scan;
+        // Drop EOI (and any trailing padding after it)
+        while (n >= 2 && !(out->scan[n - 2] == 0xFF && out->scan[n - 1] == 0xD9)) n--;
+        out->scan_len = n >= 2 ? n - 2 : end - out->scan;
+        return JPEG_DC_OK;
+      }
+      default:
+        break;
+    }
+    p = seg + body;
+  }
+  return JPEG_DC_BAD_MARKER;
+}
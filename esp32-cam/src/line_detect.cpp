@@ -0,0 +1,112 @@
+#include <string.h>
+#include "line_detect.h"
+
+#define MAX_WIDTH 255
+
+void line_detect_defaults(LineDetectConfig* cfg) {
+  cfg->n_bands = 4;
+  cfg->min_contrast = 24;
+  cfg->junction_width_pct = 45;
+}
+
+// atan2(x, y) in centi-degrees for y > 0 (angle from the vertical axis).
+// atan(z) ~ 45z - z(|z|-1)(14.02 + 3.79|z|) degrees for |z| <= 1, error < 0.1 deg.
+static int iatan2_cdeg(int x, int y) {
+  if (x == 0) return 0;
+  int ax = x < 0 ? -x : x;
+  bool swap = ax > y;
+  // z in Q12
+  int32_t z = swap ? ((int32_t)y << 12) / ax : ((int32_t)ax << 12) / y;
+  int32_t a = (4500 * z
+               - ((z * (z - 4096)) >> 12) * (1402 + ((379 * z) >> 12))) >> 12;
+  if (swap) a = 9000 - a;
+  return x < 0 ? -a : (int)a;
+}
+
+void line_detect(const uint8_t* img, uint16_t w, uint16_t h,
+                 const LineDetectConfig& cfg, LineDetectResult* out) {
+  memset(out, 0, sizeof(*out));
+  if (w == 0 || w > MAX_WIDTH || h == 0) return;
+
+  int n = cfg.n_bands;
+  if (n < 1) n = 1;
+  if (n > LINE_MAX_BANDS) n = LINE_MAX_BANDS;
+  if (n > h) n = h;
+  out->n_bands = (uint8_t)n;
+
+  int band_rows = h / n;
+  uint16_t colsum[MAX_WIDTH];
+  uint8_t col[MAX_WIDTH];
+  int cx_x16[LINE_MAX_BANDS];   // line centre, 1/16 pixel
+
+  for (int b = 0; b < n; b++) {
+    LineBand &lb = out->band[b];
+    // Band 0 = hàng dưới cùng (gần xe nhất)
+    int y1 = h - b * band_rows;
+    int y0 = y1 - band_rows;
+    lb.row = (uint8_t)((y0 + y1) / 2);
+
+    // Column sums: walk the band rows in memory order
+    memset(colsum, 0, sizeof(uint16_t) * w);
+    for (int y = y0; y < y1; y++) {
+      const uint8_t* row = img + y * w;
+      for (int x = 0; x < w; x++) colsum[x] += row[x];
+    }
+
+    int vmin = 255, vmax = 0, xmin = 0;
+    for (int x = 0; x < w; x++) {
+      int v = colsum[x] / band_rows;
+      col[x] = (uint8_t)v;
+      if (v < vmin) { vmin = v; xmin = x; }
+      if (v > vmax) vmax = v;
+    }
+    lb.contrast = (uint8_t)(vmax - vmin);
+    if (lb.contrast < cfg.min_contrast) continue;
+
+    // Dark run around the darkest column (ignores unrelated dark spots)
+    int thr = vmin + (vmax - vmin) / 2;
+    int xl = xmin, xr = xmin;
+    while (xl > 0 && col[xl - 1] < thr) xl--;
+    while (xr < w - 1 && col[xr + 1] < thr) xr++;
+
+    // Weighted centroid of the run, weight = depth below threshold
+    int32_t sw = 0, swx = 0;
+    for (int x = xl; x <= xr; x++) {
+      int wt = thr - col[x];
+      sw += wt;
+      swx += wt * (x * 16 + 8);
+    }
+    cx_x16[b] = sw ? swx / sw : xmin * 16 + 8;
+
+    int width = xr - xl + 1;
+    lb.width_px = (uint8_t)width;
+    lb.flags = LINE_FOUND;
+    if (width * 100 > w * cfg.junction_width_pct) lb.flags |= LINE_JUNCTION;
+
+    int half_x16 = w * 8;
+    lb.offset_pm = (int16_t)((cx_x16[b] - half_x16) * 1000 / half_x16);
+  }
+
+  // Heading: direction from the previous (nearer) found band to this one
+  for (int b = 0; b < n; b++) {
+    LineBand &lb = out->band[b];
+    if (!(lb.flags & LINE_FOUND)) continue;
+    int ref = -1;
+    for (int k = b - 1; k >= 0; k--) {
+      if (out->band[k].flags & LINE_FOUND) { ref = k; break; }
+    }
+    // Band gần nhất: dùng band xa hơn kế tiếp
+    if (ref < 0) {
+      for (int k = b + 1; k < n; k++) {
+        if (out->band[k].flags & LINE_FOUND) { ref = k; break; }
+      }
+    }
+    if (ref < 0) continue;
+
+    int near = ref < b ? ref : b;
+    int far = ref < b ? b : ref;
+    int dx_x16 = cx_x16[far] - cx_x16[near];
+    int dy_x16 = (out->band[near].row - out->band[far].row) * 16;
+    lb.heading_cdeg = (int16_t)iatan2_cdeg(dx_x16, dy_x16);
+  }
+}
@@ -0,0 +1,120 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include "esp_timer.h"
+#include "line_vision.h"
+#include "jpeg_dc.h"
+#include "cam_pipeline.h"
+#include "cam_metrics.h"
+
+static_assert(sizeof(LineBand) == 8, "LineBand wire size changed");
+
+// ================= Configuration =================
+const uint32_t SUBSCRIPTION_TIMEOUT_MS = 5000;
+const uint32_t VISION_TASK_STACK = 4096;
+const UBaseType_t VISION_TASK_PRIO = 3;   // below the capture task
+// Largest thumbnail handled: SVGA → 100 x 75 blocks
+#define THUMB_MAX (100 * 75)
+
+// ================= State =================
+static WiFiUDP udp;
+static IPAddress sub_ip;
+static uint16_t sub_port = 0;
+static uint32_t sub_last_ms = 0;
+
+static uint8_t thumb[THUMB_MAX];
+static JpegDcDecoder* decoder = NULL;   // own workspace, decodes run concurrently with other tasks
+static LineDetectConfig detect_cfg;
+
+// ================= Helpers =================
+// Drain pending datagrams, remember the latest subscriber
+static void poll_subscribers() {
+  char buf[16];
+  while (udp.parsePacket() > 0) {
+    int n = udp.read((uint8_t*)buf, sizeof(buf) - 1);
+    if (n <= 0) continue;
+    buf[n] = '\0';
+    if (strcmp(buf, LINE_VISION_SUBSCRIBE) == 0) {
+      if (sub_port == 0 || sub_ip != udp.remoteIP()) {
+        Serial.print("[VISION] Subscriber: ");
+        Serial.println(udp.remoteIP());
+      }
+      sub_ip = udp.remoteIP();
+      sub_port = udp.remotePort();
+      sub_last_ms = millis();
+    }
+  }
+}
+
+static bool subscribed() {
+  return sub_port != 0 && millis() - sub_last_ms < SUBSCRIPTION_TIMEOUT_MS;
+}
+
+// ================= Vision task =================
+static void vision_task(void*) {
+  uint32_t last_seq = 0;
+  LineVisionPacket pkt;
+
+  for (;;) {
+    poll_subscribers();
+    if (!subscribed()) {
+      vTaskDelay(pdMS_TO_TICKS(100));
+      continue;
+    }
+
+    CamFrame frame;
+    if (!cam_frame_acquire(&frame, last_seq, 1000)) {
+      continue;
+    }
+    last_seq = frame.seq;
+
+    // Chỉ giải mã hệ số DC của kênh Y, trả frame ngay sau đó
+    int64_t t0 = esp_timer_get_time();
+    uint16_t w = 0, h = 0;
+    JpegDcResult r = jpeg_dc_thumbnail(decoder, frame.fb->buf, frame.fb->len, thumb, sizeof(thumb), &w, &h);
+    int64_t frame_ts = frame.ts_us;
+    int64_t frame_boot_us = (int64_t)frame.fb->timestamp.tv_sec * 1000000LL + frame.fb->timestamp.tv_usec;
+    uint32_t seq = frame.seq;
+    cam_frame_release(&frame);
+    int64_t t1 = esp_timer_get_time();
+
+    if (r != JPEG_DC_OK) {
+      cam_metrics_recordVision((uint32_t)(t1 - t0), 0, false);
+      continue;
+    }
+
+    LineDetectResult res;
+    line_detect(thumb, w, h, detect_cfg, &res);
+    int64_t t2 = esp_timer_get_time();
+    cam_metrics_recordVision((uint32_t)(t1 - t0), (uint32_t)(t2 - t1), true);
+
+    pkt.magic = LINE_VISION_MAGIC;
+    pkt.version = LINE_VISION_VERSION;
+    pkt.n_bands = res.n_bands;
+    pkt.frame_seq = seq;
+    pkt.frame_ts_us = frame_ts;
+    pkt.img_w = (uint8_t)w;
+    pkt.img_h = (uint8_t)h;
+    memcpy(pkt.band, res.band, sizeof(pkt.band));
+    // frame_ts có thể là epoch; độ trễ tính theo đồng hồ boot của driver
+    pkt.latency_us = (uint32_t)(esp_timer_get_time() - frame_boot_us);
+
+    udp.beginPacket(sub_ip, sub_port);
+    udp.write((const uint8_t*)&pkt, sizeof(pkt));
+    udp.endPacket();
+  }
+}
+
+// ================= Public API =================
+void line_vision_begin() {
+  line_detect_defaults(&detect_cfg);
+  decoder = jpeg_dc_decoder_new();
+  if (!decoder) {
+    Serial.println("[VISION] Out of memory, line vision disabled");
+    return;
+  }
+  udp.begin(LINE_VISION_PORT);
+  xTaskCreatePinnedToCore(vision_task, "line_vision", VISION_TASK_STACK, NULL,
+                          VISION_TASK_PRIO, NULL, 1);
+  Serial.printf("[VISION] Listening on UDP %d\n", LINE_VISION_PORT);
+}
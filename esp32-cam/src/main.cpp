@@ -7,73 +7,99 @@
 #include "soc/soc.h"
 #include "soc/rtc_cntl_reg.h"
 #include "esp_http_server.h"
+#include "cam_metrics.h"
+#include "cam_config.h"
+#include "cam_pipeline.h"
+#include "line_vision.h"
+#include "cam_clip.h"
+#include "cam_mqtt.h"
+#include "motion_gate.h"
+#include "rtp_stream.h"
+#include "time_sync.h"
 
 // Cấu hình WiFi
 const char* ssid = "301";
 const char* password = "20042023";
 
-// Định nghĩa chân cho AI-Thinker ESP32-CAM
-#define PWDN_GPIO_NUM     32
-#define RESET_GPIO_NUM    -1
-#define XCLK_GPIO_NUM      0
-#define SIOD_GPIO_NUM     26
-#define SIOC_GPIO_NUM     27
-#define Y9_GPIO_NUM       35
-#define Y8_GPIO_NUM       34
-#define Y7_GPIO_NUM       39
-#define Y6_GPIO_NUM       36
-#define Y5_GPIO_NUM       21
-#define Y4_GPIO_NUM       19
-#define Y3_GPIO_NUM       18
-#define Y2_GPIO_NUM        5
-#define VSYNC_GPIO_NUM    25
-#define HREF_GPIO_NUM     23
-#define PCLK_GPIO_NUM     22
+// SNTP server (cùng server với xe: esp32_car/src/main.cpp)
+const char* NTP_SERVER = "pool.ntp.org";
+
+// Camera chờ tối đa bao lâu cho 1 frame mới trước khi coi là lỗi
+const uint32_t FRAME_TIMEOUT_MS = 5000;
 
 #define PART_BOUNDARY "123456789000000000000987654321"
 static const char* _STREAM_CONTENT_TYPE = "multipart/x-mixed-replace;boundary=" PART_BOUNDARY;
 static const char* _STREAM_BOUNDARY = "\r\n--" PART_BOUNDARY "\r\n";
-static const char* _STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n";
+// X-Timestamp-Us / X-Frame-Seq cho phép đo độ trễ end-to-end ở phía host
+static const char* _STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\nX-Timestamp-Us: %lld\r\nX-Frame-Seq: %u\r\n\r\n";
 
 httpd_handle_t stream_httpd = NULL;
 httpd_handle_t camera_httpd = NULL;
 
 // Stream handler
 static esp_err_t stream_handler(httpd_req_t *req) {
-  camera_fb_t * fb = NULL;
+  CamFrame frame;
   esp_err_t res = ESP_OK;
   size_t _jpg_buf_len = 0;
   uint8_t * _jpg_buf = NULL;
-  char * part_buf[64];
+  char part_buf[128];
+  uint32_t last_seq = 0;
+
+  // Motion gate (tùy chọn theo từng client): /stream?gate=1
+  MotionGateConfig gate;
+  motion_gate_defaults(&gate);
+  motion_gate_parse_query(req, &gate);
+  MotionSig sent_sig;
+  bool have_sent_sig = false;
+  int64_t last_sent_us = 0;
 
   res = httpd_resp_set_type(req, _STREAM_CONTENT_TYPE);
   if(res != ESP_OK) {
     return res;
   }
+  cam_metrics_streamOpened();
 
   while(true) {
-    fb = esp_camera_fb_get();
-    if (!fb) {
+    bool converted = false;
+    if (!cam_frame_acquire(&frame, last_seq, FRAME_TIMEOUT_MS)) {
       Serial.println("Camera capture failed");
       res = ESP_FAIL;
     } else {
-      if(fb->format != PIXFORMAT_JPEG) {
-        bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-        esp_camera_fb_return(fb);
-        fb = NULL;
-        if(!jpeg_converted) {
+      last_seq = frame.seq;
+      if(gate.enabled && frame.fb->format == PIXFORMAT_JPEG) {
+        MotionSig sig;
+        bool keepalive_due = esp_timer_get_time() - last_sent_us >= (int64_t)gate.keepalive_ms * 1000;
+        // Frame không giải mã được thì vẫn gửi
+        if(motion_gate_signature(&frame, &sig)) {
+          if(have_sent_sig && !keepalive_due &&
+             motion_gate_changed_cells(sent_sig, sig, gate.cell_thresh) < gate.min_cells) {
+            cam_metrics_recordGated(frame.fb->len);
+            cam_frame_release(&frame);
+            continue;
+          }
+          sent_sig = sig;
+          have_sent_sig = true;
+        }
+      }
+      if(frame.fb->format != PIXFORMAT_JPEG) {
+        converted = frame2jpg(frame.fb, 80, &_jpg_buf, &_jpg_buf_len);
+        cam_frame_release(&frame);
+        if(!converted) {
           Serial.println("JPEG compression failed");
+          cam_metrics_recordDrop(CAM_DROP_ENCODE);
           res = ESP_FAIL;
         }
       } else {
-        _jpg_buf_len = fb->len;
-        _jpg_buf = fb->buf;
+        _jpg_buf_len = frame.fb->len;
+        _jpg_buf = frame.fb->buf;
       }
     }
-    
+
+    int64_t t_send = esp_timer_get_time();
     if(res == ESP_OK) {
-      size_t hlen = snprintf((char *)part_buf, 64, _STREAM_PART, _jpg_buf_len);
-      res = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
+      size_t hlen = snprintf(part_buf, sizeof(part_buf), _STREAM_PART,
+                             (unsigned)_jpg_buf_len, (long long)frame.ts_us, (unsigned)frame.seq);
+      res = httpd_resp_send_chunk(req, part_buf, hlen);
     }
     if(res == ESP_OK) {
       res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
@@ -81,30 +107,58 @@ static esp_err_t stream_handler(httpd_req_t *req) {
     if(res == ESP_OK) {
       res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
     }
-    
-    if(fb) {
-      esp_camera_fb_return(fb);
-      fb = NULL;
-      _jpg_buf = NULL;
+    if(res == ESP_OK) {
+      last_sent_us = esp_timer_get_time();
+      cam_metrics_recordFrame(frame.capture_us, _jpg_buf_len, (uint32_t)(esp_timer_get_time() - t_send));
     } else if(_jpg_buf) {
+      cam_metrics_recordDrop(CAM_DROP_SEND);
+    }
+    
+    if(converted) {
       free(_jpg_buf);
-      _jpg_buf = NULL;
+    } else {
+      cam_frame_release(&frame);
     }
+    _jpg_buf = NULL;
     
     if(res != ESP_OK) {
       break;
     }
   }
+  cam_metrics_streamClosed();
   return res;
 }
 
 // Capture handler
+// Dual-stream mode: full-resolution still without stopping the preview.
+// ?preview=1 (or single-stream mode) returns the latest preview frame.
 static esp_err_t capture_handler(httpd_req_t *req) {
-  camera_fb_t * fb = NULL;
   esp_err_t res = ESP_OK;
-  
-  fb = esp_camera_fb_get();
-  if (!fb) {
+  char query[32];
+  char val[8];
+  bool preview = httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK &&
+                 httpd_query_key_value(query, "preview", val, sizeof(val)) == ESP_OK &&
+                 atoi(val) != 0;
+
+  if (!preview && cam_pipeline_dualMode()) {
+    CamStill still;
+    if (!cam_still_capture(&still, FRAME_TIMEOUT_MS)) {
+      Serial.println("Still capture failed");
+      httpd_resp_send_500(req);
+      return ESP_FAIL;
+    }
+    char ts[24];
+    snprintf(ts, sizeof(ts), "%lld", (long long)still.ts_us);
+    httpd_resp_set_type(req, "image/jpeg");
+    httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
+    httpd_resp_set_hdr(req, "X-Timestamp-Us", ts);
+    res = httpd_resp_send(req, (const char *)still.buf, still.len);
+    cam_still_release(&still);
+    return res;
+  }
+
+  CamFrame frame;
+  if (!cam_frame_acquire(&frame, 0, FRAME_TIMEOUT_MS)) {
     Serial.println("Camera capture failed");
     httpd_resp_send_500(req);
     return ESP_FAIL;
@@ -113,8 +167,8 @@ static esp_err_t capture_handler(httpd_req_t *req) {
   httpd_resp_set_type(req, "image/jpeg");
   httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
   
-  res = httpd_resp_send(req, (const char *)fb->buf, fb->len);
-  esp_camera_fb_return(fb);
+  res = httpd_resp_send(req, (const char *)frame.fb->buf, frame.fb->len);
+  cam_frame_release(&frame);
   return res;
 }
 
@@ -164,6 +218,7 @@ static esp_err_t index_handler(httpd_req_t *req) {
 void startCameraServer() {
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
   config.server_port = 80;
+  config.max_uri_handlers = 16;
 
   httpd_uri_t index_uri = {
     .uri       = "/",
@@ -179,6 +234,55 @@ void startCameraServer() {
     .user_ctx  = NULL
   };
 
+  httpd_uri_t metrics_uri = {
+    .uri       = "/metrics",
+    .method    = HTTP_GET,
+    .handler   = cam_metrics_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t control_uri = {
+    .uri       = "/control",
+    .method    = HTTP_GET,
+    .handler   = cam_config_control_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t status_uri = {
+    .uri       = "/status",
+    .method    = HTTP_GET,
+    .handler   = cam_config_status_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t clip_uri = {
+    .uri       = "/clip",
+    .method    = HTTP_GET,
+    .handler   = cam_clip_status_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t clip_trigger_uri = {
+    .uri       = "/clip/trigger",
+    .method    = HTTP_GET,
+    .handler   = cam_clip_trigger_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t clip_arm_uri = {
+    .uri       = "/clip/arm",
+    .method    = HTTP_GET,
+    .handler   = cam_clip_arm_handler,
+    .user_ctx  = NULL
+  };
+
+  httpd_uri_t clip_download_uri = {
+    .uri       = "/clip/download",
+    .method    = HTTP_GET,
+    .handler   = cam_clip_download_handler,
+    .user_ctx  = NULL
+  };
+
   httpd_uri_t stream_uri = {
     .uri       = "/stream",
     .method    = HTTP_GET,
@@ -189,6 +293,13 @@ void startCameraServer() {
   if (httpd_start(&camera_httpd, &config) == ESP_OK) {
     httpd_register_uri_handler(camera_httpd, &index_uri);
     httpd_register_uri_handler(camera_httpd, &capture_uri);
+    httpd_register_uri_handler(camera_httpd, &metrics_uri);
+    httpd_register_uri_handler(camera_httpd, &control_uri);
+    httpd_register_uri_handler(camera_httpd, &status_uri);
+    httpd_register_uri_handler(camera_httpd, &clip_uri);
+    httpd_register_uri_handler(camera_httpd, &clip_trigger_uri);
+    httpd_register_uri_handler(camera_httpd, &clip_arm_uri);
+    httpd_register_uri_handler(camera_httpd, &clip_download_uri);
   }
 
   config.server_port = 81;
@@ -203,49 +314,20 @@ void setup() {
   
   Serial.begin(115200);
   Serial.println();
+  cam_metrics_init();
   
-  // Cấu hình camera
-  camera_config_t config;
-  config.ledc_channel = LEDC_CHANNEL_0;
-  config.ledc_timer = LEDC_TIMER_0;
-  config.pin_d0 = Y2_GPIO_NUM;
-  config.pin_d1 = Y3_GPIO_NUM;
-  config.pin_d2 = Y4_GPIO_NUM;
-  config.pin_d3 = Y5_GPIO_NUM;
-  config.pin_d4 = Y6_GPIO_NUM;
-  config.pin_d5 = Y7_GPIO_NUM;
-  config.pin_d6 = Y8_GPIO_NUM;
-  config.pin_d7 = Y9_GPIO_NUM;
-  config.pin_xclk = XCLK_GPIO_NUM;
-  config.pin_pclk = PCLK_GPIO_NUM;
-  config.pin_vsync = VSYNC_GPIO_NUM;
-  config.pin_href = HREF_GPIO_NUM;
-  config.pin_sscb_sda = SIOD_GPIO_NUM;
-  config.pin_sscb_scl = SIOC_GPIO_NUM;
-  config.pin_pwdn = PWDN_GPIO_NUM;
-  config.pin_reset = RESET_GPIO_NUM;
-  config.xclk_freq_hz = 20000000;
-  config.pixel_format = PIXFORMAT_JPEG;
-  
-  if(psramFound()) {
-    config.frame_size = FRAMESIZE_UXGA;
-    config.jpeg_quality = 10;
-    config.fb_count = 2;
-  } else {
-    config.frame_size = FRAMESIZE_SVGA;
-    config.jpeg_quality = 12;
-    config.fb_count = 1;
-  }
+  // Cấu hình camera: khởi tạo thẳng ở điểm vận hành đã lưu trong NVS
+  CamSettings settings;
+  cam_config_load(&settings);
   
   // Khởi tạo camera
-  esp_err_t err = esp_camera_init(&config);
+  esp_err_t err = cam_pipeline_begin(settings);
   if (err != ESP_OK) {
     Serial.printf("Camera init failed with error 0x%x", err);
     return;
   }
-
-  sensor_t * s = esp_camera_sensor_get();
-  s->set_framesize(s, FRAMESIZE_QVGA);
+  // Ring buffer PSRAM cho clip sự kiện (pre-roll trước vật cản)
+  cam_clip_begin();
 
   // Kết nối WiFi
   WiFi.begin(ssid, password);
@@ -255,8 +337,13 @@ void setup() {
   }
   Serial.println("");
   Serial.println("WiFi connected");
+  time_sync_begin(NTP_SERVER);
   
+  motion_gate_begin();
   startCameraServer();
+  line_vision_begin();
+  rtp_stream_begin();
+  cam_mqtt_init();
   
   Serial.print("Camera Ready! Use 'http://");
   Serial.print(WiFi.localIP());
@@ -264,5 +351,7 @@ void setup() {
 }
 
 void loop() {
-  delay(10000);
+  // MQTT chỉ dùng để nhận sự kiện vật cản từ xe
+  cam_mqtt_loop();
+  delay(10);
 }
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include <Arduino.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "motion_gate.h"
+#include "jpeg_dc.h"
+#include "cam_metrics.h"
+
+// ================= Configuration =================
+// Largest thumbnail handled: SVGA → 100 x 75 blocks
+#define THUMB_MAX (100 * 75)
+
+// ================= State =================
+static uint8_t thumb[THUMB_MAX];
+static JpegDcDecoder* decoder = NULL;   // own workspace, decodes run concurrently with other tasks
+static MotionSig cached;
+static bool cached_valid = false;
+static SemaphoreHandle_t sig_lock = NULL;
+
+// ================= Helpers =================
+static void build_signature(const uint8_t* img, uint16_t w, uint16_t h, MotionSig* out) {
+  uint32_t total = 0;
+  for (int cy = 0; cy < MOTION_GRID_H; cy++) {
+    int y0 = cy * h / MOTION_GRID_H;
+    int y1 = (cy + 1) * h / MOTION_GRID_H;
+    if (y1 <= y0) y1 = y0 + 1;
+    for (int cx = 0; cx < MOTION_GRID_W; cx++) {
+      int x0 = cx * w / MOTION_GRID_W;
+      int x1 = (cx + 1) * w / MOTION_GRID_W;
+      if (x1 <= x0) x1 = x0 + 1;
+      uint32_t sum = 0;
+      for (int y = y0; y < y1 && y < h; y++) {
+        const uint8_t* row = img + y * w;
+        for (int x = x0; x < x1 && x < w; x++) sum += row[x];
+      }
+      uint8_t v = (uint8_t)(sum / ((y1 - y0) * (x1 - x0)));
+      out->cell[cy * MOTION_GRID_W + cx] = v;
+      total += v;
+    }
+  }
+  out->mean = (uint8_t)(total / MOTION_CELLS);
+}
+
+// ================= Public API =================
+void motion_gate_begin() {
+  if (!decoder) decoder = jpeg_dc_decoder_new();
+  if (decoder && !sig_lock) sig_lock = xSemaphoreCreateMutex();
+}
+
+void motion_gate_defaults(MotionGateConfig* cfg) {
+  cfg->enabled = false;
+  cfg->keepalive_ms = 1000;
+  cfg->cell_thresh = 10;
+  cfg->min_cells = 3;
+}
+
+void motion_gate_parse_query(httpd_req_t *req, MotionGateConfig* cfg) {
+  char query[96];
+  char val[16];
+  if (httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) {
+    return;
+  }
+  if (httpd_query_key_value(query, "gate", val, sizeof(val)) == ESP_OK) {
+    cfg->enabled = atoi(val) != 0;
+  }
+  if (httpd_query_key_value(query, "keepalive_ms", val, sizeof(val)) == ESP_OK) {
+    cfg->keepalive_ms = constrain(atoi(val), 100, 60000);
+  }
+  if (httpd_query_key_value(query, "thresh", val, sizeof(val)) == ESP_OK) {
+    cfg->cell_thresh = constrain(atoi(val), 1, 255);
+  }
+  if (httpd_query_key_value(query, "cells", val, sizeof(val)) == ESP_OK) {
+    cfg->min_cells = constrain(atoi(val), 1, MOTION_CELLS);
+  }
+}
+
+bool motion_gate_signature(const CamFrame* frame, MotionSig* out) {
+  if (!sig_lock || frame->fb->format != PIXFORMAT_JPEG) {
+    return false;
+  }
+  xSemaphoreTake(sig_lock, portMAX_DELAY);
+  // Nhiều client cùng frame: chỉ giải mã 1 lần
+  if (cached_valid && cached.seq == frame->seq) {
+    *out = cached;
+    xSemaphoreGive(sig_lock);
+    return true;
+  }
+
+  int64_t t0 = esp_timer_get_time();
+  uint16_t w = 0, h = 0;
+  JpegDcResult r = jpeg_dc_thumbnail(decoder, frame->fb->buf, frame->fb->len, thumb, sizeof(thumb), &w, &h);
+  bool ok = r == JPEG_DC_OK && w > 0 && h > 0;
+  if (ok) {
+    build_signature(thumb, w, h, &cached);
+    cached.seq = frame->seq;
+    cached_valid = true;
+    *out = cached;
+  }
+  xSemaphoreGive(sig_lock);
+  if (ok) {
+    cam_metrics_recordGateSignature((uint32_t)(esp_timer_get_time() - t0));
+  }
+  return ok;
+}
+
+int motion_gate_changed_cells(const MotionSig& a, const MotionSig& b, uint8_t cell_thresh) {
+  int shift = (int)b.mean - (int)a.mean;
+  int changed = 0;
+  for (int i = 0; i < MOTION_CELLS; i++) {
+    int d = (int)b.cell[i] - (int)a.cell[i] - shift;
+    if (d < 0) d = -d;
+    if (d > cell_thresh) changed++;
+  }
+  return changed;
+}
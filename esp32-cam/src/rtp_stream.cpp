@@ -0,0 +1,407 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <sys/time.h>
+#include "esp_timer.h"
+#include "rtp_stream.h"
+#include "cam_pipeline.h"
+#include "cam_metrics.h"
+#include "jpeg_dc.h"
+#include "time_sync.h"
+
+// ================= Configuration =================
+const size_t RTP_MAX_PACKET = 1400;          // below the WiFi MTU incl. IP/UDP headers
+const uint32_t RTP_MAX_FRAME_AGE_MS = 150;   // older frames are dropped, not sent
+const uint32_t RTSP_SESSION_TIMEOUT_S = 60;
+const uint32_t RTCP_SR_INTERVAL_MS = 1000;
+const uint32_t RTP_TASK_STACK = 4096;
+const UBaseType_t RTP_TASK_PRIO = 4;         // below capture (5), above vision (3)
+
+#define RTP_PT_JPEG 26
+#define RTP_CLOCK_HZ 90000
+#define NTP_UNIX_OFFSET 2208988800UL
+
+// ================= State =================
+static WiFiServer rtsp_server(RTSP_PORT);
+static WiFiClient rtsp_client;
+static char req_buf[768];
+static size_t req_len = 0;
+
+static WiFiUDP rtp_udp;
+static WiFiUDP rtcp_udp;
+static IPAddress client_ip;
+static uint16_t client_rtp_port = 0;
+static uint16_t client_rtcp_port = 0;
+
+static bool playing = false;
+static uint32_t session_id = 0;
+static uint32_t ssrc = 0;
+static uint16_t rtp_seq = 0;
+static uint32_t rtp_ts_base = 0;
+static uint32_t packets_sent = 0;
+static uint32_t octets_sent = 0;
+static uint32_t last_activity_ms = 0;
+static uint32_t last_sr_ms = 0;
+
+static uint8_t pkt[RTP_MAX_PACKET];
+
+// ================= Helpers =================
+static inline void put16(uint8_t* p, uint16_t v) { p[0] = v >> 8; p[1] = v; }
+static inline void put24(uint8_t* p, uint32_t v) { p[0] = v >> 16; p[1] = v >> 8; p[2] = v; }
+static inline void put32(uint8_t* p, uint32_t v) { p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v; }
+static inline uint32_t get32(const uint8_t* p) {
+  return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// 90 kHz media clock derived from the driver's boot timestamp
+static inline uint32_t rtp_time(int64_t boot_us) {
+  return rtp_ts_base + (uint32_t)(boot_us * 9 / 100);
+}
+
+// NTP timestamp of "now" (64-bit, 32.32 fixed point)
+static void ntp_now(uint32_t* msw, uint32_t* lsw) {
+  // Same drift-corrected clock as the frame timestamps
+  int64_t us = time_sync_nowUs();
+  if (us == 0) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    us = (int64_t)tv.tv_sec * 1000000LL + tv.tv_usec;
+  }
+  *msw = (uint32_t)(us / 1000000) + NTP_UNIX_OFFSET;
+  *lsw = (uint32_t)(((uint64_t)(us % 1000000) << 32) / 1000000);
+}
+
+static void stop_session(const char* why) {
+  if (playing || session_id) {
+    Serial.printf("[RTP] Session closed (%s)\n", why);
+    cam_metrics_rtpSession(false);
+  }
+  playing = false;
+  session_id = 0;
+  client_rtp_port = 0;
+}
+
+// ================= RTCP =================
+static void send_sender_report() {
+  uint8_t sr[28];
+  uint32_t msw, lsw;
+  ntp_now(&msw, &lsw);
+  sr[0] = 0x80;           // V=2, RC=0
+  sr[1] = 200;            // SR
+  put16(sr + 2, 6);       // length in 32-bit words - 1
+  put32(sr + 4, ssrc);
+  put32(sr + 8, msw);
+  put32(sr + 12, lsw);
+  put32(sr + 16, rtp_time(esp_timer_get_time()));
+  put32(sr + 20, packets_sent);
+  put32(sr + 24, octets_sent);
+  rtcp_udp.beginPacket(client_ip, client_rtcp_port);
+  rtcp_udp.write(sr, sizeof(sr));
+  rtcp_udp.endPacket();
+}
+
+// Receiver reports: fraction lost, cumulative lost, jitter and RTT (RFC 3550 6.4.1)
+static void poll_rtcp() {
+  uint8_t buf[256];
+  while (rtcp_udp.parsePacket() > 0) {
+    int n = rtcp_udp.read(buf, sizeof(buf));
+    if (!playing || rtcp_udp.remoteIP() != client_ip) continue;
+    last_activity_ms = millis();
+
+    // Gói ghép (compound): RR + SDES...
+    int off = 0;
+    while (off + 8 <= n) {
+      uint8_t rc = buf[off] & 0x1F;
+      uint8_t pt = buf[off + 1];
+      int plen = ((buf[off + 2] << 8) | buf[off + 3]) * 4 + 4;
+      if (pt == 201 && rc >= 1 && off + 8 + 24 <= n) {
+        const uint8_t* b = buf + off + 8;
+        if (get32(b) == ssrc) {
+          uint8_t fraction = b[4];
+          int32_t cum = (int32_t)((b[5] << 16) | (b[6] << 8) | b[7]);
+          if (cum & 0x800000) cum |= 0xFF000000;   // 24-bit signed
+          uint32_t jitter_us = (uint32_t)((uint64_t)get32(b + 12) * 1000000 / RTP_CLOCK_HZ);
+          uint32_t lsr = get32(b + 16);
+          uint32_t dlsr = get32(b + 20);
+          uint32_t rtt_us = 0;
+          if (lsr) {
+            uint32_t msw, lsw;
+            ntp_now(&msw, &lsw);
+            uint32_t a = (msw << 16) | (lsw >> 16);
+            rtt_us = (uint32_t)((uint64_t)(a - lsr - dlsr) * 1000000 >> 16);
+          }
+          cam_metrics_recordRtpReport(fraction, cum, jitter_us, rtt_us);
+        }
+      }
+      if (plen <= 0) break;
+      off += plen;
+    }
+  }
+}
+
+// ================= RTP/JPEG packetiser (RFC 2435) =================
+// Returns false if the network stack refused a packet (frame abandoned)
+static bool send_frame(const JpegLayout& jl, uint8_t type, uint32_t ts) {
+  bool dri = jl.restart_interval != 0;
+  size_t off = 0;
+
+  while (off < jl.scan_len) {
+    uint8_t* p = pkt;
+    // RTP header
+    p[0] = 0x80;
+    p[1] = RTP_PT_JPEG;
+    put16(p + 2, rtp_seq);
+    put32(p + 4, ts);
+    put32(p + 8, ssrc);
+    p += 12;
+
+    // JPEG header
+    p[0] = 0;                                  // type-specific
+    put24(p + 1, (uint32_t)off);
+    p[4] = type | (dri ? 64 : 0);
+    p[5] = 255;                                // Q=255: tables sent in-band
+    p[6] = (uint8_t)(jl.width / 8);
+    p[7] = (uint8_t)(jl.height / 8);
+    p += 8;
+
+    if (dri) {
+      // Packet boundaries are not aligned to restart intervals: F=L=1, count 0x3FFF
+      put16(p, jl.restart_interval);
+      put16(p + 2, 0xFFFF);
+      p += 4;
+    }
+    if (off == 0) {
+      p[0] = 0;                                // MBZ
+      p[1] = 0;                                // 8-bit precision
+      put16(p + 2, 128);
+      memcpy(p + 4, jl.qtable[0], 64);
+      memcpy(p + 68, jl.qtable[1], 64);
+      p += 132;
+    }
+
+    size_t hdr = p - pkt;
+    size_t chunk = jl.scan_len - off;
+    if (chunk > RTP_MAX_PACKET - hdr) chunk = RTP_MAX_PACKET - hdr;
+    memcpy(p, jl.scan + off, chunk);
+    off += chunk;
+    if (off >= jl.scan_len) pkt[1] |= 0x80;    // marker: last packet of the frame
+
+    rtp_udp.beginPacket(client_ip, client_rtp_port);
+    rtp_udp.write(pkt, hdr + chunk);
+    if (!rtp_udp.endPacket()) {
+      return false;
+    }
+    rtp_seq++;
+    packets_sent++;
+    octets_sent += hdr + chunk - 12;
+  }
+  return true;
+}
+
+// ================= RTSP =================
+static bool header_value(const char* req, const char* name, char* out, size_t cap) {
+  const char* p = strcasestr(req, name);
+  if (!p) return false;
+  p += strlen(name);
+  while (*p == ' ' || *p == ':') p++;
+  size_t n = 0;
+  while (p[n] && p[n] != '\r' && p[n] != '\n' && n + 1 < cap) {
+    out[n] = p[n];
+    n++;
+  }
+  out[n] = '\0';
+  return true;
+}
+
+static void rtsp_reply(const char* status, const char* cseq, const char* extra, const char* body) {
+  char resp[768];
+  int len = snprintf(resp, sizeof(resp), "RTSP/1.0 %s\r\nCSeq: %s\r\n%s", status, cseq, extra ? extra : "");
+  if (body) {
+    len += snprintf(resp + len, sizeof(resp) - len, "Content-Length: %u\r\n\r\n%s", (unsigned)strlen(body), body);
+  } else {
+    len += snprintf(resp + len, sizeof(resp) - len, "\r\n");
+  }
+  rtsp_client.write((const uint8_t*)resp, len);
+}
+
+static void handle_request(const char* req) {
+  char method[16] = "";
+  char cseq[12] = "0";
+  char extra[256];
+  sscanf(req, "%15s", method);
+  header_value(req, "CSeq", cseq, sizeof(cseq));
+  last_activity_ms = millis();
+  IPAddress local = WiFi.localIP();
+
+  if (!strcmp(method, "OPTIONS")) {
+    rtsp_reply("200 OK", cseq, "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n", NULL);
+  } else if (!strcmp(method, "DESCRIBE")) {
+    char sdp[256];
+    snprintf(sdp, sizeof(sdp),
+             "v=0\r\no=- %u 1 IN IP4 %s\r\ns=ESP32-CAM\r\nc=IN IP4 0.0.0.0\r\nt=0 0\r\n"
+             "m=video 0 RTP/AVP %d\r\na=control:track1\r\n",
+             (unsigned)esp_random(), local.toString().c_str(), RTP_PT_JPEG);
+    snprintf(extra, sizeof(extra), "Content-Base: rtsp://%s:%d/mjpeg/\r\nContent-Type: application/sdp\r\n",
+             local.toString().c_str(), RTSP_PORT);
+    rtsp_reply("200 OK", cseq, extra, sdp);
+  } else if (!strcmp(method, "SETUP")) {
+    char transport[128];
+    const char* cp;
+    int a = 0, b = 0;
+    // Chỉ hỗ trợ UDP unicast (không interleaved qua TCP)
+    if (!header_value(req, "Transport", transport, sizeof(transport)) ||
+        strstr(transport, "/TCP") || !(cp = strstr(transport, "client_port=")) ||
+        sscanf(cp, "client_port=%d-%d", &a, &b) < 1) {
+      rtsp_reply("461 Unsupported Transport", cseq, NULL, NULL);
+      return;
+    }
+    client_ip = rtsp_client.remoteIP();
+    client_rtp_port = a;
+    client_rtcp_port = b ? b : a + 1;
+    if (!session_id) {
+      session_id = esp_random();
+      ssrc = esp_random();
+      rtp_seq = (uint16_t)esp_random();
+      rtp_ts_base = esp_random();
+      packets_sent = 0;
+      octets_sent = 0;
+      cam_metrics_rtpSession(true);
+    }
+    snprintf(extra, sizeof(extra),
+             "Transport: RTP/AVP;unicast;client_port=%u-%u;server_port=%d-%d;ssrc=%08X\r\n"
+             "Session: %08X;timeout=%u\r\n",
+             client_rtp_port, client_rtcp_port, RTP_SERVER_PORT, RTP_SERVER_PORT + 1,
+             (unsigned)ssrc, (unsigned)session_id, RTSP_SESSION_TIMEOUT_S);
+    rtsp_reply("200 OK", cseq, extra, NULL);
+    Serial.printf("[RTP] SETUP %s:%u\n", client_ip.toString().c_str(), client_rtp_port);
+  } else if (!strcmp(method, "PLAY")) {
+    if (!session_id) {
+      rtsp_reply("454 Session Not Found", cseq, NULL, NULL);
+      return;
+    }
+    snprintf(extra, sizeof(extra),
+             "Session: %08X\r\nRange: npt=0.000-\r\nRTP-Info: url=rtsp://%s:%d/mjpeg/track1;seq=%u;rtptime=%u\r\n",
+             (unsigned)session_id, local.toString().c_str(), RTSP_PORT,
+             rtp_seq, (unsigned)rtp_time(esp_timer_get_time()));
+    rtsp_reply("200 OK", cseq, extra, NULL);
+    playing = true;
+    last_sr_ms = 0;
+  } else if (!strcmp(method, "TEARDOWN")) {
+    snprintf(extra, sizeof(extra), "Session: %08X\r\n", (unsigned)session_id);
+    rtsp_reply("200 OK", cseq, extra, NULL);
+    stop_session("teardown");
+  } else if (!strcmp(method, "GET_PARAMETER") || !strcmp(method, "SET_PARAMETER")) {
+    snprintf(extra, sizeof(extra), "Session: %08X\r\n", (unsigned)session_id);
+    rtsp_reply("200 OK", cseq, extra, NULL);
+  } else {
+    rtsp_reply("501 Not Implemented", cseq, NULL, NULL);
+  }
+}
+
+static void poll_rtsp() {
+  // Một client tại một thời điểm; client mới thay client cũ
+  if (rtsp_server.hasClient()) {
+    WiFiClient c = rtsp_server.available();
+    if (rtsp_client && rtsp_client.connected()) {
+      rtsp_client.stop();
+      stop_session("replaced");
+    }
+    rtsp_client = c;
+    rtsp_client.setNoDelay(true);
+    req_len = 0;
+  }
+  if (!rtsp_client) return;
+  if (!rtsp_client.connected()) {
+    rtsp_client.stop();
+    stop_session("disconnected");
+    return;
+  }
+
+  while (rtsp_client.available() > 0) {
+    int c = rtsp_client.read();
+    if (c < 0) break;
+    if (req_len + 1 >= sizeof(req_buf)) req_len = 0;   // request too long: drop it
+    req_buf[req_len++] = (char)c;
+    req_buf[req_len] = '\0';
+    if (req_len >= 4 && !strcmp(req_buf + req_len - 4, "\r\n\r\n")) {
+      handle_request(req_buf);
+      req_len = 0;
+    }
+  }
+}
+
+// ================= Sender task =================
+static void rtp_task(void*) {
+  uint32_t last_seq = 0;
+
+  for (;;) {
+    poll_rtsp();
+    poll_rtcp();
+    if (!playing) {
+      vTaskDelay(pdMS_TO_TICKS(20));
+      continue;
+    }
+    if (millis() - last_activity_ms > RTSP_SESSION_TIMEOUT_S * 1000) {
+      stop_session("timeout");
+      continue;
+    }
+    if (millis() - last_sr_ms >= RTCP_SR_INTERVAL_MS) {
+      last_sr_ms = millis();
+      send_sender_report();
+    }
+
+    CamFrame frame;
+    if (!cam_frame_acquire(&frame, last_seq, 50)) {
+      continue;
+    }
+    last_seq = frame.seq;
+    int64_t boot_us = (int64_t)frame.fb->timestamp.tv_sec * 1000000LL + frame.fb->timestamp.tv_usec;
+
+    // Frame đã cũ (client chậm / WiFi nghẽn): bỏ, không gửi bù
+    if (esp_timer_get_time() - boot_us > (int64_t)RTP_MAX_FRAME_AGE_MS * 1000) {
+      cam_frame_release(&frame);
+      cam_metrics_recordRtpDrop(true);
+      continue;
+    }
+
+    JpegLayout jl;
+    bool ok = frame.fb->format == PIXFORMAT_JPEG &&
+              jpeg_parse_layout(frame.fb->buf, frame.fb->len, &jl) == JPEG_DC_OK &&
+              jl.ncomp == 3 && jl.y_h == 2 && (jl.y_v == 1 || jl.y_v == 2) &&
+              jl.qtable[0] && jl.qtable[1] &&
+              jl.width <= 2040 && jl.height <= 2040;
+    if (!ok) {
+      cam_frame_release(&frame);
+      cam_metrics_recordDrop(CAM_DROP_ENCODE);
+      continue;
+    }
+
+    // Type 0 = 4:2:2, type 1 = 4:2:0
+    uint8_t type = jl.y_v == 2 ? 1 : 0;
+    int64_t t0 = esp_timer_get_time();
+    uint32_t pkts_before = packets_sent;
+    bool sent = send_frame(jl, type, rtp_time(boot_us));
+    int64_t t1 = esp_timer_get_time();
+    size_t len = frame.fb->len;
+    cam_frame_release(&frame);
+
+    if (sent) {
+      cam_metrics_recordRtpFrame(packets_sent - pkts_before, len,
+                                 (uint32_t)(t1 - t0), (uint32_t)(t1 - boot_us));
+    } else {
+      cam_metrics_recordRtpDrop(false);
+    }
+  }
+}
+
+// ================= Public API =================
+void rtp_stream_begin() {
+  rtsp_server.begin();
+  rtsp_server.setNoDelay(true);
+  rtp_udp.begin(RTP_SERVER_PORT);
+  rtcp_udp.begin(RTP_SERVER_PORT + 1);
+  xTaskCreatePinnedToCore(rtp_task, "rtp_stream", RTP_TASK_STACK, NULL,
+                          RTP_TASK_PRIO, NULL, 1);
+  Serial.printf("[RTP] RTSP on port %d (rtsp://%s:%d/mjpeg)\n", RTSP_PORT,
+                WiFi.localIP().toString().c_str(), RTSP_PORT);
+}
@@ -0,0 +1,91 @@
+#include "time_sync.h"
+#include <Arduino.h>
+#include <esp_sntp.h>
+#include <esp_timer.h>
+#include <math.h>
+
+// ================= State =================
+// Written by the SNTP callback (lwIP tcpip task), read from any task
+static portMUX_TYPE ts_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool ts_synced = false;
+static uint32_t ts_syncs = 0;
+static int64_t ts_offset_us = 0;      // epoch - boot at the last sync
+static int64_t ts_sync_boot_us = 0;   // esp_timer at the last sync
+static float ts_drift_ppm = 0;
+static int32_t ts_residual_us = 0;
+
+// Drift EWMA weight of a new measurement
+const float DRIFT_ALPHA = 0.25f;
+
+// A local clock running fast by d ppm shrinks epoch - boot by d µs per s
+static int64_t predictOffsetLocked(int64_t boot_us) {
+  return ts_offset_us -
+         (int64_t)((double)(boot_us - ts_sync_boot_us) * ts_drift_ppm / 1e6);
+}
+
+// ================= SNTP Callback =================
+static void onTimeSync(struct timeval* tv) {
+  int64_t boot_us = esp_timer_get_time();
+  int64_t new_offset = (int64_t)tv->tv_sec * 1000000LL + tv->tv_usec - boot_us;
+
+  portENTER_CRITICAL(&ts_mux);
+  if (ts_synced) {
+    int64_t elapsed = boot_us - ts_sync_boot_us;
+    ts_residual_us = (int32_t)(new_offset - predictOffsetLocked(boot_us));
+    if (elapsed > 0) {
+      float ppm = -(float)((double)(new_offset - ts_offset_us) * 1e6 / elapsed);
+      ts_drift_ppm = (ts_syncs < 2) ? ppm : ts_drift_ppm + DRIFT_ALPHA * (ppm - ts_drift_ppm);
+    }
+  }
+  ts_offset_us = new_offset;
+  ts_sync_boot_us = boot_us;
+  ts_synced = true;
+  ts_syncs++;
+  uint32_t syncs = ts_syncs;
+  int32_t residual = ts_residual_us;
+  float drift = ts_drift_ppm;
+  portEXIT_CRITICAL(&ts_mux);
+
+  Serial.printf("[TIME] SNTP sync #%u, residual %d us, drift %.1f ppm\n",
+                syncs, residual, drift);
+}
+
+// ================= Public API =================
+void time_sync_begin(const char* server) {
+  if (sntp_enabled()) sntp_stop();
+  sntp_setoperatingmode(SNTP_OPMODE_POLL);
+  sntp_setservername(0, server);
+  sntp_set_sync_mode(SNTP_SYNC_MODE_IMMED);
+  sntp_set_sync_interval(TIME_SYNC_INTERVAL_MS);
+  sntp_set_time_sync_notification_cb(onTimeSync);
+  sntp_init();
+  Serial.printf("[TIME] SNTP server %s, every %u s\n", server, TIME_SYNC_INTERVAL_MS / 1000);
+}
+
+int64_t time_sync_toEpochUs(int64_t boot_us) {
+  portENTER_CRITICAL(&ts_mux);
+  int64_t epoch = ts_synced ? boot_us + predictOffsetLocked(boot_us) : 0;
+  portEXIT_CRITICAL(&ts_mux);
+  return epoch;
+}
+
+int64_t time_sync_nowUs() {
+  return time_sync_toEpochUs(esp_timer_get_time());
+}
+
+void time_sync_getQuality(TimeSyncQuality* out) {
+  int64_t boot_us = esp_timer_get_time();
+  portENTER_CRITICAL(&ts_mux);
+  out->synced = ts_synced;
+  out->syncs = ts_syncs;
+  out->age_s = ts_synced ? (uint32_t)((boot_us - ts_sync_boot_us) / 1000000) : 0;
+  out->last_residual_us = ts_residual_us;
+  out->drift_ppm = ts_drift_ppm;
+  portEXIT_CRITICAL(&ts_mux);
+
+  // The residual is what the prediction was off by after one interval;
+  // scale it by how far into the interval we are
+  uint32_t base = out->syncs >= 2 ? (uint32_t)abs(out->last_residual_us) : TIME_SYNC_FIRST_ERR_US;
+  float frac = out->age_s * 1000.0f / TIME_SYNC_INTERVAL_MS;
+  out->err_us = out->synced ? (uint32_t)(base * (frac > 1.0f ? frac : 1.0f)) : 0;
+}
@@ -0,0 +1,159 @@
+// Line detector on recorded JPEG frames, through the firmware's own code
+// (src/jpeg_dc.cpp → src/line_detect.cpp), the same path as line_vision.
+//
+// Each fixture in tools/fixtures is a QVGA scene whose geometry is known
+// (tools/make_line_fixtures.py): a dark line whose centre is x_bottom on the
+// bottom row and moves slope px to the right per px going up, optionally a
+// branch, or no line at all. For every band the expected offset is the line
+// centre at the band's middle row and the expected heading is atan(slope):
+//   - found / not found, JUNCTION where the branch is
+//   - offset_pm within OFFSET_TOL_PM, heading_cdeg within HEADING_TOL_CDEG
+// (a junction band and headings measured against it are not compared).
+//
+// Build and run on the host:
+//   g++ -std=c++17 -O2 -Wall -Wextra -Iinclude -o line_detect_check tools/line_detect_check.cpp src/jpeg_dc.cpp src/line_detect.cpp
+//   ./line_detect_check [--dir tools/fixtures] [--verbose]
+// Exit code 1 if a fixture fails to decode or a band is off.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include "jpeg_dc.h"
+#include "line_detect.h"
+
+// ================= Fixtures =================
+const int IMG_W = 320, IMG_H = 240;
+const int OFFSET_TOL_PM = 40;       // ~6 px QVGA, dưới 1 pixel thumbnail
+const int HEADING_TOL_CDEG = 300;
+
+struct Fixture {
+  const char* name;
+  bool line;
+  float x_bottom;     // line centre on the bottom row (px)
+  float slope;        // px to the right per px going up
+  int junction_band;  // -1: none
+};
+
+// Must match SCENES in tools/make_line_fixtures.py
+static const Fixture FIXTURES[] = {
+  {"straight_center", true, 160.0f, 0.0f, -1},
+  {"offset_right", true, 232.0f, 0.0f, -1},
+  {"diagonal_right", true, 150.0f, 0.5f, -1},
+  {"diagonal_left", true, 200.0f, -0.35f, -1},
+  {"branch_right", true, 160.0f, 0.0f, 1},
+  {"no_line", false, 0.0f, 0.0f, -1},
+};
+
+static bool verbose = false;
+
+static bool readFile(const char* path, std::vector<uint8_t>* out) {
+  FILE* f = fopen(path, "rb");
+  if (!f) return false;
+  uint8_t buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) out->insert(out->end(), buf, buf + n);
+  fclose(f);
+  return !out->empty();
+}
+
+// Band geometry as in line_detect(): band 0 = bottom rows of the thumbnail
+static void bandRows(int b, int n, int h, int* y0, int* y1) {
+  int band_rows = h / n;
+  *y1 = h - b * band_rows;
+  *y0 = *y1 - band_rows;
+}
+
+// Band whose centre line_detect() measures this band's heading against
+static int headingRef(const LineDetectResult& r, int b) {
+  for (int k = b - 1; k >= 0; k--) {
+    if (r.band[k].flags & LINE_FOUND) return k;
+  }
+  for (int k = b + 1; k < r.n_bands; k++) {
+    if (r.band[k].flags & LINE_FOUND) return k;
+  }
+  return -1;
+}
+
+// ================= Check =================
+static bool check(JpegDcDecoder* dec, const char* dir, const Fixture& fx,
+                  const LineDetectConfig& cfg) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s.jpg", dir, fx.name);
+  std::vector<uint8_t> jpg;
+  if (!readFile(path, &jpg)) {
+    printf("%-16s cannot read %s\n", fx.name, path);
+    return false;
+  }
+
+  uint8_t thumb[(IMG_W / 8) * (IMG_H / 8)];
+  uint16_t w = 0, h = 0;
+  JpegDcResult jr = jpeg_dc_thumbnail(dec, jpg.data(), jpg.size(), thumb, sizeof(thumb), &w, &h);
+  if (jr != JPEG_DC_OK || w != IMG_W / 8 || h != IMG_H / 8) {
+    printf("%-16s decode failed (%d, %ux%u)\n", fx.name, (int)jr, w, h);
+    return false;
+  }
+
+  LineDetectResult r;
+  line_detect(thumb, w, h, cfg, &r);
+
+  bool ok = r.n_bands == cfg.n_bands;
+  int heading_exp = (int)lroundf(atanf(fx.slope) * 18000.0f / (float)M_PI);
+  for (int b = 0; b < r.n_bands; b++) {
+    const LineBand& lb = r.band[b];
+    int y0, y1;
+    bandRows(b, r.n_bands, h, &y0, &y1);
+    float y_mid = (y0 + y1) * 4.0f - 0.5f;   // giữa các hàng pixel y0*8 .. y1*8-1
+    float x_mid = fx.x_bottom + (IMG_H - 1 - y_mid) * fx.slope;
+    int offset_exp = (int)lroundf((x_mid - IMG_W / 2) * 1000.0f / (IMG_W / 2));
+
+    bool found = (lb.flags & LINE_FOUND) != 0;
+    bool junction = (lb.flags & LINE_JUNCTION) != 0;
+    bool band_ok = found == fx.line && junction == (b == fx.junction_band);
+    int ref = headingRef(r, b);
+    bool cmp_offset = found && fx.line && b != fx.junction_band;
+    bool cmp_heading = cmp_offset && ref >= 0 && ref != fx.junction_band;
+    if (cmp_offset && abs(lb.offset_pm - offset_exp) > OFFSET_TOL_PM) band_ok = false;
+    if (cmp_heading && abs(lb.heading_cdeg - heading_exp) > HEADING_TOL_CDEG) band_ok = false;
+    ok = ok && band_ok;
+
+    if (verbose || !band_ok) {
+      printf("%-16s band %d row %2u %s%s offset %5d", fx.name, b, lb.row,
+             found ? "found" : "-----", junction ? "+J" : "  ", lb.offset_pm);
+      if (cmp_offset) printf(" (exp %5d)", offset_exp);
+      else printf("            ");
+      printf(" heading %5d", lb.heading_cdeg);
+      if (cmp_heading) printf(" (exp %5d)", heading_exp);
+      else printf("            ");
+      printf(" contrast %3u %s\n", lb.contrast, band_ok ? "" : "FAIL");
+    }
+  }
+  printf("%-16s %s\n", fx.name, ok ? "ok" : "FAIL");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  const char* dir = "tools/fixtures";
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--dir") && i + 1 < argc) dir = argv[++i];
+    else if (!strcmp(argv[i], "--verbose")) verbose = true;
+    else {
+      fprintf(stderr, "usage: %s [--dir tools/fixtures] [--verbose]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  JpegDcDecoder* dec = jpeg_dc_decoder_new();
+  LineDetectConfig cfg;
+  line_detect_defaults(&cfg);
+
+  int failed = 0;
+  for (const Fixture& fx : FIXTURES) {
+    if (!check(dec, dir, fx, cfg)) failed++;
+  }
+  printf("%d/%d fixtures ok\n", (int)(sizeof(FIXTURES) / sizeof(FIXTURES[0])) - failed,
+         (int)(sizeof(FIXTURES) / sizeof(FIXTURES[0])));
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""
+Tạo lại các ảnh JPEG mẫu cho tools/line_detect_check.cpp.
+
+Renders QVGA (320x240) scenes of a dark tape line on a light floor, with a
+lighting gradient and sensor noise, and saves them as baseline JPEGs with
+the chroma subsampling the OV2640 uses (4:2:2; one 4:2:0 fixture covers the
+other MCU layout). The geometry of each scene (line centre at the bottom
+row, slope) is what line_detect_check.cpp checks the detector against, so
+keep the two in sync when changing a scene.
+
+Usage (needs Pillow):
+    python3 tools/make_line_fixtures.py [--out tools/fixtures]
+"""
+import argparse
+import os
+import random
+
+from PIL import Image
+
+W, H = 320, 240
+FLOOR, TAPE = 200, 30
+TAPE_W = 24
+
+
+def render(name, x_bottom, slope, branch_rows=None, line=True, seed=1):
+    """slope: px to the right per px going up (0 = straight ahead)"""
+    rnd = random.Random(seed)
+    img = Image.new("L", (W, H))
+    px = img.load()
+    for y in range(H):
+        xc = x_bottom + (H - 1 - y) * slope
+        for x in range(W):
+            v = FLOOR - 16 * x // W               # ánh sáng lệch một bên (< min_contrast)
+            dark = line and abs(x + 0.5 - xc) < TAPE_W / 2
+            if branch_rows and branch_rows[0] <= y < branch_rows[1] and x >= xc:
+                dark = True
+            if dark:
+                v = TAPE
+            v += int(rnd.gauss(0, 4))
+            px[x, y] = max(0, min(255, v))
+    return img
+
+
+SCENES = [
+    # name, x_bottom, slope, kwargs, subsampling (1 = 4:2:2, 2 = 4:2:0)
+    ("straight_center", 160, 0.0, {}, 1),
+    ("offset_right", 232, 0.0, {}, 1),
+    ("diagonal_right", 150, 0.5, {}, 1),
+    ("diagonal_left", 200, -0.35, {}, 2),
+    ("branch_right", 160, 0.0, {"branch_rows": (128, 176)}, 1),
+    ("no_line", 160, 0.0, {"line": False}, 1),
+]
+
+
+def main():
+    ap = argparse.ArgumentParser()
+    ap.add_argument("--out", default=os.path.join(os.path.dirname(__file__), "fixtures"))
+    args = ap.parse_args()
+    os.makedirs(args.out, exist_ok=True)
+    for i, (name, xb, slope, kw, sub) in enumerate(SCENES):
+        img = render(name, xb, slope, seed=i + 1, **kw).convert("RGB")
+        path = os.path.join(args.out, name + ".jpg")
+        img.save(path, "JPEG", quality=80, subsampling=sub, optimize=False, progressive=False)
+        print(path, os.path.getsize(path), "bytes")
+
+
+if __name__ == "__main__":
+    main()
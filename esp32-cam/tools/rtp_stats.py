@@ -0,0 +1,311 @@
+#!/usr/bin/env python3
+"""
+Đo mất gói / jitter / độ trễ của luồng RTP/JPEG (RFC 2435) từ ESP32-CAM.
+
+Does the RTSP handshake against rtsp://<cam>:8554/mjpeg (UDP unicast),
+receives the RTP packets, reassembles frames and prints packet loss,
+incomplete frames, RFC 3550 interarrival jitter and per-frame latency.
+It also sends RTCP receiver reports, so the camera's /metrics rtp.receiver
+section fills in while the tool runs.
+
+Latency is capture -> last packet received. It maps RTP timestamps to the
+camera's wall clock through the RTCP sender reports, so it is only absolute
+when the camera and this host share an NTP reference; otherwise the tool
+reports the delay variation relative to the fastest frame.
+
+Usage:
+    python3 rtp_stats.py 192.168.0.109 --duration 30
+    python3 rtp_stats.py 192.168.0.109 --port 5000 --csv frames.csv
+"""
+
+import argparse
+import random
+import socket
+import struct
+import sys
+import time
+
+RTP_CLOCK_HZ = 90000
+NTP_UNIX_OFFSET = 2208988800
+EPOCH_VALID_AFTER_S = 1600000000
+
+
+def percentile(values, p):
+    if not values:
+        return float("nan")
+    s = sorted(values)
+    k = (len(s) - 1) * p / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(s) - 1)
+    return s[lo] + (s[hi] - s[lo]) * (k - lo)
+
+
+def summarize(name, values, unit="ms"):
+    if not values:
+        print(f"{name:<22} (no samples)")
+        return
+    print(f"{name:<22} n={len(values):<6} "
+          f"min={min(values):8.2f} p50={percentile(values, 50):8.2f} "
+          f"p90={percentile(values, 90):8.2f} p99={percentile(values, 99):8.2f} "
+          f"max={max(values):8.2f} {unit}")
+
+
+# ================= RTSP =================
+class Rtsp:
+    def __init__(self, host, port):
+        self.url = f"rtsp://{host}:{port}/mjpeg"
+        self.sock = socket.create_connection((host, port), timeout=5)
+        self.cseq = 0
+        self.session = None
+
+    def request(self, method, url=None, headers=None):
+        self.cseq += 1
+        lines = [f"{method} {url or self.url} RTSP/1.0", f"CSeq: {self.cseq}"]
+        if self.session:
+            lines.append(f"Session: {self.session}")
+        for k, v in (headers or {}).items():
+            lines.append(f"{k}: {v}")
+        self.sock.sendall(("\r\n".join(lines) + "\r\n\r\n").encode())
+
+        data = b""
+        while b"\r\n\r\n" not in data:
+            chunk = self.sock.recv(2048)
+            if not chunk:
+                raise EOFError("RTSP connection closed")
+            data += chunk
+        head, _, body = data.partition(b"\r\n\r\n")
+        lines = head.decode("ascii", "replace").split("\r\n")
+        status = lines[0]
+        hdrs = {}
+        for line in lines[1:]:
+            k, _, v = line.partition(":")
+            hdrs[k.strip().lower()] = v.strip()
+        length = int(hdrs.get("content-length", 0))
+        while len(body) < length:
+            body += self.sock.recv(2048)
+        if " 200 " not in status + " ":
+            raise RuntimeError(f"{method}: {status}")
+        return hdrs, body
+
+
+# ================= Receiver =================
+class Stats:
+    def __init__(self):
+        self.ssrc = None
+        self.base_seq = None
+        self.max_seq = None
+        self.cycles = 0
+        self.received = 0
+        self.expected_prior = 0
+        self.received_prior = 0
+        self.jitter = 0.0          # RTP timestamp units
+        self.last_transit = None
+        self.lsr = 0
+        self.lsr_recv = 0.0
+        # RTP ts -> camera clock (from the last sender report)
+        self.sr_rtp = None
+        self.sr_wall = None
+
+    def on_packet(self, seq, ts, arrival):
+        if self.base_seq is None:
+            self.base_seq = seq
+            self.max_seq = seq
+        delta = (seq - self.max_seq) & 0xFFFF
+        if 0 < delta < 0x8000:
+            if seq < self.max_seq:
+                self.cycles += 1 << 16
+            self.max_seq = seq
+        self.received += 1
+
+        transit = arrival * RTP_CLOCK_HZ - ts
+        if self.last_transit is not None:
+            d = abs(transit - self.last_transit)
+            self.jitter += (d - self.jitter) / 16.0
+        self.last_transit = transit
+
+    def extended_max(self):
+        return self.cycles + self.max_seq
+
+    def expected(self):
+        if self.base_seq is None:
+            return 0
+        return self.extended_max() - self.base_seq + 1
+
+    def lost(self):
+        return max(0, self.expected() - self.received)
+
+    def receiver_report(self, own_ssrc):
+        expected = self.expected()
+        exp_int = expected - self.expected_prior
+        rec_int = self.received - self.received_prior
+        self.expected_prior = expected
+        self.received_prior = self.received
+        lost_int = exp_int - rec_int
+        fraction = 0 if exp_int <= 0 or lost_int <= 0 else min(255, (lost_int << 8) // exp_int)
+        cum = max(-0x800000, min(0x7FFFFF, self.lost())) & 0xFFFFFF
+        dlsr = int((time.time() - self.lsr_recv) * 65536) if self.lsr else 0
+        rr = struct.pack("!BBHI", 0x81, 201, 7, own_ssrc)
+        rr += struct.pack("!IB", self.ssrc or 0, fraction) + cum.to_bytes(3, "big")
+        rr += struct.pack("!IIII", self.extended_max() & 0xFFFFFFFF, int(self.jitter), self.lsr, dlsr)
+        return rr
+
+    def camera_time(self, ts):
+        """Camera wall-clock seconds of an RTP timestamp, via the last SR."""
+        if self.sr_rtp is None:
+            return None
+        diff = (ts - self.sr_rtp) & 0xFFFFFFFF
+        if diff >= 0x80000000:
+            diff -= 1 << 32
+        return self.sr_wall + diff / RTP_CLOCK_HZ
+
+
+def parse_sr(data, stats):
+    off = 0
+    while off + 8 <= len(data):
+        pt = data[off + 1]
+        plen = (struct.unpack("!H", data[off + 2:off + 4])[0] + 1) * 4
+        if pt == 200 and off + 28 <= len(data):
+            _, msw, lsw, rtp_ts = struct.unpack("!IIII", data[off + 4:off + 20])
+            stats.sr_rtp = rtp_ts
+            stats.sr_wall = msw - NTP_UNIX_OFFSET + lsw / 2**32
+            stats.lsr = ((msw & 0xFFFF) << 16) | (lsw >> 16)
+            stats.lsr_recv = time.time()
+        off += plen
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    ap.add_argument("host")
+    ap.add_argument("--rtsp-port", type=int, default=8554)
+    ap.add_argument("--port", type=int, default=5000, help="local RTP port (RTCP = port + 1)")
+    ap.add_argument("--duration", type=float, default=20.0)
+    ap.add_argument("--csv", help="write per-frame samples to this file")
+    args = ap.parse_args()
+
+    rtp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    rtp.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1 << 20)
+    rtp.bind(("", args.port))
+    rtcp = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    rtcp.bind(("", args.port + 1))
+    rtp.settimeout(0.05)
+    rtcp.setblocking(False)
+
+    rtsp = Rtsp(args.host, args.rtsp_port)
+    rtsp.request("OPTIONS")
+    rtsp.request("DESCRIBE", headers={"Accept": "application/sdp"})
+    hdrs, _ = rtsp.request("SETUP", url=rtsp.url + "/track1",
+                           headers={"Transport": f"RTP/AVP;unicast;client_port={args.port}-{args.port + 1}"})
+    rtsp.session = hdrs.get("session", "").split(";")[0]
+    server_rtcp = args.port + 1
+    for part in hdrs.get("transport", "").split(";"):
+        if part.startswith("server_port="):
+            server_rtcp = int(part.split("=")[1].split("-")[1])
+    rtsp.request("PLAY")
+    print(f"Playing {rtsp.url} (session {rtsp.session}) for {args.duration:.0f} s ...")
+
+    own_ssrc = random.getrandbits(32)
+    stats = Stats()
+    frames = []            # (rtp_ts, packets, bytes, complete, latency_ms or None)
+    cur_ts = None
+    cur_pkts = 0
+    cur_bytes = 0
+    cur_expected_off = 0
+    cur_ok = True
+    incomplete = 0
+    last_rr = time.time()
+    last_keepalive = time.time()
+    end = time.time() + args.duration
+
+    while time.time() < end:
+        try:
+            while True:
+                data, _ = rtcp.recvfrom(2048)
+                parse_sr(data, stats)
+        except BlockingIOError:
+            pass
+
+        now = time.time()
+        if now - last_rr >= 1.0 and stats.ssrc is not None:
+            last_rr = now
+            rtcp.sendto(stats.receiver_report(own_ssrc), (args.host, server_rtcp))
+        if now - last_keepalive >= 20.0:
+            last_keepalive = now
+            rtsp.request("GET_PARAMETER")
+
+        try:
+            pkt, _ = rtp.recvfrom(2048)
+        except socket.timeout:
+            continue
+        arrival = time.time()
+        if len(pkt) < 20:
+            continue
+        b0, b1, seq, ts, ssrc = struct.unpack("!BBHII", pkt[:12])
+        marker = b1 & 0x80
+        stats.ssrc = ssrc
+        stats.on_packet(seq, ts, arrival)
+
+        frag_off = int.from_bytes(pkt[13:16], "big")
+        jtype, q = pkt[16], pkt[17]
+        hdr = 20 + (4 if jtype & 64 else 0)
+        if q >= 128 and frag_off == 0:
+            qlen = struct.unpack("!H", pkt[hdr + 2:hdr + 4])[0]
+            hdr += 4 + qlen
+        payload = len(pkt) - hdr
+
+        if ts != cur_ts:
+            if cur_ts is not None:
+                incomplete += 1          # previous frame never got its marker
+            cur_ts, cur_pkts, cur_bytes, cur_expected_off, cur_ok = ts, 0, 0, 0, True
+        if frag_off != cur_expected_off:
+            cur_ok = False
+        cur_expected_off = frag_off + payload
+        cur_pkts += 1
+        cur_bytes += payload
+
+        if marker:
+            cam = stats.camera_time(ts)
+            latency = (arrival - cam) * 1000.0 if cam is not None else None
+            frames.append((ts, cur_pkts, cur_bytes, cur_ok, latency, arrival))
+            if not cur_ok:
+                incomplete += 1
+            cur_ts = None
+
+    try:
+        rtsp.request("TEARDOWN")
+    except (OSError, RuntimeError, EOFError):
+        pass
+
+    complete = [f for f in frames if f[3]]
+    print()
+    print(f"packets received     {stats.received}")
+    print(f"packets lost         {stats.lost()} ({100.0 * stats.lost() / max(1, stats.expected()):.2f} %)")
+    print(f"frames complete      {len(complete)}")
+    print(f"frames incomplete    {incomplete}")
+    print(f"jitter (RFC 3550)    {stats.jitter * 1000.0 / RTP_CLOCK_HZ:.2f} ms")
+    if len(complete) > 1:
+        span = complete[-1][5] - complete[0][5]
+        print(f"fps                  {(len(complete) - 1) / span:.2f}" if span > 0 else "")
+
+    lat = [f[4] for f in complete if f[4] is not None]
+    synced = stats.sr_wall is not None and stats.sr_wall > EPOCH_VALID_AFTER_S
+    if lat and not synced:
+        # Camera chưa đồng bộ NTP: chỉ báo độ trễ tương đối
+        base = min(lat)
+        lat = [x - base for x in lat]
+        summarize("delay variation", lat)
+    else:
+        summarize("latency", lat)
+    summarize("packets/frame", [f[1] for f in complete], unit="")
+    summarize("bytes/frame", [f[2] / 1024.0 for f in complete], unit="KB")
+
+    if args.csv:
+        with open(args.csv, "w") as fh:
+            fh.write("rtp_ts,packets,bytes,complete,latency_ms\n")
+            for ts, pk, by, ok, l, _ in frames:
+                fh.write(f"{ts},{pk},{by},{int(ok)},{'' if l is None else f'{l:.3f}'}\n")
+        print(f"wrote {len(frames)} frames to {args.csv}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
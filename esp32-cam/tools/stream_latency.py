@@ -0,0 +1,138 @@
+#!/usr/bin/env python3
+"""
+Đo độ trễ end-to-end (glass-to-glass) của MJPEG stream ESP32-CAM.
+
+Reads http://<cam>:81/stream, parses the X-Timestamp-Us / X-Frame-Seq part
+headers and prints latency, inter-arrival jitter and sequence-gap statistics.
+
+Latency is only meaningful when the camera clock is synced to the same NTP
+reference as this host (X-Timestamp-Us is then epoch µs). Without sync the
+camera stamps µs since boot; the tool then reports the delay *variation*
+relative to the fastest frame seen, which still shows jitter and queueing.
+
+Usage:
+    python3 stream_latency.py 192.168.0.109 --duration 30
+    python3 stream_latency.py 192.168.0.109 --csv frames.csv
+"""
+
+import argparse
+import sys
+import time
+import urllib.request
+
+EPOCH_THRESHOLD_US = 1_000_000_000_000_000  # ~2001-09 in µs, anything smaller is boot time
+
+
+def percentile(values, p):
+    if not values:
+        return float("nan")
+    s = sorted(values)
+    k = (len(s) - 1) * p / 100.0
+    lo = int(k)
+    hi = min(lo + 1, len(s) - 1)
+    return s[lo] + (s[hi] - s[lo]) * (k - lo)
+
+
+def summarize(name, values, unit="ms"):
+    if not values:
+        print(f"{name:<22} (no samples)")
+        return
+    print(f"{name:<22} n={len(values):<6} "
+          f"min={min(values):8.2f} p50={percentile(values, 50):8.2f} "
+          f"p90={percentile(values, 90):8.2f} p99={percentile(values, 99):8.2f} "
+          f"max={max(values):8.2f} {unit}")
+
+
+def read_headers(stream):
+    headers = {}
+    while True:
+        line = stream.readline()
+        if not line:
+            raise EOFError("stream closed")
+        line = line.strip()
+        if not line:
+            if headers:
+                return headers
+            continue
+        if line.startswith(b"--"):
+            continue  # boundary
+        key, _, value = line.decode("ascii", "replace").partition(":")
+        headers[key.strip().lower()] = value.strip()
+
+
+def main():
+    ap = argparse.ArgumentParser(description="ESP32-CAM stream latency / jitter meter")
+    ap.add_argument("host", help="camera IP or hostname")
+    ap.add_argument("--port", type=int, default=81)
+    ap.add_argument("--duration", type=float, default=20.0, help="seconds to record")
+    ap.add_argument("--csv", help="write per-frame samples to this file")
+    args = ap.parse_args()
+
+    url = f"http://{args.host}:{args.port}/stream"
+    print(f"Connecting to {url} ...")
+    stream = urllib.request.urlopen(url, timeout=10)
+
+    rows = []
+    latencies = []
+    arrivals = []
+    gaps = 0
+    last_seq = None
+    epoch_clock = None
+    t_end = time.time() + args.duration
+
+    try:
+        while time.time() < t_end:
+            headers = read_headers(stream)
+            length = int(headers.get("content-length", "0"))
+            stream.read(length)
+            recv_us = time.time_ns() // 1000
+
+            ts = int(headers.get("x-timestamp-us", "0"))
+            seq = int(headers.get("x-frame-seq", "0"))
+            if epoch_clock is None:
+                epoch_clock = ts >= EPOCH_THRESHOLD_US
+                print("Camera clock:", "epoch (synced)" if epoch_clock else "boot-relative (not synced)")
+
+            # X-Frame-Seq is the camera frame counter: gaps are frames this client skipped
+            if last_seq is not None and seq > last_seq + 1:
+                gaps += seq - last_seq - 1
+            last_seq = seq
+
+            latencies.append((recv_us - ts) / 1000.0)
+            arrivals.append(recv_us)
+            rows.append((seq, ts, recv_us, length))
+    except (EOFError, KeyboardInterrupt) as e:
+        print(f"Stopped: {e!r}")
+
+    if not rows:
+        print("No frames received")
+        return 1
+
+    if not epoch_clock:
+        base = min(latencies)
+        latencies = [x - base for x in latencies]
+
+    inter = [(b - a) / 1000.0 for a, b in zip(arrivals, arrivals[1:])]
+    mean_inter = sum(inter) / len(inter) if inter else 0.0
+    jitter = [abs(x - mean_inter) for x in inter]
+    span_s = (arrivals[-1] - arrivals[0]) / 1e6 if len(arrivals) > 1 else 0.0
+
+    print()
+    print(f"frames={len(rows)} seq_gaps={gaps} "
+          f"fps={(len(rows) - 1) / span_s if span_s > 0 else 0.0:.2f} "
+          f"avg_size={sum(r[3] for r in rows) / len(rows) / 1024:.1f} KiB")
+    summarize("latency" if epoch_clock else "delay variation", latencies)
+    summarize("inter-arrival", inter)
+    summarize("jitter |dt - mean|", jitter)
+
+    if args.csv:
+        with open(args.csv, "w") as f:
+            f.write("seq,cam_ts_us,recv_us,bytes\n")
+            for r in rows:
+                f.write(",".join(str(x) for x in r) + "\n")
+        print(f"Wrote {len(rows)} samples to {args.csv}")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,104 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ================= Async Logger =================
+// Call sites never touch Serial: LOG_x() copies the format pointer and up
+// to CAR_LOG_MAX_ARGS arguments into a fixed-size record in a lock-free
+// ring (any task may log), and a low-priority task formats and prints the
+// records. Cost at the call site is a few hundred ns instead of ~5 ms per
+// 60-byte line at 115200 baud.
+//
+//   LOG_I("[MQTT] Connected in %u ms", ms);
+//
+// Rules (checked at compile time where possible):
+//   - fmt must be a string literal (only the pointer is stored)
+//   - arguments: integers up to 32 bit, float / double (stored as float),
+//     bool, C strings. Strings are copied (CAR_LOG_STR_BYTES per record,
+//     truncated), so stack buffers are fine.
+//   - 64-bit integers do not compile; cast or split them.
+//
+// Levels below CAR_LOG_LEVEL compile to nothing (set it in platformio.ini,
+// e.g. -DCAR_LOG_LEVEL=CAR_LOG_LEVEL_WARN for release builds). A full ring
+// drops the record and counts it; the drain task reports drops.
+
+#define CAR_LOG_LEVEL_NONE   0
+#define CAR_LOG_LEVEL_ERROR  1
+#define CAR_LOG_LEVEL_WARN   2
+#define CAR_LOG_LEVEL_INFO   3
+#define CAR_LOG_LEVEL_DEBUG  4
+
+#ifndef CAR_LOG_LEVEL
+#define CAR_LOG_LEVEL CAR_LOG_LEVEL_INFO
+#endif
+
+#define CAR_LOG_RING       64     // records, power of two
+#define CAR_LOG_MAX_ARGS   8
+#define CAR_LOG_STR_BYTES  24     // string argument storage per record
+
+enum CarLogArgType : uint8_t { LOG_ARG_INT, LOG_ARG_UINT, LOG_ARG_FLOAT, LOG_ARG_STR };
+
+struct CarLogArg {
+  CarLogArgType type;
+  union {
+    int32_t i;
+    uint32_t u;
+    float f;
+    const char* s;
+  };
+  CarLogArg(int v) : type(LOG_ARG_INT), i(v) {}
+  CarLogArg(long v) : type(LOG_ARG_INT), i((int32_t)v) {}
+  CarLogArg(unsigned v) : type(LOG_ARG_UINT), u(v) {}
+  CarLogArg(unsigned long v) : type(LOG_ARG_UINT), u((uint32_t)v) {}
+  CarLogArg(bool v) : type(LOG_ARG_INT), i(v) {}
+  CarLogArg(float v) : type(LOG_ARG_FLOAT), f(v) {}
+  CarLogArg(double v) : type(LOG_ARG_FLOAT), f((float)v) {}
+  CarLogArg(const char* v) : type(LOG_ARG_STR), s(v) {}
+};
+
+struct CarLogStats {
+  uint32_t written;      // records accepted
+  uint32_t dropped;      // ring full
+  uint32_t printed;
+  uint16_t depth;        // records waiting now
+  uint16_t depth_max;
+};
+
+// Start the drain task (call once in setup, after Serial.begin)
+void car_log_begin();
+
+// Low-level entry point used by the macros
+void car_log_push(uint8_t level, const char* fmt, const CarLogArg* args, uint8_t nargs);
+
+template <typename... A>
+inline void car_log_write(uint8_t level, const char* fmt, A... args) {
+  static_assert(sizeof...(A) <= CAR_LOG_MAX_ARGS, "too many log arguments");
+  const CarLogArg a[] = { CarLogArg(args)... };
+  car_log_push(level, fmt, a, sizeof...(A));
+}
+inline void car_log_write(uint8_t level, const char* fmt) {
+  car_log_push(level, fmt, nullptr, 0);
+}
+
+void car_log_getStats(CarLogStats* out);
+
+#if CAR_LOG_LEVEL >= CAR_LOG_LEVEL_ERROR
+#define LOG_E(fmt, ...) car_log_write(CAR_LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#else
+#define LOG_E(fmt, ...) ((void)0)
+#endif
+#if CAR_LOG_LEVEL >= CAR_LOG_LEVEL_WARN
+#define LOG_W(fmt, ...) car_log_write(CAR_LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#else
+#define LOG_W(fmt, ...) ((void)0)
+#endif
+#if CAR_LOG_LEVEL >= CAR_LOG_LEVEL_INFO
+#define LOG_I(fmt, ...) car_log_write(CAR_LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#else
+#define LOG_I(fmt, ...) ((void)0)
+#endif
+#if CAR_LOG_LEVEL >= CAR_LOG_LEVEL_DEBUG
+#define LOG_D(fmt, ...) car_log_write(CAR_LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#else
+#define LOG_D(fmt, ...) ((void)0)
+#endif
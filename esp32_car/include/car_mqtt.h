@@ -0,0 +1,95 @@
+#pragma once
+#include <Arduino.h>
+
+// ================= MQTT Client API =================
+// Non-blocking MQTT client for ESP32 car telemetry and events.
+// Connection handling runs in the ESP-IDF esp_mqtt task; publishes are
+// queued (lock-free, per message class) and sent by a separate TX task, so
+// neither a slow nor an unreachable broker ever blocks loop().
+
+// Message classes, each with its own bounded queue and drop policy
+enum MqttClass : uint8_t {
+  MQTT_CLASS_CONTROL,     // status, format offer
+  MQTT_CLASS_EVENT,       // obstacle events (queue full → spool)
+  MQTT_CLASS_TELEMETRY,   // live samples (stale after 1 s; full → spool)
+  MQTT_CLASS_HR,          // high-rate frames (stale after 2 s; full → stay in the HR ring)
+  MQTT_CLASS_REPLAY,      // spool replay (QoS 1, one in flight; stale = resent after no PUBACK)
+  MQTT_CLASS_COUNT
+};
+
+struct MqttMetrics {
+  bool connected;
+  uint32_t connects;                  // successful connects since boot
+  uint32_t connect_fails;             // failed attempts since boot
+  uint32_t connect_ms_last;           // start of attempt → CONNACK
+  uint32_t connect_ms_max;
+  uint32_t published;
+  uint32_t publish_fails;
+  uint32_t publish_us_avg;            // time inside esp_mqtt_client_publish (EWMA)
+  uint32_t publish_us_max;
+  uint32_t queue_ms_avg;              // enqueue → sent (EWMA)
+  uint32_t queue_ms_max;
+  uint32_t cmd_ok;                    // remote commands applied
+  uint32_t cmd_dropped;               // old / stale / bad / rejected / inbound full
+  uint16_t depth[MQTT_CLASS_COUNT];
+  uint32_t dropped_full[MQTT_CLASS_COUNT];
+  uint32_t dropped_stale[MQTT_CLASS_COUNT];   // expired or failed publish
+};
+
+// Initialize MQTT client (call once in setup, after WiFi)
+void mqtt_init();
+
+// MQTT loop (call in main loop, non-blocking)
+void mqtt_loop();
+
+// Publish telemetry data (JSON format)
+// Extended version with state parameters from main.cpp
+void mqtt_publishTelemetryWithState(const char* mode, const char* motion,
+                                     int speed_linear, int speed_rot);
+
+// Publish obstacle event (when obstacle state changes)
+void mqtt_publishObstacleEvent(float distance_cm);
+
+// Check if MQTT is connected
+bool mqtt_isConnected();
+
+// Connect / publish latency, queue depth and drops
+void mqtt_getMetrics(MqttMetrics* out);
+const char* mqtt_className(uint8_t cls);
+
+// ================= Remote Commands (car/<id>/cmd) =================
+// JSON: {"seq":42,"ts":<sender epoch ms>,"ttl_ms":250,"sid":"op1","cmd":...}
+//   motion: "motion":"forward"|"stop"|...      (TELEMETRY_MOTIONS names)
+//   vel:    "lin":-255..255,"rot":-255..255,"hold_ms":500 (rot > 0 = left,
+//           hold_ms capped at 500 = safety deadman)
+//   mode:   "mode":"manual"|"line"
+//   speed:  "lin":60..255,"rot":60..255       (either may be omitted)
+//   tune:   "v_base","kp","ki","kd"            (either may be omitted)
+// seq must increase per sid; older / repeated commands and commands older
+// than ttl_ms are dropped. Every command is answered on car/<id>/ack.
+// Manual mode: a moving car stops when no accepted motion / vel command
+// arrives for 500 ms (safety deadman, safety.h), so repeat them while
+// driving; other commands and rejected ones do not feed the deadman.
+enum CarCmdType : uint8_t {
+  CAR_CMD_MOTION,
+  CAR_CMD_VELOCITY,
+  CAR_CMD_MODE,
+  CAR_CMD_SPEED,
+  CAR_CMD_TUNE,
+};
+
+struct CarCommand {
+  CarCmdType type;
+  const char* motion;   // MOTION
+  const char* mode;     // MODE
+  int lin;              // VELOCITY (signed) / SPEED (-1 = unchanged)
+  int rot;
+  uint16_t hold_ms;     // VELOCITY: stop unless renewed within
+  float v_base;         // TUNE: NAN = unchanged
+  float kp, ki, kd;
+};
+
+// Applies a command in the loop task. Returns nullptr on success, else a
+// short reason that goes into the ack.
+typedef const char* (*CarCommandHandler)(const CarCommand& cmd);
+void mqtt_setCommandHandler(CarCommandHandler fn);
@@ -0,0 +1,94 @@
+#pragma once
+#include <stdint.h>
+
+// ================= Cooperative Scheduler =================
+// Periodic tasks run from loop(): each task has a period, a phase (offset
+// of its first release) and a priority (0 = most urgent). car_sched_poll()
+// runs every due task once, most urgent first, and returns the time until
+// the next release so the caller can sleep.
+//
+// Releases stay on the period grid (next = previous release + period), so
+// a late start does not shift the phase. A task that is still not started
+// a whole period after its release loses that release (counted as missed);
+// a run longer than the period counts as an overrun.
+//
+// Pure logic (no Arduino calls): time comes from the clock passed to
+// car_sched_init, so tools/sched_sim.cpp drives the exact same code with a
+// simulated clock.
+
+#define CAR_SCHED_MAX_TASKS 8
+
+typedef uint32_t (*CarSchedClock)();   // µs, free running, may wrap
+typedef void (*CarSchedFn)();
+
+struct CarSchedTask {
+  const char* name;
+  CarSchedFn fn;
+  uint32_t period_us;
+  uint32_t phase_us;
+  uint8_t priority;
+
+  uint32_t next_release_us;
+  uint32_t last_start_us;
+  bool started;
+
+  // Since boot
+  uint32_t runs;
+  uint32_t overruns;      // run time > period
+  uint32_t missed;        // releases skipped
+
+  // Window (reset by car_sched_resetWindow)
+  uint32_t win_runs;
+  uint64_t win_run_us;
+  uint32_t win_run_max_us;
+  uint64_t win_jitter_us;
+  uint32_t win_jitter_n;
+  uint32_t win_jitter_max_us;   // |start-to-start interval - period|
+  uint32_t win_late_max_us;     // start - release
+};
+
+struct CarSched {
+  CarSchedClock clock;
+  CarSchedTask tasks[CAR_SCHED_MAX_TASKS];
+  uint8_t count;
+  bool running;
+  uint32_t win_start_us;
+  volatile bool reset_req;      // set from another task, applied in poll
+};
+
+struct CarSchedStats {
+  const char* name;
+  uint32_t period_us;
+  uint8_t priority;
+  uint32_t runs;
+  uint32_t overruns;
+  uint32_t missed;
+  float rate_hz;          // measured over the window
+  uint32_t run_us_avg;
+  uint32_t run_us_max;
+  uint32_t jitter_us_avg;
+  uint32_t jitter_us_max;
+  uint32_t late_us_max;
+  uint32_t load_pct;      // share of the window spent in this task
+};
+
+void car_sched_init(CarSched* s, CarSchedClock clock);
+
+// Register a task before car_sched_start. Returns its id, -1 if full or
+// period is 0.
+int car_sched_add(CarSched* s, const char* name, uint32_t period_us, uint32_t phase_us,
+                  uint8_t priority, CarSchedFn fn);
+
+// First release of every task = now + phase
+void car_sched_start(CarSched* s);
+
+// Run due tasks (each at most once per call). Returns µs until the next
+// release, 0 if something is already due.
+uint32_t car_sched_poll(CarSched* s);
+
+// Per-task statistics of the current window. Safe to call from another task
+// (reads only; values may be a few runs apart).
+bool car_sched_getStats(const CarSched* s, uint8_t id, CarSchedStats* out);
+
+// Start a new statistics window at the next poll (any task)
+void car_sched_resetWindow(CarSched* s);
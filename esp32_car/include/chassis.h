@@ -0,0 +1,96 @@
+#pragma once
+#include <stdint.h>
+
+// ================= Chassis Geometry =================
+// Kích thước cơ khí + encoder của khung xe, và mọi hệ số đổi đơn vị tính
+// sẵn lúc compile: ticks ↔ mét, ticks ↔ radian, ticks mỗi chu kỳ PID →
+// vận tốc (bảng tra). do_line.cpp và main.cpp dùng chung một bản mô tả.
+//
+// Khung xe khác: thêm một struct như ChassisTT2WD rồi build với
+//   -DCAR_CHASSIS=ChassisTenMoi
+// Static assert bắt lỗi đơn vị hay gặp (mm thay cho m, PPR = 0...).
+
+constexpr float CHASSIS_PI = 3.14159265358979f;
+
+// 2 động cơ TT + bánh 65 mm, đĩa encoder 20 lỗ
+struct ChassisTT2WD {
+  static constexpr float WHEEL_RADIUS_M = 0.0325f;
+  static constexpr float TRACK_WIDTH_M = 0.0950f;   // tâm bánh trái → tâm bánh phải
+  static constexpr uint16_t PULSES_PER_REV = 20;
+  static constexpr uint8_t EDGES_PER_PULSE = 2;     // ISR đếm CHANGE → 2 sườn
+  // Trim PWM mặc định 2 bánh (nhân phần trên deadband) khi NVS chưa có
+  // trim học từ encoder (wheel_trim.h). Bánh trái TT yếu hơn ~10%.
+  static constexpr float L_SCALE = 1.10f;
+  static constexpr float R_SCALE = 1.00f;
+};
+
+#ifndef CAR_CHASSIS
+#define CAR_CHASSIS ChassisTT2WD
+#endif
+
+// Chu kỳ PID của line-follow (ms)
+#define CHASSIS_CTRL_DT_MS 10
+
+template <class G, uint32_t DT_MS>
+struct ChassisKinematics {
+  static constexpr uint32_t CTRL_DT_MS = DT_MS;
+  static constexpr uint32_t TICKS_PER_REV = (uint32_t)G::PULSES_PER_REV * G::EDGES_PER_PULSE;
+  static constexpr float WHEEL_CIRC_M = 2.0f * CHASSIS_PI * G::WHEEL_RADIUS_M;
+  static constexpr float TRACK_WIDTH_M = G::TRACK_WIDTH_M;
+  static constexpr float L_SCALE = G::L_SCALE;
+  static constexpr float R_SCALE = G::R_SCALE;
+
+  // ticks ↔ mét (quãng đường một bánh)
+  static constexpr float M_PER_TICK = WHEEL_CIRC_M / TICKS_PER_REV;
+  static constexpr float TICKS_PER_M = TICKS_PER_REV / WHEEL_CIRC_M;
+  static constexpr float MM_PER_TICK = M_PER_TICK * 1000.0f;
+
+  // ticks ↔ radian: quay tại chỗ, mỗi bánh đi (track / 2) · θ
+  static constexpr float TICKS_PER_RAD_SPIN = 0.5f * TRACK_WIDTH_M * TICKS_PER_M;
+  // Đổi hướng theo chênh lệch ticks phải − trái (vi sai)
+  static constexpr float RAD_PER_TICK_DIFF = M_PER_TICK / TRACK_WIDTH_M;
+
+  // ticks trong một chu kỳ PID → m/s
+  static constexpr float VEL_PER_TICK = M_PER_TICK * 1000.0f / DT_MS;
+  static constexpr int VEL_LUT_SIZE = 16;
+  static constexpr float VEL_LUT[VEL_LUT_SIZE] = {
+     0 * VEL_PER_TICK,  1 * VEL_PER_TICK,  2 * VEL_PER_TICK,  3 * VEL_PER_TICK,
+     4 * VEL_PER_TICK,  5 * VEL_PER_TICK,  6 * VEL_PER_TICK,  7 * VEL_PER_TICK,
+     8 * VEL_PER_TICK,  9 * VEL_PER_TICK, 10 * VEL_PER_TICK, 11 * VEL_PER_TICK,
+    12 * VEL_PER_TICK, 13 * VEL_PER_TICK, 14 * VEL_PER_TICK, 15 * VEL_PER_TICK,
+  };
+
+  static constexpr long ticksForDistance(float m) {
+    return (long)(m * TICKS_PER_M + 0.5f);
+  }
+  static constexpr long ticksForSpinDeg(float deg) {
+    return (long)(deg * (CHASSIS_PI / 180.0f) * TICKS_PER_RAD_SPIN + 0.5f);
+  }
+
+  // Vận tốc (m/s, không dấu) từ số ticks đo trong dt_ms. Đúng chu kỳ PID
+  // → tra bảng; chu kỳ trễ (loop bận) → chia như cũ.
+  static inline float ticksToVel(long ticks, uint32_t dt_ms) {
+    if (dt_ms == DT_MS && ticks >= 0 && ticks < VEL_LUT_SIZE) return VEL_LUT[ticks];
+    return dt_ms ? ticks * M_PER_TICK * 1000.0f / dt_ms : 0.0f;
+  }
+
+  static_assert(G::WHEEL_RADIUS_M > 0.005f && G::WHEEL_RADIUS_M < 0.2f,
+                "WHEEL_RADIUS_M must be in metres");
+  static_assert(G::TRACK_WIDTH_M > 2.0f * G::WHEEL_RADIUS_M && G::TRACK_WIDTH_M < 1.0f,
+                "TRACK_WIDTH_M must be in metres and wider than a wheel");
+  static_assert(G::PULSES_PER_REV > 0, "PULSES_PER_REV must be > 0");
+  static_assert(G::EDGES_PER_PULSE == 1 || G::EDGES_PER_PULSE == 2 || G::EDGES_PER_PULSE == 4,
+                "EDGES_PER_PULSE: 1 (RISING), 2 (CHANGE) or 4 (quadrature)");
+  static_assert(G::L_SCALE > 0.5f && G::L_SCALE < 1.5f && G::R_SCALE > 0.5f && G::R_SCALE < 1.5f,
+                "wheel trim is a ratio near 1.0");
+  static_assert(DT_MS > 0 && DT_MS < 1000, "control period is in ms");
+  static_assert(M_PER_TICK * TICKS_PER_M > 0.999f && M_PER_TICK * TICKS_PER_M < 1.001f,
+                "ticks <-> metres factors disagree");
+  static_assert((VEL_LUT_SIZE - 1) * VEL_PER_TICK > 1.5f,
+                "velocity table must cover the top speed (1.5 m/s)");
+};
+
+template <class G, uint32_t DT_MS>
+constexpr float ChassisKinematics<G, DT_MS>::VEL_LUT[];
+
+typedef ChassisKinematics<CAR_CHASSIS, CHASSIS_CTRL_DT_MS> CarChassis;
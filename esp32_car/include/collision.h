@@ -0,0 +1,106 @@
+#pragma once
+#include <stdint.h>
+
+// ================= Collision Guard =================
+// Speed-aware obstacle braking for the front HC-SR04. Distance to the
+// obstacle is tracked with an alpha-beta filter: between echoes it is dead-
+// reckoned from encoder travel, each echo corrects it and the residual
+// estimates the obstacle's own speed. From closing speed c and free distance
+// d_free (distance − standoff):
+//   TTC        = d_free / c
+//   d_stop(c)  = c · t_react + c² / (2 a)
+// The allowed speed is the largest c whose d_stop(a_soft) fits d_free, so
+// the car slows progressively and arrives at the standoff at rest. A hard
+// stop is only requested when even twice a_soft would not be enough, with a
+// margin for the speed estimate (the obstacle appeared late or is moving
+// towards the car).
+//
+// Each braking event (threat detected → car at rest) is measured: reaction
+// time until the encoders show deceleration, time and distance to stop,
+// clearance left at rest.
+//
+// Pure logic (distance and travel are passed in) so tools/collision_sim.cpp
+// runs the same code against simulated approaches.
+
+struct CollisionConfig {
+  float standoff_m;       // stop this far from the obstacle (line mode: avoid from here)
+  float t_react_s;        // sensor age + control period + motor lag
+  float a_soft;           // m/s², progressive slow-down
+  float a_hard_ratio;     // hard stop when the needed decel exceeds a_soft · this
+  float v_max;            // fastest the car can go; below → speed is being limited
+  float range_max_m;      // echoes farther than this: no obstacle
+  float alpha, beta;      // alpha-beta filter gains (distance, closing speed)
+  float gate_m;           // |echo − prediction| above this: outlier
+  uint8_t miss_max;       // consecutive missing echoes before the track is dropped
+};
+
+void collision_defaults(CollisionConfig* cfg);
+
+enum CollisionLevel : uint8_t {
+  COLL_CLEAR,             // nothing within range / no limit
+  COLL_SLOW,              // forward speed limited to v_allow
+  COLL_STOP,              // hard stop (latched until at rest)
+  COLL_BLOCKED,           // at or inside the standoff: no forward motion
+};
+
+struct CollisionEvent {
+  float v0_mps;           // speed when the threat was detected
+  float ttc_s;            // time-to-collision at detection
+  float reaction_s;       // detection → encoders show deceleration
+  float stop_s;           // detection → at rest
+  float stop_dist_m;      // travel from detection to rest
+  float clearance_m;      // filtered distance to the obstacle at rest
+  bool hard;              // a hard stop was needed
+};
+
+struct CollisionStats {
+  uint32_t events;        // approaches that ended at rest
+  uint32_t hard_stops;
+  float reaction_max_s;
+  float stop_dist_max_m;
+  float clearance_min_m;
+  CollisionEvent last;
+};
+
+#define COLLISION_VEL_WIN 5
+
+struct CollisionGuard {
+  CollisionConfig cfg;
+  // Track
+  bool track;
+  float d_m;              // filtered distance (sensor → obstacle)
+  float v_obs;            // obstacle speed towards the car (m/s)
+  float since_meas_s;
+  uint8_t misses, outliers;
+  // Car: forward speed = encoder travel over the last COLLISION_VEL_WIN
+  // periods (1 tick / 10 ms = 0.5 m/s, too coarse to use directly)
+  float ds_win[COLLISION_VEL_WIN];
+  float dt_win[COLLISION_VEL_WIN];
+  uint8_t win_i;
+  float v_car;
+  // Outputs of the last step
+  CollisionLevel level;
+  float v_allow;          // forward speed limit (≥ 0, v_max when clear)
+  float ttc_s;            // −1: not closing
+  float d_stop_m;         // predicted stopping distance at a_soft
+  // Event in progress
+  bool braking, decel_seen, hard;
+  float t_s, t_detect_s;
+  float s_m, s_detect_m;  // integrated travel
+  CollisionEvent ev;
+  bool event_done;        // set by the step that completed ev (caller logs it)
+  CollisionStats stats;
+};
+
+void collision_init(CollisionGuard* g, const CollisionConfig& cfg);
+// Drop the track and any event in progress, keep cfg and stats (after a
+// manoeuvre that turned the car away)
+void collision_reset(CollisionGuard* g);
+// One control period. ds_m: forward travel since the last call (encoder,
+// signed). has_meas: an echo finished since the last call; meas_m < 0 =
+// no echo.
+CollisionLevel collision_step(CollisionGuard* g, float dt_s, float ds_m, bool has_meas, float meas_m);
+// Forward command after the limit (reverse commands pass through)
+inline float collision_limit(const CollisionGuard* g, float v_cmd) {
+  return v_cmd > g->v_allow ? g->v_allow : v_cmd;
+}
@@ -1,5 +1,9 @@
 #pragma once
 #include <Arduino.h>
+#include "track_map.h"
+#include "collision.h"
+#include "line_recovery.h"
+#include "safety.h"
 
 // ================= ESP32 30P + L298N + analogWrite =================
 // Mapping:
@@ -11,6 +15,7 @@
 // ====================================================================
 
 void do_line_setup();
+void do_line_begin();   // once at boot: trim + track map from NVS
 void do_line_loop();
 // yêu cầu dừng ngay mọi hành vi trong do_line (kể cả đang trong while)
 void do_line_abort();
@@ -19,9 +24,127 @@ void motorsStop();
 // Getter for ultrasonic distance (for MQTT telemetry)
 float do_line_getDistanceCM();
 
-// Update ultrasonic sensor (call frequently in manual mode)
-void do_line_updateUltrasonic();
-
 // Getter for line sensor states (for MQTT telemetry)
 void do_line_getLineSensors(bool* L2, bool* L1, bool* M, bool* R1, bool* R2);
 
+// Controller snapshot for high-rate telemetry: reads state only (no sensor
+// update), safe to call from any task
+struct DoLineSnapshot {
+  int pwm_l;          // last commanded PWM on ENA, signed (+ = forward)
+  int pwm_r;          // last commanded PWM on ENB, signed
+  long enc_l;         // encoder edge totals since boot (no direction)
+  long enc_r;
+  bool recovering;    // line-follow recovery in progress
+  float distance_cm;  // last ultrasonic reading, -1 if none
+};
+void do_line_getSnapshot(DoLineSnapshot* out);
+
+// Record PWM written outside do_line (manual drive in main.cpp)
+void do_line_notePwm(int pwm_l, int pwm_r);
+
+// Wheel travel per encoder edge (mm)
+float do_line_getMmPerTick();
+
+// Runtime tuning of line-follow (MQTT "tune" command); gains apply to both
+// wheel PIDs, the integrators restart on change
+struct DoLineTuning {
+  float v_base;       // m/s
+  float kp, ki, kd;
+};
+void do_line_getTuning(DoLineTuning* out);
+void do_line_setTuning(const DoLineTuning& t);
+
+// Obstacle-detour manoeuvres (profiled spins / moves): error = the worse
+// wheel's distance from its target at the end
+struct DoLineMotionStats {
+  uint32_t moves;
+  uint32_t timeouts;      // did not settle on the target
+  float last_err_mm;
+  float max_err_mm;
+  uint32_t last_ms;       // duration of the last manoeuvre
+};
+void do_line_getMotionStats(DoLineMotionStats* out);
+
+// Front obstacle (time-to-collision guard, collision.h): forward speed is
+// limited so the car stops at the standoff; hard stop only when it would
+// not make it. Line mode detours from the standoff.
+struct DoLineObstacle {
+  uint8_t level;              // CollisionLevel
+  float distance_m;           // filtered, -1 if nothing in range
+  float closing_mps;          // car + obstacle speed towards each other
+  float ttc_s;                // -1: not closing
+  float v_allow;              // forward speed limit
+  CollisionStats stats;
+};
+void do_line_getObstacle(DoLineObstacle* out);
+
+// Line-loss searches (line_recovery.h): found / failed, time-to-reacquire
+void do_line_getRecoveryStats(LineRecoveryStats* out);
+
+// ================= Safety supervisor =================
+// High-priority task (safety.h) that runs the HC-SR04 and owns the last gate
+// on motor output: obstacle stop, command-link deadman in manual mode and
+// control-task watchdog, motors off within SafetyConfig::latency_max_us of
+// detection. Every motor write goes through the gate; each intervention is
+// logged ([SAFETY]) with its detection-to-stop time.
+void do_line_safetyBegin();                 // once, after do_line_setup()
+void do_line_safetySetDeadman(bool on);     // manual mode: motors follow link commands
+void do_line_safetyCommand();               // command received (MQTT, HTTP)
+uint8_t do_line_safetyTripped();            // SafetyReason bits, gate closed
+// Signed PWM (+ = forward) written outside do_line (open-loop manual drive);
+// false: refused by the gate, motors stopped
+bool do_line_writeMotors(int pwm_l, int pwm_r);
+void do_line_getSafetyStats(SafetyStats* out);
+
+// ================= Manual drive =================
+// Closed loop (default): v (m/s, + = forward) and w (rad/s, + = left) are
+// tracked per wheel by encoder PID with acceleration limiting; call
+// do_line_driveLoop() from the control task in manual mode. Open loop:
+// main.cpp writes PWM itself, the loop only measures odometry.
+void do_line_setDriveTarget(float v_mps, float w_radps);
+void do_line_setDriveClosedLoop(bool on);
+bool do_line_getDriveClosedLoop();
+void do_line_driveStop();     // target 0 and motors off now (no ramp)
+void do_line_driveLoop();
+
+// Odometry while driving by hand: heading drift per metre on straight
+// commands and speed error once the ramp has reached the target
+struct DoLineDriveStats {
+  bool closed_loop;
+  float v_tgt, w_tgt;
+  float v_meas, w_meas;       // filtered, last control period
+  float straight_m;           // window
+  float drift_deg_per_m;      // + = drifts left
+  float speed_err_rms;        // m/s
+};
+void do_line_getDriveStats(DoLineDriveStats* out, bool reset);
+
+// ================= Wheel trim =================
+// Left/right motor mismatch learned from encoder speed vs PWM while the car
+// drives straight (line and manual mode); stored in NVS ("trim") and applied
+// to every PWM do_line writes. Defaults: CarChassis::L_SCALE / R_SCALE.
+struct DoLineTrim {
+  float trim_l, trim_r;       // applied
+  float est_l, est_r;         // current estimate (applied once confident)
+  float confidence;           // 0..1
+  uint32_t samples;
+  float gain_l, gain_r;       // m/s per PWM above the deadband
+  bool calibrating;
+};
+void do_line_getTrim(DoLineTrim* out);
+// Open-loop manual PWM written by main.cpp (signed, in place)
+void do_line_applyTrim(int* pwm_l, int* pwm_r);
+// Manual mode: drive straight ~1.2 m at equal PWM, then apply and save the
+// trims. Runs inside do_line_driveLoop(); any stop / new target cancels it.
+void do_line_trimCalibrate();
+bool do_line_trimCalibrating();
+
+// ================= Track learning / fast lap =================
+// LAP_LEARN: drive one lap at v_base from a start mark; the map closes by
+// itself, is stored in NVS ("track"/"map") and the mode returns to normal.
+// LAP_FAST: start from the same mark, speed comes from the stored map.
+// Requests from any task are applied at the next do_line_loop().
+enum DoLineLapMode : uint8_t { LAP_NORMAL, LAP_LEARN, LAP_FAST };
+bool do_line_setLapMode(DoLineLapMode m);   // false: LAP_FAST without a map
+DoLineLapMode do_line_getLapMode();
+bool do_line_copyTrackMap(TrackMap* out);   // false: no map learned yet
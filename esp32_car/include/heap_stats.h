@@ -0,0 +1,15 @@
+#pragma once
+#include <stdint.h>
+
+// ================= Heap Stats =================
+// Internal 8-bit heap (where String / AsyncTCP / lwIP allocate). A
+// fragmented heap shows as a largest free block far below the free total:
+// allocations start failing long before free reaches zero.
+struct HeapStats {
+  uint32_t free_bytes;
+  uint32_t largest_block;     // biggest single allocation that can succeed
+  uint32_t min_free_bytes;    // low-water mark since boot
+  uint8_t frag_pct;           // 100 - largest * 100 / free
+};
+
+void heap_getStats(HeapStats* out);
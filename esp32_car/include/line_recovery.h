@@ -0,0 +1,87 @@
+#pragma once
+#include <stdint.h>
+
+// ================= Line Recovery =================
+// Search for the line after it left the sensor bar, guided by odometry
+// instead of a fixed timer. While the line is under the sensors the pose is
+// re-zeroed every control period, so during a search (x, y, th) is the
+// car's displacement from where the line was last seen (x forward, th + =
+// left). The search:
+//   1. ARC: arc towards the side the line left by (straight when unknown:
+//      T junction, dashed line) for at most arc_m of travel or until the
+//      heading is arc_rad past the last-seen heading.
+//   2. BACK: retrace the arc in reverse to where the search started, so
+//      the sweep happens next to the point the line was lost (the side
+//      reported just before losing a sharp corner is often wrong).
+//   3. SWEEP: spin in place to headings alternating around the last-seen
+//      heading with growing amplitude (other side first), sweep_step_rad
+//      more on every reversal. Stays within ±sweep_max_rad so the line the
+//      car came along, behind it, is not picked up again.
+//   4. FAILED: sweep done or time_max_s elapsed; the car stops close to
+//      where the line ended.
+// Back at the start and still facing the last-seen heading (BACK, or SWEEP
+// within ±same_rad) the sensors only see the end of the line that was just
+// lost: that is not a reacquisition, or a dead end would loop forever.
+// Non-blocking: one step per control period returns the wheel targets.
+//
+// Pure logic (wheel travel and dt are passed in) so tools/recovery_sim.cpp
+// runs the same code against a simulated track.
+
+struct LineRecoveryConfig {
+  float v_arc;            // m/s, outer wheel while arcing
+  float r_arc_m;          // arc radius (axle centre)
+  float arc_rad;          // stop arcing this far past the last-seen heading
+  float arc_m;            // distance budget of the arc (and of the way back)
+  float v_spin;           // m/s per wheel while sweeping
+  float sweep_step_rad;
+  float sweep_max_rad;
+  float same_rad;         // sightings this close to the last-seen heading after the arc: old line
+  float time_max_s;
+};
+
+void line_recovery_defaults(LineRecoveryConfig* cfg);
+
+enum LineRecoveryPhase : uint8_t {
+  LREC_IDLE,
+  LREC_ARC,
+  LREC_BACK,
+  LREC_SWEEP,
+  LREC_FAILED,
+};
+
+struct LineRecoveryStats {
+  uint32_t attempts;
+  uint32_t found;
+  uint32_t failed;
+  float t_last_s;         // duration of the last search (found or not)
+  float t_found_sum_s;    // time-to-reacquire, successful searches
+  float t_found_max_s;
+  float dist_max_m;       // farthest from the last-seen point at the end
+};
+
+struct LineRecovery {
+  LineRecoveryConfig cfg;
+  float x, y, th;         // pose since the line was last seen
+  float s_m;              // signed travel since the search started
+  int8_t side;            // +1: line left to the left, −1: right, 0: unknown
+  LineRecoveryPhase phase;
+  float t_s;              // since the search started
+  float sweep_amp;        // current sweep amplitude (rad)
+  int8_t sweep_dir;       // +1: spinning left towards +amp
+  float vL, vR;           // wheel targets of the last step (m/s, signed)
+  LineRecoveryStats stats;
+};
+
+void line_recovery_init(LineRecovery* r, const LineRecoveryConfig& cfg);
+// Every control period, searching or not. dL_m / dR_m: signed wheel travel.
+void line_recovery_odom(LineRecovery* r, float dL_m, float dR_m);
+// Line under the sensors: this pose becomes the origin.
+void line_recovery_seen(LineRecovery* r);
+void line_recovery_start(LineRecovery* r, int8_t side);
+// One control period of the search; sets vL / vR (0 once FAILED).
+LineRecoveryPhase line_recovery_step(LineRecovery* r, float dt_s);
+// Line under the sensors during a search: false = the end of the line that
+// was lost (keep searching).
+bool line_recovery_accept(const LineRecovery* r);
+// Search over: line found, or given up / interrupted.
+void line_recovery_end(LineRecovery* r, bool found);
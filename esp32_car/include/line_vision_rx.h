@@ -0,0 +1,54 @@
+#pragma once
+#include <Arduino.h>
+
+// ================= Camera Line Vision (look-ahead) =================
+// Receives per-band line offsets from the ESP32-CAM over UDP.
+// Band 0 is the nearest band, higher bands look further ahead than the
+// TCRT sensors can.
+
+#define LINE_VISION_PORT 4210
+#define LINE_VISION_MAGIC 0x564C   // "LV"
+#define LINE_VISION_VERSION 1
+#define LINE_VISION_MAX_BANDS 6
+
+// band flags
+#define LINE_FOUND    0x01
+#define LINE_JUNCTION 0x02
+
+// Wire format, must match esp32-cam/include/line_vision.h
+struct __attribute__((packed)) VisionBand {
+  int16_t offset_pm;     // line centre vs image centre, per-mille of half width (+ = right)
+  int16_t heading_cdeg;  // line direction vs straight ahead, centi-degrees (+ = bends right)
+  uint8_t width_px;
+  uint8_t contrast;
+  uint8_t flags;
+  uint8_t row;
+};
+
+struct __attribute__((packed)) LineVisionPacket {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t n_bands;
+  uint32_t frame_seq;
+  int64_t frame_ts_us;
+  uint32_t latency_us;     // capture → send on the camera
+  uint8_t img_w;
+  uint8_t img_h;
+  VisionBand band[LINE_VISION_MAX_BANDS];
+};
+
+struct VisionLookahead {
+  uint8_t n_bands;
+  VisionBand band[LINE_VISION_MAX_BANDS];
+  uint32_t frame_seq;
+  uint32_t age_ms;         // camera latency + time since reception
+};
+
+// Open the UDP port and start subscribing to the camera (call after WiFi)
+void vision_rx_begin(const char* camera_ip);
+
+// Non-blocking: drain received packets, refresh the subscription (call in loop)
+void vision_rx_poll();
+
+// Latest look-ahead if it is younger than max_age_ms
+bool vision_rx_get(VisionLookahead* out, uint32_t max_age_ms);
@@ -0,0 +1,75 @@
+#pragma once
+#include <stdint.h>
+
+// ================= Motion Profile =================
+// Encoder-closed-loop motion primitives for the blocking manoeuvres in
+// do_line (obstacle detour): straight moves and spins in place.
+//
+// Both wheels follow the same trapezoidal position profile s(t) (accelerate
+// at a_max, cruise at v_max, decelerate to rest at the target). Each wheel
+// command is profile velocity + position feedback + a sync term that pulls
+// the two wheels to equal progress, then feedforward PWM + velocity
+// feedback. The move ends at rest on the target, so no settle pause and no
+// hard brake at speed.
+//
+// Pure logic (ticks and dt are passed in) so tools/motion_sim.cpp runs the
+// same code against a simulated motor model.
+
+struct MotionLimits {
+  float v_max;            // m/s per wheel
+  float a_max;            // m/s²
+};
+
+struct MotionGains {
+  float pwm_per_mps;      // feedforward: PWM per m/s above the deadband
+  float pwm_static;       // PWM where the wheel starts turning
+  float kp_pos;           // (m/s) per m of position error
+  float k_sync;           // (m/s) per m of left/right progress difference
+  float kp_vel;           // PWM per m/s of velocity error
+  float lead_s;           // velocity feedforward taken this far ahead (motor lag)
+  float tol_m;            // done when both wheels are this close to the target
+  float settle_s;         // time allowed after the profile to reach tol_m
+};
+
+void motion_defaults(MotionGains* g);
+
+struct MotionProfile {
+  float dist_m;
+  float v_peak;           // < v_max when the move is too short to cruise
+  float a;
+  float t_acc, t_cruise, t_total;
+};
+
+void motion_profile_plan(MotionProfile* p, float dist_m, const MotionLimits& lim);
+// Reference position / velocity at time t (clamped to [0, t_total])
+void motion_profile_at(const MotionProfile* p, float t, float* s, float* v);
+
+struct MotionResult {
+  float err_l_m;          // target − travelled, + = short of the target
+  float err_r_m;
+  float time_s;
+  bool timeout;           // did not reach tol_m within settle_s
+};
+
+struct MotionCtrl {
+  MotionProfile prof;
+  MotionGains g;
+  int8_t dir_l, dir_r;    // +1 forward / −1 backward per wheel
+  float t;
+  float pos_l, pos_r;     // progress along dir (m)
+  float vel_l, vel_r;     // filtered
+  bool done;
+  bool timeout;
+};
+
+// Straight move: dir_l = dir_r = +1. Spin left: dir_l = −1, dir_r = +1 and
+// dist_m = angle · track / 2 (CarChassis).
+void motion_begin(MotionCtrl* m, int8_t dir_l, int8_t dir_r, float dist_m, const MotionLimits& lim,
+                  const MotionGains& g);
+// One control period: encoder edges since the last call (no direction; a
+// wheel is never reversed during a move, so every edge is progress).
+// Writes signed PWM per wheel (+ = wheel forward); returns false once the
+// move is finished (PWM 0).
+bool motion_step(MotionCtrl* m, unsigned long ticks_l, unsigned long ticks_r, float dt_s, int* pwm_l,
+                 int* pwm_r);
+void motion_result(const MotionCtrl* m, MotionResult* out);
@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+
+// ================= Safety Supervisor =================
+// Last gate between every motor writer and the L298N. A high-priority task,
+// independent of loop(), calls safety_step() every period_us with the
+// output currently on the motors and stops them at once when it trips on
+//   OBSTACLE  echo closer than stop_m while the output drives forward,
+//   DEADMAN   manual drive with no command from the link for deadman_us,
+//   WATCHDOG  motors driven while the control task has not run for
+//             watchdog_us (loop() stuck: the other checks live there).
+// While tripped, safety_allows() refuses outputs until the cause is gone:
+// OBSTACLE refuses forward output only (turning / backing away is fine)
+// until an echo ≥ clear_m, DEADMAN everything until the next command,
+// WATCHDOG everything until the next heartbeat.
+//
+// Each intervention measures detection → motors off. Detection is when the
+// condition became true: echo received, last command + deadman_us, last
+// heartbeat + watchdog_us (or when the output appeared, if later). Worst
+// case = one period + the task's wake-up delay + the pin writes;
+// latency_max_us is the bound the caller promises, stops after it are
+// counted as late.
+//
+// Pure logic (time passed in) so tools/safety_sim.cpp checks the bound with
+// a mocked clock. Not thread safe: the caller serialises the calls.
+
+enum SafetyReason : uint8_t {
+  SAFETY_OBSTACLE = 1,
+  SAFETY_DEADMAN = 2,
+  SAFETY_WATCHDOG = 4,
+};
+
+struct SafetyConfig {
+  uint32_t period_us;
+  uint32_t latency_max_us;
+  float stop_m;
+  float clear_m;
+  uint32_t deadman_us;
+  uint32_t watchdog_us;
+};
+
+void safety_defaults(SafetyConfig* cfg);
+
+struct SafetyEvent {
+  uint8_t reasons;        // SafetyReason bits
+  uint32_t latency_us;    // detection → motors off
+};
+
+struct SafetyStats {
+  uint32_t obstacle;      // interventions per reason
+  uint32_t deadman;
+  uint32_t watchdog;
+  uint32_t late;          // latency > latency_max_us
+  uint32_t latency_max_us;
+  uint64_t latency_sum_us;
+  uint32_t events;
+  SafetyEvent last;
+};
+
+struct Safety {
+  SafetyConfig cfg;
+  uint8_t tripped;        // SafetyReason bits: gate closed
+  bool near;              // obstacle inside stop_m (until clear_m)
+  uint8_t misses;         // missing echoes in a row while near
+  uint32_t near_us;       // echo that set near
+  uint32_t cmd_us;        // last command from the link
+  uint32_t hb_us;         // last control task heartbeat
+  bool driving, forward;  // output at the previous step
+  uint32_t drive_us, fwd_us;   // output seen driving / forward since
+  bool pending;           // tripped, waiting for safety_stopped()
+  uint32_t detect_us;
+  SafetyEvent ev;
+  SafetyStats stats;
+};
+
+void safety_init(Safety* s, const SafetyConfig& cfg, uint32_t now_us);
+// Command from the link (MQTT, HTTP): releases DEADMAN
+void safety_command(Safety* s, uint32_t now_us);
+// Control task ran a period: releases WATCHDOG
+void safety_heartbeat(Safety* s, uint32_t now_us);
+// Ultrasonic measurement finished; dist_m < 0: no echo
+void safety_echo(Safety* s, uint32_t now_us, float dist_m);
+// Every period_us. pwm_l / pwm_r: signed output on the motors (+ = forward),
+// deadman: manual drive (link commands own the motors). true = the output
+// is not allowed: stop the motors now, then call safety_stopped().
+bool safety_step(Safety* s, uint32_t now_us, int pwm_l, int pwm_r, bool deadman);
+// Motors are off: closes the intervention. true = a new one was recorded
+// (s->ev), false = output that was already refused came back.
+bool safety_stopped(Safety* s, uint32_t now_us);
+// Gate for every motor writer
+bool safety_allows(const Safety* s, int pwm_l, int pwm_r);
+const char* safety_reasonName(uint8_t reasons);
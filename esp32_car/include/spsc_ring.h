@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+// ================= SPSC Ring =================
+// Bounded lock-free queue between exactly one producer task and one
+// consumer task (e.g. loop() → MQTT TX task). No locks, no allocation.
+// Slots are filled / read in place to avoid copying large payloads:
+//   producer: T* s = q.reserve(); if (s) { ...fill...; q.commit(); }
+//   consumer: T* s = q.front();   if (s) { ...use...;  q.pop(); }
+// N must be a power of two.
+
+template <typename T, size_t N>
+class SpscRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+ public:
+  // Free slot for the producer, nullptr when full
+  T* reserve() {
+    uint32_t h = head_.load(std::memory_order_relaxed);
+    if (h - tail_.load(std::memory_order_acquire) >= N) return nullptr;
+    return &buf_[h & (N - 1)];
+  }
+  void commit() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  // Oldest slot for the consumer, nullptr when empty
+  T* front() {
+    uint32_t t = tail_.load(std::memory_order_relaxed);
+    if (t == head_.load(std::memory_order_acquire)) return nullptr;
+    return &buf_[t & (N - 1)];
+  }
+  void pop() {
+    tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+  static constexpr size_t capacity() { return N; }
+
+ private:
+  T buf_[N];
+  std::atomic<uint32_t> head_{0};   // written by the producer only
+  std::atomic<uint32_t> tail_{0};   // written by the consumer only
+};
@@ -0,0 +1,78 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ================= Binary Telemetry Codec =================
+// Compact alternative to the JSON telemetry for high-rate (20-50 Hz)
+// publishing on car/<id>/telemetry/bin. One sample = one packed struct,
+// little-endian (ESP32 native), no device_id (it is in the topic).
+// v2 = v1 + the SNTP timestamp the JSON messages carry (ts_us, sync_err_us),
+// so the backend's latency histograms also work with binary telemetry. The
+// offline spool keeps the untimed v1 form (smaller, replay is not timed).
+//
+// The decoder lives in admin-panel/backend/src/telemetryCodec.js; any layout
+// change must bump TELEMETRY_SCHEMA_VERSION and be mirrored there.
+
+#define TELEMETRY_SCHEMA_ID       0x54   // 'T': car telemetry sample
+#define TELEMETRY_SCHEMA_VERSION  2
+#define TELEMETRY_CONTENT_TYPE    "application/x-car-telemetry;v=2"
+
+#define TELEMETRY_DIST_NONE   0xFFFF     // distance_mm: no echo / out of range
+#define TELEMETRY_CODE_NONE   0xFF       // mode / motion string not in the table
+
+// flags
+#define TELEMETRY_FLAG_OBSTACLE 0x01
+
+struct __attribute__((packed)) TelemetryBinV1 {
+  uint8_t schema;        // TELEMETRY_SCHEMA_ID
+  uint8_t version;       // 1
+  uint16_t seq;          // wraps; gaps = lost samples
+  uint32_t uptime_ms;
+  uint8_t mode;          // index into TELEMETRY_MODES
+  uint8_t motion;        // index into TELEMETRY_MOTIONS
+  int16_t speed_linear;
+  int16_t speed_rot;
+  uint16_t distance_mm;  // fixed point: cm x 10, TELEMETRY_DIST_NONE if invalid
+  uint8_t line;          // bit0 = L2, bit1 = L1, bit2 = M, bit3 = R1, bit4 = R2
+  uint8_t flags;         // TELEMETRY_FLAG_*
+  int8_t wifi_rssi;      // dBm
+};
+
+static_assert(sizeof(TelemetryBinV1) == 19, "TelemetryBinV1 layout changed: bump TELEMETRY_SCHEMA_VERSION");
+
+// v1 layout (version = 2), then the send timestamp
+struct __attribute__((packed)) TelemetryBinV2 {
+  TelemetryBinV1 v1;
+  int64_t ts_us;         // epoch µs (time_sync_nowUs), 0 = clock not synced
+  uint32_t sync_err_us;  // estimated clock error
+};
+
+static_assert(sizeof(TelemetryBinV2) == 31, "TelemetryBinV2 layout changed: bump TELEMETRY_SCHEMA_VERSION");
+
+// One telemetry sample before encoding (same fields as the JSON message)
+struct TelemetrySample {
+  const char* mode;
+  const char* motion;
+  int speed_linear;
+  int speed_rot;
+  float distance_cm;     // <= 0 if no valid reading
+  bool obstacle;
+  bool line[5];          // L2, L1, M, R1, R2
+  int wifi_rssi;
+  uint32_t uptime_ms;
+  int64_t ts_us;         // epoch µs, 0 = not synced
+  uint32_t sync_err_us;
+};
+
+// Code tables, shared with the backend decoder (order is part of the schema)
+extern const char* const TELEMETRY_MODES[];
+extern const uint8_t TELEMETRY_MODE_COUNT;
+extern const char* const TELEMETRY_MOTIONS[];
+extern const uint8_t TELEMETRY_MOTION_COUNT;
+
+// Encode a sample into out (TELEMETRY_SCHEMA_VERSION). Returns bytes written
+// (sizeof(TelemetryBinV2)), or 0 if cap is too small.
+size_t telemetry_encode(const TelemetrySample& s, uint16_t seq, uint8_t* out, size_t cap);
+
+// Untimed v1 form (offline spool). Returns sizeof(TelemetryBinV1) or 0.
+size_t telemetry_encodeV1(const TelemetrySample& s, uint16_t seq, uint8_t* out, size_t cap);
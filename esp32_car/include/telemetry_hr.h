@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ================= High-Rate Telemetry =================
+// Fine-grained controller history without one MQTT publish per sample:
+// a periodic esp_timer samples distance, line mask, wheel ticks and PWM
+// into a ring buffer (e.g. 50 Hz); the MQTT loop drains it every flush
+// interval into batched, delta-encoded frames on car/<id>/telemetry/hr.
+//
+// Frame (little-endian):
+//   TelemetryHrHeader, then per sample:
+//     varint  dt_ms        since previous sample (0 for the first)
+//     zigzag  d distance_mm  (0 = no reading)
+//     u8      (line | flags << 5) XOR previous
+//     zigzag  d ticks_l, d ticks_r, d pwm_l, d pwm_r
+//   "previous" starts at all zeros in every frame, so each frame (and each
+//   part of a split flush) decodes on its own.
+//
+// The decoder lives in admin-panel/backend/src/telemetryCodec.js.
+
+#define TELEMETRY_HR_SCHEMA_ID     0x48   // 'H'
+#define TELEMETRY_HR_VERSION       1
+#define TELEMETRY_HR_MAX_HZ        100
+#define TELEMETRY_HR_RING          256    // samples (~5 s at 50 Hz)
+#define TELEMETRY_HR_SAMPLE_MAX    19     // worst-case encoded bytes per sample
+
+// flags
+#define TELEMETRY_HR_FLAG_RECOVERING 0x01
+#define TELEMETRY_HR_FLAG_OBSTACLE   0x02
+// header flags
+#define TELEMETRY_HR_MORE            0x01 // more parts of the same flush follow
+
+struct HrSample {
+  uint32_t t_ms;
+  uint16_t distance_mm;   // 0 = no reading
+  uint8_t line;           // bit0 = L2 ... bit4 = R2
+  uint8_t flags;          // TELEMETRY_HR_FLAG_*
+  int16_t ticks_l;        // encoder edges since previous sample, signed by PWM direction
+  int16_t ticks_r;
+  int16_t pwm_l;          // commanded PWM -255..255
+  int16_t pwm_r;
+};
+
+struct __attribute__((packed)) TelemetryHrHeader {
+  uint8_t schema;         // TELEMETRY_HR_SCHEMA_ID
+  uint8_t version;        // TELEMETRY_HR_VERSION
+  uint16_t seq;           // frame counter; gaps = lost frames
+  uint8_t flags;          // TELEMETRY_HR_MORE
+  uint8_t count;          // samples in this frame
+  uint16_t period_ms;     // nominal sample period
+  uint16_t mm_per_tick_q8;// wheel travel per encoder edge, mm * 256
+  uint32_t base_ms;       // uptime of the first sample
+};
+
+static_assert(sizeof(TelemetryHrHeader) == 14, "TelemetryHrHeader layout changed: bump TELEMETRY_HR_VERSION");
+
+// Create the sampling timer (stopped until telemetry_hr_configure)
+void telemetry_hr_begin();
+
+// hz = 0 stops sampling; flush_ms is how often the MQTT loop should drain
+void telemetry_hr_configure(uint16_t hz, uint16_t flush_ms);
+
+uint16_t telemetry_hr_rate();
+uint16_t telemetry_hr_flushMs();
+
+// Samples waiting in the ring / dropped because it was full
+size_t telemetry_hr_pending();
+uint32_t telemetry_hr_dropped();
+
+// Pop as many samples as fit in cap and encode them as one frame.
+// Returns the frame size, 0 if nothing is pending. *more is set when
+// samples are still left (the caller publishes another part).
+size_t telemetry_hr_takeFrame(uint8_t* out, size_t cap, bool* more);
+
+// Pure encoder (host-testable): n samples into one frame
+size_t telemetry_hr_encode(const HrSample* s, size_t n, uint16_t seq, uint8_t flags,
+                           uint16_t period_ms, uint16_t mm_per_tick_q8,
+                           uint8_t* out, size_t cap);
@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+#include "telemetry_codec.h"
+
+// ================= Telemetry Publish Policy =================
+// Decides when a telemetry sample is worth publishing:
+//   - discrete change (mode, motion, line mask, obstacle): publish now
+//   - continuous field moved past its dead-band (distance, speed, RSSI)
+//   - nothing published for heartbeat_ms: publish anyway (offline detector)
+// A token bucket caps the burst rate; a change that finds the bucket empty
+// stays pending and the latest sample goes out as soon as a token is back.
+//
+// Pure logic (no Arduino calls) so tools/telemetry_replay.cpp can replay a
+// recorded session through the exact same code.
+
+struct TelemetryPolicyConfig {
+  float dist_deadband_cm;
+  int speed_deadband;
+  int rssi_deadband;
+  uint32_t heartbeat_ms;
+  float rate_hz;          // token refill rate
+  uint8_t burst;          // bucket size
+};
+
+enum TelemetryReason : uint8_t {
+  TLM_REASON_NONE = 0,
+  TLM_REASON_DISCRETE,
+  TLM_REASON_DEADBAND,
+  TLM_REASON_HEARTBEAT,
+  TLM_REASON_PENDING,     // earlier change held back by the rate limit
+  TLM_REASON_COUNT
+};
+
+struct TelemetryPolicy {
+  TelemetryPolicyConfig cfg;
+  TelemetrySample last;   // last published sample (mode / motion must be static strings)
+  bool has_last;
+  bool pending;
+  uint32_t last_pub_ms;
+  float tokens;
+  uint32_t last_refill_ms;
+  uint32_t rate_limited;  // changes that had to wait for a token
+};
+
+// Dead-bands 2 cm / 10 / 6 dBm, 10 s heartbeat, 4 msg/s with a burst of 5
+void telemetry_policy_defaults(TelemetryPolicyConfig* cfg);
+
+void telemetry_policy_init(TelemetryPolicy* p, const TelemetryPolicyConfig& cfg, uint32_t now_ms);
+
+// Change the token refill rate (e.g. after format negotiation)
+void telemetry_policy_setRate(TelemetryPolicy* p, float rate_hz);
+
+// Should this sample be published now? Takes a token when the answer is yes.
+TelemetryReason telemetry_policy_check(TelemetryPolicy* p, const TelemetrySample& s, uint32_t now_ms);
+
+// Record a sample as published (call only when the publish succeeded)
+void telemetry_policy_commit(TelemetryPolicy* p, const TelemetrySample& s, uint32_t now_ms);
+
+const char* telemetry_reason_name(TelemetryReason r);
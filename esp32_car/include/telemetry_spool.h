@@ -0,0 +1,98 @@
+#pragma once
+#include <Arduino.h>
+
+// ================= Telemetry Spool (store-and-forward) =================
+// While the broker is unreachable, telemetry samples and events are appended
+// to a LittleFS spool instead of being dropped. After reconnect they are
+// replayed oldest-first on car/<id>/spool with their original timestamps,
+// paced so live traffic and the control loop keep priority.
+//
+// Flash layout: /spool/<n>.seg, append-only segments of SPOOL_SEGMENT_BYTES.
+// Writes are buffered in RAM and flushed in chunks; a fully replayed segment
+// is deleted, never rewritten. When the spool exceeds SPOOL_MAX_BYTES the
+// oldest segment is dropped.
+//
+// Threads: spool_append() runs on loop() and only copies the record into an
+// SPSC ring (no flash I/O). Everything touching LittleFS - flush, segment
+// rotation, the size bound, replay - runs in spool_service() on the MQTT TX
+// task (core 0, low priority), so the control loop never waits on flash.
+//
+// Delivery: replay publishes one record at a time at QoS 1 and moves the
+// read cursor only when the broker's PUBACK for that msg_id arrives
+// (spool_acked). No ack within SPOOL_ACK_TIMEOUT_MS or a disconnect resends
+// the same record, so records in flash are delivered at-least-once (the
+// backend may see duplicates: same boot + seq). Records still in RAM (ring +
+// write buffer, at most SPOOL_FLUSH_MS old) are lost on a reset.
+
+#define SPOOL_SEGMENT_BYTES   16384
+#define SPOOL_MAX_BYTES       (256 * 1024)
+#define SPOOL_MAX_PAYLOAD     256      // per record
+
+enum SpoolType : uint8_t {
+  SPOOL_TELEMETRY = 1,   // TelemetryBinV1 (telemetry_codec.h)
+  SPOOL_EVENT = 2,       // event JSON
+};
+
+// Record header in flash
+struct __attribute__((packed)) SpoolRecord {
+  uint8_t magic;         // SPOOL_MAGIC
+  uint8_t type;          // SpoolType
+  uint16_t len;          // payload bytes
+  uint16_t boot;         // boot counter when recorded
+  uint32_t t_ms;         // uptime when recorded
+  uint32_t seq;          // spool sequence number (per boot)
+};
+
+// Header of a replayed message on car/<id>/spool, followed by the payload
+struct __attribute__((packed)) SpoolReplayHeader {
+  uint8_t schema;        // SPOOL_REPLAY_SCHEMA_ID
+  uint8_t type;          // SpoolType
+  uint16_t boot;         // boot the record was written in
+  uint16_t now_boot;     // current boot
+  uint32_t t_ms;         // uptime when recorded
+  uint32_t now_ms;       // uptime when replayed (same boot: age = now_ms - t_ms)
+  uint32_t seq;
+};
+
+#define SPOOL_MAGIC             0xA5
+#define SPOOL_REPLAY_SCHEMA_ID  0x53   // 'S'
+
+static_assert(sizeof(SpoolRecord) == 14, "SpoolRecord layout changed");
+static_assert(sizeof(SpoolReplayHeader) == 18, "SpoolReplayHeader layout changed");
+
+// Written by the TX task, read elsewhere: a snapshot, fields may lag
+struct SpoolStats {
+  uint32_t depth_bytes;      // flash + RAM buffer
+  uint32_t depth_records;
+  uint16_t segments;
+  uint32_t dropped_records;  // lost to the size bound / full ring (since boot)
+  uint32_t replayed;         // acked by the broker, since boot
+  uint32_t resent;           // no PUBACK in time or disconnected, since boot
+  uint32_t replay_lag_ms;    // age of the last replayed record (0 if older boot)
+  bool inflight;             // a replayed record waits for its PUBACK
+  bool mounted;
+};
+
+// Mount LittleFS, scan existing segments, bump the boot counter
+// (call once in setup, before the TX task starts)
+void spool_begin();
+
+// Append a record (loop(), RAM only). Returns false if the spool is
+// unavailable or the ring is full.
+bool spool_append(SpoolType type, const uint8_t* data, uint16_t len, uint32_t t_ms);
+
+bool spool_empty();
+
+// Publish callback (TX task): header + payload at QoS 1, returns the msg_id
+// or -1 if the transport is busy / down
+typedef int (*SpoolPublishFn)(const uint8_t* msg, size_t len);
+
+// Flash side of the spool, call from the MQTT TX task on every pass: moves
+// appended records to flash (by size / age), enforces the bound and, while
+// connected, replays the next record if the pacing allows it.
+void spool_service(bool connected, SpoolPublishFn publish);
+
+// PUBACK for msg_id (esp_mqtt task, MQTT_EVENT_PUBLISHED)
+void spool_acked(int msg_id);
+
+void spool_getStats(SpoolStats* out);
@@ -0,0 +1,36 @@
+#pragma once
+#include <stdint.h>
+
+// ================= Time Sync =================
+// SNTP against a configurable server (pool.ntp.org, or tools/ntp_server.py
+// on the LAN for tests). The system clock is stepped by SNTP as usual; on
+// top of that every sync measures how far the boot → epoch offset moved
+// since the previous one, which gives the crystal drift (ppm) and the
+// residual error of the drift-corrected prediction. Timestamps between
+// syncs follow esp_timer + offset + drift, so they do not jump at a sync.
+//
+// Messages carry epoch µs (ts_us) plus the estimated error (sync_err_us);
+// a receiver with its own NTP clock gets one-way latency = now - ts_us.
+
+#define TIME_SYNC_INTERVAL_MS   (5 * 60 * 1000)
+#define TIME_SYNC_FIRST_ERR_US  10000      // before a second sync measures it
+
+struct TimeSyncQuality {
+  bool synced;
+  uint32_t syncs;
+  uint32_t age_s;            // since the last sync
+  int32_t last_residual_us;  // prediction error found at the last sync
+  float drift_ppm;           // local clock vs server (+ = local runs fast)
+  uint32_t err_us;           // estimated error of time_sync_nowUs() now
+};
+
+// Start SNTP (call once after WiFi is connected)
+void time_sync_begin(const char* server);
+
+// Epoch µs, 0 until the first sync
+int64_t time_sync_nowUs();
+
+// Epoch µs of an esp_timer timestamp (µs since boot), 0 until the first sync
+int64_t time_sync_toEpochUs(int64_t boot_us);
+
+void time_sync_getQuality(TimeSyncQuality* out);
@@ -0,0 +1,133 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// ================= Track Map =================
+// Learning lap: odometry (encoder ticks) + line cues from the do_line
+// classifier are cut into segments (straight / left / right curve, split at
+// junctions) with length and mean curvature. After the lap every segment
+// gets a cruise speed (lateral acceleration limit) and an entry speed (so
+// the car can brake in time for everything that follows).
+//
+// Fast lap: the follower integrates odometry along the map, snaps to the
+// learned junctions when the classifier sees them, and returns the target
+// speed for the current position.
+//
+// Pure logic (no Arduino calls) so tools/track_sim.cpp runs the same code
+// against a simulated circuit. NVS storage and HTTP export live in
+// do_line.cpp / main.cpp.
+
+#define TRACK_MAX_SEGMENTS 48
+#define TRACK_MAX_EVENTS   16     // junctions remembered while learning
+#define TRACK_MAP_MAGIC    0x544D   // "TM"
+#define TRACK_MAP_VERSION  1
+
+// Line cue for the current control period (from the 5-sensor pattern)
+enum TrackCue : uint8_t {
+  TRACK_CUE_LINE,      // following normally
+  TRACK_CUE_CROSS,     // >= 3 sensors incl. both sides: crossing line
+  TRACK_CUE_T,         // 4 sensors on: T / corner (starts recovery)
+  TRACK_CUE_LOST,      // no sensor on the line
+};
+
+enum TrackJunction : uint8_t {
+  TRACK_JCT_NONE,
+  TRACK_JCT_CROSS,
+  TRACK_JCT_T,
+};
+
+struct TrackSegment {
+  uint16_t len_mm;
+  int16_t curv_mpm;       // mean curvature, 1/1000 m⁻¹, + = left
+  uint8_t junction;       // TrackJunction at the start of the segment
+  uint8_t v_cms;          // cruise speed inside the segment (cm/s)
+  uint8_t v_entry_cms;    // highest speed at the start that still brakes in time
+  uint8_t reserved;
+};
+
+struct TrackMap {
+  uint16_t magic;
+  uint8_t version;
+  uint8_t count;
+  uint32_t lap_mm;
+  uint32_t start_offset_mm;   // start point → map origin (first junction)
+  TrackSegment seg[TRACK_MAX_SEGMENTS];
+};
+
+struct TrackProfileConfig {
+  float v_max;            // m/s on straights
+  float v_min;            // never plan below
+  float v_junction;       // cap on segments that start at a junction
+  float a_lat;            // m/s², lateral limit → curve speed √(a_lat / κ)
+  float a_brake;          // m/s², braking before slower segments
+  float brake_margin_m;   // position uncertainty: brake this much earlier
+};
+
+void track_profile_defaults(TrackProfileConfig* cfg);
+
+// ================= Learning =================
+// The lap closes at a junction of the same type as the first one seen once
+// the heading has turned a whole number of turns, or (odometry heading
+// drifts with wheel slip) once the next junction repeats the spacing of the
+// previous lap.
+struct TrackJunctionEvent {
+  float m;                // odometry distance
+  float heading_rad;
+  uint8_t type;
+  uint8_t seg;            // index of the segment that starts here
+};
+
+struct TrackLearner {
+  TrackMap map;
+  bool active;
+  bool closed;            // lap closed at the reference junction
+  bool overflow;
+  // current window / segment
+  float win_m, win_rad;
+  float seg_m, seg_rad;
+  int8_t seg_class;       // -1 right, 0 straight, +1 left
+  uint8_t seg_junction;
+  // whole run
+  float total_m, heading_rad;
+  float last_cue_m;
+  uint8_t last_cue;
+  // junctions seen; ev[0] is the map origin, ev[lap_end] closes the lap
+  TrackJunctionEvent ev[TRACK_MAX_EVENTS];
+  uint8_t n_ev;
+  uint8_t lap_end;
+};
+
+void track_learn_begin(TrackLearner* l);
+// One control period: signed wheel ticks (+ = forward) and the line cue
+void track_learn_step(TrackLearner* l, long d_left, long d_right, TrackCue cue);
+// Build the map (segments + profile) once the lap has closed, or from
+// everything driven so far when learning is stopped by hand; false if the
+// lap is too short or overflowed.
+bool track_learn_finish(TrackLearner* l, const TrackProfileConfig& cfg, TrackMap* out);
+
+// Recompute v_cms / v_entry_cms of a map (e.g. after changing the config)
+void track_map_profile(TrackMap* m, const TrackProfileConfig& cfg);
+bool track_map_valid(const TrackMap* m);
+
+// ================= Fast lap =================
+struct TrackFollower {
+  const TrackMap* map;
+  TrackProfileConfig cfg;
+  float s_m;              // position along the lap from the map origin
+  uint8_t seg;
+  float seg_start_m;
+  float last_cue_m;       // odometry distance of the last junction cue
+  float odo_m;
+  uint8_t last_cue;
+  uint32_t resyncs;
+  float last_resync_err_m;
+};
+
+// Start at the learned start point
+void track_follow_begin(TrackFollower* f, const TrackMap* map, const TrackProfileConfig& cfg);
+// Advance by one control period; returns the target speed (m/s)
+float track_follow_step(TrackFollower* f, long d_left, long d_right, TrackCue cue);
+
+// {"valid":true,"lap_mm":..,"start_offset_mm":..,"fields":[..],"segments":[[len,curv,jct,v,v_entry],...]}
+// (48 segments fit in the 1536-byte HTTP buffer)
+size_t track_map_toJson(const TrackMap* m, char* buf, size_t cap);
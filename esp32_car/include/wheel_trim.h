@@ -0,0 +1,43 @@
+#pragma once
+#include <stdint.h>
+
+// ================= Wheel Trim =================
+// Left/right motor mismatch, learned from encoder data. Each wheel is
+// modelled as v = g · (pwm − pwm_static) in steady state; g is fitted by
+// least squares with exponential forgetting over periods where the car
+// drives straight at a steady command, so the estimate follows wear and
+// battery changes. The trims equalise the two gains around their mean:
+//   trim_l = (g_l + g_r) / (2 g_l),  trim_r = (g_l + g_r) / (2 g_r)
+// and scale the PWM above the deadband: pwm' = pwm_static + (pwm − pwm_static) · trim.
+//
+// Pure logic (samples are passed in); NVS storage and the calibration run
+// live in do_line.cpp.
+
+struct WheelTrim {
+  float pwm_static;
+  float lambda;           // forgetting factor per sample
+  // Σ u·v, Σ u², Σ v² per wheel (u = pwm − pwm_static), forgotten at lambda
+  float s_uv[2], s_uu[2], s_vv[2];
+  float n_eff;            // effective sample count
+  uint32_t samples;
+  // Result of the last wheel_trim_update
+  float gain[2];          // m/s per PWM
+  float trim_l, trim_r;
+  float confidence;       // 0..1
+};
+
+// trim_l / trim_r: starting estimate (NVS or chassis defaults)
+void wheel_trim_init(WheelTrim* t, float pwm_static, float lambda, float trim_l, float trim_r);
+// Drop learned data, keep the current trims (calibration run starts clean)
+void wheel_trim_reset(WheelTrim* t);
+// One control period of straight, steady driving: PWM actually written
+// (magnitudes, trim included) and measured wheel speeds (m/s, magnitudes).
+// Periods below the deadband are ignored.
+void wheel_trim_addSample(WheelTrim* t, float pwm_l, float pwm_r, float v_l, float v_r);
+// Refit gains, trims and confidence from the sums
+void wheel_trim_update(WheelTrim* t);
+
+// PWM magnitude after trim (wheel 0 = left, 1 = right)
+inline float wheel_trim_apply(float pwm, float trim, float pwm_static) {
+  return pwm > pwm_static ? pwm_static + (pwm - pwm_static) * trim : pwm;
+}
@@ -0,0 +1,210 @@
+#include <Arduino.h>
+#include <atomic>
+#include "car_log.h"
+
+// ================= Configuration =================
+const uint32_t LOG_TASK_STACK = 3072;
+const UBaseType_t LOG_TASK_PRIO = 1;      // below MQTT TX (2), same core
+const uint32_t LOG_DRAIN_MS = 20;
+const size_t LOG_LINE_MAX = 192;
+
+static_assert((CAR_LOG_RING & (CAR_LOG_RING - 1)) == 0, "CAR_LOG_RING must be a power of two");
+
+// ================= Ring =================
+// Bounded multi-producer queue (Vyukov): each slot carries a sequence
+// number, producers claim a position with one CAS, the single consumer
+// (log task) hands the slot back by advancing its sequence by the ring
+// size. No locks, so logging from the esp_mqtt / AsyncTCP / SNTP tasks
+// never blocks loop().
+struct LogRecord {
+  uint32_t t_ms;
+  const char* fmt;
+  uint8_t level;
+  uint8_t nargs;
+  CarLogArgType type[CAR_LOG_MAX_ARGS];
+  union {
+    int32_t i;
+    uint32_t u;
+    float f;
+    uint16_t str_off;       // into str[]
+  } arg[CAR_LOG_MAX_ARGS];
+  char str[CAR_LOG_STR_BYTES];
+};
+
+struct LogSlot {
+  std::atomic<uint32_t> seq;
+  LogRecord rec;
+};
+
+static LogSlot log_ring[CAR_LOG_RING];
+static std::atomic<uint32_t> log_enq{0};
+static uint32_t log_deq = 0;               // log task only
+static bool log_ring_ready = false;
+
+static std::atomic<uint32_t> log_written{0};
+static std::atomic<uint32_t> log_dropped{0};
+static uint32_t log_printed = 0;
+static uint16_t log_depth_max = 0;
+
+static void initRing() {
+  for (uint32_t i = 0; i < CAR_LOG_RING; i++) {
+    log_ring[i].seq.store(i, std::memory_order_relaxed);
+  }
+  log_ring_ready = true;
+}
+
+void car_log_push(uint8_t level, const char* fmt, const CarLogArg* args, uint8_t nargs) {
+  if (!log_ring_ready) return;   // before car_log_begin()
+
+  uint32_t pos = log_enq.load(std::memory_order_relaxed);
+  LogSlot* slot;
+  for (;;) {
+    slot = &log_ring[pos & (CAR_LOG_RING - 1)];
+    int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+    if (diff == 0) {
+      if (log_enq.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      log_dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    } else {
+      pos = log_enq.load(std::memory_order_relaxed);
+    }
+  }
+
+  LogRecord& r = slot->rec;
+  r.t_ms = millis();
+  r.fmt = fmt;
+  r.level = level;
+  r.nargs = nargs;
+  size_t str_used = 0;
+  for (uint8_t k = 0; k < nargs; k++) {
+    r.type[k] = args[k].type;
+    if (args[k].type == LOG_ARG_STR) {
+      // Copy (truncated); an exhausted buffer yields ""
+      const char* s = args[k].s ? args[k].s : "(null)";
+      size_t room = sizeof(r.str) - str_used;
+      r.arg[k].str_off = (uint16_t)(room ? str_used : sizeof(r.str) - 1);
+      if (room) {
+        size_t n = strnlen(s, room - 1);
+        memcpy(r.str + str_used, s, n);
+        r.str[str_used + n] = '\0';
+        str_used += n + 1;
+      }
+    } else {
+      r.arg[k].u = args[k].u;
+    }
+  }
+  r.str[sizeof(r.str) - 1] = '\0';
+  slot->seq.store(pos + 1, std::memory_order_release);
+
+  log_written.fetch_add(1, std::memory_order_relaxed);
+  uint16_t depth = (uint16_t)(pos + 1 - log_deq);
+  if (depth > log_depth_max) log_depth_max = depth;   // approximate, stats only
+}
+
+// ================= Formatting (log task) =================
+// Re-runs the format one conversion at a time with the stored argument;
+// length modifiers are dropped since every argument is 32 bit.
+static size_t formatRecord(const LogRecord& r, char* out, size_t cap) {
+  static const char LEVEL_CHAR[] = { '-', 'E', 'W', 'I', 'D' };
+  size_t n = snprintf(out, cap, "%6lu.%03lu %c ", (unsigned long)(r.t_ms / 1000),
+                      (unsigned long)(r.t_ms % 1000), LEVEL_CHAR[r.level < 5 ? r.level : 0]);
+  uint8_t k = 0;
+  const char* p = r.fmt;
+  while (*p && n < cap - 1) {
+    if (*p != '%') {
+      out[n++] = *p++;
+      continue;
+    }
+    if (p[1] == '%') {
+      out[n++] = '%';
+      p += 2;
+      continue;
+    }
+    // %[flags][width][.prec][length]conv
+    char spec[16];
+    size_t sl = 0;
+    spec[sl++] = *p++;
+    while (*p && strchr("-+ #0123456789.", *p) && sl < sizeof(spec) - 2) spec[sl++] = *p++;
+    while (*p && strchr("hlzjtL", *p)) p++;
+    char conv = *p ? *p++ : 's';
+    spec[sl++] = conv;
+    spec[sl] = '\0';
+
+    int w = 0;
+    if (k >= r.nargs) {
+      w = snprintf(out + n, cap - n, "%s", "?");
+    } else {
+      CarLogArgType t = r.type[k];
+      switch (conv) {
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+          double v = t == LOG_ARG_FLOAT ? r.arg[k].f
+                   : t == LOG_ARG_INT   ? (double)r.arg[k].i
+                   : t == LOG_ARG_UINT  ? (double)r.arg[k].u : 0.0;
+          w = snprintf(out + n, cap - n, spec, v);
+          break;
+        }
+        case 's':
+          w = snprintf(out + n, cap - n, spec, t == LOG_ARG_STR ? r.str + r.arg[k].str_off : "?");
+          break;
+        case 'd': case 'i': case 'c':
+          w = snprintf(out + n, cap - n, spec, t == LOG_ARG_FLOAT ? (int)r.arg[k].f : (int)r.arg[k].i);
+          break;
+        default:   // u x X o p
+          if (conv == 'p') { spec[sl - 1] = 'x'; }
+          w = snprintf(out + n, cap - n, spec, t == LOG_ARG_FLOAT ? (unsigned)r.arg[k].f : (unsigned)r.arg[k].u);
+          break;
+      }
+      k++;
+    }
+    if (w > 0) n += ((size_t)w < cap - n) ? (size_t)w : cap - n - 1;
+  }
+  if (n > cap - 2) n = cap - 2;
+  out[n++] = '\n';
+  out[n] = '\0';
+  return n;
+}
+
+static bool drainOne(char* line) {
+  LogSlot& slot = log_ring[log_deq & (CAR_LOG_RING - 1)];
+  if (slot.seq.load(std::memory_order_acquire) != log_deq + 1) return false;
+  LogRecord r = slot.rec;                       // copy, free the slot first
+  slot.seq.store(log_deq + CAR_LOG_RING, std::memory_order_release);
+  log_deq++;
+
+  size_t n = formatRecord(r, line, LOG_LINE_MAX);
+  Serial.write((const uint8_t*)line, n);
+  log_printed++;
+  return true;
+}
+
+static void logTask(void*) {
+  static char line[LOG_LINE_MAX];
+  uint32_t reported_drops = 0;
+  for (;;) {
+    while (drainOne(line)) {}
+    uint32_t drops = log_dropped.load(std::memory_order_relaxed);
+    if (drops != reported_drops) {
+      int n = snprintf(line, sizeof(line), "[LOG] %u records dropped (ring full)\n",
+                       (unsigned)(drops - reported_drops));
+      Serial.write((const uint8_t*)line, n);
+      reported_drops = drops;
+    }
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_MS));
+  }
+}
+
+// ================= Public API =================
+void car_log_begin() {
+  if (log_ring_ready) return;
+  initRing();
+  xTaskCreatePinnedToCore(logTask, "log", LOG_TASK_STACK, nullptr, LOG_TASK_PRIO, nullptr, 0);
+}
+
+void car_log_getStats(CarLogStats* out) {
+  out->written = log_written.load(std::memory_order_relaxed);
+  out->dropped = log_dropped.load(std::memory_order_relaxed);
+  out->printed = log_printed;
+  out->depth = (uint16_t)(log_enq.load(std::memory_order_relaxed) - log_deq);
+  out->depth_max = log_depth_max;
+}
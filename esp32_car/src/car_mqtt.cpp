@@ -0,0 +1,1044 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <ArduinoJson.h>
+#include <atomic>
+#include <math.h>
+#include <mqtt_client.h>   // ESP-IDF esp_mqtt
+#include "car_mqtt.h"
+#include "spsc_ring.h"
+#include "do_line.h"
+#include "telemetry_codec.h"
+#include "telemetry_policy.h"
+#include "telemetry_hr.h"
+#include "telemetry_spool.h"
+#include "heap_stats.h"
+#include "time_sync.h"
+#include "car_log.h"
+
+// StaticJsonDocument: ArduinoJson is pinned to v6 (platformio.ini), where it
+// is a fixed pool on the stack. In v7 it is a deprecated alias of the
+// heap-allocating JsonDocument, so every publish would churn the heap.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+
+// ================= MQTT Configuration =================
+const char* MQTT_BROKER = "192.168.0.107";
+const int MQTT_PORT = 1883;
+const char* MQTT_USER = "";
+const char* MQTT_PASS = "";
+
+// esp_mqtt connects / reconnects in its own task; a dead broker costs
+// loop() nothing, only the MQTT task waits up to the network timeout
+const int MQTT_RECONNECT_MS = 5000;
+const int MQTT_NETWORK_TIMEOUT_MS = 3000;
+const int MQTT_KEEPALIVE_S = 15;
+
+// TX task: drains the publish queues and does the spool's flash I/O (core 0,
+// next to the WiFi stack; loop() runs on core 1). LittleFS needs the stack.
+const uint32_t MQTT_TX_STACK = 6144;
+const UBaseType_t MQTT_TX_PRIO = 2;
+const uint32_t MQTT_TX_IDLE_MS = 50;       // wake-up without notification (expiry)
+const uint8_t MQTT_TX_BURST = 8;           // per class and pass
+
+// Telemetry is change-driven (see telemetry_policy.h): sensors are sampled
+// every TELEMETRY_SAMPLE_MS, published on change, capped by a token bucket
+const unsigned long TELEMETRY_SAMPLE_MS = 20;
+const float TELEMETRY_JSON_RATE_HZ = 4.0f;          // JSON: tối đa 4 msg/s
+const unsigned long TELEMETRY_STATS_MS = 60000;    // Serial summary interval
+
+// Binary telemetry rate, set by the backend through car/<id>/telemetry/format/set
+const uint8_t TELEMETRY_BIN_MAX_HZ = 50;
+
+// High-rate frames (telemetry_hr.h): payload cap per frame, larger flushes are
+// split. The esp_mqtt buffer holds fixed header + topic + payload.
+const uint16_t TELEMETRY_HR_MAX_PAYLOAD = 512;
+const uint16_t MQTT_BUFFER_SIZE = 640;
+const uint8_t TELEMETRY_HR_PARTS_PER_LOOP = 4;   // không chiếm loop quá lâu
+static_assert(5 + 2 + 64 + TELEMETRY_HR_MAX_PAYLOAD <= MQTT_BUFFER_SIZE, "MQTT buffer too small for HR frames");
+const uint8_t TELEMETRY_BIN_DEFAULT_HZ = 20;
+
+// Store-and-forward (telemetry_spool.h): while the broker is unreachable the
+// policy keeps running at a lower rate and its samples go to flash
+const float TELEMETRY_OFFLINE_RATE_HZ = 2.0f;
+const unsigned long SPOOL_STATUS_MS = 5000;      // status while replaying
+const unsigned long HEALTH_STATUS_MS = 30000;    // status with heap stats while online
+
+// Remote commands (car/<id>/cmd)
+const uint32_t CMD_DEFAULT_TTL_MS = 500;
+const uint16_t CMD_VEL_HOLD_MS = 500;            // vel without hold_ms
+const uint16_t CMD_VEL_HOLD_MAX_MS = 500;        // = safety deadman (safety_defaults)
+const uint32_t CMD_OFFSET_RELAX_DIV = 100;       // delay baseline creeps up 10 ms/s
+
+// ================= MQTT Client =================
+static esp_mqtt_client_handle_t mq_client = nullptr;
+static TaskHandle_t mq_tx_task = nullptr;
+
+// Set by the esp_mqtt task; loop() reacts to changes of mq_connect_gen
+static std::atomic<bool> mq_connected{false};
+static std::atomic<uint32_t> mq_connect_gen{0};
+static uint32_t mq_seen_gen = 0;
+
+// Device ID from MAC address (last 3 bytes)
+char device_id[20] = "";
+
+// Topic strings (built once in mqtt_init, read-only afterwards). Fixed
+// buffers: nothing on the publish path touches the heap.
+const size_t TOPIC_MAX = 48;
+char topic_telemetry[TOPIC_MAX] = "";
+char topic_event[TOPIC_MAX] = "";
+char topic_status[TOPIC_MAX] = "";
+char topic_telemetry_bin[TOPIC_MAX] = "";
+char topic_format[TOPIC_MAX] = "";       // retained: formats this car can publish
+char topic_format_set[TOPIC_MAX] = "";   // retained: format chosen by the backend
+char topic_telemetry_hr[TOPIC_MAX] = "";
+char topic_spool[TOPIC_MAX] = "";        // replayed records (SpoolReplayHeader + payload)
+char topic_cmd[TOPIC_MAX] = "";          // remote commands (subscribed)
+char topic_ack[TOPIC_MAX] = "";          // command acks
+
+enum MqttTopicId : uint8_t {
+  TOPIC_TELEMETRY, TOPIC_TELEMETRY_BIN, TOPIC_TELEMETRY_HR,
+  TOPIC_EVENT, TOPIC_STATUS, TOPIC_FORMAT, TOPIC_SPOOL, TOPIC_ACK,
+};
+static const char* const TOPICS[] = {
+  topic_telemetry, topic_telemetry_bin, topic_telemetry_hr,
+  topic_event, topic_status, topic_format, topic_spool, topic_ack,
+};
+
+// ================= Publish Queues =================
+// One SPSC ring per class: loop() produces, the TX task consumes. A full
+// queue never blocks the producer, the caller applies the class fallback.
+template <size_t CAP>
+struct MqttMsg {
+  uint32_t t_us;        // enqueue time
+  uint16_t len;
+  uint8_t topic;        // MqttTopicId
+  bool retain;
+  uint8_t data[CAP];
+};
+
+// max_age_ms = 0: kept until sent (held while disconnected, retried after a
+// failed publish). > 0: dropped once older, a newer sample supersedes it.
+struct MqttClassPolicy {
+  const char* name;
+  uint16_t max_age_ms;
+};
+static const MqttClassPolicy MQ_POLICY[MQTT_CLASS_COUNT] = {
+  {"control", 0},
+  {"event", 0},
+  {"telemetry", 1000},
+  {"hr", 2000},
+  {"replay", 0},
+};
+
+static SpscRing<MqttMsg<512>, 8> q_control;   // status (spool, heap, time), acks
+static SpscRing<MqttMsg<256>, 8> q_event;
+static SpscRing<MqttMsg<384>, 8> q_telemetry;
+static SpscRing<MqttMsg<TELEMETRY_HR_MAX_PAYLOAD>, 4> q_hr;
+// Replay has no queue: the TX task reads it from the spool (spool_service)
+
+// Inbound (esp_mqtt task → loop()): format/set and remote commands
+enum MqttInboundKind : uint8_t { IN_FORMAT_SET, IN_CMD };
+struct MqttInbound {
+  uint32_t rx_us;       // received by the esp_mqtt task
+  uint8_t kind;         // MqttInboundKind
+  uint16_t len;
+  char data[192];
+};
+static SpscRing<MqttInbound, 8> q_inbound;
+
+// Metrics: every field has a single writer task
+static struct {
+  uint32_t connects;
+  uint32_t connect_fails;
+  uint32_t connect_start_us;
+  uint32_t connect_ms_last;
+  uint32_t connect_ms_max;
+  uint32_t published;
+  uint32_t publish_fails;
+  uint32_t publish_us_avg;
+  uint32_t publish_us_max;
+  uint32_t queue_ms_avg;
+  uint32_t queue_ms_max;
+  uint32_t dropped_full[MQTT_CLASS_COUNT];    // producer (loop)
+  uint32_t dropped_stale[MQTT_CLASS_COUNT];   // TX task
+  uint32_t cmd_ok;                            // loop
+  uint32_t cmd_dropped;                       // old / stale / bad / rejected
+  uint32_t cmd_inbound_full;                  // esp_mqtt task
+} mq_metrics;
+
+template <typename Q>
+static bool enqueue(Q& q, MqttClass cls, MqttTopicId topic, const void* data, size_t len, bool retain = false) {
+  auto* m = q.reserve();
+  if (!m || len > sizeof(m->data)) {
+    mq_metrics.dropped_full[cls]++;
+    return false;
+  }
+  memcpy(m->data, data, len);
+  m->len = len;
+  m->topic = topic;
+  m->retain = retain;
+  m->t_us = micros();
+  q.commit();
+  if (mq_tx_task) xTaskNotifyGive(mq_tx_task);
+  return true;
+}
+
+// Send up to MQTT_TX_BURST messages of one class. Runs in the TX task.
+template <typename Q>
+static uint8_t drainQueue(Q& q, MqttClass cls) {
+  const MqttClassPolicy& pol = MQ_POLICY[cls];
+  uint8_t sent = 0;
+  while (sent < MQTT_TX_BURST) {
+    auto* m = q.front();
+    if (!m) break;
+    uint32_t t0 = micros();
+    uint32_t age_ms = (t0 - m->t_us) / 1000;
+    if (pol.max_age_ms > 0 && age_ms > pol.max_age_ms) {
+      mq_metrics.dropped_stale[cls]++;
+      q.pop();
+      continue;
+    }
+    if (!mq_connected) break;
+
+    int id = esp_mqtt_client_publish(mq_client, TOPICS[m->topic],
+                                     (const char*)m->data, m->len, 0, m->retain);
+    uint32_t pub_us = micros() - t0;
+    if (id < 0) {
+      mq_metrics.publish_fails++;
+      if (pol.max_age_ms > 0) {
+        mq_metrics.dropped_stale[cls]++;
+        q.pop();
+      }
+      break;   // lớp "keep": thử lại ở lần sau
+    }
+    mq_metrics.published++;
+    mq_metrics.publish_us_avg += ((int32_t)pub_us - (int32_t)mq_metrics.publish_us_avg) / 8;
+    if (pub_us > mq_metrics.publish_us_max) mq_metrics.publish_us_max = pub_us;
+    mq_metrics.queue_ms_avg += ((int32_t)age_ms - (int32_t)mq_metrics.queue_ms_avg) / 8;
+    if (age_ms > mq_metrics.queue_ms_max) mq_metrics.queue_ms_max = age_ms;
+    q.pop();
+    sent++;
+  }
+  return sent;
+}
+
+// Spool replay record at QoS 1: the spool advances on its PUBACK. Runs in
+// the TX task (spool_service).
+static int publishSpoolRecord(const uint8_t* msg, size_t len) {
+  if (!mq_connected) return -1;
+  uint32_t t0 = micros();
+  int id = esp_mqtt_client_publish(mq_client, topic_spool, (const char*)msg, len, 1, 0);
+  uint32_t pub_us = micros() - t0;
+  if (id < 0) {
+    mq_metrics.publish_fails++;
+    return -1;
+  }
+  mq_metrics.published++;
+  mq_metrics.publish_us_avg += ((int32_t)pub_us - (int32_t)mq_metrics.publish_us_avg) / 8;
+  if (pub_us > mq_metrics.publish_us_max) mq_metrics.publish_us_max = pub_us;
+  return id;
+}
+
+static void mqttTxTask(void*) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(MQTT_TX_IDLE_MS));
+    // Control first, bulk last; repeat while anything went out
+    uint8_t sent;
+    do {
+      sent = drainQueue(q_control, MQTT_CLASS_CONTROL);
+      sent += drainQueue(q_event, MQTT_CLASS_EVENT);
+      sent += drainQueue(q_telemetry, MQTT_CLASS_TELEMETRY);
+      sent += drainQueue(q_hr, MQTT_CLASS_HR);
+    } while (sent > 0);
+    // Spool flash writes and replay: lowest priority, never on loop()
+    spool_service(mq_connected, publishSpoolRecord);
+  }
+}
+
+// ================= Telemetry Format =================
+// JSON until the backend asks for binary; back to JSON on every reconnect
+// until the retained choice is delivered again.
+enum TelemetryFormat { TLM_JSON, TLM_BIN };
+TelemetryFormat telemetry_format = TLM_JSON;
+float telemetry_bin_rate_hz = TELEMETRY_BIN_DEFAULT_HZ;
+uint16_t telemetry_seq = 0;
+
+#ifdef TELEMETRY_BENCH
+void mqtt_benchTelemetry();
+#endif
+
+// ================= Telemetry Timing =================
+unsigned long last_sample_ms = 0;
+TelemetryPolicy telemetry_policy;
+bool mqtt_online = false;       // false → telemetry/events are spooled
+
+// Publish counters since the last Serial summary
+struct TelemetryStats {
+  unsigned long since_ms;
+  uint32_t msgs;
+  uint32_t bytes;       // payload + topic
+  uint32_t by_reason[TLM_REASON_COUNT];
+  uint32_t hr_frames;
+  uint32_t hr_bytes;
+  uint32_t hr_samples;
+  uint32_t spooled;
+};
+TelemetryStats telemetry_stats;
+
+// ================= Helper Functions =================
+// Epoch µs + estimated clock error, once SNTP has synced (time_sync.h).
+// The backend derives publish → ingest latency from it.
+static void addTimestamp(JsonDocument& doc) {
+  int64_t ts_us = time_sync_nowUs();
+  if (ts_us == 0) return;
+  TimeSyncQuality q;
+  time_sync_getQuality(&q);
+  doc["ts_us"] = ts_us;
+  doc["sync_err_us"] = q.err_us;
+}
+
+const char* getDeviceId() {
+  if (device_id[0] == '\0') {
+    uint8_t mac[6];
+    WiFi.macAddress(mac);
+    snprintf(device_id, sizeof(device_id), "esp32_car_%02X%02X%02X", mac[3], mac[4], mac[5]);
+  }
+  return device_id;
+}
+
+static void buildTopic(char* out, const char* suffix) {
+  snprintf(out, TOPIC_MAX, "car/%s/%s", device_id, suffix);
+}
+
+void buildTopics() {
+  getDeviceId();
+  buildTopic(topic_telemetry, "telemetry");
+  buildTopic(topic_event, "event");
+  buildTopic(topic_status, "status");
+  buildTopic(topic_telemetry_bin, "telemetry/bin");
+  buildTopic(topic_format, "telemetry/format");
+  buildTopic(topic_format_set, "telemetry/format/set");
+  buildTopic(topic_telemetry_hr, "telemetry/hr");
+  buildTopic(topic_spool, "spool");
+  buildTopic(topic_cmd, "cmd");
+  buildTopic(topic_ack, "ack");
+}
+
+// Advertise the supported telemetry encodings (retained, so the backend
+// sees it whenever it (re)subscribes)
+void publishFormatOffer() {
+  char buf[384];
+  int n = snprintf(buf, sizeof(buf),
+           "{\"device_id\":\"%s\",\"formats\":[\"json\",\"bin\"],"
+           "\"content_type\":\"%s\",\"schema\":%u,\"version\":%u,"
+           "\"topic\":\"%s\",\"max_hz\":%u,"
+           "\"hr\":{\"topic\":\"%s\",\"version\":%u,\"max_hz\":%u}}",
+           device_id, TELEMETRY_CONTENT_TYPE,
+           TELEMETRY_SCHEMA_ID, TELEMETRY_SCHEMA_VERSION,
+           topic_telemetry_bin, TELEMETRY_BIN_MAX_HZ,
+           topic_telemetry_hr, TELEMETRY_HR_VERSION, TELEMETRY_HR_MAX_HZ);
+  enqueue(q_control, MQTT_CLASS_CONTROL, TOPIC_FORMAT, buf, n, true);
+}
+
+// {"format":"bin"|"json","hz":20,"hr_hz":50,"hr_flush_ms":500}
+void applyFormatChoice(const char* payload, unsigned int length) {
+  StaticJsonDocument<128> doc;
+  if (deserializeJson(doc, payload, length)) {
+    LOG_W("[MQTT] Bad telemetry format request");
+    return;
+  }
+  const char* fmt = doc["format"] | "json";
+  int hz = doc["hz"] | (int)TELEMETRY_BIN_DEFAULT_HZ;
+  if (hz < 1) hz = 1;
+  if (hz > TELEMETRY_BIN_MAX_HZ) hz = TELEMETRY_BIN_MAX_HZ;
+
+  telemetry_format = (strcmp(fmt, "bin") == 0) ? TLM_BIN : TLM_JSON;
+  telemetry_bin_rate_hz = hz;
+  telemetry_policy_setRate(&telemetry_policy,
+                           telemetry_format == TLM_BIN ? telemetry_bin_rate_hz : TELEMETRY_JSON_RATE_HZ);
+  if (telemetry_format == TLM_BIN) {
+    LOG_I("[MQTT] Telemetry format: bin @ %d Hz", hz);
+  } else {
+    LOG_I("[MQTT] Telemetry format: json");
+  }
+
+  int hr_hz = doc["hr_hz"] | 0;
+  int hr_flush_ms = doc["hr_flush_ms"] | 500;
+  telemetry_hr_configure(hr_hz < 0 ? 0 : hr_hz, hr_flush_ms < 0 ? 0 : hr_flush_ms);
+  if (telemetry_hr_rate() > 0) {
+    LOG_I("[MQTT] High-rate telemetry: %u Hz, flush every %u ms",
+          telemetry_hr_rate(), telemetry_hr_flushMs());
+  }
+}
+
+// Status with spool depth / replay lag and heap stats (on connect, while
+// replaying and every HEALTH_STATUS_MS)
+bool publishStatus(const char* status) {
+  SpoolStats sp;
+  spool_getStats(&sp);
+  HeapStats hs;
+  heap_getStats(&hs);
+
+  StaticJsonDocument<512> statusDoc;
+  statusDoc["device_id"] = device_id;
+  statusDoc["status"] = status;
+  statusDoc["timestamp"] = millis();
+  if (sp.mounted) {
+    statusDoc["spool"]["depth_records"] = sp.depth_records;
+    statusDoc["spool"]["depth_bytes"] = sp.depth_bytes;
+    statusDoc["spool"]["segments"] = sp.segments;
+    statusDoc["spool"]["dropped"] = sp.dropped_records;
+    statusDoc["spool"]["replayed"] = sp.replayed;
+    statusDoc["spool"]["resent"] = sp.resent;
+    statusDoc["spool"]["replay_lag_ms"] = sp.replay_lag_ms;
+  }
+  statusDoc["heap"]["free"] = hs.free_bytes;
+  statusDoc["heap"]["largest"] = hs.largest_block;
+  statusDoc["heap"]["min_free"] = hs.min_free_bytes;
+  statusDoc["heap"]["frag_pct"] = hs.frag_pct;
+  TimeSyncQuality q;
+  time_sync_getQuality(&q);
+  statusDoc["time"]["synced"] = q.synced;
+  statusDoc["time"]["syncs"] = q.syncs;
+  statusDoc["time"]["age_s"] = q.age_s;
+  statusDoc["time"]["drift_ppm"] = q.drift_ppm;
+  statusDoc["time"]["err_us"] = q.err_us;
+  addTimestamp(statusDoc);
+
+  char statusBuffer[512];
+  size_t n = serializeJson(statusDoc, statusBuffer);
+  return enqueue(q_control, MQTT_CLASS_CONTROL, TOPIC_STATUS, statusBuffer, n);
+}
+
+// ================= MQTT Events =================
+static bool topicIs(esp_mqtt_event_handle_t event, const char* topic) {
+  return strlen(topic) == (size_t)event->topic_len &&
+         strncmp(event->topic, topic, event->topic_len) == 0;
+}
+
+// Runs in the esp_mqtt task: only flags, counters and hand-over to loop()
+static void mqttEventHandler(void* arg, esp_event_base_t base, int32_t event_id, void* event_data) {
+  esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+  switch ((esp_mqtt_event_id_t)event_id) {
+    case MQTT_EVENT_BEFORE_CONNECT:
+      mq_metrics.connect_start_us = micros();
+      break;
+
+    case MQTT_EVENT_CONNECTED: {
+      uint32_t ms = (micros() - mq_metrics.connect_start_us) / 1000;
+      mq_metrics.connects++;
+      mq_metrics.connect_ms_last = ms;
+      if (ms > mq_metrics.connect_ms_max) mq_metrics.connect_ms_max = ms;
+      esp_mqtt_client_subscribe(mq_client, topic_format_set, 0);
+      esp_mqtt_client_subscribe(mq_client, topic_cmd, 0);
+      mq_connected = true;
+      mq_connect_gen++;
+      if (mq_tx_task) xTaskNotifyGive(mq_tx_task);
+      break;
+    }
+
+    case MQTT_EVENT_PUBLISHED:   // PUBACK (only spool replay uses QoS 1)
+      spool_acked(event->msg_id);
+      if (mq_tx_task) xTaskNotifyGive(mq_tx_task);
+      break;
+
+    case MQTT_EVENT_DISCONNECTED:
+      if (mq_connected) {
+        mq_connected = false;
+        mq_connect_gen++;
+      } else {
+        mq_metrics.connect_fails++;
+      }
+      break;
+
+    case MQTT_EVENT_DATA: {
+      if (event->current_data_offset != 0) break;   // chỉ nhận message 1 mảnh
+      uint8_t kind;
+      if (topicIs(event, topic_cmd)) kind = IN_CMD;
+      else if (topicIs(event, topic_format_set)) kind = IN_FORMAT_SET;
+      else break;
+      MqttInbound* in = q_inbound.reserve();
+      if (!in || event->data_len > (int)sizeof(in->data)) {
+        mq_metrics.cmd_inbound_full++;
+        break;
+      }
+      in->rx_us = micros();
+      in->kind = kind;
+      memcpy(in->data, event->data, event->data_len);
+      in->len = event->data_len;
+      q_inbound.commit();
+      break;
+    }
+
+    default:
+      break;
+  }
+}
+
+// loop() side of a (re)connect
+static void onConnected() {
+  LOG_I("[MQTT] Connected in %u ms, device %s", mq_metrics.connect_ms_last, device_id);
+
+  // The TX task replays records spooled while offline (spool_service)
+  mqtt_online = true;
+  publishStatus("online");
+
+  // Telemetry content-type negotiation
+  telemetry_format = TLM_JSON;
+  telemetry_policy_setRate(&telemetry_policy, TELEMETRY_JSON_RATE_HZ);
+  publishFormatOffer();
+}
+
+// ================= Remote Commands =================
+// Staleness without a shared clock: offset = car uptime at receive - sender
+// ts. The smallest offset seen is the fastest path; a command whose offset
+// exceeds it by more than ttl_ms waited that much longer somewhere (broker,
+// WiFi, queue) and is dropped. The baseline creeps up slowly so clock drift
+// or a sender clock step cannot lock it.
+static CarCommandHandler cmd_handler = nullptr;
+static struct {
+  char sid[16];
+  bool has_seq;
+  uint32_t last_seq;
+  bool has_offset;
+  double min_offset_ms;
+  uint32_t last_rx_ms;
+} cmd_state;
+
+void mqtt_setCommandHandler(CarCommandHandler fn) {
+  cmd_handler = fn;
+}
+
+static void publishAck(uint32_t seq, double ts, const char* status, const char* err,
+                       long age_ms, uint32_t queue_us, uint32_t act_us) {
+  char buf[192];
+  int n = snprintf(buf, sizeof(buf),
+                   "{\"seq\":%lu,\"ts\":%.0f,\"status\":\"%s\",\"err\":\"%s\","
+                   "\"age_ms\":%ld,\"queue_us\":%lu,\"act_us\":%lu}",
+                   (unsigned long)seq, ts, status, err ? err : "",
+                   age_ms, (unsigned long)queue_us, (unsigned long)act_us);
+  if (n > 0 && n < (int)sizeof(buf)) {
+    enqueue(q_control, MQTT_CLASS_CONTROL, TOPIC_ACK, buf, n);
+  }
+}
+
+static bool parseCommand(JsonDocument& doc, CarCommand* c) {
+  const char* cmd = doc["cmd"] | "";
+  c->motion = nullptr;
+  c->mode = nullptr;
+  c->lin = -1;
+  c->rot = -1;
+  // Giữ lâu hơn deadman vô nghĩa: supervisor dừng xe trước đó
+  uint16_t hold = doc["hold_ms"] | CMD_VEL_HOLD_MS;
+  c->hold_ms = hold > CMD_VEL_HOLD_MAX_MS ? CMD_VEL_HOLD_MAX_MS : hold;
+  c->v_base = doc["v_base"] | NAN;
+  c->kp = doc["kp"] | NAN;
+  c->ki = doc["ki"] | NAN;
+  c->kd = doc["kd"] | NAN;
+  if (strcmp(cmd, "motion") == 0) {
+    c->type = CAR_CMD_MOTION;
+    c->motion = doc["motion"] | (const char*)nullptr;
+    return c->motion != nullptr;
+  }
+  if (strcmp(cmd, "vel") == 0) {
+    c->type = CAR_CMD_VELOCITY;
+    c->lin = doc["lin"] | 0;
+    c->rot = doc["rot"] | 0;
+    return true;
+  }
+  if (strcmp(cmd, "mode") == 0) {
+    c->type = CAR_CMD_MODE;
+    c->mode = doc["mode"] | (const char*)nullptr;
+    return c->mode != nullptr;
+  }
+  if (strcmp(cmd, "speed") == 0) {
+    c->type = CAR_CMD_SPEED;
+    c->lin = doc["lin"] | -1;
+    c->rot = doc["rot"] | -1;
+    return true;
+  }
+  if (strcmp(cmd, "tune") == 0) {
+    c->type = CAR_CMD_TUNE;
+    return true;
+  }
+  return false;
+}
+
+static void handleCommand(const MqttInbound& in) {
+  uint32_t t_deq = micros();
+  uint32_t queue_us = t_deq - in.rx_us;
+  uint32_t rx_ms = millis() - queue_us / 1000;
+
+  StaticJsonDocument<256> doc;
+  if (deserializeJson(doc, in.data, in.len) || !doc.containsKey("seq")) {
+    mq_metrics.cmd_dropped++;
+    publishAck(0, 0, "bad", "invalid json", 0, queue_us, 0);
+    return;
+  }
+  uint32_t seq = doc["seq"];
+  double ts = doc["ts"] | 0.0;
+  uint32_t ttl_ms = doc["ttl_ms"] | CMD_DEFAULT_TTL_MS;
+  const char* sid = doc["sid"] | "";
+
+  // New sender session: sequence and delay baseline start over
+  if (strncmp(sid, cmd_state.sid, sizeof(cmd_state.sid) - 1) != 0) {
+    strncpy(cmd_state.sid, sid, sizeof(cmd_state.sid) - 1);
+    cmd_state.sid[sizeof(cmd_state.sid) - 1] = '\0';
+    cmd_state.has_seq = false;
+    cmd_state.has_offset = false;
+  }
+
+  if (cmd_state.has_seq && (int32_t)(seq - cmd_state.last_seq) <= 0) {
+    mq_metrics.cmd_dropped++;
+    publishAck(seq, ts, "old", "out of order", 0, queue_us, 0);
+    return;
+  }
+  cmd_state.has_seq = true;
+  cmd_state.last_seq = seq;
+
+  long age_ms = 0;
+  if (ts > 0) {
+    double offset = (double)rx_ms - ts;
+    if (cmd_state.has_offset) {
+      cmd_state.min_offset_ms += (double)(rx_ms - cmd_state.last_rx_ms) / CMD_OFFSET_RELAX_DIV;
+    }
+    if (!cmd_state.has_offset || offset < cmd_state.min_offset_ms) {
+      cmd_state.min_offset_ms = offset;
+      cmd_state.has_offset = true;
+    }
+    cmd_state.last_rx_ms = rx_ms;
+    age_ms = (long)(offset - cmd_state.min_offset_ms) + queue_us / 1000;
+  }
+  if (ttl_ms > 0 && age_ms > (long)ttl_ms) {
+    mq_metrics.cmd_dropped++;
+    publishAck(seq, ts, "stale", "ttl expired", age_ms, queue_us, 0);
+    return;
+  }
+
+  CarCommand c;
+  if (!parseCommand(doc, &c)) {
+    mq_metrics.cmd_dropped++;
+    publishAck(seq, ts, "bad", "unknown command", age_ms, queue_us, 0);
+    return;
+  }
+  const char* err = cmd_handler ? cmd_handler(c) : "no handler";
+  uint32_t act_us = micros() - t_deq;
+  if (err) {
+    mq_metrics.cmd_dropped++;
+    publishAck(seq, ts, "rejected", err, age_ms, queue_us, act_us);
+    return;
+  }
+  mq_metrics.cmd_ok++;
+  publishAck(seq, ts, "ok", nullptr, age_ms, queue_us, act_us);
+}
+
+// ================= MQTT Init =================
+void mqtt_init() {
+  // Build device ID and topics
+  getDeviceId();
+  buildTopics();
+
+  Serial.print("MQTT configured for device: ");
+  Serial.println(device_id);
+  Serial.print("Telemetry topic: ");
+  Serial.println(topic_telemetry);
+  Serial.print("Event topic: ");
+  Serial.println(topic_event);
+  Serial.print("Status topic: ");
+  Serial.println(topic_status);
+
+  // Initialize telemetry timing
+  last_sample_ms = 0;
+  TelemetryPolicyConfig policy_cfg;
+  telemetry_policy_defaults(&policy_cfg);
+  policy_cfg.rate_hz = TELEMETRY_JSON_RATE_HZ;
+  telemetry_policy_init(&telemetry_policy, policy_cfg, millis());
+  memset(&telemetry_stats, 0, sizeof(telemetry_stats));
+  telemetry_stats.since_ms = millis();
+  telemetry_hr_begin();
+  spool_begin();
+
+  // TX task first, then the client (its task starts connecting right away)
+  xTaskCreatePinnedToCore(mqttTxTask, "mqtt_tx", MQTT_TX_STACK, nullptr,
+                          MQTT_TX_PRIO, &mq_tx_task, 0);
+
+  static char uri[64];
+  static char client_id[32];
+  snprintf(uri, sizeof(uri), "mqtt://%s:%d", MQTT_BROKER, MQTT_PORT);
+  snprintf(client_id, sizeof(client_id), "ESP32Car_%s", device_id);
+
+  esp_mqtt_client_config_t cfg = {};
+  cfg.uri = uri;
+  cfg.client_id = client_id;
+  if (strlen(MQTT_USER) > 0) {
+    cfg.username = MQTT_USER;
+    cfg.password = MQTT_PASS;
+  }
+  cfg.keepalive = MQTT_KEEPALIVE_S;
+  cfg.buffer_size = MQTT_BUFFER_SIZE;          // JSON telemetry and HR frames
+  cfg.reconnect_timeout_ms = MQTT_RECONNECT_MS;
+  cfg.network_timeout_ms = MQTT_NETWORK_TIMEOUT_MS;
+  mq_client = esp_mqtt_client_init(&cfg);
+  esp_mqtt_client_register_event(mq_client, (esp_mqtt_event_id_t)ESP_EVENT_ANY_ID,
+                                 mqttEventHandler, nullptr);
+  esp_mqtt_client_start(mq_client);
+
+#ifdef TELEMETRY_BENCH
+  mqtt_benchTelemetry();
+#endif
+}
+
+// ================= High-Rate Telemetry Flush =================
+// Drain the HR ring every flush interval; a flush larger than one frame is
+// split, at most TELEMETRY_HR_PARTS_PER_LOOP parts per call. Frames are
+// encoded straight into the queue slot; when the queue is full the samples
+// stay in the HR ring.
+static void flushHrTelemetry() {
+  static unsigned long last_flush_ms = 0;
+  static bool draining = false;
+  if (telemetry_hr_rate() == 0 && telemetry_hr_pending() == 0) {
+    return;
+  }
+  unsigned long now = millis();
+  if (!draining && now - last_flush_ms < telemetry_hr_flushMs()) {
+    return;
+  }
+  if (!draining) last_flush_ms = now;
+
+  bool more = false;
+  for (uint8_t part = 0; part < TELEMETRY_HR_PARTS_PER_LOOP; part++) {
+    auto* m = q_hr.reserve();
+    if (!m) {
+      mq_metrics.dropped_full[MQTT_CLASS_HR]++;
+      more = telemetry_hr_pending() > 0;
+      break;
+    }
+    size_t n = telemetry_hr_takeFrame(m->data, sizeof(m->data), &more);
+    if (n == 0) break;
+    m->len = n;
+    m->topic = TOPIC_TELEMETRY_HR;
+    m->retain = false;
+    m->t_us = micros();
+    q_hr.commit();
+    telemetry_stats.hr_frames++;
+    telemetry_stats.hr_bytes += n + strlen(topic_telemetry_hr);
+    telemetry_stats.hr_samples += ((const TelemetryHrHeader*)m->data)->count;
+    if (!more) break;
+  }
+  if (mq_tx_task) xTaskNotifyGive(mq_tx_task);
+  draining = more;
+}
+
+// ================= Spool Replay =================
+// The replay itself runs in the TX task; loop() only reports progress:
+// status every SPOOL_STATUS_MS while it runs and once when it is drained
+static void replaySpool() {
+  static bool replaying = false;
+  static unsigned long last_status_ms = 0;
+  if (spool_empty()) {
+    if (replaying) {
+      replaying = false;
+      SpoolStats sp;
+      spool_getStats(&sp);
+      LOG_I("[MQTT] Spool replay done: %u records", (unsigned)sp.replayed);
+      publishStatus("online");
+    }
+    return;
+  }
+  if (!replaying) {
+    replaying = true;
+    last_status_ms = millis();
+  }
+  unsigned long now = millis();
+  if (now - last_status_ms >= SPOOL_STATUS_MS) {
+    last_status_ms = now;
+    publishStatus("online");
+  }
+}
+
+// ================= MQTT Loop =================
+// Never blocks: connection state comes from the esp_mqtt task, publishes
+// only go into the queues
+void mqtt_loop() {
+  uint32_t gen = mq_connect_gen;
+  if (gen != mq_seen_gen) {
+    mq_seen_gen = gen;
+    if (mq_connected) {
+      onConnected();
+    }
+  }
+  if (mqtt_online && !mq_connected) {
+    mqtt_online = false;
+    telemetry_policy_setRate(&telemetry_policy, TELEMETRY_OFFLINE_RATE_HZ);
+    LOG_W("[MQTT] Connection lost, spooling telemetry");
+  }
+
+  // Messages handed over by the esp_mqtt task
+  while (MqttInbound* in = q_inbound.front()) {
+    if (in->kind == IN_CMD) {
+      handleCommand(*in);
+    } else {
+      applyFormatChoice(in->data, in->len);
+    }
+    q_inbound.pop();
+  }
+
+  if (mqtt_online) {
+    flushHrTelemetry();
+    replaySpool();
+
+    static unsigned long last_health_ms = 0;
+    unsigned long now = millis();
+    if (now - last_health_ms >= HEALTH_STATUS_MS) {
+      last_health_ms = now;
+      publishStatus("online");
+    }
+  }
+}
+
+// ================= Telemetry Sample =================
+static void readSample(TelemetrySample* s, const char* mode, const char* motion,
+                       int speed_linear, int speed_rot) {
+  s->mode = mode;
+  s->motion = motion;
+  s->speed_linear = speed_linear;
+  s->speed_rot = speed_rot;
+  s->distance_cm = do_line_getDistanceCM();
+  DoLineObstacle ob;
+  do_line_getObstacle(&ob);
+  s->obstacle = ob.level == COLL_STOP || ob.level == COLL_BLOCKED;
+  do_line_getLineSensors(&s->line[0], &s->line[1], &s->line[2], &s->line[3], &s->line[4]);
+  s->wifi_rssi = WiFi.RSSI();
+  s->uptime_ms = millis();
+  s->ts_us = 0;
+  s->sync_err_us = 0;
+}
+
+// Send timestamp, taken when the sample is queued (not when it was read:
+// the backend measures publish → ingest)
+static void stampSample(TelemetrySample* s) {
+  s->ts_us = time_sync_nowUs();
+  TimeSyncQuality q;
+  time_sync_getQuality(&q);
+  s->sync_err_us = q.err_us;
+}
+
+static size_t serializeJsonSample(const TelemetrySample& s, char* buffer, size_t cap) {
+  StaticJsonDocument<640> doc;
+  doc["device_id"] = device_id;
+  doc["mode"] = s.mode;
+  doc["motion"] = s.motion;
+  doc["speed_linear"] = s.speed_linear;
+  doc["speed_rot"] = s.speed_rot;
+  // distance_cm: luôn gửi, -1 nếu chưa có giá trị hoặc quá xa
+  doc["distance_cm"] = (s.distance_cm > 0) ? s.distance_cm : -1.0f;
+  doc["obstacle"] = s.obstacle;
+  for (int i = 0; i < 5; i++) {
+    doc["line"][i] = s.line[i];
+  }
+  doc["wifi_rssi"] = s.wifi_rssi;
+  doc["uptime_ms"] = s.uptime_ms;
+  // Heap: chỉ đi kèm, không phải lý do để gửi (xem telemetry_policy.h)
+  HeapStats hs;
+  heap_getStats(&hs);
+  doc["heap"]["free"] = hs.free_bytes;
+  doc["heap"]["largest"] = hs.largest_block;
+  doc["heap"]["min_free"] = hs.min_free_bytes;
+  // Wheel trim đang áp dụng + độ tin cậy của ước lượng (cũng chỉ đi kèm)
+  DoLineTrim tr;
+  do_line_getTrim(&tr);
+  doc["trim"]["l"] = tr.trim_l;
+  doc["trim"]["r"] = tr.trim_r;
+  doc["trim"]["conf"] = tr.confidence;
+  addTimestamp(doc);
+  return serializeJson(doc, buffer, cap);
+}
+
+// Queue one sample in the negotiated format. Returns bytes queued (0 when
+// the telemetry queue is full).
+static size_t publishSample(const TelemetrySample& sample) {
+  if (telemetry_format == TLM_BIN) {
+    TelemetrySample stamped = sample;
+    stampSample(&stamped);
+    uint8_t buf[sizeof(TelemetryBinV2)];
+    size_t n = telemetry_encode(stamped, telemetry_seq++, buf, sizeof(buf));
+    if (!enqueue(q_telemetry, MQTT_CLASS_TELEMETRY, TOPIC_TELEMETRY_BIN, buf, n)) {
+      return 0;
+    }
+    return n + strlen(topic_telemetry_bin);
+  }
+
+  char buffer[512];
+  size_t n = serializeJsonSample(sample, buffer, sizeof(buffer));
+  if (!enqueue(q_telemetry, MQTT_CLASS_TELEMETRY, TOPIC_TELEMETRY, buffer, n)) {
+    return 0;
+  }
+  return n + strlen(topic_telemetry);
+}
+
+// Offline: the sample goes to the spool as TelemetryBinV1 (smallest form,
+// the backend decodes it like car/<id>/telemetry/bin)
+static bool spoolSample(const TelemetrySample& sample) {
+  uint8_t buf[sizeof(TelemetryBinV1)];
+  size_t n = telemetry_encodeV1(sample, telemetry_seq++, buf, sizeof(buf));
+  return n > 0 && spool_append(SPOOL_TELEMETRY, buf, n, sample.uptime_ms);
+}
+
+static void logTelemetryStats(unsigned long now) {
+  unsigned long span = now - telemetry_stats.since_ms;
+  if (span < TELEMETRY_STATS_MS) {
+    return;
+  }
+  const TelemetryStats& st = telemetry_stats;
+  LOG_I("[MQTT] Telemetry %.1f msg/s, %.0f B/s (discrete %u, deadband %u, heartbeat %u, pending %u, rate-limited %u)",
+        st.msgs * 1000.0f / span, st.bytes * 1000.0f / span,
+        st.by_reason[TLM_REASON_DISCRETE], st.by_reason[TLM_REASON_DEADBAND],
+        st.by_reason[TLM_REASON_HEARTBEAT], st.by_reason[TLM_REASON_PENDING],
+        telemetry_policy.rate_limited);
+  MqttMetrics mm;
+  mqtt_getMetrics(&mm);
+  LOG_I("[MQTT] Connect %u ms (max %u, %u ok / %u failed), publish %u us avg / %u max, queued %u ms avg / %u max",
+        mm.connect_ms_last, mm.connect_ms_max, mm.connects, mm.connect_fails,
+        mm.publish_us_avg, mm.publish_us_max, mm.queue_ms_avg, mm.queue_ms_max);
+  if (st.spooled > 0) {
+    SpoolStats sp;
+    spool_getStats(&sp);
+    LOG_I("[MQTT] Spooled %u samples, spool %u records / %u B, %u dropped",
+          st.spooled, sp.depth_records, sp.depth_bytes, sp.dropped_records);
+  }
+  if (st.hr_frames > 0 || telemetry_hr_dropped() > 0) {
+    LOG_I("[MQTT] HR telemetry %.1f frames/s, %.0f B/s, %.1f samples/frame, %u dropped total",
+          st.hr_frames * 1000.0f / span, st.hr_bytes * 1000.0f / span,
+          st.hr_frames ? st.hr_samples / (float)st.hr_frames : 0.0f,
+          telemetry_hr_dropped());
+  }
+  if (mm.cmd_ok > 0 || mm.cmd_dropped > 0) {
+    LOG_I("[MQTT] Commands %u applied / %u dropped total", mm.cmd_ok, mm.cmd_dropped);
+  }
+  memset(&telemetry_stats, 0, sizeof(telemetry_stats));
+  telemetry_stats.since_ms = now;
+  telemetry_policy.rate_limited = 0;
+}
+
+// ================= Publish Telemetry (Extended with state) =================
+void mqtt_publishTelemetryWithState(const char* mode, const char* motion, 
+                                     int speed_linear, int speed_rot) {
+  unsigned long now = millis();
+  if (now - last_sample_ms < TELEMETRY_SAMPLE_MS) {
+    return;
+  }
+  last_sample_ms = now;
+  
+  TelemetrySample sample;
+  readSample(&sample, mode, motion, speed_linear, speed_rot);
+
+  TelemetryReason why = telemetry_policy_check(&telemetry_policy, sample, now);
+  if (why != TLM_REASON_NONE) {
+    size_t bytes = mqtt_online ? publishSample(sample) : 0;
+    if (bytes > 0) {
+      telemetry_policy_commit(&telemetry_policy, sample, now);
+      telemetry_stats.msgs++;
+      telemetry_stats.bytes += bytes;
+      telemetry_stats.by_reason[why]++;
+    } else if (spoolSample(sample)) {
+      telemetry_policy_commit(&telemetry_policy, sample, now);
+      telemetry_stats.spooled++;
+    }
+  }
+  logTelemetryStats(now);
+}
+
+// ================= Telemetry Encode Benchmark =================
+// Build with -DTELEMETRY_BENCH to print encode time and size of both paths
+#ifdef TELEMETRY_BENCH
+void mqtt_benchTelemetry() {
+  const int N = 1000;
+  TelemetrySample s;
+  readSample(&s, "line", "line_follow", 180, -40);
+  char json[512];
+  uint8_t bin[sizeof(TelemetryBinV2)];
+  size_t json_len = 0, bin_len = 0;
+
+  uint32_t t0 = micros();
+  for (int i = 0; i < N; i++) {
+    s.uptime_ms += 20;
+    json_len = serializeJsonSample(s, json, sizeof(json));
+  }
+  uint32_t t_json = micros() - t0;
+
+  t0 = micros();
+  for (int i = 0; i < N; i++) {
+    s.uptime_ms += 20;
+    bin_len = telemetry_encode(s, (uint16_t)i, bin, sizeof(bin));
+  }
+  uint32_t t_bin = micros() - t0;
+
+  Serial.printf("[BENCH] telemetry json: %u B/sample, %.2f us/encode\n",
+                (unsigned)json_len, t_json / (float)N);
+  Serial.printf("[BENCH] telemetry bin:  %u B/sample, %.2f us/encode\n",
+                (unsigned)bin_len, t_bin / (float)N);
+}
+#endif
+
+// ================= Publish Obstacle Event =================
+void mqtt_publishObstacleEvent(float distance_cm) {
+  StaticJsonDocument<256> doc;
+  doc["type"] = "obstacle";
+  // distance_cm: khoảng cách đến vật cản (cm)
+  doc["distance_cm"] = distance_cm;
+  doc["timestamp"] = millis();
+  addTimestamp(doc);
+  
+  char buffer[256];
+  size_t len = serializeJson(doc, buffer);
+  
+  if (!mqtt_online || !enqueue(q_event, MQTT_CLASS_EVENT, TOPIC_EVENT, buffer, len)) {
+    // Offline (or queue full): keep it for replay (timestamp = millis() above)
+    spool_append(SPOOL_EVENT, (const uint8_t*)buffer, len, doc["timestamp"].as<uint32_t>());
+    LOG_I("[MQTT] Obstacle event spooled: %.1f cm", distance_cm);
+    return;
+  }
+  
+  LOG_I("[MQTT] Obstacle event queued: %.1f cm", distance_cm);
+}
+
+// ================= Check Connection =================
+bool mqtt_isConnected() {
+  return mq_connected;
+}
+
+// ================= Metrics =================
+const char* mqtt_className(uint8_t cls) {
+  return cls < MQTT_CLASS_COUNT ? MQ_POLICY[cls].name : "?";
+}
+
+void mqtt_getMetrics(MqttMetrics* out) {
+  out->connected = mq_connected;
+  out->connects = mq_metrics.connects;
+  out->connect_fails = mq_metrics.connect_fails;
+  out->connect_ms_last = mq_metrics.connect_ms_last;
+  out->connect_ms_max = mq_metrics.connect_ms_max;
+  out->published = mq_metrics.published;
+  out->publish_fails = mq_metrics.publish_fails;
+  out->publish_us_avg = mq_metrics.publish_us_avg;
+  out->publish_us_max = mq_metrics.publish_us_max;
+  out->queue_ms_avg = mq_metrics.queue_ms_avg;
+  out->queue_ms_max = mq_metrics.queue_ms_max;
+  out->cmd_ok = mq_metrics.cmd_ok;
+  out->cmd_dropped = mq_metrics.cmd_dropped + mq_metrics.cmd_inbound_full;
+  out->depth[MQTT_CLASS_CONTROL] = q_control.size();
+  out->depth[MQTT_CLASS_EVENT] = q_event.size();
+  out->depth[MQTT_CLASS_TELEMETRY] = q_telemetry.size();
+  out->depth[MQTT_CLASS_HR] = q_hr.size();
+  SpoolStats sp;
+  spool_getStats(&sp);
+  out->depth[MQTT_CLASS_REPLAY] = sp.inflight ? 1 : 0;
+  for (int i = 0; i < MQTT_CLASS_COUNT; i++) {
+    out->dropped_full[i] = mq_metrics.dropped_full[i];
+    out->dropped_stale[i] = mq_metrics.dropped_stale[i];
+  }
+  out->dropped_stale[MQTT_CLASS_REPLAY] = sp.resent;   // gửi lại, không mất
+}
+
+#pragma GCC diagnostic pop
+
@@ -0,0 +1,143 @@
+#include "car_sched.h"
+#include <string.h>
+
+static void clearWindow(CarSched* s, uint32_t now_us) {
+  for (uint8_t i = 0; i < s->count; i++) {
+    CarSchedTask& t = s->tasks[i];
+    t.win_runs = 0;
+    t.win_run_us = 0;
+    t.win_run_max_us = 0;
+    t.win_jitter_us = 0;
+    t.win_jitter_n = 0;
+    t.win_jitter_max_us = 0;
+    t.win_late_max_us = 0;
+  }
+  s->win_start_us = now_us;
+}
+
+// ================= Setup =================
+void car_sched_init(CarSched* s, CarSchedClock clock) {
+  memset(s, 0, sizeof(*s));
+  s->clock = clock;
+}
+
+int car_sched_add(CarSched* s, const char* name, uint32_t period_us, uint32_t phase_us,
+                  uint8_t priority, CarSchedFn fn) {
+  if (s->count >= CAR_SCHED_MAX_TASKS || period_us == 0 || !fn) return -1;
+  CarSchedTask& t = s->tasks[s->count];
+  memset(&t, 0, sizeof(t));
+  t.name = name;
+  t.fn = fn;
+  t.period_us = period_us;
+  t.phase_us = phase_us;
+  t.priority = priority;
+  return s->count++;
+}
+
+void car_sched_start(CarSched* s) {
+  uint32_t now = s->clock();
+  for (uint8_t i = 0; i < s->count; i++) {
+    s->tasks[i].next_release_us = now + s->tasks[i].phase_us;
+    s->tasks[i].started = false;
+  }
+  clearWindow(s, now);
+  s->running = true;
+}
+
+// ================= Run =================
+static void runTask(CarSched* s, CarSchedTask& t, uint32_t start) {
+  uint32_t late = start - t.next_release_us;
+  if (late > t.win_late_max_us) t.win_late_max_us = late;
+  if (t.started) {
+    uint32_t interval = start - t.last_start_us;
+    uint32_t jitter = interval > t.period_us ? interval - t.period_us : t.period_us - interval;
+    t.win_jitter_us += jitter;
+    t.win_jitter_n++;
+    if (jitter > t.win_jitter_max_us) t.win_jitter_max_us = jitter;
+  }
+  t.last_start_us = start;
+  t.started = true;
+
+  t.fn();
+
+  uint32_t end = s->clock();
+  uint32_t run = end - start;
+  t.runs++;
+  t.win_runs++;
+  t.win_run_us += run;
+  if (run > t.win_run_max_us) t.win_run_max_us = run;
+  if (run > t.period_us) t.overruns++;
+
+  // Next release on the grid; releases already a full period old are lost
+  t.next_release_us += t.period_us;
+  int32_t behind = (int32_t)(end - t.next_release_us);
+  if (behind >= (int32_t)t.period_us) {
+    uint32_t skip = (uint32_t)behind / t.period_us;
+    t.missed += skip;
+    t.next_release_us += skip * t.period_us;
+  }
+}
+
+uint32_t car_sched_poll(CarSched* s) {
+  if (!s->running) return 0;
+  if (s->reset_req) {
+    s->reset_req = false;
+    clearWindow(s, s->clock());
+  }
+
+  uint32_t ran = 0;   // bit per task: once per poll, so an overrunning task cannot starve the rest forever
+  for (;;) {
+    uint32_t now = s->clock();
+    int best = -1;
+    int32_t best_late = 0;
+    for (uint8_t i = 0; i < s->count; i++) {
+      if (ran & (1u << i)) continue;
+      const CarSchedTask& t = s->tasks[i];
+      int32_t late = (int32_t)(now - t.next_release_us);
+      if (late < 0) continue;
+      if (best < 0 || t.priority < s->tasks[best].priority ||
+          (t.priority == s->tasks[best].priority && late > best_late)) {
+        best = i;
+        best_late = late;
+      }
+    }
+    if (best < 0) break;
+    ran |= 1u << best;
+    runTask(s, s->tasks[best], now);
+  }
+
+  uint32_t now = s->clock();
+  uint32_t wait = UINT32_MAX;
+  for (uint8_t i = 0; i < s->count; i++) {
+    int32_t until = (int32_t)(s->tasks[i].next_release_us - now);
+    if (until <= 0) return 0;
+    if ((uint32_t)until < wait) wait = until;
+  }
+  return s->count ? wait : 0;
+}
+
+// ================= Stats =================
+bool car_sched_getStats(const CarSched* s, uint8_t id, CarSchedStats* out) {
+  if (id >= s->count) return false;
+  const CarSchedTask& t = s->tasks[id];
+  uint32_t span = s->clock() - s->win_start_us;
+  uint32_t n = t.win_runs;
+  out->name = t.name;
+  out->period_us = t.period_us;
+  out->priority = t.priority;
+  out->runs = t.runs;
+  out->overruns = t.overruns;
+  out->missed = t.missed;
+  out->rate_hz = span ? n * 1e6f / span : 0.0f;
+  out->run_us_avg = n ? (uint32_t)(t.win_run_us / n) : 0;
+  out->run_us_max = t.win_run_max_us;
+  out->jitter_us_avg = t.win_jitter_n ? (uint32_t)(t.win_jitter_us / t.win_jitter_n) : 0;
+  out->jitter_us_max = t.win_jitter_max_us;
+  out->late_us_max = t.win_late_max_us;
+  out->load_pct = span ? (uint32_t)(t.win_run_us * 100 / span) : 0;
+  return true;
+}
+
+void car_sched_resetWindow(CarSched* s) {
+  s->reset_req = true;
+}
@@ -0,0 +1,191 @@
+#include "collision.h"
+#include <math.h>
+#include <string.h>
+
+// ================= Config =================
+const float COLL_V_REST = 0.03f;        // dưới mức này coi như đứng yên
+const float COLL_V_EVENT = 0.10f;       // bò chậm tới standoff: không tính là một lần phanh
+const float COLL_V_HARD_MARGIN = 0.10f; // sai số vận tốc đo + trễ bám khi đang giảm tốc
+const float COLL_V_OBS_MAX = 1.0f;      // vật cản nhanh hơn → nhiễu
+const float COLL_BLOCK_HYST_M = 0.03f;  // rời BLOCKED khi xa thêm chừng này
+
+void collision_defaults(CollisionConfig* cfg) {
+  cfg->standoff_m = 0.15f;     // = OBSTACLE_TH_CM cũ
+  cfg->t_react_s = 0.10f;      // echo 60 ms + PID 10 ms + động cơ ~30 ms
+  cfg->a_soft = 1.0f;          // PID bám được khi giảm tốc
+  cfg->a_hard_ratio = 2.0f;
+  cfg->v_max = 0.8f;           // = V_MAX của line-follow / DRIVE_V_MAX
+  cfg->range_max_m = 1.5f;
+  cfg->alpha = 0.5f;
+  cfg->beta = 0.2f;
+  cfg->gate_m = 0.25f;
+  cfg->miss_max = 3;
+}
+
+void collision_init(CollisionGuard* g, const CollisionConfig& cfg) {
+  memset(g, 0, sizeof(*g));
+  g->cfg = cfg;
+  g->level = COLL_CLEAR;
+  g->v_allow = cfg.v_max;
+  g->ttc_s = -1.0f;
+}
+
+void collision_reset(CollisionGuard* g) {
+  CollisionStats st = g->stats;
+  collision_init(g, g->cfg);
+  g->stats = st;
+}
+
+// Tốc độ tiếp cận lớn nhất còn dừng kịp trong d_free với gia tốc a:
+//   c · t + c² / (2a) = d  →  c = −a t + sqrt((a t)² + 2 a d)
+static float closingAllowed(float d_free, float a, float t_react) {
+  if (d_free <= 0.0f) return 0.0f;
+  float at = a * t_react;
+  return -at + sqrtf(at * at + 2.0f * a * d_free);
+}
+
+static void trackUpdate(CollisionGuard* g, float dt_s, float ds_m, bool has_meas, float meas_m) {
+  const CollisionConfig& c = g->cfg;
+  if (g->track) {
+    g->d_m -= ds_m + g->v_obs * dt_s;
+    g->since_meas_s += dt_s;
+  }
+  if (!has_meas) return;
+
+  if (meas_m < 0.0f) {
+    // Không có echo: giữ dự đoán theo encoder, mất hẳn sau miss_max lần
+    if (++g->misses >= c.miss_max) g->track = false;
+    return;
+  }
+  g->misses = 0;
+  if (meas_m > c.range_max_m) {
+    g->track = false;
+    return;
+  }
+  if (!g->track) {
+    g->track = true;
+    g->d_m = meas_m;
+    g->v_obs = 0.0f;
+    g->since_meas_s = 0.0f;
+    g->outliers = 0;
+    return;
+  }
+  float r = meas_m - g->d_m;
+  if (fabsf(r) > c.gate_m) {
+    // Một echo lạc thì bỏ; hai lần liên tiếp → vật cản khác, bắt đầu lại
+    if (++g->outliers >= 2) {
+      g->d_m = meas_m;
+      g->v_obs = 0.0f;
+      g->since_meas_s = 0.0f;
+      g->outliers = 0;
+    }
+    return;
+  }
+  g->outliers = 0;
+  g->d_m += c.alpha * r;
+  if (g->since_meas_s > 0.0f) {
+    // Gần hơn dự đoán (r < 0) → vật cản đang tiến lại
+    g->v_obs -= c.beta * r / g->since_meas_s;
+    g->v_obs = fminf(fmaxf(g->v_obs, -COLL_V_OBS_MAX), COLL_V_OBS_MAX);
+  }
+  g->since_meas_s = 0.0f;
+}
+
+static void eventUpdate(CollisionGuard* g) {
+  if (!g->braking) {
+    // Giới hạn thực sự cắt vào tốc độ đang chạy → bắt đầu một lần phanh
+    bool limiting = g->level == COLL_STOP || (g->level == COLL_SLOW && g->v_car > g->v_allow + 0.02f);
+    if (!limiting || g->v_car <= COLL_V_EVENT) return;
+    g->braking = true;
+    g->decel_seen = false;
+    g->t_detect_s = g->t_s;
+    g->s_detect_m = g->s_m;
+    memset(&g->ev, 0, sizeof(g->ev));
+    g->ev.v0_mps = g->v_car;
+    g->ev.ttc_s = g->ttc_s;
+  }
+  if (g->level == COLL_CLEAR) {
+    g->braking = false;   // vật cản đi mất trước khi dừng: không tính
+    return;
+  }
+  if (g->level == COLL_STOP) g->ev.hard = true;
+  float dv = fmaxf(0.05f, 0.1f * g->ev.v0_mps);
+  if (!g->decel_seen && g->v_car < g->ev.v0_mps - dv) {
+    g->decel_seen = true;
+    g->ev.reaction_s = g->t_s - g->t_detect_s;
+  }
+  if (g->v_car > COLL_V_REST) return;
+
+  g->braking = false;
+  g->ev.stop_s = g->t_s - g->t_detect_s;
+  g->ev.stop_dist_m = g->s_m - g->s_detect_m;
+  g->ev.clearance_m = g->track ? g->d_m : -1.0f;
+  if (!g->decel_seen) g->ev.reaction_s = g->ev.stop_s;
+  CollisionStats& st = g->stats;
+  st.events++;
+  if (g->ev.hard) st.hard_stops++;
+  st.reaction_max_s = fmaxf(st.reaction_max_s, g->ev.reaction_s);
+  st.stop_dist_max_m = fmaxf(st.stop_dist_max_m, g->ev.stop_dist_m);
+  if (g->ev.clearance_m >= 0.0f && (st.events == 1 || g->ev.clearance_m < st.clearance_min_m)) {
+    st.clearance_min_m = g->ev.clearance_m;
+  }
+  st.last = g->ev;
+  g->event_done = true;
+}
+
+CollisionLevel collision_step(CollisionGuard* g, float dt_s, float ds_m, bool has_meas, float meas_m) {
+  const CollisionConfig& c = g->cfg;
+  g->event_done = false;
+  if (dt_s <= 0.0f) return g->level;
+  g->t_s += dt_s;
+  g->s_m += ds_m;
+  g->ds_win[g->win_i] = ds_m;
+  g->dt_win[g->win_i] = dt_s;
+  g->win_i = (g->win_i + 1) % COLLISION_VEL_WIN;
+  float s_win = 0.0f, t_win = 0.0f;
+  for (int i = 0; i < COLLISION_VEL_WIN; i++) {
+    s_win += g->ds_win[i];
+    t_win += g->dt_win[i];
+  }
+  g->v_car = s_win / t_win;
+  trackUpdate(g, dt_s, ds_m, has_meas, meas_m);
+
+  if (!g->track) {
+    g->level = COLL_CLEAR;
+    g->v_allow = c.v_max;
+    g->ttc_s = -1.0f;
+    g->d_stop_m = 0.0f;
+    g->hard = false;
+    eventUpdate(g);
+    return g->level;
+  }
+
+  float closing = g->v_car + g->v_obs;
+  float d_free = g->d_m - c.standoff_m;
+  float v_allow = closingAllowed(d_free, c.a_soft, c.t_react_s) - g->v_obs;
+  g->v_allow = fminf(fmaxf(v_allow, 0.0f), c.v_max);
+  g->d_stop_m = closing > 0.0f ? closing * c.t_react_s + closing * closing / (2.0f * c.a_soft) : 0.0f;
+  g->ttc_s = closing > 0.01f ? fmaxf(d_free, 0.0f) / closing : -1.0f;
+
+  // Phanh cứng chỉ để giữ được nửa standoff: nửa còn lại là khoảng đệm cho
+  // trễ bám của PID khi đang giảm tốc theo a_soft
+  bool moving = g->v_car > COLL_V_REST;
+  float d_hard = g->d_m - 0.5f * c.standoff_m;
+  float c_hard = closingAllowed(d_hard, c.a_soft * c.a_hard_ratio, c.t_react_s);
+  if (!moving) g->hard = false;
+  else if (closing > c_hard + COLL_V_HARD_MARGIN) g->hard = true;
+
+  if (g->hard) {
+    g->level = COLL_STOP;
+  } else if (d_free <= 0.0f || (g->level == COLL_BLOCKED && d_free <= COLL_BLOCK_HYST_M)) {
+    g->level = COLL_BLOCKED;
+    g->v_allow = 0.0f;
+  } else if (g->v_allow < c.v_max) {
+    g->level = COLL_SLOW;
+  } else {
+    g->level = COLL_CLEAR;
+  }
+  if (g->level == COLL_STOP) g->v_allow = 0.0f;
+  eventUpdate(g);
+  return g->level;
+}
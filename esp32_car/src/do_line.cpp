@@ -1,5 +1,15 @@
 #include <Arduino.h>
 #include "do_line.h"
+#include "line_vision_rx.h"
+#include "chassis.h"
+#include "track_map.h"
+#include "motion_profile.h"
+#include "wheel_trim.h"
+#include "collision.h"
+#include "line_recovery.h"
+#include "safety.h"
+#include "car_log.h"
+#include <Preferences.h>
 
 /* ================= ESP32 30P + L298N + analogWrite =================
 Mapping:
@@ -29,42 +39,38 @@ Mapping:
 // ================= Encoders =================
 #define ENC_L 26
 #define ENC_R 22
-#define PULSES_PER_REV 20
-#define PPR_EFFECTIVE (PULSES_PER_REV * 2) // đếm CHANGE → 2 sườn
+// PPR, bán kính bánh, bề rộng xe: chassis.h
 // Lọc nhiễu xung trong ISR: bỏ xung < MIN_EDGE_US
 #define MIN_EDGE_US 300
 
 // ================= HC-SR04 =================
 #define TRIG_PIN 21
 #define ECHO_PIN 19
-const float OBSTACLE_TH_CM = 15.0f; // cm
 const unsigned long US_TIMEOUT = 30000; // 30 ms (~5m)
 
 // ==== Biến cho SR04 non-blocking ====
 enum USState { US_IDLE, US_WAIT_HIGH, US_WAIT_LOW };
 USState us_state = US_IDLE;
 unsigned long us_last_ms = 0; // lần cuối bắn trigger
-const unsigned long US_PERIOD_MS = 250; // chu kỳ đo ~250ms
+const unsigned long US_PERIOD_MS = 60; // chu kỳ đo (HC-SR04 cần ≥ 60 ms để echo cũ tắt)
 unsigned long us_wait_start_us = 0; // bắt đầu chờ ECHO HIGH
 unsigned long echo_start_us = 0; // thời điểm ECHO HIGH
 float ultrasonic_distance_cm = -1.0f; // kết quả đo gần nhất
-bool ultrasonic_new = false; // true khi có mẫu mới
-
-// ================= Thông số cơ khí =================
-const float WHEEL_RADIUS_M = 0.0325f;
-const float CIRC = 2.0f * 3.1415926f * WHEEL_RADIUS_M; // m/vòng
-const float TRACK_WIDTH_M = 0.0950f;
+static volatile uint32_t us_seq = 0; // +1 mỗi lần đo xong (kể cả không có echo)
 
 // ================= Tham số điều khiển =================
 float v_base = 0.5f; // m/s cơ sở cho line-follow
-const unsigned long CTRL_DT_MS = 10; // chu kỳ PID
-// Bù lệch 2 bánh (tune giống code PID đi thẳng)
-const float L_SCALE = 1.00f; // nếu xe lệch trái → tăng L_SCALE
-const float R_SCALE = 1.00f;
+const unsigned long CTRL_DT_MS = CarChassis::CTRL_DT_MS; // chu kỳ PID
 // Lái bằng PWM (thêm/bớt sau PID)
 const int STEER_PWM_SOFT = 4; // lệch nhẹ
 const int STEER_PWM_HARD = 7; // lệch mạnh
 
+// ================= Look-ahead từ camera =================
+// Camera thấy line xa hơn 5 cảm biến TCRT → giảm tốc trước khi vào cua
+const float V_CURVE_MIN = 0.30f; // m/s khi phía trước là cua gắt
+const int CURVE_FULL_CDEG = 3000; // lệch >= 30° ở band xa → V_CURVE_MIN
+const uint32_t VISION_MAX_AGE_MS = 150; // dữ liệu cũ hơn → bỏ qua
+
 // ================= PID cho từng bánh =================
 struct PID {
   float Kp, Ki, Kd;
@@ -74,6 +80,10 @@ struct PID {
 };
 PID pidL{250.0f, 0.0f, 0.0f, 0, 0, 0, 255};
 PID pidR{250.0f, 0.0f, 0.0f, 0, 0, 0, 255};
+// Manual drive: feedforward lo phần lớn PWM, PID chỉ sửa sai lệch → có I
+// để bù lệch động cơ / pin yếu (i_term giới hạn ±100 PWM)
+PID pidDriveL{120.0f, 600.0f, 0.0f, 0, 0, -100, 100};
+PID pidDriveR{120.0f, 600.0f, 0.0f, 0, 0, -100, 100};
 
 // ================= Biến encoder =================
 volatile long encL_count = 0;
@@ -89,6 +99,23 @@ const int PWM_SLEW = 50; // bước tối đa mỗi chu kỳ
 static int pwmL_prev = 0;
 static int pwmR_prev = 0;
 
+// PWM thực tế đã ghi ra (có dấu), cho telemetry
+static volatile int g_pwm_l = 0;
+static volatile int g_pwm_r = 0;
+
+// ================= Safety gate =================
+// Supervisor task (safety.h) đóng gate, mọi hàm ghi motor hỏi trước khi ghi
+static Safety safety;
+static portMUX_TYPE safetyMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Control task còn sống: do_line_loop / driveLoop / mỗi chu kỳ motion_run
+static void wd_kick(){
+  uint32_t now = micros();
+  portENTER_CRITICAL(&safetyMux);
+  safety_heartbeat(&safety, now);
+  portEXIT_CRITICAL(&safetyMux);
+}
+
 // Lưu hướng lần cuối thấy line
 enum Side { NONE, LEFT, RIGHT };
 Side last_seen = NONE;
@@ -96,13 +123,26 @@ Side last_seen = NONE;
 bool seen_line_ever = false;
 
 // ================= Recovery =================
+// Mất line: tìm lại theo odometry từ chỗ thấy line lần cuối (line_recovery.h)
 bool recovering = false;
-unsigned long rec_t0 = 0;
-const unsigned long RECOV_TIME_MS = 2000; // 2 s
+static LineRecovery recov;                      // chỉ control task ghi
+static portMUX_TYPE recovMux = portMUX_INITIALIZER_UNLOCKED;
 
 // ================= Cờ enable =================
 static volatile bool g_line_enabled = true;
 
+// ================= Track map (học vòng / fast lap) =================
+// Chỉ control task ghi track_map (lúc học xong); HTTP đọc bản sao qua trackMux
+static TrackMap track_map;
+static TrackLearner track_learner;
+static TrackFollower track_follower;
+static TrackProfileConfig track_cfg;
+static portMUX_TYPE trackMux = portMUX_INITIALIZER_UNLOCKED;
+static DoLineLapMode lap_mode = LAP_NORMAL;
+static volatile int8_t lap_mode_req = -1;       // -1: không có yêu cầu
+static uint8_t lap_cue = TRACK_CUE_LINE;        // cue giữ tới chu kỳ PID kế tiếp
+static float track_v = 0.0f;                    // tốc độ theo map (m/s)
+
 // ================= Utils =================
 inline int clamp255(int v){
   if (v < 0) return 0;
@@ -138,19 +178,13 @@ static inline int shape_pwm(int target, int prev){
   return clamp255(s);
 }
 
-// Đổi ticks → vận tốc m/s
-float ticksToVel(long ticks, float dt_s){
-  float rev = (float)ticks / (float)PPR_EFFECTIVE;
-  return (rev * CIRC) / dt_s;
-}
-
-// 1 bước PID
-int pidStep(PID &pid, float v_target, float v_meas, float dt_s){
+// 1 bước PID (ff: feedforward cộng thẳng vào PWM)
+int pidStep(PID &pid, float v_target, float v_meas, float dt_s, float ff = 0.0f){
   float err = v_target - v_meas;
   pid.i_term += pid.Ki * err * dt_s;
   pid.i_term = clampf(pid.i_term, pid.out_min, pid.out_max);
   float d = (err - pid.prev_err) / dt_s;
-  float u = pid.Kp * err + pid.i_term + pid.Kd * d;
+  float u = ff + pid.Kp * err + pid.i_term + pid.Kd * d;
   pid.prev_err = err;
   return clamp255((int)u);
 }
@@ -175,32 +209,60 @@ void IRAM_ATTR encR_isr(){
 }
 
 /* ================= Motor control ================= */
-// Left motor: IN1/IN2 = chiều, ENA = PWM
-void driveWheelLeft(float v_cmd, int pwm){
-  int d = clamp255(abs(pwm));
-  if (v_cmd >= 0) {
+static bool safety_gate(int pwmL, int pwmR){
+  portENTER_CRITICAL(&safetyMux);
+  bool ok = safety_allows(&safety, pwmL, pwmR);
+  portEXIT_CRITICAL(&safetyMux);
+  return ok;
+}
+
+// Mọi lệnh PWM (có dấu, + = tiến) ra L298N đi qua đây.
+// Left: IN1/IN2 = chiều, ENA = PWM; Right: IN3/IN4, ENB.
+// Gate đóng → dừng motor, trả về false.
+static bool motorWriteLR_signed(int pwmL, int pwmR){
+  pwmL = pwmL < -255 ? -255 : (pwmL > 255 ? 255 : pwmL);
+  pwmR = pwmR < -255 ? -255 : (pwmR > 255 ? 255 : pwmR);
+  if (!safety_gate(pwmL, pwmR)) {
+    motorsStop();
+    return false;
+  }
+  g_pwm_l = pwmL;
+  g_pwm_r = pwmR;
+  
+  // Right
+  if (pwmR >= 0){
+    digitalWrite(IN3, HIGH);
+    digitalWrite(IN4, LOW);
+    analogWrite(ENB, pwmR);
+  } else {
+    digitalWrite(IN3, LOW);
+    digitalWrite(IN4, HIGH);
+    analogWrite(ENB, -pwmR);
+  }
+  
+  // Left
+  if (pwmL >= 0){
     digitalWrite(IN1, HIGH);
     digitalWrite(IN2, LOW);
-    analogWrite(ENA, d);
+    analogWrite(ENA, pwmL);
   } else {
     digitalWrite(IN1, LOW);
     digitalWrite(IN2, HIGH);
-    analogWrite(ENA, d);
+    analogWrite(ENA, -pwmL);
   }
+  
+  // Supervisor (ưu tiên cao hơn) có thể vừa dừng motor giữa lúc đang ghi
+  if (!safety_gate(pwmL, pwmR)) {
+    motorsStop();
+    return false;
+  }
+  return true;
 }
 
-// Right motor: IN3/IN4 = chiều, ENB = PWM
-void driveWheelRight(float v_cmd, int pwm){
+// PWM có dấu theo chiều của vận tốc lệnh
+static inline int signed_pwm(float v_cmd, int pwm){
   int d = clamp255(abs(pwm));
-  if (v_cmd >= 0) {
-    digitalWrite(IN3, HIGH);
-    digitalWrite(IN4, LOW);
-    analogWrite(ENB, d);
-  } else {
-    digitalWrite(IN3, LOW);
-    digitalWrite(IN4, HIGH);
-    analogWrite(ENB, d);
-  }
+  return v_cmd >= 0 ? d : -d;
 }
 
 void motorsStop(){
@@ -210,10 +272,12 @@ void motorsStop(){
   digitalWrite(IN4, HIGH);
   analogWrite(ENA, 0);
   analogWrite(ENB, 0);
+  g_pwm_l = 0;
+  g_pwm_r = 0;
 }
 
 /* ================= HC-SR04 NON-BLOCKING ================= */
-// cập nhật state machine HC-SR04, không chặn
+// cập nhật state machine HC-SR04, không chặn (chỉ safety supervisor task gọi)
 static void ultrasonic_update() {
   unsigned long now_ms = millis();
   unsigned long now_us = micros();
@@ -223,7 +287,6 @@ static void ultrasonic_update() {
       // tới chu kỳ thì bắn trigger
       if (now_ms - us_last_ms >= US_PERIOD_MS) {
         us_last_ms = now_ms;
-        ultrasonic_new = false;
         // Trigger 10 µs
         digitalWrite(TRIG_PIN, LOW);
         delayMicroseconds(2);
@@ -243,7 +306,7 @@ static void ultrasonic_update() {
       } else if (now_us - us_wait_start_us > US_TIMEOUT) {
         // không thấy cạnh lên
         ultrasonic_distance_cm = -1.0f;
-        ultrasonic_new = true;
+        us_seq++;
         us_state = US_IDLE;
       }
       break;
@@ -256,247 +319,409 @@ static void ultrasonic_update() {
         } else {
           ultrasonic_distance_cm = -1.0f;
         }
-        ultrasonic_new = true;
+        us_seq++;
         us_state = US_IDLE;
       } else if (now_us - echo_start_us > US_TIMEOUT) {
         // echo quá dài / lỗi
         ultrasonic_distance_cm = -1.0f;
-        ultrasonic_new = true;
+        us_seq++;
         us_state = US_IDLE;
       }
       break;
   }
 }
 
-// API: trả về giá trị mới nếu có, ngược lại trả -1
-float readDistanceCM_nonblock() {
-  ultrasonic_update();
-  if (ultrasonic_new) {
-    ultrasonic_new = false;
-    return ultrasonic_distance_cm;
+/* ================= Collision guard (TTC) ================= */
+// Khoảng cách từ HC-SR04 + quãng đường encoder → giới hạn tốc độ tiến,
+// phanh cứng khi không còn kịp (collision.h). Chỉ control task gọi step.
+static CollisionGuard coll;
+static uint32_t coll_seq = 0;                    // us_seq đã đưa vào guard
+static portMUX_TYPE collMux = portMUX_INITIALIZER_UNLOCKED;
+
+static CollisionLevel coll_step(float dt_s, float ds_m){
+  uint32_t seq = us_seq;
+  float d_cm = ultrasonic_distance_cm;
+  bool has = seq != coll_seq;
+  coll_seq = seq;
+  portENTER_CRITICAL(&collMux);
+  CollisionLevel lv = collision_step(&coll, dt_s, ds_m, has, d_cm > 0 ? d_cm / 100.0f : -1.0f);
+  portEXIT_CRITICAL(&collMux);
+  if (coll.event_done) {
+    const CollisionEvent& e = coll.stats.last;
+    LOG_I("[TTC] %s stop from %.2f m/s: ttc %.2f s, reaction %.0f ms, %.0f ms / %.1f cm to rest, clearance %.1f cm",
+          e.hard ? "hard" : "soft", e.v0_mps, e.ttc_s, e.reaction_s * 1000.0f, e.stop_s * 1000.0f,
+          e.stop_dist_m * 100.0f, e.clearance_m * 100.0f);
   }
-  return -1.0f;
+  return lv;
 }
 
-/* ================= Hình học encoder / quay / tiến ================= */
-long countsForDistance(double dist_m){
-  double rot = dist_m / CIRC;
-  return (long)(rot * PPR_EFFECTIVE + 0.5);
+// Sau khi né / dừng hẳn: xe đã quay hướng khác, bỏ track cũ
+static void coll_reset(){
+  portENTER_CRITICAL(&collMux);
+  collision_reset(&coll);
+  portEXIT_CRITICAL(&collMux);
 }
 
-// SỐ XUNG CẦN CHO MỖI BÁNH KHI QUAY "deg" ĐỘ
-long countsForSpinDeg(double deg){
-  double theta = deg * 3.141592653589793 / 180.0; // rad
-  double arc = (TRACK_WIDTH_M * 0.5) * theta; // quãng đường mỗi bánh
-  double rot = arc / CIRC; // số vòng bánh
-  return (long)(rot * PPR_EFFECTIVE + 0.5); // đổi sang xung
+/* ================= Look-ahead speed planning ================= */
+// Tốc độ cơ sở theo độ cong phía trước (band xa của camera).
+// Không có dữ liệu camera → giữ v_base như trước.
+static float plan_speed(float base){
+  VisionLookahead la;
+  if (!vision_rx_get(&la, VISION_MAX_AGE_MS)) return base;
+
+  int worst = 0;
+  for (int i = 1; i < la.n_bands; i++){
+    const VisionBand &b = la.band[i];
+    if (!(b.flags & LINE_FOUND)) continue;
+    int h = abs(b.heading_cdeg);
+    if (h > worst) worst = h;
+  }
+  // v_base < V_CURVE_MIN: không bao giờ tăng tốc vào cua
+  float vmin = fminf(base, V_CURVE_MIN);
+  float k = (float)worst / (float)CURVE_FULL_CDEG;
+  return base - (base - vmin) * fminf(k, 1.0f);
 }
 
-inline void motorWriteLR_signed(int pwmL, int pwmR){
-  pwmL = pwmL < -255 ? -255 : (pwmL > 255 ? 255 : pwmL);
-  pwmR = pwmR < -255 ? -255 : (pwmR > 255 ? 255 : pwmR);
-  
-  // Right
-  if (pwmR >= 0){
-    digitalWrite(IN3, HIGH);
-    digitalWrite(IN4, LOW);
-    analogWrite(ENB, pwmR);
-  } else {
-    digitalWrite(IN3, LOW);
-    digitalWrite(IN4, HIGH);
-    analogWrite(ENB, -pwmR);
+/* ================= Track map: NVS + lap mode ================= */
+static void track_load(){
+  TrackMap m;
+  Preferences prefs;
+  size_t n = 0;
+  if (prefs.begin("track", true)) {
+    n = prefs.getBytes("map", &m, sizeof(m));
+    prefs.end();
   }
-  
-  // Left
-  if (pwmL >= 0){
-    digitalWrite(IN1, HIGH);
-    digitalWrite(IN2, LOW);
-    analogWrite(ENA, pwmL);
-  } else {
-    digitalWrite(IN1, LOW);
-    digitalWrite(IN2, HIGH);
-    analogWrite(ENA, -pwmL);
+  if (n != sizeof(m) || !track_map_valid(&m)) return;
+  track_map_profile(&m, track_cfg);   // cấu hình tốc độ có thể đã đổi từ lúc học
+  portENTER_CRITICAL(&trackMux);
+  track_map = m;
+  portEXIT_CRITICAL(&trackMux);
+  LOG_I("[TRACK] map loaded: %u segments, lap %u mm", (unsigned)m.count, (unsigned)m.lap_mm);
+}
+
+// Kết thúc học: dựng map, lưu NVS (ghi flash ~vài ms, một lần mỗi vòng học)
+static void track_learn_done(){
+  TrackMap m;
+  if (!track_learn_finish(&track_learner, track_cfg, &m)) {
+    LOG_W("[TRACK] learning failed (%s)", track_learner.overflow ? "too many segments" : "lap too short");
+    return;
   }
+  portENTER_CRITICAL(&trackMux);
+  track_map = m;
+  portEXIT_CRITICAL(&trackMux);
+  Preferences prefs;
+  if (prefs.begin("track", false)) {
+    prefs.putBytes("map", &m, sizeof(m));
+    prefs.end();
+  }
+  LOG_I("[TRACK] map learned (%s): %u segments, lap %u mm", track_learner.closed ? "closed" : "stopped",
+        (unsigned)m.count, (unsigned)m.lap_mm);
 }
 
-static inline double theta_from_counts(long dL, long dR, int signL, int signR){
-  double sL = (double)dL / PPR_EFFECTIVE * CIRC * signL;
-  double sR = (double)dR / PPR_EFFECTIVE * CIRC * signR;
-  return (sR - sL) / TRACK_WIDTH_M;
+static void apply_lap_request(){
+  int8_t req = lap_mode_req;
+  if (req < 0) return;
+  lap_mode_req = -1;
+  if (lap_mode == LAP_LEARN && req != LAP_LEARN) track_learn_done();
+  switch (req) {
+    case LAP_LEARN:
+      track_learn_begin(&track_learner);
+      break;
+    case LAP_FAST:
+      if (!track_map_valid(&track_map)) {
+        req = LAP_NORMAL;
+        break;
+      }
+      track_follow_begin(&track_follower, &track_map, track_cfg);
+      track_v = track_cfg.v_min;
+      break;
+    default:
+      break;
+  }
+  lap_mode = (DoLineLapMode)req;
+  lap_cue = TRACK_CUE_LINE;
 }
 
-void spin_left_deg(double deg, int pwmAbs){
-  long target = countsForSpinDeg(deg);
-  long L0, R0;
-  noInterrupts();
-  L0 = encL_total;
-  R0 = encR_total;
-  interrupts();
-  
-  const unsigned long T_FAIL_MS = 4000; // watchdog 4s
-  unsigned long t0 = millis();
-  
-  while (true){
-    long L, R;
-    noInterrupts();
-    L = encL_total;
-    R = encR_total;
-    interrupts();
-    
-    long dL = labs(L - L0);
-    long dR = labs(R - R0);
-    
-    // đủ xung cho cả hai bánh → dừng
-    if (dL >= target && dR >= target) break;
-    
-    // an toàn: quá thời gian thì dừng, tránh quay mãi
-    if (millis() - t0 > T_FAIL_MS) break;
-    
-    // quay trái: bánh trái lùi, bánh phải tiến
-    motorWriteLR_signed(-pwmAbs, +pwmAbs);
-    delay(1);
+// Né vật cản lệch khỏi line → odometry không còn khớp map
+static void lap_abort(const char* why){
+  if (lap_mode == LAP_NORMAL) return;
+  LOG_W("[TRACK] %s aborted: %s", lap_mode == LAP_LEARN ? "learning" : "fast lap", why);
+  lap_mode = LAP_NORMAL;
+}
+
+/* ================= Wheel trim (học từ encoder, NVS "trim") ================= */
+// Bù lệch 2 động cơ: wheel_trim.h ước lượng m/s mỗi PWM của từng bánh khi
+// xe chạy thẳng đều; trim nhân vào phần PWM trên deadband ở mọi chế độ
+// (line, lái tay, motion). Chưa học được gì → CarChassis::L_SCALE / R_SCALE.
+const float TRIM_LAMBDA = 0.997f;               // ~330 mẫu ≈ 66 s chạy thẳng
+const uint32_t TRIM_WINDOW_MS = 200;            // gộp mẫu: 1 tick / 10 ms quá thô
+const float TRIM_APPLY_CONF = 0.5f;             // dưới mức này giữ trim cũ
+const float TRIM_SAVE_DELTA = 0.01f;            // chỉ ghi NVS khi trim đổi > 1%
+const unsigned long TRIM_SAVE_MIN_MS = 60000;   // hạn chế ghi flash
+const int TRIM_CAL_PWM = 150;                   // chạy thử: cùng PWM 2 bánh
+const unsigned long TRIM_CAL_SPINUP_MS = 400;
+const unsigned long TRIM_CAL_RUN_MS = 2500;     // ~1.2 m đường thẳng
+
+static WheelTrim wheel_trim;                    // chỉ control task ghi
+static float trim_l = CarChassis::L_SCALE;      // đang áp dụng
+static float trim_r = CarChassis::R_SCALE;
+static float trim_saved_l = CarChassis::L_SCALE, trim_saved_r = CarChassis::R_SCALE;
+static unsigned long trim_saved_ms = 0;
+static portMUX_TYPE trimMux = portMUX_INITIALIZER_UNLOCKED;
+// Cửa sổ gộp mẫu: Σ |pwm| · ms và ticks
+static uint32_t trim_win_ms = 0;
+static float trim_win_pwm_l = 0.0f, trim_win_pwm_r = 0.0f;
+static long trim_win_ticks_l = 0, trim_win_ticks_r = 0;
+// Chạy calibrate (lái tay, trong do_line_driveLoop)
+enum TrimCalPhase : uint8_t { TRIM_CAL_IDLE, TRIM_CAL_SPINUP, TRIM_CAL_RUN };
+static volatile bool trim_cal_req = false;      // bật bởi API, tắt khi stop / lệnh lái mới
+static TrimCalPhase trim_cal_phase = TRIM_CAL_IDLE;
+static unsigned long trim_cal_t0 = 0;
+
+// PWM có dấu sau trim (chỉ control task)
+static inline int trim_pwm(int pwm, float trim){
+  float a = wheel_trim_apply((float)abs(pwm), trim, wheel_trim.pwm_static);
+  int d = clamp255((int)(a + 0.5f));
+  return pwm < 0 ? -d : d;
+}
+
+static void trim_save(){
+  Preferences prefs;
+  if (prefs.begin("trim", false)) {
+    prefs.putFloat("l", trim_l);
+    prefs.putFloat("r", trim_r);
+    prefs.end();
   }
-  motorsStop();
+  trim_saved_l = trim_l;
+  trim_saved_r = trim_r;
+  trim_saved_ms = millis();
 }
 
-void spin_right_deg(double deg, int pwmAbs){
-  long target = countsForSpinDeg(deg);
-  long L0, R0;
-  noInterrupts();
-  L0 = encL_total;
-  R0 = encR_total;
-  interrupts();
-  
-  const unsigned long T_FAIL_MS = 4000; // watchdog 4s
-  unsigned long t0 = millis();
-  
-  while (true){
-    long L, R;
-    noInterrupts();
-    L = encL_total;
-    R = encR_total;
-    interrupts();
-    
-    long dL = labs(L - L0);
-    long dR = labs(R - R0);
-    
-    if (dL >= target && dR >= target) break;
-    if (millis() - t0 > T_FAIL_MS) break;
-    
-    // quay phải: bánh trái tiến, bánh phải lùi
-    motorWriteLR_signed(+pwmAbs, -pwmAbs);
-    delay(1);
+static void trim_load(float pwm_static){
+  float l = CarChassis::L_SCALE, r = CarChassis::R_SCALE;
+  Preferences prefs;
+  if (prefs.begin("trim", true)) {
+    l = prefs.getFloat("l", l);
+    r = prefs.getFloat("r", r);
+    prefs.end();
   }
-  motorsStop();
+  if (!(l > 0.5f && l < 1.5f && r > 0.5f && r < 1.5f)) {
+    l = CarChassis::L_SCALE;
+    r = CarChassis::R_SCALE;
+  }
+  portENTER_CRITICAL(&trimMux);
+  wheel_trim_init(&wheel_trim, pwm_static, TRIM_LAMBDA, l, r);
+  trim_l = trim_saved_l = l;
+  trim_r = trim_saved_r = r;
+  portEXIT_CRITICAL(&trimMux);
+  trim_win_ms = 0;
+  LOG_I("[TRIM] L %.3f R %.3f", l, r);
 }
 
-void move_forward_distance(double dist_m, int pwmAbs){
-  long target = countsForDistance(dist_m);
-  long sL, sR;
-  noInterrupts();
-  sL = encL_total;
-  sR = encR_total;
-  interrupts();
-  
-  motorWriteLR_signed(+pwmAbs, +pwmAbs);
-  
-  while (true){
-    if (!g_line_enabled){
+// Ước lượng đủ tin cậy → áp dụng; lưu NVS khi đổi đáng kể (force: sau calibrate)
+static bool trim_commit(bool force){
+  float l, r, conf;
+  portENTER_CRITICAL(&trimMux);
+  conf = wheel_trim.confidence;
+  l = wheel_trim.trim_l;
+  r = wheel_trim.trim_r;
+  if (conf >= TRIM_APPLY_CONF) {
+    trim_l = l;
+    trim_r = r;
+  }
+  portEXIT_CRITICAL(&trimMux);
+  if (conf < TRIM_APPLY_CONF) return false;
+  bool changed = fabsf(l - trim_saved_l) > TRIM_SAVE_DELTA || fabsf(r - trim_saved_r) > TRIM_SAVE_DELTA;
+  if (force || (changed && millis() - trim_saved_ms >= TRIM_SAVE_MIN_MS)) {
+    trim_save();
+    LOG_I("[TRIM] saved L %.3f R %.3f (conf %.2f)", l, r, conf);
+  }
+  return true;
+}
+
+// Một chu kỳ điều khiển: straight = 2 bánh cùng target và đã ổn định.
+// PWM đã ghi (g_pwm_*) + ticks gộp thành mẫu mỗi TRIM_WINDOW_MS.
+static void trim_feed(bool straight, long cL, long cR, uint32_t dt_ms){
+  int pl = g_pwm_l, pr = g_pwm_r;
+  if (!straight || pl == 0 || pr == 0 || (pl > 0) != (pr > 0)) {
+    trim_win_ms = 0;
+    return;
+  }
+  if (trim_win_ms == 0) {
+    trim_win_pwm_l = trim_win_pwm_r = 0.0f;
+    trim_win_ticks_l = trim_win_ticks_r = 0;
+  }
+  trim_win_ms += dt_ms;
+  trim_win_pwm_l += abs(pl) * (float)dt_ms;
+  trim_win_pwm_r += abs(pr) * (float)dt_ms;
+  trim_win_ticks_l += cL;
+  trim_win_ticks_r += cR;
+  if (trim_win_ms < TRIM_WINDOW_MS) return;
+
+  float s = trim_win_ms / 1000.0f;
+  portENTER_CRITICAL(&trimMux);
+  wheel_trim_addSample(&wheel_trim, trim_win_pwm_l / trim_win_ms, trim_win_pwm_r / trim_win_ms,
+                       trim_win_ticks_l * CarChassis::M_PER_TICK / s,
+                       trim_win_ticks_r * CarChassis::M_PER_TICK / s);
+  wheel_trim_update(&wheel_trim);
+  portEXIT_CRITICAL(&trimMux);
+  trim_win_ms = 0;
+  if (trim_cal_phase == TRIM_CAL_IDLE) trim_commit(false);
+}
+
+// Calibrate: cùng PWM thô cho 2 bánh, bỏ dữ liệu cũ, gom mẫu rồi áp dụng +
+// lưu. Trả về true khi đang giữ motor (driveLoop bỏ qua phần còn lại).
+static bool trim_cal_step(long cL, long cR, uint32_t dt_ms, bool resumed){
+  if (trim_cal_phase == TRIM_CAL_IDLE) {
+    if (!trim_cal_req) return false;
+    portENTER_CRITICAL(&trimMux);
+    wheel_trim_reset(&wheel_trim);
+    portEXIT_CRITICAL(&trimMux);
+    trim_win_ms = 0;
+    trim_cal_phase = TRIM_CAL_SPINUP;
+    trim_cal_t0 = millis();
+    LOG_I("[TRIM] calibration started (PWM %d)", TRIM_CAL_PWM);
+  } else if (!trim_cal_req || resumed) {
+    // Dừng / lệnh lái mới / vừa rời line mode
+    trim_cal_phase = TRIM_CAL_IDLE;
+    trim_cal_req = false;
+    motorsStop();
+    LOG_W("[TRIM] calibration cancelled");
+    return false;
+  }
+
+  unsigned long el = millis() - trim_cal_t0;
+  if (trim_cal_phase == TRIM_CAL_SPINUP && el >= TRIM_CAL_SPINUP_MS) trim_cal_phase = TRIM_CAL_RUN;
+  if (trim_cal_phase == TRIM_CAL_RUN) {
+    trim_feed(true, cL, cR, dt_ms);
+    if (el >= TRIM_CAL_SPINUP_MS + TRIM_CAL_RUN_MS) {
       motorsStop();
-      return;
+      trim_cal_phase = TRIM_CAL_IDLE;
+      trim_cal_req = false;
+      if (!trim_commit(true)) {
+        LOG_W("[TRIM] calibration inconclusive (conf %.2f, %u samples), trims unchanged",
+              wheel_trim.confidence, (unsigned)wheel_trim.samples);
+      }
+      return true;
     }
-    
-    long cL, cR;
-    noInterrupts();
-    cL = encL_total;
-    cR = encR_total;
-    interrupts();
-    
-    bool left_done = (labs(cL - sL) >= target);
-    bool right_done = (labs(cR - sR) >= target);
-    
-    if (left_done && right_done) break;
-    
-    if (left_done && !right_done)
-      motorWriteLR_signed(0, +pwmAbs);
-    else if (!left_done && right_done)
-      motorWriteLR_signed(+pwmAbs, 0);
-    
-    delay(1);
   }
-  motorsStop();
+  motorWriteLR_signed(TRIM_CAL_PWM, TRIM_CAL_PWM);
+  return true;
+}
+
+/* ================= Quay / tiến theo profile ================= */
+// Hai bánh bám cùng một profile hình thang (motion_profile.h), kết thúc
+// đứng yên đúng đích → không cần delay chờ xe ổn định sau mỗi bước
+const MotionLimits SPIN_LIMITS = {0.25f, 1.0f};   // m/s, m/s² mỗi bánh
+const MotionLimits MOVE_LIMITS = {0.40f, 1.0f};
+const MotionLimits SEEK_LIMITS = {0.25f, 1.0f};   // dò line: chậm để dừng kịp trên vạch
+const float AVOID_STEP_M = 0.20f;
+const float AVOID_SEEK_M = 0.60f;
+
+static MotionGains motion_gains;
+static DoLineMotionStats motion_stats;
+static portMUX_TYPE motionMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void motion_note(const char* what, float amount, const MotionResult& res){
+  float err_mm = fmaxf(fabsf(res.err_l_m), fabsf(res.err_r_m)) * 1000.0f;
+  uint32_t ms = (uint32_t)(res.time_s * 1000.0f);
+  portENTER_CRITICAL(&motionMux);
+  motion_stats.moves++;
+  if (res.timeout) motion_stats.timeouts++;
+  motion_stats.last_err_mm = err_mm;
+  if (err_mm > motion_stats.max_err_mm) motion_stats.max_err_mm = err_mm;
+  motion_stats.last_ms = ms;
+  portEXIT_CRITICAL(&motionMux);
+  LOG_D("[MOTION] %s %.2f: err L %.1f R %.1f mm, %u ms%s", what, amount, res.err_l_m * 1000.0f,
+        res.err_r_m * 1000.0f, ms, res.timeout ? " (timeout)" : "");
 }
 
-bool move_forward_distance_until_line(double dist_m, int pwmAbs){
-  long target = countsForDistance(dist_m);
-  long sL, sR;
+// Chạy một profile (blocking, chu kỳ PID). until_line: dừng ngay khi M
+// thấy vạch. Trả về true nếu dừng vì thấy line.
+static bool motion_run(int8_t dirL, int8_t dirR, float dist_m, const MotionLimits& lim,
+                       bool until_line, MotionResult* res){
+  MotionCtrl mc;
+  motion_begin(&mc, dirL, dirR, dist_m, lim, motion_gains);
+  long L0, R0;
   noInterrupts();
-  sL = encL_total;
-  sR = encR_total;
+  L0 = encL_total;
+  R0 = encR_total;
   interrupts();
-  
-  motorWriteLR_signed(+pwmAbs, +pwmAbs);
+  unsigned long t_prev = millis();
+  bool seen = false;
   
   while (true){
-    if (!g_line_enabled){
-      motorsStop();
-      return false;
+    if (!g_line_enabled) break;
+    if (until_line && onLine(M_SENSOR)){
+      seen = true;
+      break;
     }
+    unsigned long now = millis();
+    if (now - t_prev < CTRL_DT_MS){
+      delay(1);
+      continue;
+    }
+    float dt_s = (now - t_prev) / 1000.0f;
+    t_prev = now;
     
-    long cL, cR;
+    long L, R;
     noInterrupts();
-    cL = encL_total;
-    cR = encR_total;
+    L = encL_total;
+    R = encR_total;
     interrupts();
-    
-    if (onLine(M_SENSOR)){
-      motorsStop();
-      return true;
-    }
-    
-    bool left_done = (labs(cL - sL) >= target);
-    bool right_done = (labs(cR - sR) >= target);
-    
-    if (left_done && right_done) break;
-    
-    if (left_done && !right_done)
-      motorWriteLR_signed(0, +pwmAbs);
-    else if (!left_done && right_done)
-      motorWriteLR_signed(+pwmAbs, 0);
-    
-    delay(1);
+    int pwmL, pwmR;
+    bool running = motion_step(&mc, (unsigned long)(L - L0), (unsigned long)(R - R0), dt_s, &pwmL, &pwmR);
+    L0 = L;
+    R0 = R;
+    if (!running) break;
+    wd_kick();
+    // Supervisor chặn (vật cản quá gần): bỏ bước này, avoidObstacle làm tiếp
+    if (!motorWriteLR_signed(trim_pwm(pwmL, trim_l), trim_pwm(pwmR, trim_r))) break;
   }
   motorsStop();
-  return false;
+  motion_result(&mc, res);
+  return seen;
+}
+
+// Quay tại chỗ: mỗi bánh đi (track / 2) · θ
+static inline float spin_arc_m(float deg){
+  return deg * (CHASSIS_PI / 180.0f) * 0.5f * CarChassis::TRACK_WIDTH_M;
+}
+
+void spin_left_deg(float deg){
+  MotionResult res;
+  motion_run(-1, +1, spin_arc_m(deg), SPIN_LIMITS, false, &res);
+  motion_note("spin_left", deg, res);
+}
+
+void spin_right_deg(float deg){
+  MotionResult res;
+  motion_run(+1, -1, spin_arc_m(deg), SPIN_LIMITS, false, &res);
+  motion_note("spin_right", deg, res);
+}
+
+void move_forward_distance(float m){
+  MotionResult res;
+  motion_run(+1, +1, m, MOVE_LIMITS, false, &res);
+  motion_note("forward", m, res);
+}
+
+bool move_forward_distance_until_line(float m){
+  MotionResult res;
+  bool seen = motion_run(+1, +1, m, SEEK_LIMITS, true, &res);
+  if (!seen) motion_note("seek", m, res);
+  return seen;
 }
 
 void avoidObstacle(){
-  const int TURN_PWM = 120;
-  const int FWD_PWM = 130;
+  spin_left_deg(60.0f);
+  move_forward_distance(AVOID_STEP_M);
+  spin_right_deg(60.0f);
+  move_forward_distance(AVOID_STEP_M);
+  spin_right_deg(50.0f);
+  if (move_forward_distance_until_line(AVOID_SEEK_M)) return;
   
-  spin_left_deg(60.0, TURN_PWM);
-  motorsStop();
-  delay(500);
-  move_forward_distance(0.2, FWD_PWM);
-  motorsStop();
-  delay(500);
-  spin_right_deg(60.0, TURN_PWM);
-  motorsStop();
-  delay(500);
-  move_forward_distance(0.2, FWD_PWM);
-  motorsStop();
-  delay(500);
-  spin_right_deg(50.0, TURN_PWM);
-  motorsStop();
-  delay(500);
-  bool seen = move_forward_distance_until_line(0.6, FWD_PWM);
-  motorsStop();
-  delay(500);
-  if (seen) return;
-  
-  spin_left_deg(40.0, TURN_PWM);
-  motorsStop();
-  delay(500);
+  spin_left_deg(40.0f);
 }
 
 // API abort
@@ -516,6 +741,110 @@ inline void resetBothPID() {
   resetPID(pidR);
 }
 
+/* ================= Recovery: bắt đầu / kết thúc ================= */
+static void recov_start(){
+  int8_t side = last_seen == LEFT ? 1 : (last_seen == RIGHT ? -1 : 0);
+  portENTER_CRITICAL(&recovMux);
+  line_recovery_start(&recov, side);
+  portEXIT_CRITICAL(&recovMux);
+  recovering = true;
+}
+
+static void recov_end(bool found){
+  float t_s = recov.t_s;
+  portENTER_CRITICAL(&recovMux);
+  line_recovery_end(&recov, found);
+  portEXIT_CRITICAL(&recovMux);
+  recovering = false;
+  if (found) LOG_D("[RECOV] line found after %.0f ms", t_s * 1000.0f);
+  else LOG_W("[RECOV] line not found after %.0f ms, stopped", t_s * 1000.0f);
+}
+
+/* ================= Safety supervisor ================= */
+// Task riêng, ưu tiên cao, cùng core với loop(): chạy HC-SR04 và kiểm tra
+// vật cản / deadman / watchdog mỗi 1 ms nên lệnh dừng không phải chờ loop()
+// (avoidObstacle, handler chậm, ...). Flash (NVS) dừng cả 2 core: có thể trễ
+// hơn latency_max_us, được đếm là late.
+const uint32_t SAFETY_TASK_STACK = 3072;
+const UBaseType_t SAFETY_TASK_PRIO = configMAX_PRIORITIES - 5;   // trên loop (1), MQTT TX (2), async_tcp (3)
+const BaseType_t SAFETY_TASK_CORE = 1;                           // core của loop(): luôn chen được
+static bool safety_started = false;
+static volatile bool safety_deadman = true;     // manual: motor theo lệnh từ link
+
+static void safetyTask(void*){
+  TickType_t period = pdMS_TO_TICKS(safety.cfg.period_us / 1000);
+  if (period == 0) period = 1;
+  uint32_t seq = us_seq;
+  TickType_t wake = xTaskGetTickCount();
+  for (;;) {
+    ultrasonic_update();
+    uint32_t now = micros();
+    // Calibrate trim tự chạy ~3 s sau một lệnh: không tính deadman
+    bool deadman = safety_deadman && trim_cal_phase == TRIM_CAL_IDLE;
+    portENTER_CRITICAL(&safetyMux);
+    if (us_seq != seq) {
+      seq = us_seq;
+      safety_echo(&safety, now, ultrasonic_distance_cm >= 0 ? ultrasonic_distance_cm / 100.0f : -1.0f);
+    }
+    bool stop = safety_step(&safety, now, g_pwm_l, g_pwm_r, deadman);
+    portEXIT_CRITICAL(&safetyMux);
+    
+    if (stop) {
+      motorsStop();
+      uint32_t t_off = micros();
+      portENTER_CRITICAL(&safetyMux);
+      bool done = safety_stopped(&safety, t_off);
+      SafetyEvent ev = safety.ev;
+      portEXIT_CRITICAL(&safetyMux);
+      if (done) {
+        LOG_W("[SAFETY] %s stop: motors off %u us after detection%s", safety_reasonName(ev.reasons),
+              (unsigned)ev.latency_us, ev.latency_us > safety.cfg.latency_max_us ? " (late)" : "");
+      }
+    }
+    vTaskDelayUntil(&wake, period);
+  }
+}
+
+void do_line_safetyBegin(){
+  if (safety_started) return;
+  pinMode(TRIG_PIN, OUTPUT);
+  pinMode(ECHO_PIN, INPUT);
+  us_state = US_IDLE;
+  us_last_ms = 0;
+  ultrasonic_distance_cm = -1.0f;
+  SafetyConfig cfg;
+  safety_defaults(&cfg);
+  safety_init(&safety, cfg, micros());
+  safety_started = true;
+  xTaskCreatePinnedToCore(safetyTask, "safety", SAFETY_TASK_STACK, nullptr, SAFETY_TASK_PRIO, nullptr,
+                          SAFETY_TASK_CORE);
+}
+
+void do_line_safetySetDeadman(bool on){
+  safety_deadman = on;
+}
+
+void do_line_safetyCommand(){
+  uint32_t now = micros();
+  portENTER_CRITICAL(&safetyMux);
+  safety_command(&safety, now);
+  portEXIT_CRITICAL(&safetyMux);
+}
+
+uint8_t do_line_safetyTripped(){
+  return safety.tripped;
+}
+
+bool do_line_writeMotors(int pwm_l, int pwm_r){
+  return motorWriteLR_signed(pwm_l, pwm_r);
+}
+
+void do_line_getSafetyStats(SafetyStats* out){
+  portENTER_CRITICAL(&safetyMux);
+  *out = safety.stats;
+  portEXIT_CRITICAL(&safetyMux);
+}
+
 /* ================= Setup → do_line_setup ================= */
 void do_line_setup() {
   // Motor DIR + PWM
@@ -537,18 +866,22 @@ void do_line_setup() {
   attachInterrupt(digitalPinToInterrupt(ENC_L), encL_isr, CHANGE);
   attachInterrupt(digitalPinToInterrupt(ENC_R), encR_isr, CHANGE);
   
-  // Ultrasonic
-  pinMode(TRIG_PIN, OUTPUT);
-  pinMode(ECHO_PIN, INPUT);
-  
-  us_state = US_IDLE;
-  us_last_ms = 0;
-  ultrasonic_distance_cm = -1.0f;
-  ultrasonic_new = false;
+  // Ultrasonic: supervisor task (do_line_safetyBegin)
+  CollisionConfig coll_cfg;
+  collision_defaults(&coll_cfg);
+  portENTER_CRITICAL(&collMux);
+  collision_init(&coll, coll_cfg);
+  portEXIT_CRITICAL(&collMux);
+  coll_seq = us_seq;
   
   g_line_enabled = true;
   seen_line_ever = false;
   recovering = false;
+  LineRecoveryConfig recov_cfg;
+  line_recovery_defaults(&recov_cfg);
+  portENTER_CRITICAL(&recovMux);
+  line_recovery_init(&recov, recov_cfg);
+  portEXIT_CRITICAL(&recovMux);
   last_seen = NONE;
   pwmL_prev = 0;
   pwmR_prev = 0;
@@ -558,12 +891,23 @@ void do_line_setup() {
   motorsStop();
 }
 
+// Once at boot, not per mode switch: trim statistics keep learning across
+// modes and the applied (not yet saved) trim is not replaced by NVS
+void do_line_begin() {
+  motion_defaults(&motion_gains);
+  trim_load(motion_gains.pwm_static);
+  track_profile_defaults(&track_cfg);
+  track_load();
+}
+
 /* ================= Loop → do_line_loop ================= */
 void do_line_loop() {
+  wd_kick();
   if (!g_line_enabled) {
     motorsStop();
     return;
   }
+  apply_lap_request();
   
   static unsigned long t_prev = millis();
   static unsigned long bad_t = 0;
@@ -578,13 +922,14 @@ void do_line_loop() {
   if (L2 || L1 || M || R1 || R2) seen_line_ever = true;
   
   // ---- Chặn mẫu "tất cả HIGH" hoặc "tất cả LOW" > 1500ms -> dừng hẳn ----
+  // (đang recovery thì không thấy line là bình thường: recovery tự giới hạn)
   bool allH = L2 && L1 && M && R1 && R2;
   bool allL = !L2 && !L1 && !M && !R1 && !R2;
-  bool bad = allH || allL;
+  bool bad = allH || (allL && !recovering);
   
   if (bad) {
     if (millis() - bad_t > 1500) {
-      recovering = false;
+      if (recovering) recov_end(false);
       motorsStop();
       noInterrupts();
       encL_count = 0;
@@ -608,14 +953,16 @@ void do_line_loop() {
   bool use_steer_pwm = false; // chỉ bật khi line-follow
   int steer_dir = 0; // +1: quay TRÁI, -1: quay PHẢI, 0: thẳng
   int steer_pwm = 0; // SOFT/HARD
+  TrackCue cue = TRACK_CUE_LINE; // cho track map
   
   // ================== RECOVERY (mất line) ==================
   if (recovering) {
     resetBothPID();
     
-    // Nếu thấy lại line (ít nhất 1 cảm biến ON và KHÔNG phải 4 đèn ON) → thoát recovery
-    if ((L2 || L1 || M || R1 || R2) && onCount < 4) {
-      recovering = false;
+    // Nếu thấy lại line (ít nhất 1 cảm biến ON và KHÔNG phải 4 đèn ON, không
+    // phải đầu line vừa mất) → thoát recovery
+    if ((L2 || L1 || M || R1 || R2) && onCount < 4 && line_recovery_accept(&recov)) {
+      recov_end(true);
       motorsStop();
       noInterrupts();
       encL_count = 0;
@@ -624,9 +971,11 @@ void do_line_loop() {
       t_prev = millis();
       return;
     }
-    // Hết thời gian recovery mà chưa thấy line → dừng hẳn
-    else if (millis() - rec_t0 >= RECOV_TIME_MS) {
-      recovering = false;
+    // Dò hết cung + góc quét (hoặc hết giờ) mà chưa thấy line → dừng hẳn,
+    // chờ tới khi cảm biến thấy line lại
+    else if (recov.phase == LREC_FAILED) {
+      recov_end(false);
+      seen_line_ever = false;
       motorsStop();
       noInterrupts();
       encL_count = 0;
@@ -635,26 +984,19 @@ void do_line_loop() {
       t_prev = millis();
       return;
     }
-    // Đang recovery và chưa thấy line → quay theo last_seen
+    // Đang recovery và chưa thấy line → theo bước tìm (cập nhật ở chu kỳ PID)
     else {
-      float vF = 0.3f;
-      if (last_seen == LEFT) {
-        vL_tgt = 0;
-        vR_tgt = vF;
-      } else if (last_seen == RIGHT) {
-        vL_tgt = vF;
-        vR_tgt = 0;
-      } else {
-        vL_tgt = vF;
-        vR_tgt = vF;
-      }
+      vL_tgt = recov.vL;
+      vR_tgt = recov.vR;
     }
   }
   // ================== LOGIC CHÍNH (giống Nano) ==================
   else {
-    // Mặc định: đi thẳng
-    vL_tgt = v_base;
-    vR_tgt = v_base;
+    // Mặc định: đi thẳng (tốc độ theo look-ahead của camera; fast lap:
+    // theo map, camera vẫn được quyền giảm thêm)
+    float v_plan = plan_speed(lap_mode == LAP_FAST ? track_v : v_base);
+    vL_tgt = v_plan;
+    vR_tgt = v_plan;
     use_steer_pwm = true;
     
     // Trường hợp ĐẶC BIỆT: 4 đèn ON, 1 đèn OFF -> CHUYỂN SANG RECOVERY
@@ -669,8 +1011,8 @@ void do_line_loop() {
       }
       // Nếu chỉ M OFF (L2,L1,R1,R2 đều ON) → chữ T, giữ nguyên last_seen
       use_steer_pwm = false;
-      recovering = true;
-      rec_t0 = millis();
+      cue = TRACK_CUE_T;
+      recov_start();
     }
     // Lệch trái mạnh
     else if ( (L2 && !R2 && !R1) || (L2 && L1 && !R1 && !R2) ) {
@@ -698,6 +1040,7 @@ void do_line_loop() {
     }
     // Giao/cắt hoặc vùng line rộng (>=3 đèn, nhưng không phải 4 đèn ON)
     else if ( (L1 || L2) && M && (R1 || R2) ) {
+      cue = TRACK_CUE_CROSS;
       last_seen = NONE;
       steer_dir = 0;
       steer_pwm = 0;
@@ -710,39 +1053,27 @@ void do_line_loop() {
     }
     // Mất line hoàn toàn
     else {
+      cue = TRACK_CUE_LOST;
       use_steer_pwm = false;
       if (!seen_line_ever) {
         vL_tgt = 0.0f;
         vR_tgt = 0.0f;
       } else {
-        recovering = true;
-        rec_t0 = millis();
+        recov_start();
       }
     }
   }
   
-  // ==== Né vật cản (giữ nguyên logic, giống Nano về điều kiện) ====
   bool line_follow_active = isValidLineSample5(L2, L1, M, R1, R2);
-  float dist = readDistanceCM_nonblock();
-  if (!recovering && line_follow_active && dist > 0 && dist < OBSTACLE_TH_CM){
-    avoidObstacle();
-    noInterrupts();
-    encL_count = 0;
-    encR_count = 0;
-    interrupts();
-    resetBothPID();
-    t_prev = millis();
-    return;
-  }
   
-  // Áp bù lệch 2 bánh
-  vL_tgt *= L_SCALE;
-  vR_tgt *= R_SCALE;
+  // Loop chạy nhanh hơn PID: giữ cue giao lộ tới chu kỳ PID kế tiếp
+  if (lap_cue == TRACK_CUE_LINE) lap_cue = cue;
   
   // ================== Chu kỳ PID + steer PWM ==================
   unsigned long now = millis();
   if (now - t_prev >= CTRL_DT_MS){
-    float dt_s = (now - t_prev) / 1000.0f;
+    uint32_t dt_ms = now - t_prev;
+    float dt_s = dt_ms / 1000.0f;
     t_prev = now;
     
     long cL, cR;
@@ -753,15 +1084,77 @@ void do_line_loop() {
     encR_count = 0;
     interrupts();
     
-    float vL_meas = ticksToVel(cL, dt_s) * (vL_tgt >= 0 ? 1.0f : -1.0f);
-    float vR_meas = ticksToVel(cR, dt_s) * (vR_tgt >= 0 ? 1.0f : -1.0f);
+    float vL_meas = CarChassis::ticksToVel(cL, dt_ms) * (vL_tgt >= 0 ? 1.0f : -1.0f);
+    float vR_meas = CarChassis::ticksToVel(cR, dt_ms) * (vR_tgt >= 0 ? 1.0f : -1.0f);
+    
+    // Track map: encoder không có chiều → lấy dấu theo target
+    if (lap_mode != LAP_NORMAL) {
+      long dL = vL_tgt >= 0 ? cL : -cL;
+      long dR = vR_tgt >= 0 ? cR : -cR;
+      if (lap_mode == LAP_LEARN) {
+        track_learn_step(&track_learner, dL, dR, (TrackCue)lap_cue);
+        if (!track_learner.active) {
+          track_learn_done();
+          lap_mode = LAP_NORMAL;
+        }
+      } else {
+        track_v = track_follow_step(&track_follower, dL, dR, (TrackCue)lap_cue);
+      }
+    }
+    lap_cue = TRACK_CUE_LINE;
+    
+    // Quãng đường 2 bánh, dấu theo target
+    float dL_m = cL * CarChassis::M_PER_TICK * (vL_tgt >= 0 ? 1.0f : -1.0f);
+    float dR_m = cR * CarChassis::M_PER_TICK * (vR_tgt >= 0 ? 1.0f : -1.0f);
+    
+    // ==== Recovery: odometry từ lần cuối thấy line, bước tìm theo chu kỳ PID ====
+    line_recovery_odom(&recov, dL_m, dR_m);
+    if (recovering) {
+      line_recovery_step(&recov, dt_s);
+      vL_tgt = recov.vL;
+      vR_tgt = recov.vR;
+    } else if (onCount > 0 && onCount < 4) {
+      line_recovery_seen(&recov);
+    }
+    
+    // ==== Vật cản: giảm tốc theo TTC, tới standoff thì né (điều kiện như Nano) ====
+    CollisionLevel coll_lv = coll_step(dt_s, 0.5f * (dL_m + dR_m));
+    if (coll_lv == COLL_STOP) {
+      // Không kịp dừng êm: phanh cứng, chờ tới khi đứng yên
+      motorsStop();
+      resetBothPID();
+      pwmL_prev = 0;
+      pwmR_prev = 0;
+      return;
+    }
+    if (coll_lv == COLL_BLOCKED && !recovering && line_follow_active) {
+      lap_abort("obstacle");
+      avoidObstacle();
+      coll_reset();
+      line_recovery_seen(&recov);   // gốc odometry mới sau khi né
+      noInterrupts();
+      encL_count = 0;
+      encR_count = 0;
+      interrupts();
+      resetBothPID();
+      t_prev = millis();
+      return;
+    }
+    float v_fwd = 0.5f * (vL_tgt + vR_tgt);
+    if (v_fwd > coll.v_allow) {
+      // Giữ tỉ lệ 2 bánh (độ cong) khi giảm tốc
+      float k = coll.v_allow / v_fwd;
+      vL_tgt *= k;
+      vR_tgt *= k;
+    }
     
     const float V_MAX = 0.8f;
     vL_tgt = clampf(vL_tgt, -V_MAX, V_MAX);
     vR_tgt = clampf(vR_tgt, -V_MAX, V_MAX);
     
-    int pwmL = pidStep(pidL, vL_tgt, vL_meas, dt_s);
-    int pwmR = pidStep(pidR, vR_tgt, vR_meas, dt_s);
+    // PID trên độ lớn, chiều theo dấu target (recovery lùi / quay tại chỗ)
+    int pwmL = pidStep(pidL, fabsf(vL_tgt), fabsf(vL_meas), dt_s);
+    int pwmR = pidStep(pidR, fabsf(vR_tgt), fabsf(vR_meas), dt_s);
     
     // ======= Lái bằng steer PWM (giống code Nano) =======
     if (use_steer_pwm && !recovering) {
@@ -776,26 +1169,237 @@ void do_line_loop() {
       }
     }
     
-    // Shaper PWM: deadband + slew
-    int pwmL_cmd = shape_pwm((int)(1.1 * pwmL), pwmL_prev);
-    int pwmR_cmd = shape_pwm(pwmR, pwmR_prev);
+    // Đi thẳng theo line (không steer, không recovery) → mẫu cho wheel trim
+    trim_feed(use_steer_pwm && steer_dir == 0 && !recovering && vL_tgt == vR_tgt, cL, cR, dt_ms);
+    
+    // Shaper PWM: trim 2 bánh + deadband + slew
+    int pwmL_cmd = shape_pwm(trim_pwm(pwmL, trim_l), pwmL_prev);
+    int pwmR_cmd = shape_pwm(trim_pwm(pwmR, trim_r), pwmR_prev);
     pwmL_prev = pwmL_cmd;
     pwmR_prev = pwmR_cmd;
     
-    driveWheelLeft (vL_tgt, pwmL_cmd);
-    driveWheelRight(vR_tgt, pwmR_cmd);
+    motorWriteLR_signed(signed_pwm(vL_tgt, pwmL_cmd), signed_pwm(vR_tgt, pwmR_cmd));
   }
 }
 
-/* ================= Getter functions for MQTT ================= */
-// Update ultrasonic sensor (exposed for manual mode)
-void do_line_updateUltrasonic() {
-  ultrasonic_update();
+/* ================= Manual drive (vòng kín encoder) ================= */
+// Lệnh tay → vận tốc 2 bánh, bám bằng encoder + PID như line-follow.
+// Giới hạn gia tốc: dòng khởi động 2 động cơ cùng lúc làm sụt áp ESP32.
+const float DRIVE_ACCEL = 1.5f;          // m/s² mỗi bánh
+const float DRIVE_V_MAX = 0.8f;          // = V_MAX của line-follow
+const float DRIVE_VEL_ALPHA = 0.3f;      // lọc vận tốc đo (1 tick / 10 ms = 0.5 m/s)
+const float DRIVE_SETTLE_S = 0.30f;      // ramp tới target + chừng này → tính thống kê
+
+static portMUX_TYPE driveMux = portMUX_INITIALIZER_UNLOCKED;
+static float drive_v_tgt = 0.0f, drive_w_tgt = 0.0f;   // ghi từ task bất kỳ
+static volatile bool drive_closed = true;
+static volatile bool drive_stop_req = false;            // dừng ngay, bỏ ramp
+static float driveL_cmd = 0.0f, driveR_cmd = 0.0f;     // sau ramp
+static float driveL_meas = 0.0f, driveR_meas = 0.0f;   // m/s có dấu, đã lọc
+static bool drive_active = false;
+static float drive_hold_s = 0.0f;                       // thời gian target không đổi
+static unsigned long drive_t_prev = 0;
+// Thống kê (cửa sổ, reset khi đọc)
+static float drive_straight_m = 0.0f, drive_straight_rad = 0.0f;
+static float drive_err_sq = 0.0f;
+static uint32_t drive_err_n = 0;
+
+void do_line_setDriveTarget(float v_mps, float w_radps) {
+  trim_cal_req = false;   // lệnh lái mới huỷ calibrate
+  portENTER_CRITICAL(&driveMux);
+  drive_v_tgt = v_mps;
+  drive_w_tgt = w_radps;
+  portEXIT_CRITICAL(&driveMux);
+}
+
+void do_line_setDriveClosedLoop(bool on) {
+  drive_closed = on;
+}
+
+bool do_line_getDriveClosedLoop() {
+  return drive_closed;
+}
+
+void do_line_driveStop() {
+  do_line_setDriveTarget(0.0f, 0.0f);
+  drive_stop_req = true;
+  motorsStop();
+}
+
+static inline float ramp(float cur, float tgt, float step){
+  if (tgt > cur + step) return cur + step;
+  if (tgt < cur - step) return cur - step;
+  return tgt;
+}
+
+void do_line_driveLoop() {
+  wd_kick();
+  unsigned long now = millis();
+  if (now - drive_t_prev < CTRL_DT_MS) return;
+  uint32_t dt_ms = now - drive_t_prev;
+  drive_t_prev = now;
+  bool resumed = dt_ms > 100;
+  if (resumed) dt_ms = CTRL_DT_MS;   // lần đầu / vừa rời line mode
+  float dt_s = dt_ms / 1000.0f;
+  
+  long cL, cR;
+  noInterrupts();
+  cL = encL_count;
+  encL_count = 0;
+  cR = encR_count;
+  encR_count = 0;
+  interrupts();
+  
+  // Encoder không có chiều → theo dấu PWM đang chạy (cả vòng hở)
+  float dL = cL * CarChassis::M_PER_TICK * (g_pwm_l >= 0 ? 1.0f : -1.0f);
+  float dR = cR * CarChassis::M_PER_TICK * (g_pwm_r >= 0 ? 1.0f : -1.0f);
+  if (resumed) coll_reset();
+  CollisionLevel coll_lv = coll_step(dt_s, 0.5f * (dL + dR));
+  // BLOCKED: chỉ dừng khi đang tiến (quay tại chỗ / lùi ra vẫn được)
+  bool fwd = driveL_cmd + driveR_cmd > 0.0f || trim_cal_phase != TRIM_CAL_IDLE;
+  bool coll_halt = coll_lv == COLL_STOP || (coll_lv == COLL_BLOCKED && fwd);
+  if (coll_halt && trim_cal_phase != TRIM_CAL_IDLE) trim_cal_req = false;   // vật cản huỷ calibrate
+  
+  // Đang calibrate wheel trim: giữ motor, bỏ qua lệnh lái
+  if (trim_cal_step(cL, cR, dt_ms, resumed)) {
+    driveL_meas = driveR_meas = 0.0f;
+    driveL_cmd = driveR_cmd = 0.0f;
+    drive_hold_s = 0.0f;
+    return;
+  }
+  
+  float vL_raw = CarChassis::ticksToVel(cL, dt_ms) * (g_pwm_l >= 0 ? 1.0f : -1.0f);
+  float vR_raw = CarChassis::ticksToVel(cR, dt_ms) * (g_pwm_r >= 0 ? 1.0f : -1.0f);
+  driveL_meas += DRIVE_VEL_ALPHA * (vL_raw - driveL_meas);
+  driveR_meas += DRIVE_VEL_ALPHA * (vR_raw - driveR_meas);
+  
+  float v_tgt, w_tgt;
+  portENTER_CRITICAL(&driveMux);
+  v_tgt = drive_v_tgt;
+  w_tgt = drive_w_tgt;
+  portEXIT_CRITICAL(&driveMux);
+  // Vật cản phía trước: giới hạn tốc độ tiến (giữ bán kính cua)
+  float v_lim = collision_limit(&coll, v_tgt);
+  if (v_lim < v_tgt) {
+    w_tgt *= v_lim / v_tgt;
+    v_tgt = v_lim;
+  }
+  float half = 0.5f * CarChassis::TRACK_WIDTH_M;
+  float vL_tgt = clampf(v_tgt - w_tgt * half, -DRIVE_V_MAX, DRIVE_V_MAX);
+  float vR_tgt = clampf(v_tgt + w_tgt * half, -DRIVE_V_MAX, DRIVE_V_MAX);
+  
+  if (drive_stop_req || coll_halt) {
+    drive_stop_req = false;
+    driveL_cmd = driveR_cmd = 0.0f;
+  }
+  float step = DRIVE_ACCEL * dt_s;
+  driveL_cmd = ramp(driveL_cmd, vL_tgt, step);
+  driveR_cmd = ramp(driveR_cmd, vR_tgt, step);
+  
+  // Thống kê từ odometry: lệch hướng khi đi thẳng, sai số tốc độ khi ổn định
+  drive_hold_s = (driveL_cmd == vL_tgt && driveR_cmd == vR_tgt) ? drive_hold_s + dt_s : 0.0f;
+  bool steady = drive_hold_s >= DRIVE_SETTLE_S;
+  portENTER_CRITICAL(&driveMux);
+  if (steady && w_tgt == 0.0f && v_tgt != 0.0f) {
+    drive_straight_m += fabsf(0.5f * (dL + dR));
+    drive_straight_rad += (dR - dL) / CarChassis::TRACK_WIDTH_M;
+  }
+  if (steady && v_tgt != 0.0f) {
+    float e = 0.5f * (driveL_meas + driveR_meas) - v_tgt;
+    drive_err_sq += e * e;
+    drive_err_n++;
+  }
+  portEXIT_CRITICAL(&driveMux);
+  // Mẫu wheel trim: PWM đã ghi (cả vòng hở) so với vận tốc encoder
+  trim_feed(steady && w_tgt == 0.0f && v_tgt != 0.0f, cL, cR, dt_ms);
+  
+  // Vòng hở: main.cpp ghi PWM trực tiếp, ramp chỉ để biết lúc nào ổn định
+  if (!drive_closed) return;
+  
+  if (driveL_cmd == 0.0f && driveR_cmd == 0.0f) {
+    if (drive_active) {
+      motorsStop();
+      resetPID(pidDriveL);
+      resetPID(pidDriveR);
+      drive_active = false;
+    }
+    return;
+  }
+  drive_active = true;
+  
+  // PID trên độ lớn, chiều theo dấu lệnh; feedforward như motion_profile
+  float aL = fabsf(driveL_cmd), aR = fabsf(driveR_cmd);
+  float ffL = aL > 0.0f ? motion_gains.pwm_static + motion_gains.pwm_per_mps * aL : 0.0f;
+  float ffR = aR > 0.0f ? motion_gains.pwm_static + motion_gains.pwm_per_mps * aR : 0.0f;
+  int pwmL = pidStep(pidDriveL, aL, fabsf(driveL_meas), dt_s, ffL);
+  int pwmR = pidStep(pidDriveR, aR, fabsf(driveR_meas), dt_s, ffR);
+  motorWriteLR_signed(signed_pwm(driveL_cmd, trim_pwm(pwmL, trim_l)),
+                      signed_pwm(driveR_cmd, trim_pwm(pwmR, trim_r)));
 }
 
+void do_line_getDriveStats(DoLineDriveStats* out, bool reset) {
+  portENTER_CRITICAL(&driveMux);
+  out->v_tgt = drive_v_tgt;
+  out->w_tgt = drive_w_tgt;
+  float straight_m = drive_straight_m, straight_rad = drive_straight_rad;
+  float err_sq = drive_err_sq;
+  uint32_t err_n = drive_err_n;
+  if (reset) {
+    drive_straight_m = drive_straight_rad = 0.0f;
+    drive_err_sq = 0.0f;
+    drive_err_n = 0;
+  }
+  portEXIT_CRITICAL(&driveMux);
+  out->closed_loop = drive_closed;
+  out->v_meas = 0.5f * (driveL_meas + driveR_meas);
+  out->w_meas = (driveR_meas - driveL_meas) / CarChassis::TRACK_WIDTH_M;
+  out->straight_m = straight_m;
+  out->drift_deg_per_m = straight_m > 0.05f ? straight_rad * (180.0f / CHASSIS_PI) / straight_m : 0.0f;
+  out->speed_err_rms = err_n ? sqrtf(err_sq / err_n) : 0.0f;
+}
+
+/* ================= Wheel trim API ================= */
+void do_line_applyTrim(int* pwm_l, int* pwm_r) {
+  float l, r, ps;
+  portENTER_CRITICAL(&trimMux);
+  l = trim_l;
+  r = trim_r;
+  ps = wheel_trim.pwm_static;
+  portEXIT_CRITICAL(&trimMux);
+  float al = wheel_trim_apply((float)abs(*pwm_l), l, ps);
+  float ar = wheel_trim_apply((float)abs(*pwm_r), r, ps);
+  int dl = clamp255((int)(al + 0.5f)), dr = clamp255((int)(ar + 0.5f));
+  *pwm_l = *pwm_l < 0 ? -dl : dl;
+  *pwm_r = *pwm_r < 0 ? -dr : dr;
+}
+
+void do_line_trimCalibrate() {
+  trim_cal_req = true;
+}
+
+bool do_line_trimCalibrating() {
+  return trim_cal_req;
+}
+
+void do_line_getTrim(DoLineTrim* out) {
+  portENTER_CRITICAL(&trimMux);
+  out->trim_l = trim_l;
+  out->trim_r = trim_r;
+  out->est_l = wheel_trim.trim_l;
+  out->est_r = wheel_trim.trim_r;
+  out->confidence = wheel_trim.confidence;
+  out->samples = wheel_trim.samples;
+  out->gain_l = wheel_trim.gain[0];
+  out->gain_r = wheel_trim.gain[1];
+  portEXIT_CRITICAL(&trimMux);
+  out->calibrating = trim_cal_req;
+}
+
+/* ================= Getter functions for MQTT ================= */
+// Update ultrasonic sensor (exposed for manual mode)
 float do_line_getDistanceCM() {
-  // Return current distance (may be -1 if no valid reading)
-  ultrasonic_update(); // Update state machine
+  // Return current distance (may be -1 if no valid reading); measured by
+  // the safety supervisor task
   return ultrasonic_distance_cm;
 }
 
@@ -807,3 +1411,84 @@ void do_line_getLineSensors(bool* L2, bool* L1, bool* M, bool* R1, bool* R2) {
   if (R2) *R2 = onLine(R2_SENSOR);
 }
 
+/* ================= Snapshot for telemetry ================= */
+void do_line_getSnapshot(DoLineSnapshot* out) {
+  out->pwm_l = g_pwm_l;
+  out->pwm_r = g_pwm_r;
+  out->enc_l = encL_total;
+  out->enc_r = encR_total;
+  out->recovering = recovering;
+  out->distance_cm = ultrasonic_distance_cm;
+}
+
+void do_line_notePwm(int pwm_l, int pwm_r) {
+  g_pwm_l = pwm_l;
+  g_pwm_r = pwm_r;
+}
+
+float do_line_getMmPerTick() {
+  return CarChassis::MM_PER_TICK;
+}
+
+void do_line_getTuning(DoLineTuning* out) {
+  out->v_base = v_base;
+  out->kp = pidL.Kp;
+  out->ki = pidL.Ki;
+  out->kd = pidL.Kd;
+}
+
+void do_line_setTuning(const DoLineTuning& t) {
+  v_base = clampf(t.v_base, 0.0f, 0.8f);
+  pidL.Kp = pidR.Kp = fmaxf(t.kp, 0.0f);
+  pidL.Ki = pidR.Ki = fmaxf(t.ki, 0.0f);
+  pidL.Kd = pidR.Kd = fmaxf(t.kd, 0.0f);
+  pidL.i_term = pidL.prev_err = 0;
+  pidR.i_term = pidR.prev_err = 0;
+}
+
+/* ================= Track map API ================= */
+bool do_line_setLapMode(DoLineLapMode m) {
+  if (m == LAP_FAST) {
+    portENTER_CRITICAL(&trackMux);
+    bool ok = track_map_valid(&track_map);
+    portEXIT_CRITICAL(&trackMux);
+    if (!ok) return false;
+  }
+  lap_mode_req = (int8_t)m;
+  return true;
+}
+
+DoLineLapMode do_line_getLapMode() {
+  int8_t req = lap_mode_req;
+  return req >= 0 ? (DoLineLapMode)req : lap_mode;
+}
+
+bool do_line_copyTrackMap(TrackMap* out) {
+  portENTER_CRITICAL(&trackMux);
+  *out = track_map;
+  portEXIT_CRITICAL(&trackMux);
+  return track_map_valid(out);
+}
+
+void do_line_getMotionStats(DoLineMotionStats* out) {
+  portENTER_CRITICAL(&motionMux);
+  *out = motion_stats;
+  portEXIT_CRITICAL(&motionMux);
+}
+
+void do_line_getObstacle(DoLineObstacle* out) {
+  portENTER_CRITICAL(&collMux);
+  out->level = coll.level;
+  out->distance_m = coll.track ? coll.d_m : -1.0f;
+  out->closing_mps = coll.track ? coll.v_car + coll.v_obs : 0.0f;
+  out->ttc_s = coll.ttc_s;
+  out->v_allow = coll.v_allow;
+  out->stats = coll.stats;
+  portEXIT_CRITICAL(&collMux);
+}
+
+void do_line_getRecoveryStats(LineRecoveryStats* out) {
+  portENTER_CRITICAL(&recovMux);
+  *out = recov.stats;
+  portEXIT_CRITICAL(&recovMux);
+}
@@ -0,0 +1,11 @@
+#include "heap_stats.h"
+#include <esp_heap_caps.h>
+
+void heap_getStats(HeapStats* out) {
+  out->free_bytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  out->largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  out->min_free_bytes = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  out->frag_pct = out->free_bytes
+      ? (uint8_t)(100 - (uint64_t)out->largest_block * 100 / out->free_bytes)
+      : 0;
+}
@@ -0,0 +1,133 @@
+#include "line_recovery.h"
+#include "chassis.h"
+#include <math.h>
+#include <string.h>
+
+// ================= Config =================
+void line_recovery_defaults(LineRecoveryConfig* cfg) {
+  cfg->v_arc = 0.30f;                   // = vF của recovery cũ
+  cfg->r_arc_m = 0.05f;
+  cfg->arc_rad = 100.0f * CHASSIS_PI / 180.0f;
+  cfg->arc_m = 0.12f;                   // cũng đủ vượt line đứt đoạn
+  cfg->v_spin = 0.20f;                  // ~240°/s
+  cfg->sweep_step_rad = 45.0f * CHASSIS_PI / 180.0f;
+  cfg->sweep_max_rad = 135.0f * CHASSIS_PI / 180.0f;   // không quay về phía line vừa đi qua
+  cfg->same_rad = 45.0f * CHASSIS_PI / 180.0f;
+  cfg->time_max_s = 5.0f;
+}
+
+void line_recovery_init(LineRecovery* r, const LineRecoveryConfig& cfg) {
+  memset(r, 0, sizeof(*r));
+  r->cfg = cfg;
+  r->phase = LREC_IDLE;
+}
+
+void line_recovery_odom(LineRecovery* r, float dL_m, float dR_m) {
+  float ds = 0.5f * (dL_m + dR_m);
+  float dth = (dR_m - dL_m) / CarChassis::TRACK_WIDTH_M;
+  float mid = r->th + 0.5f * dth;
+  r->x += ds * cosf(mid);
+  r->y += ds * sinf(mid);
+  r->th += dth;
+  r->s_m += ds;
+}
+
+void line_recovery_seen(LineRecovery* r) {
+  r->x = r->y = r->th = 0.0f;
+}
+
+void line_recovery_start(LineRecovery* r, int8_t side) {
+  r->side = side;
+  r->phase = LREC_ARC;
+  r->t_s = 0.0f;
+  r->s_m = 0.0f;
+  r->stats.attempts++;
+}
+
+// Tốc độ 2 bánh của cung (bánh ngoài v_arc, bánh trong theo bán kính)
+static void arcSpeeds(const LineRecovery* r, float* vL, float* vR) {
+  const LineRecoveryConfig& c = r->cfg;
+  if (r->side == 0) {
+    *vL = *vR = c.v_arc;
+    return;
+  }
+  float half = 0.5f * CarChassis::TRACK_WIDTH_M;
+  float v_in = c.v_arc * (c.r_arc_m - half) / (c.r_arc_m + half);
+  *vL = r->side > 0 ? v_in : c.v_arc;
+  *vR = r->side > 0 ? c.v_arc : v_in;
+}
+
+static void fail(LineRecovery* r) {
+  r->phase = LREC_FAILED;
+  r->vL = r->vR = 0.0f;
+}
+
+LineRecoveryPhase line_recovery_step(LineRecovery* r, float dt_s) {
+  const LineRecoveryConfig& c = r->cfg;
+  if (r->phase == LREC_IDLE || r->phase == LREC_FAILED) {
+    r->vL = r->vR = 0.0f;
+    return r->phase;
+  }
+  r->t_s += dt_s;
+  if (r->t_s >= c.time_max_s) {
+    fail(r);
+    return r->phase;
+  }
+
+  if (r->phase == LREC_ARC) {
+    bool turned = r->side != 0 && r->side * r->th >= c.arc_rad;
+    if (!turned && r->s_m < c.arc_m) {
+      arcSpeeds(r, &r->vL, &r->vR);
+      return r->phase;
+    }
+    r->phase = LREC_BACK;
+  }
+
+  if (r->phase == LREC_BACK) {
+    // Đi lùi đúng cung vừa chạy về chỗ bắt đầu tìm
+    if (r->s_m > 0.005f) {
+      arcSpeeds(r, &r->vL, &r->vR);
+      r->vL = -r->vL;
+      r->vR = -r->vR;
+      return r->phase;
+    }
+    r->phase = LREC_SWEEP;
+    r->sweep_dir = r->side ? -r->side : 1;   // phía arc đã dò rồi → bên kia trước
+    r->sweep_amp = c.sweep_step_rad;
+  }
+
+  // SWEEP: quay tại chỗ tới ±amp quanh hướng lúc thấy line lần cuối
+  if (r->sweep_dir * (r->th - r->sweep_dir * r->sweep_amp) >= 0.0f) {
+    r->sweep_dir = -r->sweep_dir;
+    r->sweep_amp += c.sweep_step_rad;
+    if (r->sweep_amp > c.sweep_max_rad + 1e-3f) {
+      fail(r);
+      return r->phase;
+    }
+  }
+  r->vL = -r->sweep_dir * c.v_spin;
+  r->vR = r->sweep_dir * c.v_spin;
+  return r->phase;
+}
+
+bool line_recovery_accept(const LineRecovery* r) {
+  if (r->phase == LREC_BACK) return false;
+  if (r->phase == LREC_SWEEP || r->phase == LREC_FAILED) return fabsf(r->th) > r->cfg.same_rad;
+  return true;
+}
+
+void line_recovery_end(LineRecovery* r, bool found) {
+  if (r->phase == LREC_IDLE) return;
+  LineRecoveryStats& st = r->stats;
+  st.t_last_s = r->t_s;
+  if (found) {
+    st.found++;
+    st.t_found_sum_s += r->t_s;
+    st.t_found_max_s = fmaxf(st.t_found_max_s, r->t_s);
+  } else {
+    st.failed++;
+  }
+  st.dist_max_m = fmaxf(st.dist_max_m, sqrtf(r->x * r->x + r->y * r->y));
+  r->phase = LREC_IDLE;
+  r->vL = r->vR = 0.0f;
+}
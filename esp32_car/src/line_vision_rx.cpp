@@ -0,0 +1,85 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include "line_vision_rx.h"
+
+// ================= Configuration =================
+// Camera drops the subscription after 5 s of silence
+const unsigned long SUBSCRIBE_INTERVAL_MS = 2000;
+static const char* SUBSCRIBE_MSG = "LVSUB";
+// Older frame_seq is accepted after this long without packets (camera
+// reboot: seq restarts at 0), same as the look-ahead age limit in do_line
+const unsigned long SEQ_STALE_MS = 150;
+// ... or at once when it jumps back further than any UDP reordering could
+const int32_t SEQ_REORDER_MAX = 64;
+
+// ================= State =================
+static WiFiUDP udp;
+static IPAddress cam_ip;
+static bool rx_started = false;
+static unsigned long last_subscribe_ms = 0;
+
+static LineVisionPacket latest;
+static bool have_latest = false;
+static unsigned long latest_rx_ms = 0;
+
+void vision_rx_begin(const char* camera_ip) {
+  if (!cam_ip.fromString(camera_ip)) {
+    Serial.println("[VISION] Invalid camera IP, look-ahead disabled");
+    return;
+  }
+  udp.begin(LINE_VISION_PORT);
+  rx_started = true;
+  last_subscribe_ms = 0;
+  have_latest = false;
+}
+
+void vision_rx_poll() {
+  if (!rx_started || WiFi.status() != WL_CONNECTED) {
+    return;
+  }
+
+  unsigned long now = millis();
+  if (now - last_subscribe_ms >= SUBSCRIBE_INTERVAL_MS || last_subscribe_ms == 0) {
+    last_subscribe_ms = now;
+    udp.beginPacket(cam_ip, LINE_VISION_PORT);
+    udp.write((const uint8_t*)SUBSCRIBE_MSG, strlen(SUBSCRIBE_MSG));
+    udp.endPacket();
+  }
+
+  // Chỉ giữ gói mới nhất
+  LineVisionPacket pkt;
+  while (udp.parsePacket() > 0) {
+    int n = udp.read((uint8_t*)&pkt, sizeof(pkt));
+    if (n != (int)sizeof(pkt) || pkt.magic != LINE_VISION_MAGIC ||
+        pkt.version != LINE_VISION_VERSION || pkt.n_bands > LINE_VISION_MAX_BANDS) {
+      continue;
+    }
+    // Out-of-order datagram: keep the newer frame
+    if (have_latest) {
+      int32_t d = (int32_t)(pkt.frame_seq - latest.frame_seq);
+      bool restarted = d < -SEQ_REORDER_MAX || now - latest_rx_ms > SEQ_STALE_MS;
+      if (d <= 0 && !restarted) {
+        continue;
+      }
+    }
+    latest = pkt;
+    latest_rx_ms = now;
+    have_latest = true;
+  }
+}
+
+bool vision_rx_get(VisionLookahead* out, uint32_t max_age_ms) {
+  if (!have_latest) {
+    return false;
+  }
+  uint32_t age = (millis() - latest_rx_ms) + latest.latency_us / 1000;
+  if (age > max_age_ms) {
+    return false;
+  }
+  out->n_bands = latest.n_bands;
+  memcpy(out->band, latest.band, sizeof(out->band));
+  out->frame_seq = latest.frame_seq;
+  out->age_ms = age;
+  return true;
+}
@@ -2,12 +2,26 @@
 #include <ESPAsyncWebServer.h>
 #include <ESPmDNS.h>
 #include <HTTPClient.h>
+#include <esp_wifi.h>
+#include <stdarg.h>
+#include <atomic>
 #include "do_line.h"
-#include "mqtt_client.h"
+#include "car_mqtt.h"
+#include "telemetry_spool.h"
+#include "line_vision_rx.h"
+#include "heap_stats.h"
+#include "time_sync.h"
+#include "car_log.h"
+#include "car_sched.h"
+#include "spsc_ring.h"
+#include "chassis.h"
 
 // ESP32-CAM IP address
 const char* CAMERA_IP = "192.168.0.109";
 
+// SNTP server (đổi thành IP máy chạy tools/ntp_server.py khi test trong LAN)
+const char* NTP_SERVER = "pool.ntp.org";
+
 // ================= WiFi Configuration =================
 // Chọn chế độ WiFi: true = STA-only (chỉ kết nối router), false = AP+STA (cả hai)
 const bool WIFI_STA_ONLY = true;  // Đổi thành false nếu muốn dùng AP+STA
@@ -37,10 +51,6 @@ const int SPEED_MIN = 60;
 const int SPEED_MAX = 255;
 const int SPEED_STEP = 10;
 
-// Hệ số bù lệch giữa 2 bánh
-const float L_SCALE = 1.06f; // tăng nhẹ tốc độ target bánh trái (hoặc)
-const float R_SCALE = 1.00f; // giữ nguyên bánh phải
-
 // Giảm tốc bánh phía "bên trong cua" khi đi chéo (0–100%)
 const int DIAG_SCALE = 70; // 70% -> cua mượt
 static inline int diagScale(int v){
@@ -51,6 +61,11 @@ static inline int clamp(int v, int lo, int hi){
   return v<lo?lo:(v>hi?hi:v);
 }
 
+// Lệnh tay bám vận tốc bằng encoder (false: ghi PWM thẳng như bản cũ;
+// đổi lúc chạy bằng GET /drive/loop?closed=0|1)
+const bool MANUAL_CLOSED_LOOP = true;
+const float MANUAL_V_PER_PWM = 0.8f / SPEED_MAX;   // thang speed_* → m/s mỗi bánh
+
 // ============ Đảo hướng steer tiến ============
 const bool INVERT_STEER = true; // true: forward-left giảm bánh PHẢI
 
@@ -64,8 +79,112 @@ static bool lineInited = false; // để chỉ gọi do_line_setup() một lần
 bool line_mode = false;
 
 // ================= MQTT Obstacle Tracking =================
+// Ngưỡng theo TTC trong do_line (collision.h): sự kiện khi xe phải dừng
 bool obstacle_prev_state = true;
-const float OBSTACLE_TH_CM = 15.0f; // Same as do_line.cpp
+
+// ================= Loop Timing =================
+// Chu kỳ loop() (GET /metrics): MQTT chạy ở task riêng nên broker chết
+// không được làm tăng loop_max_us. Cửa sổ reset mỗi lần đọc.
+portMUX_TYPE loopStatsMux = portMUX_INITIALIZER_UNLOCKED;
+uint32_t loop_last_us = 0;
+uint32_t loop_count = 0;
+uint64_t loop_sum_us = 0;
+uint32_t loop_max_us = 0;
+
+// ================= Scheduler =================
+// loop() chỉ chạy scheduler; mỗi việc có chu kỳ / pha / ưu tiên riêng
+// (0 = gấp nhất). Thời gian chạy, jitter, overrun: GET /sched.
+const uint32_t SCHED_CONTROL_US = 2000;      // line-follow (PID tự chia 10 ms) / lệnh vel hết hạn
+const uint32_t SCHED_OBSTACLE_US = 10000;
+const uint32_t SCHED_MQTT_US = 5000;         // lệnh MQTT vào + UDP camera
+const uint32_t SCHED_TELEMETRY_US = 10000;   // policy tự giới hạn tốc độ gửi
+static CarSched sched;
+
+// ================= HTTP Buffers =================
+// Handler chạy trong task AsyncTCP: response dựng trong buffer cố định bằng
+// snprintf thay vì nối String (mỗi lần nối là một lần realloc → phân mảnh
+// heap sau vài giờ chạy).
+static char http_buf[2048];   // /metrics lúc mọi bộ đếm đầy: ~1.7 KB
+
+static size_t appendf(char* buf, size_t cap, size_t n, const char* fmt, ...) {
+  if (n >= cap) return n;
+  va_list ap;
+  va_start(ap, fmt);
+  int w = vsnprintf(buf + n, cap - n, fmt, ap);
+  va_end(ap);
+  return w > 0 ? n + w : n;
+}
+
+// Ảnh JPEG từ ESP32-CAM: task captureTask (ưu tiên thấp) tải ảnh từ camera
+// vào một ring chunk cố định, response chunked của /camera/capture chỉ lấy
+// byte đã có sẵn trong ring. Callback AsyncTCP không bao giờ chạm socket tới
+// camera, nên camera chậm không chặn /forward…/stop hay nhịp deadman. Không
+// buffer cả ảnh (ảnh chụp dual-stream vượt xa vài chục KB); ring đầy thì task
+// chờ client đọc. Một capture tại một thời điểm.
+const uint16_t CAPTURE_TIMEOUT_MS = 5000;       // HTTPClient tới camera
+const unsigned long CAPTURE_STALL_MS = 10000;   // client không đọc: bỏ
+struct CaptureChunk {
+  uint16_t len;
+  uint8_t data[1024];
+};
+static SpscRing<CaptureChunk, 8> capture_ring;  // captureTask → AsyncTCP
+static size_t capture_rd_off = 0;               // AsyncTCP: đã gửi trong chunk đầu
+enum CaptureState : uint8_t { CAPTURE_IDLE, CAPTURE_FETCHING, CAPTURE_DONE };
+static std::atomic<uint8_t> capture_state{CAPTURE_IDLE};
+static std::atomic<bool> capture_cancel{false};  // request đã đóng
+static TaskHandle_t capture_task = nullptr;
+static char camera_stream_url[48];
+static char camera_capture_url[48];
+
+// Tải một ảnh vào capture_ring; camera lỗi → response kết thúc sớm
+static void fetchCapture(HTTPClient& http) {
+  http.begin(camera_capture_url);
+  http.setTimeout(CAPTURE_TIMEOUT_MS);
+  int code = http.GET();
+  if (code != HTTP_CODE_OK) {
+    LOG_W("[CAPTURE] Camera returned %d", code);
+    http.end();
+    return;
+  }
+  int left = http.getSize();            // -1: không biết độ dài
+  WiFiClient& stream = http.getStream();
+  unsigned long progress_ms = millis();
+  while (left != 0 && !capture_cancel) {
+    CaptureChunk* c = capture_ring.reserve();
+    if (!c) {
+      if (millis() - progress_ms > CAPTURE_STALL_MS) {
+        LOG_W("[CAPTURE] Client stalled, aborting");
+        break;
+      }
+      ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));   // chờ client đọc
+      continue;
+    }
+    size_t want = sizeof(c->data);
+    if (left > 0 && (size_t)left < want) want = left;
+    size_t got = stream.readBytes(c->data, want);
+    if (got == 0) break;                 // camera đóng kết nối / timeout
+    c->len = got;
+    capture_ring.commit();
+    if (left > 0) left -= got;
+    progress_ms = millis();
+  }
+  http.end();
+}
+
+static void captureTask(void*) {
+  static HTTPClient http;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (capture_state != CAPTURE_FETCHING) continue;   // notify từ callback
+    fetchCapture(http);
+    uint8_t st = CAPTURE_FETCHING;
+    capture_state.compare_exchange_strong(st, CAPTURE_DONE);
+    if (capture_cancel) {
+      st = CAPTURE_DONE;
+      capture_state.compare_exchange_strong(st, CAPTURE_IDLE);   // request đã đóng
+    }
+  }
+}
 
 // ================= UI =================
 const char index_html[] PROGMEM = R"rawliteral(
@@ -308,7 +427,7 @@ modeSel.addEventListener('change', async ()=>{
  uiLock(m !== 'manual');
  }catch(e){}
 });
-let activeHold = { btn:null, pointerId:null };
+let activeHold = { btn:null, pointerId:null, timer:null };
 function guardManual(handler){
  return function(e){
  if (modeSel.value !== 'manual') {
@@ -321,7 +440,8 @@ function guardManual(handler){
 document.querySelectorAll('.hold').forEach(btn=>{
  btn.addEventListener('pointerdown', guardManual(e=>{
  e.preventDefault();
- activeHold = { btn, pointerId: e.pointerId };
+ clearInterval(activeHold.timer);
+ activeHold = { btn, pointerId: e.pointerId, timer: setInterval(()=>send(btn.dataset.path), 200) };
  btn.classList.add('active');
  btn.setPointerCapture(e.pointerId);
  send(btn.dataset.path);
@@ -330,8 +450,9 @@ document.querySelectorAll('.hold').forEach(btn=>{
  e.preventDefault();
  if (activeHold.btn === btn && activeHold.pointerId === e.pointerId) {
  btn.classList.remove('active');
+ clearInterval(activeHold.timer);
  send('/stop');
- activeHold = { btn:null, pointerId:null };
+ activeHold = { btn:null, pointerId:null, timer:null };
  }
  try{ btn.releasePointerCapture(e.pointerId); }catch(_){}
  });
@@ -358,9 +479,14 @@ refreshSpeed();
 )rawliteral";
 
 // ================= Motion state =================
-enum Motion { STOPPED, FWD, BWD, LEFT_TURN, RIGHT_TURN, FWD_LEFT, FWD_RIGHT, BACK_LEFT, BACK_RIGHT };
+enum Motion { STOPPED, FWD, BWD, LEFT_TURN, RIGHT_TURN, FWD_LEFT, FWD_RIGHT, BACK_LEFT, BACK_RIGHT, VELOCITY };
 volatile Motion curMotion = STOPPED;
 
+// VELOCITY (MQTT "vel"): signed lin / rot PWM, dừng nếu không được gia hạn
+int vel_lin = 0;
+int vel_rot = 0;
+unsigned long vel_deadline_ms = 0;
+
 // ======= Prototypes
 void forward();
 void backward();
@@ -371,12 +497,18 @@ void forwardLeft();
 void forwardRight();
 void backwardLeft();
 void backwardRight();
+void driveVelocity();
 void applyCurrentMotion();
 const char* motionToString(Motion m);
+bool motionFromString(const char* s, Motion* out);
+void setMode(bool line);
+const char* handleRemoteCommand(const CarCommand& cmd);
+void setupScheduler();
 
 // ================= WiFi Setup =================
 void setupWiFi() {
   Serial.begin(115200);
+  car_log_begin();
   delay(1000);
   
   if (WIFI_STA_ONLY) {
@@ -467,14 +599,25 @@ void setup() {
   
   stopCar();
   
-  // Initialize line-follow module (for ultrasonic sensor)
+  // Initialize line-follow module (ultrasonic, encoders, manual drive loop)
   do_line_setup();
+  do_line_begin();
+  do_line_setDriveClosedLoop(MANUAL_CLOSED_LOOP);
+  do_line_safetyBegin();   // HC-SR04 + gate motor, task ưu tiên cao
   
   // Setup WiFi (AP+STA mode)
   setupWiFi();
+  time_sync_begin(NTP_SERVER);
   
   // Initialize MQTT
   mqtt_init();
+  mqtt_setCommandHandler(handleRemoteCommand);
+  
+  // Camera line look-ahead (UDP)
+  vision_rx_begin(CAMERA_IP);
+  snprintf(camera_stream_url, sizeof(camera_stream_url), "http://%s:81/stream", CAMERA_IP);
+  snprintf(camera_capture_url, sizeof(camera_capture_url), "http://%s/capture", CAMERA_IP);
+  xTaskCreatePinnedToCore(captureTask, "capture", 4096, nullptr, 1, &capture_task, 0);
   
   // UI Server
   server.on("/", HTTP_GET, [](AsyncWebServerRequest *req){
@@ -491,48 +634,43 @@ void setup() {
       r->send(400,"text/plain","manual");
       return;
     }
-    String m = r->getParam("m")->value();
-    if (m=="line") {
-      stopCar();
-      do_line_setup();
-      lineInited = true;
-      currentMode = MODE_LINE;
-      line_mode = true;
-    } else {
-      do_line_abort(); // Stop any line-follow operations
-      stopCar();
-      currentMode = MODE_MANUAL;
-      line_mode = false;
-    }
+    const String& m = r->getParam("m")->value();
+    setMode(m=="line");
     r->send(200,"text/plain",(currentMode==MODE_LINE)?"line":"manual");
   });
   
-  // Moves (Manual only)
+  // Moves (Manual only). UI gửi lại lệnh đang giữ mỗi 200 ms: deadman
+  // của safety supervisor dừng xe nếu link im lặng (do_line.h)
   server.on("/forward", HTTP_GET, [](AsyncWebServerRequest *r){
+    do_line_safetyCommand();
     curMotion=FWD;
     if(currentMode==MODE_MANUAL) forward();
     r->send(200,"text/plain","OK");
   });
   
   server.on("/backward", HTTP_GET, [](AsyncWebServerRequest *r){
+    do_line_safetyCommand();
     curMotion=BWD;
     if(currentMode==MODE_MANUAL) backward();
     r->send(200,"text/plain","OK");
   });
   
   server.on("/left", HTTP_GET, [](AsyncWebServerRequest *r){
+    do_line_safetyCommand();
     curMotion=LEFT_TURN;
     if(currentMode==MODE_MANUAL) left();
     r->send(200,"text/plain","OK");
   });
   
   server.on("/right", HTTP_GET, [](AsyncWebServerRequest *r){
+    do_line_safetyCommand();
     curMotion=RIGHT_TURN;
     if(currentMode==MODE_MANUAL) right();
     r->send(200,"text/plain","OK");
   });
   
   server.on("/stop", HTTP_GET, [](AsyncWebServerRequest *r){
+    do_line_safetyCommand();
     curMotion=STOPPED;
     if(currentMode==MODE_MANUAL) stopCar();
     r->send(200,"text/plain","OK");
@@ -540,24 +678,28 @@ void setup() {
   
   // Diagonals (Manual only)
   server.on("/fwd_left", HTTP_GET, [](AsyncWebServerRequest *r){
+    do_line_safetyCommand();
     curMotion=FWD_LEFT;
     if(currentMode==MODE_MANUAL) forwardLeft();
     r->send(200,"text/plain","OK");
   });
   
   server.on("/fwd_right", HTTP_GET, [](AsyncWebServerRequest *r){
+    do_line_safetyCommand();
     curMotion=FWD_RIGHT;
     if(currentMode==MODE_MANUAL) forwardRight();
     r->send(200,"text/plain","OK");
   });
   
   server.on("/back_left", HTTP_GET, [](AsyncWebServerRequest *r){
+    do_line_safetyCommand();
     curMotion=BACK_LEFT;
     if(currentMode==MODE_MANUAL) backwardLeft();
     r->send(200,"text/plain","OK");
   });
   
   server.on("/back_right", HTTP_GET, [](AsyncWebServerRequest *r){
+    do_line_safetyCommand();
     curMotion=BACK_RIGHT;
     if(currentMode==MODE_MANUAL) backwardRight();
     r->send(200,"text/plain","OK");
@@ -589,64 +731,250 @@ void setup() {
   });
   
   server.on("/speed", HTTP_GET, [](AsyncWebServerRequest *r){
-    String s = "Lin: " + String(speed_linear) + " | Rot: " + String(speed_rot);
+    char s[32];
+    snprintf(s, sizeof(s), "Lin: %d | Rot: %d", speed_linear, speed_rot);
     r->send(200,"text/plain", s);
   });
   
   // Get IP address endpoint (useful for STA mode)
   server.on("/getIP", HTTP_GET, [](AsyncWebServerRequest *r){
     IPAddress ip = WiFi.localIP();
-    String ipStr = String(ip[0]) + "." + String(ip[1]) + "." + String(ip[2]) + "." + String(ip[3]);
+    char ipStr[16];
+    snprintf(ipStr, sizeof(ipStr), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
     r->send(200, "text/plain", ipStr);
   });
   
   // Get WiFi info endpoint
   server.on("/getWiFiInfo", HTTP_GET, [](AsyncWebServerRequest *r){
-    String json = "{";
-    json += "\"ssid\":\"" + String(WiFi.SSID()) + "\",";
-    json += "\"ip\":\"" + WiFi.localIP().toString() + "\",";
-    json += "\"rssi\":" + String(WiFi.RSSI()) + ",";
-    json += "\"mode\":\"" + String(WIFI_STA_ONLY ? "STA" : "AP+STA") + "\"";
+    // SSID đọc thẳng từ driver (WiFi.SSID() trả về String)
+    wifi_ap_record_t ap = {};
+    if (esp_wifi_sta_get_ap_info(&ap) != ESP_OK) ap.ssid[0] = '\0';
+    IPAddress ip = WiFi.localIP();
+    size_t n = appendf(http_buf, sizeof(http_buf), 0,
+                       "{\"ssid\":\"%s\",\"ip\":\"%u.%u.%u.%u\",\"rssi\":%d,\"mode\":\"%s\"",
+                       (const char*)ap.ssid, ip[0], ip[1], ip[2], ip[3], WiFi.RSSI(),
+                       WIFI_STA_ONLY ? "STA" : "AP+STA");
     if (!WIFI_STA_ONLY) {
-      json += ",\"ap_ip\":\"" + WiFi.softAPIP().toString() + "\"";
+      IPAddress ap_ip = WiFi.softAPIP();
+      n = appendf(http_buf, sizeof(http_buf), n, ",\"ap_ip\":\"%u.%u.%u.%u\"",
+                  ap_ip[0], ap_ip[1], ap_ip[2], ap_ip[3]);
+    }
+    appendf(http_buf, sizeof(http_buf), n, "}");
+    r->send(200, "application/json", http_buf);
+  });
+  
+  // Loop period + MQTT connect / publish latency, queue depth and drops, spool
+  server.on("/metrics", HTTP_GET, [](AsyncWebServerRequest *r){
+    portENTER_CRITICAL(&loopStatsMux);
+    uint32_t count = loop_count;
+    uint32_t avg_us = count ? (uint32_t)(loop_sum_us / count) : 0;
+    uint32_t max_us = loop_max_us;
+    loop_count = 0;
+    loop_sum_us = 0;
+    loop_max_us = 0;
+    portEXIT_CRITICAL(&loopStatsMux);
+
+    MqttMetrics m;
+    mqtt_getMetrics(&m);
+    HeapStats hs;
+    heap_getStats(&hs);
+    char* b = http_buf;
+    const size_t cap = sizeof(http_buf);
+    size_t n = appendf(b, cap, 0, "{\"loop\":{\"count\":%u,\"avg_us\":%u,\"max_us\":%u},",
+                       count, avg_us, max_us);
+    n = appendf(b, cap, n, "\"heap\":{\"free\":%u,\"largest\":%u,\"min_free\":%u,\"frag_pct\":%u},",
+                hs.free_bytes, hs.largest_block, hs.min_free_bytes, hs.frag_pct);
+    TimeSyncQuality tq;
+    time_sync_getQuality(&tq);
+    n = appendf(b, cap, n, "\"time\":{\"synced\":%s,\"syncs\":%u,\"age_s\":%u,"
+                "\"drift_ppm\":%.2f,\"residual_us\":%d,\"err_us\":%u,\"now_us\":%lld},",
+                tq.synced ? "true" : "false", tq.syncs, tq.age_s, tq.drift_ppm,
+                tq.last_residual_us, tq.err_us, (long long)time_sync_nowUs());
+    CarLogStats ls;
+    car_log_getStats(&ls);
+    n = appendf(b, cap, n, "\"log\":{\"written\":%u,\"dropped\":%u,\"depth\":%u,\"depth_max\":%u},",
+                ls.written, ls.dropped, ls.depth, ls.depth_max);
+    DoLineMotionStats ms;
+    do_line_getMotionStats(&ms);
+    n = appendf(b, cap, n, "\"motion\":{\"moves\":%u,\"timeouts\":%u,\"last_err_mm\":%.1f,"
+                "\"max_err_mm\":%.1f,\"last_ms\":%u},",
+                ms.moves, ms.timeouts, ms.last_err_mm, ms.max_err_mm, ms.last_ms);
+    DoLineObstacle ob;
+    do_line_getObstacle(&ob);
+    n = appendf(b, cap, n, "\"obstacle\":{\"level\":%u,\"d_cm\":%.1f,\"ttc_s\":%.2f,\"v_allow\":%.2f,"
+                "\"events\":%u,\"hard\":%u,\"react_ms_max\":%.0f,\"stop_cm_max\":%.1f,\"clear_cm_min\":%.1f},",
+                ob.level, ob.distance_m * 100.0f, ob.ttc_s, ob.v_allow, ob.stats.events, ob.stats.hard_stops,
+                ob.stats.reaction_max_s * 1000.0f, ob.stats.stop_dist_max_m * 100.0f,
+                ob.stats.clearance_min_m * 100.0f);
+    LineRecoveryStats rs;
+    do_line_getRecoveryStats(&rs);
+    n = appendf(b, cap, n, "\"recovery\":{\"attempts\":%u,\"found\":%u,\"failed\":%u,\"t_avg_ms\":%.0f,"
+                "\"t_max_ms\":%.0f,\"dist_max_cm\":%.1f},",
+                rs.attempts, rs.found, rs.failed, rs.found ? rs.t_found_sum_s * 1000.0f / rs.found : 0.0f,
+                rs.t_found_max_s * 1000.0f, rs.dist_max_m * 100.0f);
+    SafetyStats ss;
+    do_line_getSafetyStats(&ss);
+    SafetyConfig sc;
+    safety_defaults(&sc);
+    n = appendf(b, cap, n, "\"safety\":{\"tripped\":\"%s\",\"obstacle\":%u,\"deadman\":%u,\"watchdog\":%u,"
+                "\"late\":%u,\"latency_us_avg\":%u,\"latency_us_max\":%u,\"bound_us\":%u},",
+                safety_reasonName(do_line_safetyTripped()), ss.obstacle, ss.deadman, ss.watchdog, ss.late,
+                ss.events ? (uint32_t)(ss.latency_sum_us / ss.events) : 0, ss.latency_max_us, sc.latency_max_us);
+    n = appendf(b, cap, n, "\"mqtt\":{\"connected\":%s,\"connects\":%u,\"connect_fails\":%u,"
+                "\"connect_ms_last\":%u,\"connect_ms_max\":%u,\"published\":%u,\"publish_fails\":%u,"
+                "\"publish_us_avg\":%u,\"publish_us_max\":%u,\"queue_ms_avg\":%u,\"queue_ms_max\":%u,"
+                "\"cmd_ok\":%u,\"cmd_dropped\":%u,\"classes\":{",
+                m.connected ? "true" : "false", m.connects, m.connect_fails,
+                m.connect_ms_last, m.connect_ms_max, m.published, m.publish_fails,
+                m.publish_us_avg, m.publish_us_max, m.queue_ms_avg, m.queue_ms_max,
+                m.cmd_ok, m.cmd_dropped);
+    for (int i = 0; i < MQTT_CLASS_COUNT; i++) {
+      n = appendf(b, cap, n, "%s\"%s\":{\"depth\":%u,\"dropped_full\":%u,\"dropped_stale\":%u}",
+                  i ? "," : "", mqtt_className(i), m.depth[i], m.dropped_full[i], m.dropped_stale[i]);
     }
-    json += "}";
-    r->send(200, "application/json", json);
+    SpoolStats sp;
+    spool_getStats(&sp);
+    appendf(b, cap, n, "}},\"spool\":{\"depth_records\":%u,\"depth_bytes\":%u,\"segments\":%u,"
+            "\"dropped\":%u,\"replayed\":%u,\"resent\":%u,\"inflight\":%s}}",
+            sp.depth_records, sp.depth_bytes, sp.segments, sp.dropped_records,
+            sp.replayed, sp.resent, sp.inflight ? "true" : "false");
+    r->send(200, "application/json", http_buf);
+  });
+
+  // Scheduler: chu kỳ thực tế, thời gian chạy, jitter, overrun từng task.
+  // Cửa sổ thống kê reset mỗi lần đọc.
+  server.on("/sched", HTTP_GET, [](AsyncWebServerRequest *r){
+    char* b = http_buf;
+    const size_t cap = sizeof(http_buf);
+    size_t n = appendf(b, cap, 0, "{\"tasks\":[");
+    CarSchedStats st;
+    for (uint8_t i = 0; car_sched_getStats(&sched, i, &st); i++) {
+      n = appendf(b, cap, n, "%s{\"name\":\"%s\",\"period_us\":%u,\"prio\":%u,\"rate_hz\":%.1f,"
+                  "\"run_us_avg\":%u,\"run_us_max\":%u,\"jitter_us_avg\":%u,\"jitter_us_max\":%u,"
+                  "\"late_us_max\":%u,\"load_pct\":%u,\"runs\":%u,\"overruns\":%u,\"missed\":%u}",
+                  i ? "," : "", st.name, st.period_us, st.priority, st.rate_hz,
+                  st.run_us_avg, st.run_us_max, st.jitter_us_avg, st.jitter_us_max,
+                  st.late_us_max, st.load_pct, st.runs, st.overruns, st.missed);
+    }
+    appendf(b, cap, n, "]}");
+    car_sched_resetWindow(&sched);
+    r->send(200, "application/json", http_buf);
+  });
+  
+  // Manual drive: odometry khi lái tay (lệch hướng / m khi đi thẳng, sai
+  // số tốc độ). Cửa sổ thống kê reset mỗi lần đọc.
+  server.on("/drive", HTTP_GET, [](AsyncWebServerRequest *r){
+    DoLineDriveStats ds;
+    do_line_getDriveStats(&ds, true);
+    appendf(http_buf, sizeof(http_buf), 0,
+            "{\"closed_loop\":%s,\"v_tgt\":%.3f,\"w_tgt\":%.2f,\"v_meas\":%.3f,\"w_meas\":%.2f,"
+            "\"straight_m\":%.2f,\"drift_deg_per_m\":%.2f,\"speed_err_rms\":%.3f}",
+            ds.closed_loop ? "true" : "false", ds.v_tgt, ds.w_tgt, ds.v_meas, ds.w_meas,
+            ds.straight_m, ds.drift_deg_per_m, ds.speed_err_rms);
+    r->send(200, "application/json", http_buf);
+  });
+
+  server.on("/drive/loop", HTTP_GET, [](AsyncWebServerRequest *r){
+    if (r->hasParam("closed")) {
+      stopCar();
+      curMotion = STOPPED;
+      do_line_setDriveClosedLoop(r->getParam("closed")->value() == "1");
+    }
+    r->send(200, "text/plain", do_line_getDriveClosedLoop() ? "closed" : "open");
+  });
+
+  // Wheel trim: ước lượng hiện tại; /trim/calibrate chạy thẳng ~1.2 m
+  // (chỉ lái tay, xe phải đứng yên và có đường thẳng phía trước)
+  server.on("/trim", HTTP_GET, [](AsyncWebServerRequest *r){
+    DoLineTrim t;
+    do_line_getTrim(&t);
+    appendf(http_buf, sizeof(http_buf), 0,
+            "{\"l\":%.3f,\"r\":%.3f,\"est_l\":%.3f,\"est_r\":%.3f,\"confidence\":%.2f,"
+            "\"samples\":%u,\"gain_l\":%.5f,\"gain_r\":%.5f,\"calibrating\":%s}",
+            t.trim_l, t.trim_r, t.est_l, t.est_r, t.confidence, (unsigned)t.samples,
+            t.gain_l, t.gain_r, t.calibrating ? "true" : "false");
+    r->send(200, "application/json", http_buf);
+  });
+
+  server.on("/trim/calibrate", HTTP_GET, [](AsyncWebServerRequest *r){
+    if (currentMode != MODE_MANUAL) {
+      r->send(409, "text/plain", "manual mode only");
+      return;
+    }
+    stopCar();
+    curMotion = STOPPED;
+    do_line_trimCalibrate();
+    r->send(200, "text/plain", "calibrating");
+  });
+
+  // Track map: học một vòng rồi chạy fast lap theo map (do_line.h).
+  // ?on=1 bắt đầu, ?on=0 dừng (dừng học = lưu những gì đã đi được)
+  server.on("/track", HTTP_GET, [](AsyncWebServerRequest *r){
+    static TrackMap map;   // handler chạy tuần tự trong task AsyncTCP
+    do_line_copyTrackMap(&map);
+    track_map_toJson(&map, http_buf, sizeof(http_buf));
+    r->send(200, "application/json", http_buf);
+  });
+
+  server.on("/track/learn", HTTP_GET, [](AsyncWebServerRequest *r){
+    bool on = r->hasParam("on") && r->getParam("on")->value() == "1";
+    do_line_setLapMode(on ? LAP_LEARN : LAP_NORMAL);
+    r->send(200, "text/plain", on ? "learn" : "normal");
+  });
+
+  server.on("/track/fast", HTTP_GET, [](AsyncWebServerRequest *r){
+    bool on = r->hasParam("on") && r->getParam("on")->value() == "1";
+    if (!do_line_setLapMode(on ? LAP_FAST : LAP_NORMAL)) {
+      r->send(409, "text/plain", "no track map");
+      return;
+    }
+    r->send(200, "text/plain", on ? "fast" : "normal");
   });
   
   // Camera stream proxy (redirect to avoid CORS - browser will load directly)
   // Note: This redirects to ESP32-CAM, so browser loads from same origin perspective
   server.on("/camera/stream", HTTP_GET, [](AsyncWebServerRequest *r){
-    String url = "http://" + String(CAMERA_IP) + ":81/stream";
-    r->redirect(url);
+    r->redirect(camera_stream_url);
   });
   
-  // Camera capture proxy
+  // Camera capture proxy: captureTask tải ảnh, callback chỉ copy từ ring
   server.on("/camera/capture", HTTP_GET, [](AsyncWebServerRequest *r){
-    HTTPClient http;
-    String url = "http://" + String(CAMERA_IP) + "/capture";
-    http.begin(url);
-    http.setTimeout(5000);
-    
-    int httpCode = http.GET();
-    if (httpCode == HTTP_CODE_OK) {
-      // Get image data
-      int len = http.getSize();
-      uint8_t* buffer = (uint8_t*)malloc(len);
-      if (buffer) {
-        http.getStream().readBytes(buffer, len);
-        // Create response with CORS header using beginResponse_P
-        AsyncWebServerResponse *response = r->beginResponse_P(200, "image/jpeg", buffer, len);
-        response->addHeader("Access-Control-Allow-Origin", "*");
-        r->send(response);
-        free(buffer);
-      } else {
-        r->send(500, "text/plain", "Memory allocation failed");
-      }
-    } else {
-      r->send(500, "text/plain", "Failed to capture image");
+    uint8_t idle = CAPTURE_IDLE;
+    if (!capture_task || !capture_state.compare_exchange_strong(idle, CAPTURE_FETCHING)) {
+      r->send(503, "text/plain", "Capture busy");
+      return;
     }
-    http.end();
+    while (capture_ring.front()) capture_ring.pop();   // dư từ lần trước bị hủy
+    capture_rd_off = 0;
+    capture_cancel = false;
+    xTaskNotifyGive(capture_task);
+
+    r->onDisconnect([](){
+      capture_cancel = true;
+      uint8_t done = CAPTURE_DONE;
+      capture_state.compare_exchange_strong(done, CAPTURE_IDLE);
+    });
+    AsyncWebServerResponse *response = r->beginChunkedResponse("image/jpeg",
+        [](uint8_t *buf, size_t maxLen, size_t) -> size_t {
+      CaptureChunk* c = capture_ring.front();
+      if (!c) {
+        if (capture_state == CAPTURE_FETCHING) return RESPONSE_TRY_AGAIN;
+        c = capture_ring.front();   // chunk cuối commit trước khi DONE
+        if (!c) return 0;           // hết ảnh (hoặc camera lỗi): kết thúc response
+      }
+      size_t n = c->len - capture_rd_off;
+      if (n > maxLen) n = maxLen;
+      memcpy(buf, c->data + capture_rd_off, n);
+      capture_rd_off += n;
+      if (capture_rd_off >= c->len) {
+        capture_ring.pop();
+        capture_rd_off = 0;
+        xTaskNotifyGive(capture_task);   // có chỗ trống trong ring
+      }
+      return n;
+    });
+    response->addHeader("Access-Control-Allow-Origin", "*");
+    r->send(response);
   });
   
   server.begin();
@@ -654,76 +982,104 @@ void setup() {
   
   // Add mDNS service
   MDNS.addService("http", "tcp", 80);
+
+  setupScheduler();
 }
 
-// ================= Loop =================
-void loop() {
-  // Always call MQTT loop (non-blocking)
-  mqtt_loop();
-  
+// ================= Scheduled Tasks =================
+static uint32_t schedClock() {
+  return micros();
+}
+
+static void taskControl() {
   if (currentMode == MODE_LINE) {
     // Line-follow mode: do_line handles everything
     do_line_loop();
-    
-    // Check for obstacle state change and publish event
-    float dist = do_line_getDistanceCM();
-    bool obstacle_now = (dist > 0 && dist < OBSTACLE_TH_CM);
-    if (obstacle_now != obstacle_prev_state) {
-      if (obstacle_now) {
-        // Obstacle detected
-        mqtt_publishObstacleEvent(dist);
-      }
-      obstacle_prev_state = obstacle_now;
-    }
-    
-    // Publish telemetry
-    mqtt_publishTelemetryWithState("line", "line_follow", speed_linear, speed_rot);
-    
-  } else {
-    // Manual mode
-    if (line_mode) {
+    return;
+  }
+  if (line_mode) {
+    stopCar();
+    line_mode = false;
+  }
+  // Lệnh vel qua MQTT hết hạn (mất kết nối / operator ngừng gửi) → dừng
+  if (curMotion == VELOCITY && (long)(millis() - vel_deadline_ms) >= 0) {
+    stopCar();
+    curMotion = STOPPED;
+  }
+  // Supervisor đã cắt motor (mất link / loop kẹt): bỏ lệnh đang chạy để
+  // gate mở lại không tự chạy tiếp
+  if (curMotion != STOPPED && (do_line_safetyTripped() & (SAFETY_DEADMAN | SAFETY_WATCHDOG))) {
+    stopCar();
+    curMotion = STOPPED;
+  }
+  do_line_driveLoop();
+}
+
+static void taskObstacle() {
+  DoLineObstacle ob;
+  do_line_getObstacle(&ob);
+  bool obstacle_now = ob.level == COLL_STOP || ob.level == COLL_BLOCKED;
+  float dist = ob.distance_m * 100.0f;
+
+  // Manual mode: vòng kín do_line tự giảm tốc theo TTC; ở đây dừng hẳn lệnh
+  // đang tiến (vòng hở chỉ dừng được ở đây). Lùi ra khỏi vật cản vẫn được.
+  // Line mode: do_line tự né vật cản.
+  if (obstacle_now && currentMode == MODE_MANUAL) {
+    if (curMotion == FWD || curMotion == FWD_LEFT || curMotion == FWD_RIGHT ||
+        (curMotion == VELOCITY && vel_lin > 0) || do_line_trimCalibrating()) {
       stopCar();
-      line_mode = false;
+      curMotion = STOPPED;
+      LOG_W("[OBSTACLE] Vật cản phát hiện ở %.1f cm - Đã dừng xe tự động!", dist);
     }
-    
-    // Update ultrasonic sensor thường xuyên (cần cho state machine hoạt động)
-    do_line_updateUltrasonic();
-    
-    // Publish telemetry with current motion state
-    const char* mode_str = "manual";
-    const char* motion_str = motionToString(curMotion);
-    mqtt_publishTelemetryWithState(mode_str, motion_str, speed_linear, speed_rot);
-    
-    // Check obstacle in manual mode - dừng xe tự động khi có vật cản
-    float dist = do_line_getDistanceCM();
-    bool obstacle_now = (dist > 0 && dist < OBSTACLE_TH_CM);
-    
-    // Phát hiện vật cản → dừng xe tự động (chỉ khi đang di chuyển)
+  }
+
+  // Publish event khi state thay đổi
+  if (obstacle_now != obstacle_prev_state) {
     if (obstacle_now) {
-      // Chỉ dừng nếu đang di chuyển (forward, backward, diagonal)
-      if (curMotion == FWD || curMotion == BWD || 
-          curMotion == FWD_LEFT || curMotion == FWD_RIGHT ||
-          curMotion == BACK_LEFT || curMotion == BACK_RIGHT) {
-        stopCar();
-        curMotion = STOPPED;
-        Serial.print("[OBSTACLE] Vật cản phát hiện ở ");
-        Serial.print(dist, 1);
-        Serial.println(" cm - Đã dừng xe tự động!");
-      }
+      mqtt_publishObstacleEvent(dist);
     }
-    
-    // Publish event khi state thay đổi
-    if (obstacle_now != obstacle_prev_state) {
-      if (obstacle_now) {
-        mqtt_publishObstacleEvent(dist);
-        Serial.print("[MQTT] Obstacle event published: ");
-        Serial.print(dist, 1);
-        Serial.println(" cm");
-      }
-      obstacle_prev_state = obstacle_now;
-    }
-    
-    delay(5); // Manual mode doesn't need tight loop
+    obstacle_prev_state = obstacle_now;
+  }
+}
+
+static void taskMqtt() {
+  mqtt_loop();
+  vision_rx_poll();
+}
+
+static void taskTelemetry() {
+  if (currentMode == MODE_LINE) {
+    mqtt_publishTelemetryWithState("line", "line_follow", speed_linear, speed_rot);
+  } else {
+    mqtt_publishTelemetryWithState("manual", motionToString(curMotion), speed_linear, speed_rot);
+  }
+}
+
+void setupScheduler() {
+  car_sched_init(&sched, schedClock);
+  car_sched_add(&sched, "control", SCHED_CONTROL_US, 0, 0, taskControl);
+  car_sched_add(&sched, "obstacle", SCHED_OBSTACLE_US, 500, 1, taskObstacle);
+  car_sched_add(&sched, "mqtt", SCHED_MQTT_US, 1000, 2, taskMqtt);
+  car_sched_add(&sched, "telemetry", SCHED_TELEMETRY_US, 1500, 3, taskTelemetry);
+  car_sched_start(&sched);
+}
+
+// ================= Loop =================
+void loop() {
+  uint32_t now_us = micros();
+  if (loop_last_us != 0) {
+    uint32_t period = now_us - loop_last_us;
+    portENTER_CRITICAL(&loopStatsMux);
+    loop_count++;
+    loop_sum_us += period;
+    if (period > loop_max_us) loop_max_us = period;
+    portEXIT_CRITICAL(&loopStatsMux);
+  }
+  loop_last_us = now_us;
+
+  uint32_t idle_us = car_sched_poll(&sched);
+  if (idle_us >= 1000) {
+    delay(idle_us / 1000);   // nhường CPU tới lần release kế
   }
 }
 
@@ -738,10 +1094,86 @@ const char* motionToString(Motion m){
     case FWD_RIGHT: return "fwd_right";
     case BACK_LEFT: return "back_left";
     case BACK_RIGHT: return "back_right";
+    case VELOCITY: return "velocity";
     default: return "stop";
   }
 }
 
+bool motionFromString(const char* s, Motion* out){
+  static const Motion ALL[] = { STOPPED, FWD, BWD, LEFT_TURN, RIGHT_TURN,
+                                FWD_LEFT, FWD_RIGHT, BACK_LEFT, BACK_RIGHT };
+  for (Motion m : ALL) {
+    if (strcmp(s, motionToString(m)) == 0) { *out = m; return true; }
+  }
+  return false;
+}
+
+// ================= Mode switch =================
+void setMode(bool line){
+  if (line) {
+    stopCar();
+    do_line_setup();
+    lineInited = true;
+    currentMode = MODE_LINE;
+    line_mode = true;
+    do_line_safetySetDeadman(false);
+  } else {
+    do_line_abort(); // Stop any line-follow operations
+    stopCar();
+    currentMode = MODE_MANUAL;
+    line_mode = false;
+    do_line_safetySetDeadman(true);
+  }
+}
+
+// ================= Remote commands (MQTT car/<id>/cmd) =================
+// Chạy trong loop() (mqtt_loop), cùng task với điều khiển motor
+// Deadman chỉ được nạp bởi lệnh lái đã chấp nhận: lệnh bị từ chối hay
+// speed / tune không giữ cho xe tiếp tục chạy
+const char* handleRemoteCommand(const CarCommand& cmd){
+  switch (cmd.type) {
+    case CAR_CMD_MOTION: {
+      Motion m;
+      if (!motionFromString(cmd.motion, &m)) return "unknown motion";
+      if (currentMode != MODE_MANUAL) return "line mode";
+      do_line_safetyCommand();
+      curMotion = m;
+      applyCurrentMotion();
+      return nullptr;
+    }
+    case CAR_CMD_VELOCITY:
+      if (currentMode != MODE_MANUAL) return "line mode";
+      do_line_safetyCommand();
+      vel_lin = clamp(cmd.lin, -SPEED_MAX, SPEED_MAX);
+      vel_rot = clamp(cmd.rot, -SPEED_MAX, SPEED_MAX);
+      vel_deadline_ms = millis() + cmd.hold_ms;
+      curMotion = VELOCITY;
+      driveVelocity();
+      return nullptr;
+    case CAR_CMD_MODE:
+      if (strcmp(cmd.mode, "line") == 0) setMode(true);
+      else if (strcmp(cmd.mode, "manual") == 0) setMode(false);
+      else return "unknown mode";
+      return nullptr;
+    case CAR_CMD_SPEED:
+      if (cmd.lin >= 0) speed_linear = clamp(cmd.lin, SPEED_MIN, SPEED_MAX);
+      if (cmd.rot >= 0) speed_rot = clamp(cmd.rot, SPEED_MIN, SPEED_MAX);
+      if (currentMode == MODE_MANUAL && curMotion != VELOCITY) applyCurrentMotion();
+      return nullptr;
+    case CAR_CMD_TUNE: {
+      DoLineTuning t;
+      do_line_getTuning(&t);
+      if (!isnan(cmd.v_base)) t.v_base = cmd.v_base;
+      if (!isnan(cmd.kp)) t.kp = cmd.kp;
+      if (!isnan(cmd.ki)) t.ki = cmd.ki;
+      if (!isnan(cmd.kd)) t.kd = cmd.kd;
+      do_line_setTuning(t);
+      return nullptr;
+    }
+  }
+  return "unknown command";
+}
+
 // ================= Apply current motion (Manual) =================
 void applyCurrentMotion(){
   switch(curMotion){
@@ -753,105 +1185,84 @@ void applyCurrentMotion(){
     case FWD_RIGHT: forwardRight(); break;
     case BACK_LEFT: backwardLeft(); break;
     case BACK_RIGHT: backwardRight(); break;
+    case VELOCITY: driveVelocity(); break;
     default: stopCar(); break;
   }
 }
 
 // ================= Motor control (Manual) =================
+// Mọi lệnh tay quy về PWM có dấu cho 2 bánh (thang speed_linear / speed_rot,
+// + = tiến). Vòng kín: đổi sang v (m/s) / ω (rad/s) cho do_line bám bằng
+// encoder; vòng hở: ghi PWM thẳng ra L298N.
+static void driveWheels(int pwm_l, int pwm_r) {
+  pwm_l = clamp(pwm_l, -SPEED_MAX, SPEED_MAX);
+  pwm_r = clamp(pwm_r, -SPEED_MAX, SPEED_MAX);
+  float v_l = pwm_l * MANUAL_V_PER_PWM;
+  float v_r = pwm_r * MANUAL_V_PER_PWM;
+  do_line_setDriveTarget(0.5f * (v_l + v_r), (v_r - v_l) / CarChassis::TRACK_WIDTH_M);
+  if (do_line_getDriveClosedLoop()) return;
+  
+  do_line_applyTrim(&pwm_l, &pwm_r);
+  do_line_writeMotors(pwm_l, pwm_r);   // qua gate của safety supervisor
+}
+
 void forward() {
-  digitalWrite(IN1,HIGH);
-  digitalWrite(IN2,LOW);
-  digitalWrite(IN3,HIGH);
-  digitalWrite(IN4,LOW);
-  analogWrite(ENA, speed_linear);
-  analogWrite(ENB, speed_linear);
+  driveWheels(speed_linear, speed_linear);
 }
 
 void backward() {
-  digitalWrite(IN1,LOW);
-  digitalWrite(IN2,HIGH);
-  digitalWrite(IN3,LOW);
-  digitalWrite(IN4,HIGH);
-  analogWrite(ENA, speed_linear);
-  analogWrite(ENB, speed_linear);
+  driveWheels(-speed_linear, -speed_linear);
 }
 
 void left() {
   // quay tại chỗ
-  digitalWrite(IN1,LOW);
-  digitalWrite(IN2,HIGH);
-  digitalWrite(IN3,HIGH);
-  digitalWrite(IN4,LOW);
-  analogWrite(ENA, speed_rot);
-  analogWrite(ENB, speed_rot);
+  driveWheels(-speed_rot, speed_rot);
 }
 
 void right() {
   // quay tại chỗ
-  digitalWrite(IN1,HIGH);
-  digitalWrite(IN2,LOW);
-  digitalWrite(IN3,LOW);
-  digitalWrite(IN4,HIGH);
-  analogWrite(ENA, speed_rot);
-  analogWrite(ENB, speed_rot);
+  driveWheels(speed_rot, -speed_rot);
 }
 
+// Dừng ngay (không ramp): nút stop, vật cản, đổi mode
 void stopCar() {
+  do_line_driveStop();
   digitalWrite(IN1,LOW);
   digitalWrite(IN2,LOW);
   digitalWrite(IN3,LOW);
   digitalWrite(IN4,LOW);
   analogWrite(ENA, 0);
   analogWrite(ENB, 0);
+  do_line_notePwm(0, 0);
 }
 
 // ========= Diagonal steering (Manual) =========
 void forwardLeft() {
-  digitalWrite(IN1,HIGH);
-  digitalWrite(IN2,LOW);
-  digitalWrite(IN3,HIGH);
-  digitalWrite(IN4,LOW);
   if (!INVERT_STEER) {
-    // giảm TRÁI
-    analogWrite(ENA, speed_linear);
-    analogWrite(ENB, diagScale(speed_linear));
+    driveWheels(speed_linear, diagScale(speed_linear));   // giảm TRÁI
   } else {
-    // giảm PHẢI
-    analogWrite(ENA, diagScale(speed_linear));
-    analogWrite(ENB, speed_linear);
+    driveWheels(diagScale(speed_linear), speed_linear);   // giảm PHẢI
   }
 }
 
 void forwardRight() {
-  digitalWrite(IN1,HIGH);
-  digitalWrite(IN2,LOW);
-  digitalWrite(IN3,HIGH);
-  digitalWrite(IN4,LOW);
   if (!INVERT_STEER) {
-    // giảm PHẢI
-    analogWrite(ENA, diagScale(speed_linear));
-    analogWrite(ENB, speed_linear);
+    driveWheels(diagScale(speed_linear), speed_linear);   // giảm PHẢI
   } else {
-    // giảm TRÁI
-    analogWrite(ENA, speed_linear);
-    analogWrite(ENB, diagScale(speed_linear));
+    driveWheels(speed_linear, diagScale(speed_linear));   // giảm TRÁI
   }
 }
 
 void backwardLeft() {
-  digitalWrite(IN1,LOW);
-  digitalWrite(IN2,HIGH);
-  digitalWrite(IN3,LOW);
-  digitalWrite(IN4,HIGH);
-  analogWrite(ENA, diagScale(speed_linear)); // bánh PHẢI chậm hơn
-  analogWrite(ENB, speed_linear);
+  driveWheels(-diagScale(speed_linear), -speed_linear);   // bánh PHẢI chậm hơn
 }
 
 void backwardRight() {
-  digitalWrite(IN1,LOW);
-  digitalWrite(IN2,HIGH);
-  digitalWrite(IN3,LOW);
-  digitalWrite(IN4,HIGH);
-  analogWrite(ENA, speed_linear);
-  analogWrite(ENB, diagScale(speed_linear)); // bánh TRÁI chậm hơn
+  driveWheels(-speed_linear, -diagScale(speed_linear));   // bánh TRÁI chậm hơn
+}
+
+// ========= Signed velocity (MQTT "vel") =========
+// rot > 0 quay trái: bánh trái (ENA) chậm lại, bánh phải (ENB) nhanh lên
+void driveVelocity() {
+  driveWheels(vel_lin - vel_rot, vel_lin + vel_rot);
 }
@@ -0,0 +1,134 @@
+#include "motion_profile.h"
+#include "chassis.h"
+#include <math.h>
+#include <string.h>
+
+// ================= Config =================
+const float MOTION_V_STATIC = 0.02f;   // below this command: no deadband feedforward
+const float MOTION_VEL_ALPHA = 0.3f;   // 1 tick / 10 ms = 0.5 m/s → lọc vận tốc đo
+
+void motion_defaults(MotionGains* g) {
+  g->pwm_per_mps = 240.0f;   // TT motor @ 7.4 V: ~0.9 m/s at PWM 255
+  g->pwm_static = 45.0f;     // ~ PWM_MIN_RUN của do_line
+  g->kp_pos = 4.0f;
+  g->k_sync = 6.0f;
+  g->kp_vel = 120.0f;
+  g->lead_s = 0.06f;         // hằng số thời gian động cơ TT
+  g->tol_m = 0.003f;         // ~½ tick
+  g->settle_s = 0.30f;
+}
+
+// ================= Profile =================
+void motion_profile_plan(MotionProfile* p, float dist_m, const MotionLimits& lim) {
+  memset(p, 0, sizeof(*p));
+  if (dist_m <= 0.0f || lim.v_max <= 0.0f || lim.a_max <= 0.0f) return;
+  p->dist_m = dist_m;
+  p->a = lim.a_max;
+  // Triangle when the move is too short to reach v_max
+  float v_peak = sqrtf(dist_m * lim.a_max);
+  p->v_peak = v_peak < lim.v_max ? v_peak : lim.v_max;
+  p->t_acc = p->v_peak / p->a;
+  float d_ramps = p->v_peak * p->t_acc;   // accel + decel
+  p->t_cruise = (dist_m - d_ramps) / p->v_peak;
+  if (p->t_cruise < 0.0f) p->t_cruise = 0.0f;
+  p->t_total = 2.0f * p->t_acc + p->t_cruise;
+}
+
+void motion_profile_at(const MotionProfile* p, float t, float* s, float* v) {
+  if (t <= 0.0f || p->t_total <= 0.0f) {
+    *s = 0.0f;
+    *v = 0.0f;
+  } else if (t < p->t_acc) {
+    *v = p->a * t;
+    *s = 0.5f * p->a * t * t;
+  } else if (t < p->t_acc + p->t_cruise) {
+    *v = p->v_peak;
+    *s = 0.5f * p->v_peak * p->t_acc + p->v_peak * (t - p->t_acc);
+  } else if (t < p->t_total) {
+    float td = p->t_total - t;
+    *v = p->a * td;
+    *s = p->dist_m - 0.5f * p->a * td * td;
+  } else {
+    *s = p->dist_m;
+    *v = 0.0f;
+  }
+}
+
+// ================= Controller =================
+void motion_begin(MotionCtrl* m, int8_t dir_l, int8_t dir_r, float dist_m, const MotionLimits& lim,
+                  const MotionGains& g) {
+  memset(m, 0, sizeof(*m));
+  motion_profile_plan(&m->prof, dist_m, lim);
+  m->g = g;
+  m->dir_l = dir_l >= 0 ? 1 : -1;
+  m->dir_r = dir_r >= 0 ? 1 : -1;
+  m->done = dist_m <= 0.0f;
+}
+
+// Wheel command → PWM along dir. Encoder không có chiều → không bao giờ
+// đảo chiều bánh giữa chừng: lệnh âm = thả trôi (PWM 0)
+static int wheelPwm(const MotionGains& g, float v_cmd, float v_meas) {
+  if (v_cmd <= 0.0f) return 0;
+  float u = g.kp_vel * (v_cmd - v_meas);
+  if (v_cmd > MOTION_V_STATIC) u += g.pwm_static + g.pwm_per_mps * v_cmd;
+  if (u > 255.0f) u = 255.0f;
+  if (u < 0.0f) u = 0.0f;
+  return (int)u;
+}
+
+bool motion_step(MotionCtrl* m, unsigned long ticks_l, unsigned long ticks_r, float dt_s, int* pwm_l, int* pwm_r) {
+  *pwm_l = 0;
+  *pwm_r = 0;
+  if (m->done || dt_s <= 0.0f) return !m->done;
+
+  float dl = ticks_l * CarChassis::M_PER_TICK;
+  float dr = ticks_r * CarChassis::M_PER_TICK;
+  m->pos_l += dl;
+  m->pos_r += dr;
+  m->vel_l += MOTION_VEL_ALPHA * (dl / dt_s - m->vel_l);
+  m->vel_r += MOTION_VEL_ALPHA * (dr / dt_s - m->vel_r);
+  m->t += dt_s;
+
+  const MotionGains& g = m->g;
+  // Sau N cạnh encoder bánh đã đi [N, N+1) tick → ước lượng giữa khoảng
+  float est_l = m->pos_l > 0.0f ? m->pos_l + 0.5f * CarChassis::M_PER_TICK : 0.0f;
+  float est_r = m->pos_r > 0.0f ? m->pos_r + 0.5f * CarChassis::M_PER_TICK : 0.0f;
+  float err_l = m->prof.dist_m - est_l;
+  float err_r = m->prof.dist_m - est_r;
+  if (m->t >= m->prof.t_total) {
+    bool at_rest = fabsf(m->vel_l) < MOTION_V_STATIC && fabsf(m->vel_r) < MOTION_V_STATIC;
+    if (err_l <= g.tol_m && err_r <= g.tol_m && at_rest) {
+      m->done = true;
+      return false;
+    }
+    if (m->t >= m->prof.t_total + g.settle_s) {
+      m->done = true;
+      m->timeout = true;
+      return false;
+    }
+  }
+
+  // Position from the profile now, velocity feedforward from lead_s ahead:
+  // the motor lags, so it starts braking early enough to end at rest
+  float s_ref, v_ref, s_lead;
+  motion_profile_at(&m->prof, m->t, &s_ref, &v_ref);
+  motion_profile_at(&m->prof, m->t + g.lead_s, &s_lead, &v_ref);
+  float sync = est_r - est_l;
+  float v_l = v_ref + g.kp_pos * (s_ref - est_l) + g.k_sync * sync;
+  float v_r = v_ref + g.kp_pos * (s_ref - est_r) - g.k_sync * sync;
+  // A wheel at the target stays put (overshoot is not driven back)
+  if (err_l <= g.tol_m && m->t >= m->prof.t_total) v_l = 0.0f;
+  if (err_r <= g.tol_m && m->t >= m->prof.t_total) v_r = 0.0f;
+
+  *pwm_l = m->dir_l * wheelPwm(g, v_l, m->vel_l);
+  *pwm_r = m->dir_r * wheelPwm(g, v_r, m->vel_r);
+  return true;
+}
+
+void motion_result(const MotionCtrl* m, MotionResult* out) {
+  float half = 0.5f * CarChassis::M_PER_TICK;
+  out->err_l_m = m->prof.dist_m - (m->pos_l > 0.0f ? m->pos_l + half : 0.0f);
+  out->err_r_m = m->prof.dist_m - (m->pos_r > 0.0f ? m->pos_r + half : 0.0f);
+  out->time_s = m->t;
+  out->timeout = m->timeout;
+}
@@ -0,0 +1,134 @@
+#include "safety.h"
+#include <string.h>
+
+// ================= Config =================
+const uint8_t SAFETY_MISS_CLEAR = 3;    // echo mất liên tiếp chừng này → hết vật cản
+
+void safety_defaults(SafetyConfig* cfg) {
+  cfg->period_us = 1000;            // = chu kỳ poll echo HC-SR04
+  cfg->latency_max_us = 3000;       // 1 chu kỳ + trễ đánh thức task + ghi chân
+  cfg->stop_m = 0.10f;              // trong standoff 15 cm của guard TTC: chỉ khi guard không kịp
+  cfg->clear_m = 0.13f;
+  cfg->deadman_us = 500000;         // UI gửi lại lệnh đang giữ mỗi 200 ms
+  cfg->watchdog_us = 100000;        // control 2 ms, PID / manoeuvre 10 ms
+}
+
+void safety_init(Safety* s, const SafetyConfig& cfg, uint32_t now_us) {
+  memset(s, 0, sizeof(*s));
+  s->cfg = cfg;
+  s->cmd_us = now_us;
+  s->hb_us = now_us;
+}
+
+// ================= Inputs =================
+void safety_command(Safety* s, uint32_t now_us) {
+  s->cmd_us = now_us;
+  s->tripped &= ~SAFETY_DEADMAN;
+}
+
+void safety_heartbeat(Safety* s, uint32_t now_us) {
+  s->hb_us = now_us;
+  s->tripped &= ~SAFETY_WATCHDOG;
+}
+
+void safety_echo(Safety* s, uint32_t now_us, float dist_m) {
+  if (dist_m >= 0.0f && dist_m < s->cfg.stop_m) {
+    if (!s->near) s->near_us = now_us;
+    s->near = true;
+    s->misses = 0;
+  } else if (s->near) {
+    // Quá gần HC-SR04 cũng hay mất echo: một lần mất chưa phải là hết vật cản
+    if (dist_m >= s->cfg.clear_m || (dist_m < 0.0f && ++s->misses >= SAFETY_MISS_CLEAR)) {
+      s->near = false;
+    }
+  }
+  if (s->near) s->tripped |= SAFETY_OBSTACLE;
+  else s->tripped &= ~SAFETY_OBSTACLE;
+}
+
+// ================= Supervisor step =================
+static inline bool reached(uint32_t now_us, uint32_t t_us) {
+  return (int32_t)(now_us - t_us) >= 0;
+}
+
+static inline uint32_t later(uint32_t a_us, uint32_t b_us) {
+  return (int32_t)(a_us - b_us) >= 0 ? a_us : b_us;
+}
+
+static inline uint32_t earlier(uint32_t a_us, uint32_t b_us) {
+  return (int32_t)(a_us - b_us) <= 0 ? a_us : b_us;
+}
+
+bool safety_step(Safety* s, uint32_t now_us, int pwm_l, int pwm_r, bool deadman) {
+  const SafetyConfig& c = s->cfg;
+  bool driving = pwm_l != 0 || pwm_r != 0;
+  bool forward = pwm_l + pwm_r > 0;
+  // Output xuất hiện giữa hai step: coi như từ step này
+  if (driving && !s->driving) s->drive_us = now_us;
+  if (forward && !s->forward) s->fwd_us = now_us;
+  s->driving = driving;
+  s->forward = forward;
+
+  uint8_t trip = 0;
+  uint32_t detect = now_us;
+  if (forward && s->near) {
+    trip |= SAFETY_OBSTACLE;
+    detect = later(s->near_us, s->fwd_us);
+  }
+  uint32_t t_dead = s->cmd_us + c.deadman_us;
+  if (deadman && driving && reached(now_us, t_dead)) {
+    uint32_t d = later(t_dead, s->drive_us);
+    detect = trip ? earlier(detect, d) : d;
+    trip |= SAFETY_DEADMAN;
+  }
+  uint32_t t_wd = s->hb_us + c.watchdog_us;
+  if (driving && reached(now_us, t_wd)) {
+    uint32_t d = later(t_wd, s->drive_us);
+    detect = trip ? earlier(detect, d) : d;
+    trip |= SAFETY_WATCHDOG;
+  }
+  s->tripped |= trip;
+
+  if (trip && !s->pending) {
+    s->pending = true;
+    s->detect_us = detect;
+    s->ev.reasons = trip;
+  } else if (s->pending) {
+    s->ev.reasons |= trip;
+  }
+  return driving && !safety_allows(s, pwm_l, pwm_r);
+}
+
+bool safety_stopped(Safety* s, uint32_t now_us) {
+  s->driving = false;
+  s->forward = false;
+  if (!s->pending) return false;
+  s->pending = false;
+  s->ev.latency_us = now_us - s->detect_us;
+  SafetyStats& st = s->stats;
+  st.events++;
+  if (s->ev.reasons & SAFETY_OBSTACLE) st.obstacle++;
+  if (s->ev.reasons & SAFETY_DEADMAN) st.deadman++;
+  if (s->ev.reasons & SAFETY_WATCHDOG) st.watchdog++;
+  if (s->ev.latency_us > s->cfg.latency_max_us) st.late++;
+  if (s->ev.latency_us > st.latency_max_us) st.latency_max_us = s->ev.latency_us;
+  st.latency_sum_us += s->ev.latency_us;
+  st.last = s->ev;
+  return true;
+}
+
+// ================= Gate =================
+bool safety_allows(const Safety* s, int pwm_l, int pwm_r) {
+  if (pwm_l == 0 && pwm_r == 0) return true;
+  if (s->tripped & (SAFETY_DEADMAN | SAFETY_WATCHDOG)) return false;
+  if ((s->tripped & SAFETY_OBSTACLE) && pwm_l + pwm_r > 0) return false;
+  return true;
+}
+
+const char* safety_reasonName(uint8_t reasons) {
+  static const char* const NAMES[8] = {
+    "none", "obstacle", "deadman", "obstacle+deadman",
+    "watchdog", "obstacle+watchdog", "deadman+watchdog", "obstacle+deadman+watchdog",
+  };
+  return NAMES[reasons & 7];
+}
@@ -0,0 +1,76 @@
+#include "telemetry_codec.h"
+#include <string.h>
+
+// ================= Code Tables =================
+// Thứ tự là một phần của schema: chỉ thêm vào cuối
+const char* const TELEMETRY_MODES[] = { "manual", "line" };
+const uint8_t TELEMETRY_MODE_COUNT = sizeof(TELEMETRY_MODES) / sizeof(TELEMETRY_MODES[0]);
+
+const char* const TELEMETRY_MOTIONS[] = {
+  "stop", "forward", "backward", "left", "right",
+  "fwd_left", "fwd_right", "back_left", "back_right", "line_follow",
+  "velocity"
+};
+const uint8_t TELEMETRY_MOTION_COUNT = sizeof(TELEMETRY_MOTIONS) / sizeof(TELEMETRY_MOTIONS[0]);
+
+// ================= Helpers =================
+static uint8_t lookup(const char* const* table, uint8_t count, const char* s) {
+  if (!s) return TELEMETRY_CODE_NONE;
+  for (uint8_t i = 0; i < count; i++) {
+    if (strcmp(table[i], s) == 0) return i;
+  }
+  return TELEMETRY_CODE_NONE;
+}
+
+static int16_t clamp16(int v) {
+  if (v > INT16_MAX) return INT16_MAX;
+  if (v < INT16_MIN) return INT16_MIN;
+  return (int16_t)v;
+}
+
+// ================= Encode =================
+static void fillV1(const TelemetrySample& s, uint16_t seq, TelemetryBinV1& p) {
+  p.schema = TELEMETRY_SCHEMA_ID;
+  p.version = 1;
+  p.seq = seq;
+  p.uptime_ms = s.uptime_ms;
+  p.mode = lookup(TELEMETRY_MODES, TELEMETRY_MODE_COUNT, s.mode);
+  p.motion = lookup(TELEMETRY_MOTIONS, TELEMETRY_MOTION_COUNT, s.motion);
+  p.speed_linear = clamp16(s.speed_linear);
+  p.speed_rot = clamp16(s.speed_rot);
+
+  // distance: cm -> mm (0.1 cm fixed point), 0xFFFF = không có giá trị
+  if (s.distance_cm > 0 && s.distance_cm * 10.0f < (float)TELEMETRY_DIST_NONE) {
+    p.distance_mm = (uint16_t)(s.distance_cm * 10.0f + 0.5f);
+  } else {
+    p.distance_mm = TELEMETRY_DIST_NONE;
+  }
+
+  p.line = 0;
+  for (int i = 0; i < 5; i++) {
+    if (s.line[i]) p.line |= (uint8_t)(1u << i);
+  }
+  p.flags = s.obstacle ? TELEMETRY_FLAG_OBSTACLE : 0;
+  p.wifi_rssi = (int8_t)(s.wifi_rssi < -128 ? -128 : (s.wifi_rssi > 127 ? 127 : s.wifi_rssi));
+}
+
+size_t telemetry_encodeV1(const TelemetrySample& s, uint16_t seq, uint8_t* out, size_t cap) {
+  if (cap < sizeof(TelemetryBinV1)) return 0;
+
+  TelemetryBinV1 p;
+  fillV1(s, seq, p);
+  memcpy(out, &p, sizeof(p));
+  return sizeof(p);
+}
+
+size_t telemetry_encode(const TelemetrySample& s, uint16_t seq, uint8_t* out, size_t cap) {
+  if (cap < sizeof(TelemetryBinV2)) return 0;
+
+  TelemetryBinV2 p;
+  fillV1(s, seq, p.v1);
+  p.v1.version = 2;
+  p.ts_us = s.ts_us;
+  p.sync_err_us = s.ts_us ? s.sync_err_us : 0;
+  memcpy(out, &p, sizeof(p));
+  return sizeof(p);
+}
@@ -0,0 +1,185 @@
+#include <Arduino.h>
+#include "esp_timer.h"
+#include "telemetry_hr.h"
+#include "do_line.h"
+
+// ================= State =================
+static esp_timer_handle_t hr_timer = nullptr;
+static portMUX_TYPE hr_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static HrSample hr_ring[TELEMETRY_HR_RING];
+static size_t hr_head = 0;       // next write
+static size_t hr_count = 0;
+static uint32_t hr_dropped = 0;
+
+static uint16_t hr_hz = 0;
+static uint16_t hr_flush_ms = 500;
+static uint16_t hr_seq = 0;
+static uint16_t hr_mm_per_tick_q8 = 0;
+
+// previous encoder totals (sampler only)
+static long hr_enc_l_prev = 0;
+static long hr_enc_r_prev = 0;
+
+// ================= Sampler (esp_timer task) =================
+static int16_t sat16(long v) {
+  if (v > INT16_MAX) return INT16_MAX;
+  if (v < INT16_MIN) return INT16_MIN;
+  return (int16_t)v;
+}
+
+static void sampleCb(void*) {
+  DoLineSnapshot snap;
+  do_line_getSnapshot(&snap);
+  bool L2, L1, M, R1, R2;
+  do_line_getLineSensors(&L2, &L1, &M, &R1, &R2);
+
+  HrSample s;
+  s.t_ms = millis();
+  s.distance_mm = (snap.distance_cm > 0 && snap.distance_cm < 6553.0f)
+                    ? (uint16_t)(snap.distance_cm * 10.0f + 0.5f) : 0;
+  s.line = (uint8_t)(L2 | (L1 << 1) | (M << 2) | (R1 << 3) | (R2 << 4));
+  s.flags = 0;
+  if (snap.recovering) s.flags |= TELEMETRY_HR_FLAG_RECOVERING;
+  if (snap.distance_cm > 0 && snap.distance_cm < 15.0f) s.flags |= TELEMETRY_HR_FLAG_OBSTACLE;
+
+  // Encoder không có chiều: lấy dấu theo PWM đang lệnh
+  long dl = snap.enc_l - hr_enc_l_prev;
+  long dr = snap.enc_r - hr_enc_r_prev;
+  hr_enc_l_prev = snap.enc_l;
+  hr_enc_r_prev = snap.enc_r;
+  s.ticks_l = sat16(snap.pwm_l < 0 ? -dl : dl);
+  s.ticks_r = sat16(snap.pwm_r < 0 ? -dr : dr);
+  s.pwm_l = (int16_t)snap.pwm_l;
+  s.pwm_r = (int16_t)snap.pwm_r;
+
+  portENTER_CRITICAL(&hr_mux);
+  hr_ring[hr_head] = s;
+  hr_head = (hr_head + 1) % TELEMETRY_HR_RING;
+  if (hr_count < TELEMETRY_HR_RING) {
+    hr_count++;
+  } else {
+    hr_dropped++;   // ghi đè mẫu cũ nhất
+  }
+  portEXIT_CRITICAL(&hr_mux);
+}
+
+// ================= Config =================
+void telemetry_hr_begin() {
+  if (hr_timer) return;
+  esp_timer_create_args_t args = {};
+  args.callback = sampleCb;
+  args.name = "tlm_hr";
+  if (esp_timer_create(&args, &hr_timer) != ESP_OK) {
+    Serial.println("[TLM-HR] Timer create failed");
+    hr_timer = nullptr;
+  }
+  hr_mm_per_tick_q8 = (uint16_t)(do_line_getMmPerTick() * 256.0f + 0.5f);
+}
+
+void telemetry_hr_configure(uint16_t hz, uint16_t flush_ms) {
+  if (!hr_timer) return;
+  if (hz > TELEMETRY_HR_MAX_HZ) hz = TELEMETRY_HR_MAX_HZ;
+  if (flush_ms < 100) flush_ms = 100;
+  hr_flush_ms = flush_ms;
+  if (hz == hr_hz) return;
+
+  esp_timer_stop(hr_timer);   // ESP_ERR_INVALID_STATE nếu chưa chạy: bỏ qua
+  hr_hz = hz;
+  if (hz == 0) return;
+
+  DoLineSnapshot snap;
+  do_line_getSnapshot(&snap);
+  hr_enc_l_prev = snap.enc_l;
+  hr_enc_r_prev = snap.enc_r;
+  esp_timer_start_periodic(hr_timer, 1000000ULL / hz);
+}
+
+uint16_t telemetry_hr_rate() { return hr_hz; }
+uint16_t telemetry_hr_flushMs() { return hr_flush_ms; }
+
+size_t telemetry_hr_pending() {
+  portENTER_CRITICAL(&hr_mux);
+  size_t n = hr_count;
+  portEXIT_CRITICAL(&hr_mux);
+  return n;
+}
+
+uint32_t telemetry_hr_dropped() {
+  return hr_dropped;
+}
+
+// ================= Frame =================
+size_t telemetry_hr_takeFrame(uint8_t* out, size_t cap, bool* more) {
+  *more = false;
+  if (cap <= sizeof(TelemetryHrHeader)) return 0;
+  size_t fit = (cap - sizeof(TelemetryHrHeader)) / TELEMETRY_HR_SAMPLE_MAX;
+  if (fit > 255) fit = 255;
+
+  static HrSample batch[TELEMETRY_HR_RING];
+  size_t n;
+  portENTER_CRITICAL(&hr_mux);
+  n = hr_count < fit ? hr_count : fit;
+  size_t tail = (hr_head + TELEMETRY_HR_RING - hr_count) % TELEMETRY_HR_RING;
+  for (size_t i = 0; i < n; i++) {
+    batch[i] = hr_ring[(tail + i) % TELEMETRY_HR_RING];
+  }
+  hr_count -= n;
+  *more = hr_count > 0;
+  portEXIT_CRITICAL(&hr_mux);
+
+  if (n == 0) return 0;
+  uint16_t period = hr_hz ? 1000 / hr_hz : 0;
+  return telemetry_hr_encode(batch, n, hr_seq++, *more ? TELEMETRY_HR_MORE : 0,
+                             period, hr_mm_per_tick_q8, out, cap);
+}
+
+// ================= Encoder =================
+static size_t putVarint(uint8_t* p, uint32_t v) {
+  size_t n = 0;
+  while (v >= 0x80) {
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+static size_t putZigzag(uint8_t* p, int32_t v) {
+  return putVarint(p, ((uint32_t)v << 1) ^ (uint32_t)(v >> 31));
+}
+
+size_t telemetry_hr_encode(const HrSample* s, size_t n, uint16_t seq, uint8_t flags,
+                           uint16_t period_ms, uint16_t mm_per_tick_q8,
+                           uint8_t* out, size_t cap) {
+  if (n == 0 || n > 255 || cap < sizeof(TelemetryHrHeader) + n * TELEMETRY_HR_SAMPLE_MAX) {
+    return 0;
+  }
+
+  TelemetryHrHeader h;
+  h.schema = TELEMETRY_HR_SCHEMA_ID;
+  h.version = TELEMETRY_HR_VERSION;
+  h.seq = seq;
+  h.flags = flags;
+  h.count = (uint8_t)n;
+  h.period_ms = period_ms;
+  h.mm_per_tick_q8 = mm_per_tick_q8;
+  h.base_ms = s[0].t_ms;
+  memcpy(out, &h, sizeof(h));
+  size_t o = sizeof(h);
+
+  HrSample prev = {};
+  prev.t_ms = s[0].t_ms;
+  for (size_t i = 0; i < n; i++) {
+    const HrSample& c = s[i];
+    o += putVarint(out + o, c.t_ms - prev.t_ms);
+    o += putZigzag(out + o, (int32_t)c.distance_mm - prev.distance_mm);
+    out[o++] = (uint8_t)((c.line | (c.flags << 5)) ^ (prev.line | (prev.flags << 5)));
+    o += putZigzag(out + o, (int32_t)c.ticks_l - prev.ticks_l);
+    o += putZigzag(out + o, (int32_t)c.ticks_r - prev.ticks_r);
+    o += putZigzag(out + o, (int32_t)c.pwm_l - prev.pwm_l);
+    o += putZigzag(out + o, (int32_t)c.pwm_r - prev.pwm_r);
+    prev = c;
+  }
+  return o;
+}
@@ -0,0 +1,100 @@
+#include "telemetry_policy.h"
+#include <string.h>
+#include <math.h>
+#include <stdlib.h>
+
+// ================= Config =================
+void telemetry_policy_defaults(TelemetryPolicyConfig* cfg) {
+  cfg->dist_deadband_cm = 2.0f;
+  cfg->speed_deadband = 10;
+  cfg->rssi_deadband = 6;
+  cfg->heartbeat_ms = 10000;   // < OFFLINE_TIMEOUT_MS (25 s) của backend
+  cfg->rate_hz = 4.0f;
+  cfg->burst = 5;
+}
+
+void telemetry_policy_init(TelemetryPolicy* p, const TelemetryPolicyConfig& cfg, uint32_t now_ms) {
+  memset(p, 0, sizeof(*p));
+  p->cfg = cfg;
+  p->tokens = cfg.burst;
+  p->last_refill_ms = now_ms;
+}
+
+void telemetry_policy_setRate(TelemetryPolicy* p, float rate_hz) {
+  p->cfg.rate_hz = rate_hz;
+}
+
+// ================= Change Detection =================
+static bool sameStr(const char* a, const char* b) {
+  if (a == b) return true;
+  if (!a || !b) return false;
+  return strcmp(a, b) == 0;
+}
+
+static bool discreteChanged(const TelemetrySample& a, const TelemetrySample& b) {
+  if (!sameStr(a.mode, b.mode) || !sameStr(a.motion, b.motion)) return true;
+  if (a.obstacle != b.obstacle) return true;
+  for (int i = 0; i < 5; i++) {
+    if (a.line[i] != b.line[i]) return true;
+  }
+  return false;
+}
+
+static bool outsideDeadband(const TelemetryPolicyConfig& cfg,
+                            const TelemetrySample& a, const TelemetrySample& b) {
+  // distance: valid <-> invalid luôn tính là thay đổi
+  bool va = a.distance_cm > 0, vb = b.distance_cm > 0;
+  if (va != vb) return true;
+  if (va && fabsf(a.distance_cm - b.distance_cm) >= cfg.dist_deadband_cm) return true;
+
+  if (abs(a.speed_linear - b.speed_linear) >= cfg.speed_deadband) return true;
+  if (abs(a.speed_rot - b.speed_rot) >= cfg.speed_deadband) return true;
+  if (abs(a.wifi_rssi - b.wifi_rssi) >= cfg.rssi_deadband) return true;
+  return false;
+}
+
+// ================= Check / Commit =================
+TelemetryReason telemetry_policy_check(TelemetryPolicy* p, const TelemetrySample& s, uint32_t now_ms) {
+  // Token bucket refill
+  uint32_t dt = now_ms - p->last_refill_ms;
+  p->last_refill_ms = now_ms;
+  p->tokens += dt * p->cfg.rate_hz / 1000.0f;
+  if (p->tokens > p->cfg.burst) p->tokens = p->cfg.burst;
+
+  TelemetryReason why = TLM_REASON_NONE;
+  if (!p->has_last || discreteChanged(s, p->last)) {
+    why = TLM_REASON_DISCRETE;
+  } else if (outsideDeadband(p->cfg, s, p->last)) {
+    why = TLM_REASON_DEADBAND;
+  } else if (now_ms - p->last_pub_ms >= p->cfg.heartbeat_ms) {
+    why = TLM_REASON_HEARTBEAT;
+  } else if (p->pending) {
+    why = TLM_REASON_PENDING;
+  }
+  if (why == TLM_REASON_NONE) return why;
+
+  if (p->tokens < 1.0f) {
+    if (!p->pending) p->rate_limited++;
+    p->pending = true;
+    return TLM_REASON_NONE;
+  }
+  p->tokens -= 1.0f;
+  return why;
+}
+
+void telemetry_policy_commit(TelemetryPolicy* p, const TelemetrySample& s, uint32_t now_ms) {
+  p->last = s;
+  p->has_last = true;
+  p->pending = false;
+  p->last_pub_ms = now_ms;
+}
+
+const char* telemetry_reason_name(TelemetryReason r) {
+  switch (r) {
+    case TLM_REASON_DISCRETE: return "discrete";
+    case TLM_REASON_DEADBAND: return "deadband";
+    case TLM_REASON_HEARTBEAT: return "heartbeat";
+    case TLM_REASON_PENDING: return "pending";
+    default: return "none";
+  }
+}
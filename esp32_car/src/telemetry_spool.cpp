@@ -0,0 +1,406 @@
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <Preferences.h>
+#include <atomic>
+#include "telemetry_spool.h"
+#include "spsc_ring.h"
+#include "car_log.h"
+
+// ================= Config =================
+const size_t SPOOL_WRITE_BUF = 1024;          // RAM buffer before a flash write
+const unsigned long SPOOL_FLUSH_MS = 2000;    // flush buffered records at least this often
+
+// Replay pacing: token bucket, one record in flight (stop-and-wait on PUBACK)
+const float SPOOL_REPLAY_HZ = 20.0f;
+const uint8_t SPOOL_REPLAY_BURST = 5;
+const unsigned long SPOOL_BACKOFF_MS = 500;   // publish failed: let the socket drain
+// esp_mqtt retransmits an unacked QoS 1 message itself; ours is the fallback
+const unsigned long SPOOL_ACK_TIMEOUT_MS = 5000;
+
+#define SPOOL_DIR "/spool"
+
+// ================= State =================
+// Set in spool_begin(), read-only afterwards
+static bool sp_mounted = false;
+static uint16_t sp_boot = 0;
+
+// loop() → TX task: records not yet in the write buffer
+struct SpoolEntry {
+  SpoolRecord rec;
+  uint8_t data[SPOOL_MAX_PAYLOAD];
+};
+static SpscRing<SpoolEntry, 16> sp_ring;
+static uint32_t sp_seq = 0;            // loop()
+static uint32_t sp_ring_full = 0;      // loop()
+
+// PUBACKs: esp_mqtt task → TX task
+static SpscRing<int, 8> sp_acks;
+
+// Everything below belongs to the TX task (spool_service)
+static std::atomic<bool> sp_idle{true};   // wbuf and flash empty, nothing in flight
+
+// Segments [seg_first, seg_last] exist in flash when sp_has_segments
+static bool sp_has_segments = false;
+static uint32_t seg_first = 0;
+static uint32_t seg_last = 0;
+static uint32_t seg_next = 0;          // number for the next new segment
+static uint32_t seg_last_size = 0;
+static uint32_t sp_flash_bytes = 0;    // sum of segment sizes
+static uint32_t sp_records = 0;        // unreplayed records in flash
+
+// Write buffer
+static uint8_t wbuf[SPOOL_WRITE_BUF];
+static size_t wlen = 0;
+static uint32_t wrecords = 0;
+static unsigned long wbuf_since_ms = 0;
+
+// Reader (always on seg_first); roff = first record not yet acked
+static File rfile;
+static bool ropen = false;
+static uint32_t roff = 0;
+
+// Record waiting for its PUBACK (starts at roff)
+static bool rp_inflight = false;
+static int rp_msg_id = -1;
+static uint32_t rp_size = 0;           // header + payload in flash
+static uint32_t rp_t_ms = 0;
+static uint16_t rp_boot = 0;
+static unsigned long rp_sent_ms = 0;
+
+// Replay pacing
+static float rp_tokens = SPOOL_REPLAY_BURST;
+static unsigned long rp_last_ms = 0;
+static unsigned long rp_backoff_until = 0;
+
+// Stats
+static uint32_t sp_dropped = 0;
+static uint32_t sp_replayed = 0;
+static uint32_t sp_resent = 0;
+static uint32_t sp_lag_ms = 0;
+
+// ================= Helpers =================
+static void segPath(uint32_t n, char* out, size_t cap) {
+  snprintf(out, cap, SPOOL_DIR "/%08lu.seg", (unsigned long)n);
+}
+
+static bool validHeader(const SpoolRecord& r) {
+  return r.magic == SPOOL_MAGIC && r.len <= SPOOL_MAX_PAYLOAD &&
+         (r.type == SPOOL_TELEMETRY || r.type == SPOOL_EVENT);
+}
+
+// Count valid records of a segment from offset 'from' (headers only)
+static uint32_t countRecords(const char* path, uint32_t from) {
+  File f = LittleFS.open(path, "r");
+  if (!f) return 0;
+  uint32_t n = 0;
+  uint32_t off = from;
+  uint32_t size = f.size();
+  SpoolRecord r;
+  while (off + sizeof(r) <= size) {
+    f.seek(off);
+    if (f.read((uint8_t*)&r, sizeof(r)) != sizeof(r) || !validHeader(r)) break;
+    if (off + sizeof(r) + r.len > size) break;   // đuôi bị cắt (mất điện)
+    off += sizeof(r) + r.len;
+    n++;
+  }
+  f.close();
+  return n;
+}
+
+static void closeReader() {
+  if (ropen) {
+    rfile.close();
+    ropen = false;
+  }
+}
+
+// Delete seg_first (fully replayed or dropped) and move to the next one
+static void removeFirstSegment() {
+  char path[32];
+  segPath(seg_first, path, sizeof(path));
+  closeReader();
+  File f = LittleFS.open(path, "r");
+  uint32_t size = f ? f.size() : 0;
+  if (f) f.close();
+  LittleFS.remove(path);
+  sp_flash_bytes = sp_flash_bytes > size ? sp_flash_bytes - size : 0;
+  roff = 0;
+  rp_inflight = false;
+  if (seg_first == seg_last) {
+    sp_has_segments = false;
+    sp_flash_bytes = 0;
+    sp_records = 0;
+    seg_last_size = 0;
+  } else {
+    seg_first++;
+  }
+}
+
+// Spool over its bound: drop the oldest segment
+static void enforceBound() {
+  while (sp_has_segments && seg_first != seg_last && sp_flash_bytes > SPOOL_MAX_BYTES) {
+    char path[32];
+    segPath(seg_first, path, sizeof(path));
+    uint32_t lost = countRecords(path, roff);
+    sp_dropped += lost;
+    sp_records = sp_records > lost ? sp_records - lost : 0;
+    LOG_W("[SPOOL] Full, dropping segment %lu (%u records)",
+          (unsigned long)seg_first, (unsigned)lost);
+    removeFirstSegment();
+  }
+}
+
+// ================= Init =================
+void spool_begin() {
+  if (!LittleFS.begin(true)) {
+    Serial.println("[SPOOL] LittleFS mount failed, spool disabled");
+    return;
+  }
+  sp_mounted = true;
+  if (!LittleFS.exists(SPOOL_DIR)) {
+    LittleFS.mkdir(SPOOL_DIR);
+  }
+
+  // Boot counter: timestamps of an older boot cannot be mapped to now
+  Preferences prefs;
+  prefs.begin("spool", false);
+  sp_boot = (uint16_t)(prefs.getUInt("boot", 0) + 1);
+  prefs.putUInt("boot", sp_boot);
+  prefs.end();
+
+  // Scan segments left from before the reboot
+  File dir = LittleFS.open(SPOOL_DIR);
+  File f = dir ? dir.openNextFile() : File();
+  while (f) {
+    const char* name = f.name();
+    const char* base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+    char* end = nullptr;
+    uint32_t n = strtoul(base, &end, 10);
+    if (end && strcmp(end, ".seg") == 0) {
+      if (!sp_has_segments || n < seg_first) seg_first = n;
+      if (!sp_has_segments || n > seg_last) {
+        seg_last = n;
+        seg_last_size = f.size();
+      }
+      sp_has_segments = true;
+      sp_flash_bytes += f.size();
+    }
+    f.close();
+    f = dir.openNextFile();
+  }
+  if (dir) dir.close();
+
+  if (sp_has_segments) {
+    for (uint32_t n = seg_first; n <= seg_last; n++) {
+      char path[32];
+      segPath(n, path, sizeof(path));
+      sp_records += countRecords(path, 0);
+    }
+    seg_next = seg_last + 1;
+  }
+  sp_idle = !sp_has_segments;
+  Serial.printf("[SPOOL] Ready (boot %u): %u records, %lu bytes in %u segments\n",
+                sp_boot, (unsigned)sp_records, (unsigned long)sp_flash_bytes,
+                sp_has_segments ? (unsigned)(seg_last - seg_first + 1) : 0);
+}
+
+// ================= Write (loop) =================
+bool spool_append(SpoolType type, const uint8_t* data, uint16_t len, uint32_t t_ms) {
+  if (!sp_mounted || len > SPOOL_MAX_PAYLOAD) return false;
+  SpoolEntry* e = sp_ring.reserve();
+  if (!e) {
+    sp_ring_full++;   // TX task bị treo lâu: bỏ bản ghi, không chờ
+    return false;
+  }
+  e->rec.magic = SPOOL_MAGIC;
+  e->rec.type = type;
+  e->rec.len = len;
+  e->rec.boot = sp_boot;
+  e->rec.t_ms = t_ms;
+  e->rec.seq = sp_seq++;
+  memcpy(e->data, data, len);
+  sp_ring.commit();
+  return true;
+}
+
+bool spool_empty() {
+  return sp_ring.size() == 0 && sp_idle;
+}
+
+// ================= Flash (TX task) =================
+static void flushWriteBuffer() {
+  if (wlen == 0) return;
+
+  if (!sp_has_segments || seg_last_size + wlen > SPOOL_SEGMENT_BYTES) {
+    // Segment mới: file mới → LittleFS cấp block mới (wear leveling)
+    seg_last = seg_next++;
+    seg_last_size = 0;
+    if (!sp_has_segments) {
+      seg_first = seg_last;
+      roff = 0;
+    }
+    sp_has_segments = true;
+  }
+  if (seg_first == seg_last) {
+    closeReader();   // handle đọc không thấy dữ liệu append mới
+  }
+
+  char path[32];
+  segPath(seg_last, path, sizeof(path));
+  File f = LittleFS.open(path, "a");
+  if (!f) {
+    LOG_E("[SPOOL] Open for append failed");
+    sp_dropped += wrecords;
+  } else {
+    size_t n = f.write(wbuf, wlen);
+    f.close();
+    if (n == wlen) {
+      seg_last_size += wlen;
+      sp_flash_bytes += wlen;
+      sp_records += wrecords;
+    } else {
+      LOG_E("[SPOOL] Short write (flash full?)");
+      sp_dropped += wrecords;
+    }
+  }
+  wlen = 0;
+  wrecords = 0;
+  enforceBound();
+}
+
+// Ring → write buffer, flash when full
+static void drainRing() {
+  while (SpoolEntry* e = sp_ring.front()) {
+    size_t n = sizeof(SpoolRecord) + e->rec.len;
+    if (wlen + n > sizeof(wbuf)) flushWriteBuffer();
+    if (wlen == 0) wbuf_since_ms = millis();
+    memcpy(wbuf + wlen, &e->rec, sizeof(SpoolRecord));
+    memcpy(wbuf + wlen + sizeof(SpoolRecord), e->data, e->rec.len);
+    wlen += n;
+    wrecords++;
+    sp_ring.pop();
+  }
+}
+
+// ================= Replay (TX task) =================
+void spool_acked(int msg_id) {
+  int* a = sp_acks.reserve();
+  if (!a) return;   // mất ack → hết timeout thì gửi lại
+  *a = msg_id;
+  sp_acks.commit();
+}
+
+// Outcome of the record in flight: acked → advance, timeout / down → resend
+static void checkInflight(bool connected, unsigned long now) {
+  bool acked = false;
+  while (int* a = sp_acks.front()) {
+    if (rp_inflight && *a == rp_msg_id) acked = true;
+    sp_acks.pop();
+  }
+  if (!rp_inflight) return;
+
+  if (acked) {
+    rp_inflight = false;
+    roff += rp_size;
+    if (sp_records > 0) sp_records--;
+    sp_replayed++;
+    sp_lag_ms = (rp_boot == sp_boot) ? now - rp_t_ms : 0;
+  } else if (!connected || now - rp_sent_ms >= SPOOL_ACK_TIMEOUT_MS) {
+    rp_inflight = false;
+    sp_resent++;
+    LOG_D("[SPOOL] No PUBACK for msg %d, resending", rp_msg_id);
+  }
+}
+
+// Publish the record at roff (skips missing / fully read segments)
+static void replayNext(SpoolPublishFn publish, unsigned long now) {
+  static uint8_t msg[sizeof(SpoolReplayHeader) + SPOOL_MAX_PAYLOAD];
+  while (sp_has_segments) {
+    if (!ropen) {
+      char path[32];
+      segPath(seg_first, path, sizeof(path));
+      rfile = LittleFS.open(path, "r");
+      if (!rfile) {
+        removeFirstSegment();   // file mất: bỏ qua
+        continue;
+      }
+      ropen = true;
+    }
+
+    SpoolRecord r;
+    rfile.seek(roff);   // lần gửi lại đọc lại đúng bản ghi chưa được ack
+    bool ok = rfile.read((uint8_t*)&r, sizeof(r)) == sizeof(r) && validHeader(r) &&
+              rfile.read(msg + sizeof(SpoolReplayHeader), r.len) == r.len;
+    if (!ok) {
+      // Hết segment (hoặc đuôi hỏng sau mất điện): xoá và sang segment kế
+      uint32_t size = rfile.size();
+      if (roff < size) {
+        LOG_W("[SPOOL] Segment %lu: %lu unreadable bytes skipped",
+              (unsigned long)seg_first, (unsigned long)(size - roff));
+      }
+      removeFirstSegment();
+      continue;
+    }
+
+    SpoolReplayHeader h;
+    h.schema = SPOOL_REPLAY_SCHEMA_ID;
+    h.type = r.type;
+    h.boot = r.boot;
+    h.now_boot = sp_boot;
+    h.t_ms = r.t_ms;
+    h.now_ms = now;
+    h.seq = r.seq;
+    memcpy(msg, &h, sizeof(h));
+
+    int id = publish(msg, sizeof(h) + r.len);
+    if (id < 0) {
+      rp_backoff_until = now + SPOOL_BACKOFF_MS;   // outbox đầy / mất kết nối
+      return;
+    }
+    rp_inflight = true;
+    rp_msg_id = id;
+    rp_size = sizeof(r) + r.len;
+    rp_t_ms = r.t_ms;
+    rp_boot = r.boot;
+    rp_sent_ms = now;
+    rp_tokens -= 1.0f;
+    return;
+  }
+}
+
+void spool_service(bool connected, SpoolPublishFn publish) {
+  if (!sp_mounted) return;
+  if (sp_ring.size() > 0) sp_idle = false;   // trước khi lấy khỏi ring (spool_empty)
+  drainRing();
+
+  unsigned long now = millis();
+  // Online: flush ngay để replay giữ đúng thứ tự
+  if (wlen > 0 && (connected || now - wbuf_since_ms >= SPOOL_FLUSH_MS)) {
+    flushWriteBuffer();
+  }
+
+  checkInflight(connected, now);
+  if (connected && !rp_inflight && sp_has_segments &&
+      (long)(now - rp_backoff_until) >= 0) {
+    rp_tokens += (now - rp_last_ms) * SPOOL_REPLAY_HZ / 1000.0f;
+    if (rp_tokens > SPOOL_REPLAY_BURST) rp_tokens = SPOOL_REPLAY_BURST;
+    rp_last_ms = now;
+    if (rp_tokens >= 1.0f) replayNext(publish, now);
+  }
+
+  sp_idle = wlen == 0 && !sp_has_segments && !rp_inflight;
+}
+
+// ================= Stats =================
+void spool_getStats(SpoolStats* out) {
+  out->mounted = sp_mounted;
+  out->depth_bytes = (sp_flash_bytes > roff ? sp_flash_bytes - roff : 0) + wlen;
+  out->depth_records = sp_records + wrecords + sp_ring.size();
+  out->segments = sp_has_segments ? (uint16_t)(seg_last - seg_first + 1) : 0;
+  out->dropped_records = sp_dropped + sp_ring_full;
+  out->replayed = sp_replayed;
+  out->resent = sp_resent;
+  out->inflight = rp_inflight;
+  out->replay_lag_ms = sp_lag_ms;
+}
@@ -0,0 +1,325 @@
+#include "track_map.h"
+#include "chassis.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// ================= Config =================
+const float TRACK_WINDOW_M = 0.10f;          // curvature is classified per 10 cm of travel
+const float TRACK_K_STRAIGHT = 1.2f;         // |κ| below (radius > ~0.8 m) → straight
+const float TRACK_MIN_SEG_M = 0.15f;         // shorter pieces merge into the previous segment
+const float TRACK_CUE_DEBOUNCE_M = 0.10f;    // one junction per 10 cm
+const float TRACK_MIN_LAP_M = 1.0f;
+const float TRACK_CLOSE_HEADING_RAD = 0.8f;  // lap closes if heading turned k·2π (±45°)
+const float TRACK_CLOSE_TOL_M = 0.15f;       // junction spacing repeats within max(15 cm, 3%)
+const float TRACK_CLOSE_TOL_FRAC = 0.03f;
+const float TRACK_RESYNC_M = 0.30f;          // fast lap: snap to a learned junction this close
+
+const float TWO_PI_F = 2.0f * CHASSIS_PI;
+
+void track_profile_defaults(TrackProfileConfig* cfg) {
+  cfg->v_max = 0.80f;       // = V_MAX của PID trong do_line
+  cfg->v_min = 0.30f;       // = V_CURVE_MIN
+  cfg->v_junction = 0.40f;
+  cfg->a_lat = 1.5f;
+  cfg->a_brake = 1.0f;
+  cfg->brake_margin_m = 0.10f;
+}
+
+static inline void odometry(long d_left, long d_right, float* ds, float* dth) {
+  *ds = 0.5f * (d_left + d_right) * CarChassis::M_PER_TICK;
+  *dth = (d_right - d_left) * CarChassis::RAD_PER_TICK_DIFF;
+}
+
+static inline uint8_t cueJunction(uint8_t cue) {
+  return cue == TRACK_CUE_CROSS ? TRACK_JCT_CROSS : cue == TRACK_CUE_T ? TRACK_JCT_T : TRACK_JCT_NONE;
+}
+
+static inline int8_t curvClass(float k) {
+  return fabsf(k) < TRACK_K_STRAIGHT ? 0 : (k > 0 ? 1 : -1);
+}
+
+// ================= Learning =================
+void track_learn_begin(TrackLearner* l) {
+  memset(l, 0, sizeof(*l));
+  l->last_cue_m = -TRACK_CUE_DEBOUNCE_M;
+  l->active = true;
+}
+
+static void closeSegment(TrackLearner* l) {
+  if (l->seg_m <= 0.0f) return;
+  if (l->map.count >= TRACK_MAX_SEGMENTS) {
+    l->overflow = true;
+  } else {
+    TrackSegment& s = l->map.seg[l->map.count++];
+    float len_mm = l->seg_m * 1000.0f;
+    float k = l->seg_rad / l->seg_m * 1000.0f;
+    s.len_mm = (uint16_t)(len_mm > 65535.0f ? 65535.0f : len_mm + 0.5f);
+    s.curv_mpm = (int16_t)(k > 32767.0f ? 32767.0f : k < -32767.0f ? -32767.0f : k);
+    s.junction = l->seg_junction;
+  }
+  l->seg_m = 0.0f;
+  l->seg_rad = 0.0f;
+  l->seg_junction = TRACK_JCT_NONE;
+}
+
+static void flushWindow(TrackLearner* l) {
+  if (l->win_m > 0.0f) {
+    int8_t cls = curvClass(l->win_rad / l->win_m);
+    if (cls != l->seg_class && l->seg_m > 0.0f) closeSegment(l);
+    l->seg_class = cls;
+    l->seg_m += l->win_m;
+    l->seg_rad += l->win_rad;
+  }
+  l->win_m = 0.0f;
+  l->win_rad = 0.0f;
+}
+
+static bool headingCloses(float dth) {
+  float r = fmodf(fabsf(dth), TWO_PI_F);
+  return r < TRACK_CLOSE_HEADING_RAD || r > TWO_PI_F - TRACK_CLOSE_HEADING_RAD;
+}
+
+// Lap candidate: ev[k] of the same type as ev[0]. Accepted if the heading
+// closes at ev[k] (checked when it is seen) or the junctions after ev[k]
+// repeat ev[1], ev[2]... one lap later.
+static void checkLapClosed(TrackLearner* l) {
+  uint8_t n = l->n_ev;
+  const TrackJunctionEvent* ev = l->ev;
+  for (uint8_t k = 1; k < n; k++) {
+    if (ev[k].type != ev[0].type) continue;
+    float lap = ev[k].m - ev[0].m;
+    if (lap < TRACK_MIN_LAP_M) continue;
+    float tol = fmaxf(TRACK_CLOSE_TOL_M, lap * TRACK_CLOSE_TOL_FRAC);
+    bool repeats = true;
+    for (uint8_t i = k + 1; i < n && repeats; i++) {
+      repeats = ev[i].type == ev[i - k].type && fabsf(ev[i].m - ev[i - k].m - lap) <= tol;
+    }
+    bool heading = k == n - 1 && headingCloses(ev[k].heading_rad - ev[0].heading_rad);
+    if (repeats && (heading || n > k + 1)) {
+      l->lap_end = k;
+      l->closed = true;
+      l->active = false;
+      return;
+    }
+  }
+}
+
+void track_learn_step(TrackLearner* l, long d_left, long d_right, TrackCue cue) {
+  if (!l->active) return;
+  float ds, dth;
+  odometry(d_left, d_right, &ds, &dth);
+  l->total_m += ds;
+  l->heading_rad += dth;
+  l->win_m += ds;
+  l->win_rad += dth;
+
+  uint8_t j = cueJunction(cue);
+  if (j != TRACK_JCT_NONE && cue != l->last_cue &&
+      l->total_m - l->last_cue_m >= TRACK_CUE_DEBOUNCE_M) {
+    l->last_cue_m = l->total_m;
+    flushWindow(l);
+    closeSegment(l);
+    l->seg_junction = j;
+    if (l->n_ev < TRACK_MAX_EVENTS) {
+      TrackJunctionEvent& e = l->ev[l->n_ev++];
+      e.m = l->total_m;
+      e.heading_rad = l->heading_rad;
+      e.type = j;
+      e.seg = l->map.count;
+      checkLapClosed(l);
+    }
+  }
+  l->last_cue = cue;
+  if (l->win_m >= TRACK_WINDOW_M) flushWindow(l);
+}
+
+// Merge pieces shorter than TRACK_MIN_SEG_M into their predecessor, then
+// neighbours of the same class (unless the second one starts at a junction)
+static void mergeSegments(TrackMap* m) {
+  bool changed = true;
+  while (changed && m->count > 1) {
+    changed = false;
+    for (uint8_t i = 1; i < m->count; i++) {
+      TrackSegment& a = m->seg[i - 1];
+      TrackSegment& b = m->seg[i];
+      if (b.junction != TRACK_JCT_NONE) continue;
+      bool short_b = b.len_mm < TRACK_MIN_SEG_M * 1000.0f;
+      bool same = curvClass(a.curv_mpm / 1000.0f) == curvClass(b.curv_mpm / 1000.0f);
+      if (!short_b && !same) continue;
+      float rad = (float)a.curv_mpm * a.len_mm + (float)b.curv_mpm * b.len_mm;   // 1e-6 rad
+      uint32_t len = (uint32_t)a.len_mm + b.len_mm;
+      a.len_mm = (uint16_t)(len > 65535 ? 65535 : len);
+      a.curv_mpm = (int16_t)(rad / len);
+      memmove(&m->seg[i], &m->seg[i + 1], (m->count - i - 1) * sizeof(TrackSegment));
+      m->count--;
+      changed = true;
+      break;
+    }
+  }
+}
+
+bool track_learn_finish(TrackLearner* l, const TrackProfileConfig& cfg, TrackMap* out) {
+  flushWindow(l);
+  if (!l->closed) closeSegment(l);
+  l->active = false;
+
+  memset(out, 0, sizeof(*out));
+  uint8_t first = 0, end = l->map.count;
+  if (l->closed) {
+    // Lap = first junction → same junction one lap later; the part before
+    // the first junction is the tail of the lap, driven again at the end
+    first = l->ev[0].seg;
+    end = l->ev[l->lap_end].seg;
+    out->start_offset_mm = (uint32_t)(l->ev[0].m * 1000.0f + 0.5f);
+  }
+  out->count = end - first;
+  memcpy(out->seg, &l->map.seg[first], out->count * sizeof(TrackSegment));
+  mergeSegments(out);
+
+  uint32_t lap = 0;
+  for (uint8_t i = 0; i < out->count; i++) lap += out->seg[i].len_mm;
+  out->lap_mm = lap;
+  out->magic = TRACK_MAP_MAGIC;
+  out->version = TRACK_MAP_VERSION;
+  if (l->overflow || out->count == 0 || lap < TRACK_MIN_LAP_M * 1000.0f) {
+    out->magic = 0;
+    return false;
+  }
+  track_map_profile(out, cfg);
+  return true;
+}
+
+// ================= Speed profile =================
+static inline uint8_t toCms(float v) {
+  float c = v * 100.0f + 0.5f;
+  return (uint8_t)(c > 255.0f ? 255.0f : c < 0.0f ? 0.0f : c);
+}
+
+void track_map_profile(TrackMap* m, const TrackProfileConfig& cfg) {
+  for (uint8_t i = 0; i < m->count; i++) {
+    TrackSegment& s = m->seg[i];
+    float k = fabsf(s.curv_mpm) / 1000.0f;
+    float v = cfg.v_max;
+    if (k > 1e-3f) v = fminf(v, sqrtf(cfg.a_lat / k));
+    if (s.junction != TRACK_JCT_NONE) v = fminf(v, cfg.v_junction);
+    s.v_cms = toCms(fmaxf(v, cfg.v_min));
+    s.v_entry_cms = s.v_cms;
+  }
+  // Backward pass, twice round the lap so the wrap-around is covered:
+  // entry_i = min(v_i, √(entry_{i+1}² + 2·a·len_i))
+  for (int pass = 0; pass < 2; pass++) {
+    for (int i = m->count - 1; i >= 0; i--) {
+      TrackSegment& s = m->seg[i];
+      float next = m->seg[(i + 1) % m->count].v_entry_cms / 100.0f;
+      float reach = sqrtf(next * next + 2.0f * cfg.a_brake * s.len_mm / 1000.0f);
+      s.v_entry_cms = toCms(fminf(s.v_cms / 100.0f, reach));
+    }
+  }
+}
+
+bool track_map_valid(const TrackMap* m) {
+  return m->magic == TRACK_MAP_MAGIC && m->version == TRACK_MAP_VERSION &&
+         m->count > 0 && m->count <= TRACK_MAX_SEGMENTS && m->lap_mm > 0;
+}
+
+// ================= Fast lap =================
+static void locate(TrackFollower* f) {
+  const TrackMap* m = f->map;
+  float start = 0.0f;
+  for (uint8_t i = 0; i < m->count; i++) {
+    float len = m->seg[i].len_mm / 1000.0f;
+    if (f->s_m < start + len || i == m->count - 1) {
+      f->seg = i;
+      f->seg_start_m = start;
+      return;
+    }
+    start += len;
+  }
+}
+
+void track_follow_begin(TrackFollower* f, const TrackMap* map, const TrackProfileConfig& cfg) {
+  memset(f, 0, sizeof(*f));
+  f->map = map;
+  f->cfg = cfg;
+  f->last_cue_m = -TRACK_CUE_DEBOUNCE_M;
+  float lap = map->lap_mm / 1000.0f;
+  float off = fmodf(map->start_offset_mm / 1000.0f, lap);
+  f->s_m = off > 0.0f ? lap - off : 0.0f;
+  locate(f);
+}
+
+// Learned junction of this type closest to s (cyclic), within TRACK_RESYNC_M
+static bool nearestJunction(const TrackFollower* f, uint8_t type, float* s_out) {
+  const TrackMap* m = f->map;
+  float lap = m->lap_mm / 1000.0f;
+  float start = 0.0f, best = TRACK_RESYNC_M;
+  bool found = false;
+  for (uint8_t i = 0; i < m->count; i++) {
+    if (m->seg[i].junction == type) {
+      float d = fabsf(start - f->s_m);
+      d = fminf(d, lap - d);
+      if (d <= best) {
+        best = d;
+        *s_out = start;
+        found = true;
+      }
+    }
+    start += m->seg[i].len_mm / 1000.0f;
+  }
+  return found;
+}
+
+float track_follow_step(TrackFollower* f, long d_left, long d_right, TrackCue cue) {
+  const TrackMap* m = f->map;
+  float lap = m->lap_mm / 1000.0f;
+  float ds, dth;
+  odometry(d_left, d_right, &ds, &dth);
+  f->odo_m += ds;
+  f->s_m += ds;
+  if (f->s_m >= lap) f->s_m = fmodf(f->s_m, lap);
+  if (f->s_m < 0.0f) f->s_m = 0.0f;
+
+  uint8_t j = cueJunction(cue);
+  if (j != TRACK_JCT_NONE && cue != f->last_cue && f->odo_m - f->last_cue_m >= TRACK_CUE_DEBOUNCE_M) {
+    f->last_cue_m = f->odo_m;
+    float s_j;
+    if (nearestJunction(f, j, &s_j)) {
+      float err = s_j - f->s_m;
+      if (err > lap / 2) err -= lap;
+      if (err < -lap / 2) err += lap;
+      f->last_resync_err_m = err;
+      f->resyncs++;
+      f->s_m = s_j;
+    }
+  }
+  f->last_cue = cue;
+  locate(f);
+
+  // Cruise speed of this segment, or less if the next one needs braking
+  const TrackSegment& s = m->seg[f->seg];
+  const TrackSegment& next = m->seg[(f->seg + 1) % m->count];
+  float remain = f->seg_start_m + s.len_mm / 1000.0f - f->s_m - f->cfg.brake_margin_m;
+  float v_next = next.v_entry_cms / 100.0f;
+  float v_brake = sqrtf(v_next * v_next + 2.0f * f->cfg.a_brake * fmaxf(remain, 0.0f));
+  return fmaxf(fminf(s.v_cms / 100.0f, v_brake), f->cfg.v_min);
+}
+
+// ================= Export =================
+size_t track_map_toJson(const TrackMap* m, char* buf, size_t cap) {
+  if (!track_map_valid(m)) {
+    return (size_t)snprintf(buf, cap, "{\"valid\":false}");
+  }
+  size_t n = (size_t)snprintf(buf, cap,
+                              "{\"valid\":true,\"lap_mm\":%u,\"start_offset_mm\":%u,"
+                              "\"fields\":[\"len_mm\",\"curv_mpm\",\"jct\",\"v_cms\",\"v_entry_cms\"],"
+                              "\"segments\":[",
+                              (unsigned)m->lap_mm, (unsigned)m->start_offset_mm);
+  for (uint8_t i = 0; i < m->count && n < cap; i++) {
+    const TrackSegment& s = m->seg[i];
+    n += (size_t)snprintf(buf + n, cap - n, "%s[%u,%d,%u,%u,%u]", i ? "," : "",
+                          s.len_mm, s.curv_mpm, s.junction, s.v_cms, s.v_entry_cms);
+  }
+  if (n < cap) n += (size_t)snprintf(buf + n, cap - n, "]}");
+  return n < cap ? n : cap - 1;
+}
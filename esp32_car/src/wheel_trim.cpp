@@ -0,0 +1,60 @@
+#include "wheel_trim.h"
+#include <math.h>
+#include <string.h>
+
+// ================= Config =================
+const float TRIM_MIN = 0.70f;             // wheel ratio beyond this = broken motor, not trim
+const float TRIM_MAX = 1.30f;
+const float TRIM_N_HALF = 5.0f;           // confidence 0.5 at this many samples (no noise)
+const float TRIM_ERR_REF = 0.02f;         // 2% ratio uncertainty halves the confidence
+const float TRIM_U_MIN = 20.0f;           // PWM above the deadband for a usable sample
+
+void wheel_trim_init(WheelTrim* t, float pwm_static, float lambda, float trim_l, float trim_r) {
+  memset(t, 0, sizeof(*t));
+  t->pwm_static = pwm_static;
+  t->lambda = lambda;
+  t->trim_l = trim_l;
+  t->trim_r = trim_r;
+}
+
+void wheel_trim_reset(WheelTrim* t) {
+  wheel_trim_init(t, t->pwm_static, t->lambda, t->trim_l, t->trim_r);
+}
+
+void wheel_trim_addSample(WheelTrim* t, float pwm_l, float pwm_r, float v_l, float v_r) {
+  float u[2] = {pwm_l - t->pwm_static, pwm_r - t->pwm_static};
+  float v[2] = {v_l, v_r};
+  if (u[0] < TRIM_U_MIN || u[1] < TRIM_U_MIN) return;
+  for (int i = 0; i < 2; i++) {
+    t->s_uv[i] = t->lambda * t->s_uv[i] + u[i] * v[i];
+    t->s_uu[i] = t->lambda * t->s_uu[i] + u[i] * u[i];
+    t->s_vv[i] = t->lambda * t->s_vv[i] + v[i] * v[i];
+  }
+  t->n_eff = t->lambda * t->n_eff + 1.0f;
+  t->samples++;
+}
+
+void wheel_trim_update(WheelTrim* t) {
+  if (t->n_eff < 2.0f || t->s_uu[0] <= 0.0f || t->s_uu[1] <= 0.0f) {
+    t->confidence = 0.0f;
+    return;
+  }
+  // g = Σuv / Σu²; residual variance → relative variance of g
+  float rel_var = 0.0f;
+  for (int i = 0; i < 2; i++) {
+    float g = t->s_uv[i] / t->s_uu[i];
+    float res = (t->s_vv[i] - g * t->s_uv[i]) / (t->n_eff - 1.0f);
+    if (g <= 0.0f) {
+      t->confidence = 0.0f;
+      return;
+    }
+    t->gain[i] = g;
+    rel_var += fmaxf(res, 0.0f) / t->s_uu[i] / (g * g);
+  }
+  float mean = 0.5f * (t->gain[0] + t->gain[1]);
+  t->trim_l = fminf(fmaxf(mean / t->gain[0], TRIM_MIN), TRIM_MAX);
+  t->trim_r = fminf(fmaxf(mean / t->gain[1], TRIM_MIN), TRIM_MAX);
+
+  float e = sqrtf(rel_var) / TRIM_ERR_REF;
+  t->confidence = t->n_eff / (t->n_eff + TRIM_N_HALF) / (1.0f + e * e);
+}
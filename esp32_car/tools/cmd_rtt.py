@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""Command channel round trip: car/<id>/cmd → car/<id>/ack latency.
+
+Sends harmless "motion stop" commands to the car through the broker at a
+fixed rate and matches every ack by seq. Reports round-trip percentiles
+(host send → host ack receive), the car-side queue time (esp_mqtt task →
+loop()) and apply time, plus loss and ack status counts.
+
+--check-drop additionally sends a repeated seq and a command whose ts is
+older than its ttl_ms; both must come back as "old" / "stale".
+
+  pip install paho-mqtt
+  python3 tools/cmd_rtt.py --device esp32-car-01 --rate 20 -n 500
+"""
+import argparse
+import json
+import sys
+import threading
+import time
+import uuid
+
+import paho.mqtt.client as mqtt
+
+
+def pct(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    k = min(len(values) - 1, max(0, int(round(p / 100.0 * (len(values) - 1)))))
+    return values[k]
+
+
+def summary(name, values, unit='ms'):
+    print(f'{name:10s} p50 {pct(values, 50):7.2f}  p90 {pct(values, 90):7.2f}  '
+          f'p99 {pct(values, 99):7.2f}  max {max(values, default=0):7.2f} {unit}')
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('--host', default='localhost')
+    ap.add_argument('--port', type=int, default=1883)
+    ap.add_argument('--device', required=True, help='device_id, e.g. esp32-car-01')
+    ap.add_argument('--rate', type=float, default=20.0, help='commands per second')
+    ap.add_argument('-n', type=int, default=200, help='number of commands')
+    ap.add_argument('--ttl-ms', type=int, default=500)
+    ap.add_argument('--check-drop', action='store_true')
+    args = ap.parse_args()
+
+    topic_cmd = f'car/{args.device}/cmd'
+    topic_ack = f'car/{args.device}/ack'
+    sid = uuid.uuid4().hex[:8]
+    sent = {}        # seq -> host send time (s)
+    acks = {}        # seq -> (host receive time, ack json)
+    lock = threading.Lock()
+    subscribed = threading.Event()
+
+    def on_connect(client, userdata, flags, rc, *extra):
+        client.subscribe(topic_ack, qos=0)
+
+    def on_subscribe(client, userdata, mid, *extra):
+        subscribed.set()
+
+    def on_message(client, userdata, msg):
+        now = time.time()
+        try:
+            ack = json.loads(msg.payload)
+        except ValueError:
+            return
+        with lock:
+            acks.setdefault(ack.get('seq'), (now, ack))
+
+    try:
+        client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
+    except AttributeError:  # paho-mqtt < 2.0
+        client = mqtt.Client()
+    client.on_connect = on_connect
+    client.on_subscribe = on_subscribe
+    client.on_message = on_message
+    client.connect(args.host, args.port, keepalive=30)
+    client.loop_start()
+    if not subscribed.wait(5):
+        sys.exit(f'could not subscribe to {topic_ack} on {args.host}:{args.port}')
+
+    def send(seq, ts_ms=None, ttl_ms=args.ttl_ms):
+        t = time.time()
+        cmd = {'seq': seq, 'ts': ts_ms if ts_ms is not None else round(t * 1000),
+               'ttl_ms': ttl_ms, 'sid': sid, 'cmd': 'motion', 'motion': 'stop'}
+        with lock:
+            sent.setdefault(seq, t)
+        client.publish(topic_cmd, json.dumps(cmd, separators=(',', ':')), qos=0)
+
+    period = 1.0 / args.rate
+    t_next = time.time()
+    for seq in range(1, args.n + 1):
+        send(seq)
+        t_next += period
+        time.sleep(max(0.0, t_next - time.time()))
+
+    drop_checks = {}
+    if args.check_drop:
+        time.sleep(0.5)
+        seq = args.n + 1
+        send(seq)                                   # baseline for the car's delay estimate
+        time.sleep(0.2)
+        drop_checks[seq + 1] = 'stale'
+        send(seq + 1, ts_ms=round(time.time() * 1000) - 5 * args.ttl_ms)
+        time.sleep(0.2)
+        drop_checks[seq] = 'old'
+        # repeated seq: reply arrives with the same seq, so match by status
+        with lock:
+            acks.pop(seq, None)
+        send(seq)
+
+    time.sleep(1.0)
+    client.loop_stop()
+    client.disconnect()
+
+    rtt, queue, act = [], [], []
+    statuses = {}
+    with lock:
+        for seq in range(1, args.n + 1):
+            if seq not in acks:
+                continue
+            t_rx, ack = acks[seq]
+            statuses[ack.get('status')] = statuses.get(ack.get('status'), 0) + 1
+            rtt.append((t_rx - sent[seq]) * 1000)
+            queue.append(ack.get('queue_us', 0) / 1000)
+            act.append(ack.get('act_us', 0) / 1000)
+        got = {s: acks[s][1].get('status') for s in drop_checks if s in acks}
+
+    lost = args.n - len(rtt)
+    print(f'{args.n} commands at {args.rate:g}/s to {args.host}:{args.port}, '
+          f'{len(rtt)} acked, {lost} lost ({100.0 * lost / max(1, args.n):.1f}%)')
+    print('status    ' + ', '.join(f'{k}={v}' for k, v in sorted(statuses.items())))
+    summary('rtt', rtt)
+    summary('car queue', queue)
+    summary('car apply', act)
+
+    failed = lost > 0 or statuses.get('ok', 0) != len(rtt)
+    for seq, want in drop_checks.items():
+        ok = got.get(seq) == want
+        print(f'drop check seq {seq}: want {want}, got {got.get(seq)} -> {"ok" if ok else "FAIL"}')
+        failed |= not ok
+    print('FAIL' if failed else 'PASS')
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,256 @@
+// Obstacle approaches at several speeds: the old fixed 15 cm threshold
+// (HC-SR04 every 250 ms, last reading checked every 10 ms, hard stop)
+// against the time-to-collision guard (src/collision.cpp) fed with an echo
+// every 60 ms and the wheel encoders every control period.
+//
+// Car model: commanded speed ramps at the drive loop's 1.5 m/s² and the
+// wheels follow it with the PID/motor lag; a command below the deadband
+// still creeps; hard brake (motorsStop) stops within ~TAU_BRAKE. Encoders
+// count whole ticks. Sensor: Gaussian noise, missing echoes and stray
+// echoes, reading taken at trigger time and available a few ms later.
+//
+// Scenarios: static obstacle approached at 0.2 .. 0.8 m/s, an obstacle that
+// appears close in front at speed, an obstacle coming towards the car.
+//
+// Build and run on the host:
+//   g++ -std=c++17 -O2 -Iinclude -o collision_sim tools/collision_sim.cpp src/collision.cpp
+//   ./collision_sim [--standoff 0.15] [--seed 1] [--verbose]
+// gap: distance left at rest (HIT = touched the obstacle), rest: time from
+// start until at rest, react / stop: worst guard event (detection → encoders
+// show deceleration, travel from detection to rest).
+// Exit code 1 if the guard collides, stops more than 4 cm from the standoff
+// on a static approach, or needs a hard stop where a progressive stop would do.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "chassis.h"
+#include "collision.h"
+
+// ================= Car + sensor =================
+const float SIM_DT = 0.001f;
+const float CTRL_DT = CarChassis::CTRL_DT_MS / 1000.0f;
+const float DRIVE_ACCEL = 1.5f;        // do_line DRIVE_ACCEL
+const float TAU_TRACK = 0.08f;         // PID + motor lag
+const float TAU_BRAKE = 0.03f;
+const float V_CREEP = 0.05f;           // lệnh nhỏ hơn vẫn bò (deadband PWM)
+const float ECHO_DELAY = 0.005f;
+const float ECHO_NOISE_M = 0.005f;
+const float ECHO_MISS_P = 0.03f;
+const float ECHO_STRAY_P = 0.01f;
+
+static std::mt19937 rng(1);
+static bool verbose = false;
+
+struct Scenario {
+  const char* name;
+  float v_req;            // m/s
+  float gap0;             // m, initial gap to the obstacle
+  float obs_v;            // m/s towards the car
+  float obs_move_s;       // obstacle moves this long, then stops
+  float appear_s;         // obstacle invisible (and absent) before this
+  bool is_static;         // static approach: judged on final gap / no hard stop
+};
+
+static const Scenario SCENARIOS[] = {
+  {"static 0.2 m/s", 0.2f, 1.4f, 0.0f, 0.0f, 0.0f, true},
+  {"static 0.4 m/s", 0.4f, 1.4f, 0.0f, 0.0f, 0.0f, true},
+  {"static 0.6 m/s", 0.6f, 1.4f, 0.0f, 0.0f, 0.0f, true},
+  {"static 0.8 m/s", 0.8f, 1.4f, 0.0f, 0.0f, 0.0f, true},
+  {"appears 0.30 m @0.6", 0.6f, 0.30f, 0.0f, 0.0f, 1.5f, false},
+  {"appears 0.30 m @0.8", 0.8f, 0.30f, 0.0f, 0.0f, 1.5f, false},
+  {"oncoming 0.2 @0.4", 0.4f, 1.4f, 0.2f, 2.0f, 0.0f, false},
+};
+
+struct World {
+  float x = 0;            // car front
+  float v = 0;
+  float cmd = 0;          // after ramp
+  bool brake = false;
+  float obs_x = 0;
+  float t = 0;
+  float tick_frac = 0;
+  long ticks = 0;         // since the last control period
+  float min_gap = 1e9f;
+};
+
+static float gap(const World& w) {
+  return w.obs_x - w.x;
+}
+
+static void simStep(World& w, const Scenario& s) {
+  float target = w.brake ? 0.0f : (w.cmd > 0.0f && w.cmd < V_CREEP ? V_CREEP : w.cmd);
+  float tau = w.brake ? TAU_BRAKE : TAU_TRACK;
+  w.v += (target - w.v) * SIM_DT / tau;
+  if (w.brake && w.v < 0.002f) w.v = 0.0f;
+  float ds = w.v * SIM_DT;
+  w.x += ds;
+  w.tick_frac += fabsf(ds) * CarChassis::TICKS_PER_M;
+  long n = (long)w.tick_frac;
+  w.tick_frac -= n;
+  w.ticks += n;
+  if (w.t < s.appear_s) w.obs_x = w.x + s.gap0;   // chưa xuất hiện: luôn ở phía trước
+  else if (w.t < s.appear_s + s.obs_move_s) w.obs_x -= s.obs_v * SIM_DT;
+  w.t += SIM_DT;
+  if (w.t >= s.appear_s) w.min_gap = fminf(w.min_gap, gap(w));
+}
+
+// HC-SR04: trigger every period, reading at trigger time, ready after ECHO_DELAY
+struct Sonar {
+  float period;
+  float next_trigger = 0;
+  float ready_at = -1;
+  float pending = -1;
+  float last = -1;        // ultrasonic_distance_cm (m)
+  bool fresh = false;
+
+  void step(const World& w, const Scenario& s) {
+    if (ready_at >= 0 && w.t >= ready_at) {
+      last = pending;
+      fresh = true;
+      ready_at = -1;
+    }
+    if (w.t < next_trigger) return;
+    next_trigger += period;
+    std::uniform_real_distribution<float> u(0.0f, 1.0f);
+    std::normal_distribution<float> noise(0.0f, ECHO_NOISE_M);
+    float d = w.t >= s.appear_s ? gap(w) : -1.0f;
+    float p = u(rng);
+    if (d < 0.02f || d > 4.0f || p < ECHO_MISS_P) pending = -1.0f;
+    else if (p < ECHO_MISS_P + ECHO_STRAY_P) pending = 0.2f + 2.8f * u(rng);
+    else pending = d + noise(rng);
+    ready_at = w.t + ECHO_DELAY;
+  }
+};
+
+static inline float rampTo(float cur, float tgt, float step) {
+  if (tgt > cur + step) return cur + step;
+  if (tgt < cur - step) return cur - step;
+  return tgt;
+}
+
+struct Outcome {
+  float final_gap, min_gap;
+  float rest_s;           // start → at rest in front of the obstacle
+  bool hard;
+  CollisionStats st;
+};
+
+// Old: stop when the last reading < 15 cm (taskObstacle, 10 ms)
+static Outcome runOld(const Scenario& s) {
+  World w;
+  w.obs_x = s.gap0;
+  Sonar sonar{0.25f};
+  float t_rest = -1;
+  bool stopped = false;
+  while (w.t < 8.0f) {
+    sonar.step(w, s);
+    if (fmodf(w.t + 1e-6f, CTRL_DT) < SIM_DT) {
+      if (!stopped) w.cmd = rampTo(w.cmd, s.v_req, DRIVE_ACCEL * CTRL_DT);
+      if (!stopped && sonar.last > 0 && sonar.last < 0.15f) {
+        stopped = true;
+        w.cmd = 0;
+        w.brake = true;
+      }
+    }
+    simStep(w, s);
+    if (stopped && w.v == 0.0f && t_rest < 0) t_rest = w.t;
+    if (t_rest >= 0 && w.t > t_rest + 0.5f) break;
+  }
+  Outcome o{};
+  o.final_gap = gap(w);
+  o.min_gap = w.min_gap;
+  o.rest_s = t_rest;
+  o.hard = true;
+  return o;
+}
+
+static Outcome runGuard(const Scenario& s, const CollisionConfig& cfg) {
+  World w;
+  w.obs_x = s.gap0;
+  Sonar sonar{0.06f};
+  static CollisionGuard g;
+  collision_init(&g, cfg);
+  float t_rest = -1;
+  bool hard = false;
+  while (w.t < 8.0f) {
+    sonar.step(w, s);
+    if (fmodf(w.t + 1e-6f, CTRL_DT) < SIM_DT) {
+      float ds = w.ticks * CarChassis::M_PER_TICK;
+      w.ticks = 0;
+      bool has = sonar.fresh;
+      sonar.fresh = false;
+      CollisionLevel lv = collision_step(&g, CTRL_DT, ds, has, sonar.last);
+      if (lv == COLL_STOP || lv == COLL_BLOCKED) {
+        if (lv == COLL_STOP) hard = true;
+        w.cmd = 0;
+        w.brake = true;
+      } else {
+        w.brake = false;
+        w.cmd = rampTo(w.cmd, collision_limit(&g, s.v_req), DRIVE_ACCEL * CTRL_DT);
+      }
+      if (g.event_done && verbose) {
+        const CollisionEvent& e = g.ev;
+        printf("    event: v0 %.2f m/s, ttc %.2f s, reaction %.0f ms, stop %.0f ms / %.1f cm, clearance %.1f cm%s\n",
+               e.v0_mps, e.ttc_s, e.reaction_s * 1000, e.stop_s * 1000, e.stop_dist_m * 100,
+               e.clearance_m * 100, e.hard ? " HARD" : "");
+      }
+    }
+    simStep(w, s);
+    bool rest = w.v < 0.002f && (g.level == COLL_BLOCKED || w.brake);
+    if (rest && t_rest < 0) t_rest = w.t;
+    if (!rest) t_rest = -1;
+    if (t_rest >= 0 && w.t > t_rest + 0.5f && (s.obs_move_s == 0 || w.t > s.appear_s + s.obs_move_s)) break;
+  }
+  Outcome o{};
+  o.final_gap = gap(w);
+  o.min_gap = w.min_gap;
+  o.rest_s = t_rest;
+  o.hard = hard;
+  o.st = g.stats;
+  return o;
+}
+
+int main(int argc, char** argv) {
+  CollisionConfig cfg;
+  collision_defaults(&cfg);
+  unsigned seed = 1;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--standoff") && i + 1 < argc) cfg.standoff_m = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--verbose")) verbose = true;
+  }
+  printf("standoff %.0f cm, a_soft %.1f m/s², t_react %.0f ms\n", cfg.standoff_m * 100, cfg.a_soft,
+         cfg.t_react_s * 1000);
+  printf("%-20s | %-17s | %-43s\n", "", "old (15 cm, 250 ms)", "TTC guard (60 ms echo + encoder)");
+  printf("%-20s | %8s %8s | %8s %8s %5s %6s %8s\n", "scenario", "gap", "rest", "gap", "rest", "hard",
+         "react", "stop");
+  auto gapStr = [](const Outcome& o, char* buf) {
+    if (o.min_gap < 0.0f) snprintf(buf, 16, "HIT");
+    else snprintf(buf, 16, "%.1fcm", o.final_gap * 100);
+  };
+  bool pass = true;
+  for (const Scenario& s : SCENARIOS) {
+    rng.seed(seed);
+    if (verbose) printf("  %s\n", s.name);
+    Outcome o = runOld(s);
+    rng.seed(seed);
+    Outcome n = runGuard(s, cfg);
+    char go[16], gn[16];
+    gapStr(o, go);
+    gapStr(n, gn);
+    printf("%-20s | %8s %6.0fms | %8s %6.0fms %5s %4.0fms %6.1fcm\n", s.name, go, o.rest_s * 1000, gn,
+           n.rest_s * 1000, n.hard ? "yes" : "no", n.st.reaction_max_s * 1000, n.st.stop_dist_max_m * 100);
+    bool ok = n.min_gap > 0.02f;
+    if (s.is_static) ok = ok && !n.hard && fabsf(n.final_gap - cfg.standoff_m) < 0.04f;
+    if (!ok) {
+      printf("  ^ FAIL\n");
+      pass = false;
+    }
+  }
+  printf(pass ? "PASS\n" : "FAIL\n");
+  return pass ? 0 : 1;
+}
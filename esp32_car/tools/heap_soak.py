@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+"""Heap soak: free heap and largest free block must stay flat under load.
+
+Drives the car with simulated steady-state load for hours:
+
+  http   GET /speed, /getIP, /getWiFiInfo, /getMode (and /camera/capture
+         with --capture) in a loop, --http-rate requests per second
+  mqtt   with --device: "motion stop" / "speed" commands on car/<id>/cmd
+         at --cmd-rate per second through the broker at --host
+
+and samples GET /metrics every --sample seconds (heap free / largest block /
+min free, loop period). Writes a CSV and fits a line through the samples
+after --warmup; fails if the largest free block or free heap trends down by
+more than --max-slope bytes per hour, or if fragmentation grows by more
+than --max-frag-growth percentage points.
+
+  python3 tools/heap_soak.py --car http://192.168.0.120 --hours 4 \\
+      --device esp32_car_ABCDEF --host localhost --csv soak.csv
+"""
+import argparse
+import csv
+import itertools
+import json
+import sys
+import threading
+import time
+import urllib.request
+
+HTTP_PATHS = ['/speed', '/getIP', '/getWiFiInfo', '/getMode']
+
+
+def get(car, path, timeout=5):
+    with urllib.request.urlopen(car.rstrip('/') + path, timeout=timeout) as r:
+        return r.read()
+
+
+def http_load(car, paths, rate, stop, counts):
+    period = 1.0 / rate
+    for path in itertools.cycle(paths):
+        if stop.is_set():
+            return
+        t0 = time.time()
+        try:
+            get(car, path)
+            counts['http_ok'] += 1
+        except OSError:
+            counts['http_err'] += 1
+        stop.wait(max(0.0, period - (time.time() - t0)))
+
+
+def mqtt_load(host, port, device, rate, stop, counts):
+    import paho.mqtt.client as mqtt
+    try:
+        client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
+    except AttributeError:  # paho-mqtt < 2.0
+        client = mqtt.Client()
+    client.connect(host, port, keepalive=30)
+    client.loop_start()
+    topic = f'car/{device}/cmd'
+    sid = f'soak{int(time.time()) % 100000}'
+    period = 1.0 / rate
+    for seq in itertools.count(1):
+        if stop.is_set():
+            break
+        if seq % 2:
+            cmd = {'cmd': 'motion', 'motion': 'stop'}
+        else:
+            cmd = {'cmd': 'speed', 'lin': 130, 'rot': 110}
+        cmd.update(seq=seq, ts=round(time.time() * 1000), ttl_ms=1000, sid=sid)
+        client.publish(topic, json.dumps(cmd, separators=(',', ':')), qos=0)
+        counts['cmd_sent'] += 1
+        stop.wait(period)
+    client.loop_stop()
+    client.disconnect()
+
+
+def slope_per_hour(ts, ys):
+    n = len(ts)
+    if n < 2:
+        return 0.0
+    mt = sum(ts) / n
+    my = sum(ys) / n
+    var = sum((t - mt) ** 2 for t in ts)
+    if var == 0:
+        return 0.0
+    return sum((t - mt) * (y - my) for t, y in zip(ts, ys)) / var * 3600
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('--car', required=True, help='car base URL, e.g. http://192.168.0.120')
+    ap.add_argument('--hours', type=float, default=2.0)
+    ap.add_argument('--sample', type=float, default=30.0, help='seconds between /metrics samples')
+    ap.add_argument('--warmup', type=float, default=300.0, help='seconds excluded from the fit')
+    ap.add_argument('--http-rate', type=float, default=5.0)
+    ap.add_argument('--capture', action='store_true', help='include /camera/capture')
+    ap.add_argument('--device', help='device_id for MQTT command load')
+    ap.add_argument('--host', default='localhost')
+    ap.add_argument('--port', type=int, default=1883)
+    ap.add_argument('--cmd-rate', type=float, default=10.0)
+    ap.add_argument('--csv', default='heap_soak.csv')
+    ap.add_argument('--max-slope', type=float, default=512.0, help='bytes per hour')
+    ap.add_argument('--max-frag-growth', type=float, default=5.0, help='percentage points')
+    args = ap.parse_args()
+
+    counts = {'http_ok': 0, 'http_err': 0, 'cmd_sent': 0}
+    stop = threading.Event()
+    paths = HTTP_PATHS + (['/camera/capture'] if args.capture else [])
+    workers = [threading.Thread(target=http_load, daemon=True,
+                                args=(args.car, paths, args.http_rate, stop, counts))]
+    if args.device:
+        workers.append(threading.Thread(target=mqtt_load, daemon=True,
+                                        args=(args.host, args.port, args.device,
+                                              args.cmd_rate, stop, counts)))
+    for w in workers:
+        w.start()
+
+    rows = []
+    t_start = time.time()
+    t_end = t_start + args.hours * 3600
+    with open(args.csv, 'w', newline='') as f:
+        out = csv.writer(f)
+        out.writerow(['t_s', 'free', 'largest', 'min_free', 'frag_pct', 'loop_max_us',
+                      'http_ok', 'http_err', 'cmd_sent'])
+        try:
+            while time.time() < t_end:
+                time.sleep(args.sample)
+                try:
+                    m = json.loads(get(args.car, '/metrics'))
+                except (OSError, ValueError) as e:
+                    print(f'metrics failed: {e}')
+                    continue
+                h = m['heap']
+                row = [round(time.time() - t_start, 1), h['free'], h['largest'], h['min_free'],
+                       h['frag_pct'], m['loop']['max_us'],
+                       counts['http_ok'], counts['http_err'], counts['cmd_sent']]
+                rows.append(row)
+                out.writerow(row)
+                f.flush()
+                print(f't={row[0]:8.0f}s free {row[1]:7d} largest {row[2]:7d} '
+                      f'min {row[3]:7d} frag {row[4]:3d}% | http {row[6]} ok / {row[7]} err, '
+                      f'cmd {row[8]}')
+        except KeyboardInterrupt:
+            print('interrupted')
+    stop.set()
+
+    fit = [r for r in rows if r[0] >= args.warmup]
+    if len(fit) < 3:
+        sys.exit('not enough samples after warmup')
+    ts = [r[0] for r in fit]
+    s_free = slope_per_hour(ts, [r[1] for r in fit])
+    s_largest = slope_per_hour(ts, [r[2] for r in fit])
+    frag_growth = fit[-1][4] - fit[0][4]
+    print(f'free {s_free:+.0f} B/h, largest block {s_largest:+.0f} B/h, '
+          f'fragmentation {fit[0][4]}% -> {fit[-1][4]}%, min free {fit[-1][3]} B')
+
+    failed = False
+    if s_free < -args.max_slope:
+        print(f'FAIL: free heap trends down {s_free:.0f} B/h')
+        failed = True
+    if s_largest < -args.max_slope:
+        print(f'FAIL: largest free block trends down {s_largest:.0f} B/h')
+        failed = True
+    if frag_growth > args.max_frag_growth:
+        print(f'FAIL: fragmentation grew {frag_growth} points')
+        failed = True
+    print('FAIL' if failed else 'PASS')
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,224 @@
+// Obstacle-detour manoeuvres on a simulated drivetrain: the old fixed-PWM
+// primitives (bang-bang until the tick target, hard brake, 500 ms settle)
+// against the profiled primitives (src/motion_profile.cpp).
+//
+// Motor model per wheel: first-order speed response to PWM above a
+// deadband, the left motor weaker than the right, hard brake on
+// motorsStop(); encoders count edges without direction like the car's.
+// The car pose is integrated from the true wheel travel.
+//
+// Build and run on the host:
+//   g++ -std=c++17 -O2 -Iinclude -o motion_sim tools/motion_sim.cpp src/motion_profile.cpp
+//   ./motion_sim [--mismatch 0.06] [--verbose]
+// Exit code 1 if the profiled detour is not both faster and more accurate.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "chassis.h"
+#include "motion_profile.h"
+
+// ================= Drivetrain =================
+const float SIM_DT = 0.001f;
+const float PWM_DEAD = 40.0f;
+const float V_AT_255 = 0.9f;           // m/s
+const float TAU_DRIVE = 0.06f;         // s, PWM → speed
+const float TAU_COAST = 0.15f;         // PWM 0 (EN low): coast
+const float TAU_BRAKE = 0.03f;         // motorsStop(): IN1 = IN2 = HIGH
+
+struct Wheel {
+  float gain = 1.0f;
+  float v = 0;           // m/s, signed
+  float travel = 0;      // m, signed
+  float frac = 0;        // unreported |travel| in ticks
+  long edges = 0;        // like encX_total
+};
+
+struct Car {
+  Wheel l, r;
+  int pwm_l = 0, pwm_r = 0;
+  bool brake = false;
+  float x = 0, y = 0, th = 0;
+  float t = 0;
+};
+
+static void simStep(Car& c) {
+  Wheel* w[2] = {&c.l, &c.r};
+  int pwm[2] = {c.pwm_l, c.pwm_r};
+  float ds[2];
+  for (int i = 0; i < 2; i++) {
+    float mag = fabsf((float)pwm[i]) - PWM_DEAD;
+    float v_ss = mag > 0 ? (pwm[i] > 0 ? 1 : -1) * mag / (255.0f - PWM_DEAD) * V_AT_255 * w[i]->gain : 0.0f;
+    float tau = c.brake ? TAU_BRAKE : (pwm[i] == 0 || mag <= 0 ? TAU_COAST : TAU_DRIVE);
+    w[i]->v += (v_ss - w[i]->v) * SIM_DT / tau;
+    ds[i] = w[i]->v * SIM_DT;
+    w[i]->travel += ds[i];
+    w[i]->frac += fabsf(ds[i]) * CarChassis::TICKS_PER_M;
+    long n = (long)w[i]->frac;
+    w[i]->frac -= n;
+    w[i]->edges += n;
+  }
+  float d = 0.5f * (ds[0] + ds[1]);
+  c.th += (ds[1] - ds[0]) / CarChassis::TRACK_WIDTH_M;
+  c.x += d * cosf(c.th);
+  c.y += d * sinf(c.th);
+  c.t += SIM_DT;
+}
+
+static void write(Car& c, int l, int r) {
+  c.pwm_l = l;
+  c.pwm_r = r;
+  c.brake = false;
+}
+
+static void stop(Car& c) {
+  c.pwm_l = c.pwm_r = 0;
+  c.brake = true;
+}
+
+static void runFor(Car& c, float s) {
+  for (float t = 0; t < s; t += SIM_DT) simStep(c);
+}
+
+static void settle(Car& c) {
+  while (fabsf(c.l.v) > 1e-4f || fabsf(c.r.v) > 1e-4f) simStep(c);
+}
+
+// ================= Old primitives (do_line before) =================
+const int TURN_PWM = 120;
+const int FWD_PWM = 130;
+
+static void oldSpin(Car& c, long target, int dir) {   // dir +1 = left
+  long L0 = c.l.edges, R0 = c.r.edges;
+  float t0 = c.t;
+  while (!(c.l.edges - L0 >= target && c.r.edges - R0 >= target) && c.t - t0 < 4.0f) {
+    write(c, -dir * TURN_PWM, dir * TURN_PWM);
+    runFor(c, 0.001f);
+  }
+  stop(c);
+}
+
+static void oldForward(Car& c, long target) {
+  long L0 = c.l.edges, R0 = c.r.edges;
+  write(c, FWD_PWM, FWD_PWM);
+  while (true) {
+    bool ld = c.l.edges - L0 >= target, rd = c.r.edges - R0 >= target;
+    if (ld && rd) break;
+    if (ld) write(c, 0, FWD_PWM);
+    else if (rd) write(c, FWD_PWM, 0);
+    runFor(c, 0.001f);
+  }
+  stop(c);
+}
+
+// ================= New primitives (do_line now) =================
+const float CTRL_DT = CarChassis::CTRL_DT_MS / 1000.0f;
+const MotionLimits SPIN_LIM = {0.25f, 1.0f};
+const MotionLimits FWD_LIM = {0.40f, 1.0f};
+
+static void newMove(Car& c, int8_t dl, int8_t dr, float dist, const MotionLimits& lim, MotionResult* res) {
+  MotionGains g;
+  motion_defaults(&g);
+  MotionCtrl m;
+  motion_begin(&m, dl, dr, dist, lim, g);
+  long L = c.l.edges, R = c.r.edges;
+  int pl = 0, pr = 0;
+  while (true) {
+    unsigned long tl = c.l.edges - L, tr = c.r.edges - R;
+    L = c.l.edges;
+    R = c.r.edges;
+    if (!motion_step(&m, tl, tr, CTRL_DT, &pl, &pr)) break;
+    write(c, pl, pr);
+    runFor(c, CTRL_DT);
+  }
+  stop(c);
+  motion_result(&m, res);
+}
+
+// ================= Detour =================
+// spin L 60°, 20 cm, spin R 60°, 20 cm, spin R 50° (seek move not simulated)
+struct Step {
+  int spin;        // +1 left, −1 right, 0 forward
+  float amount;    // deg or m
+};
+static const Step DETOUR[] = {{+1, 60}, {0, 0.2f}, {-1, 60}, {0, 0.2f}, {-1, 50}};
+
+struct Pose {
+  float x, y, th;
+};
+
+static Pose ideal() {
+  Pose p = {0, 0, 0};
+  for (const Step& s : DETOUR) {
+    if (s.spin) p.th += s.spin * s.amount * (float)M_PI / 180;
+    else {
+      p.x += s.amount * cosf(p.th);
+      p.y += s.amount * sinf(p.th);
+    }
+  }
+  return p;
+}
+
+static bool verbose = false;
+
+static Pose runDetour(bool profiled, float mismatch, float* t_out) {
+  Car c;
+  c.l.gain = 1.0f - mismatch;
+  for (const Step& s : DETOUR) {
+    float t0 = c.t;
+    float th0 = c.th;
+    if (!profiled) {
+      if (s.spin) oldSpin(c, CarChassis::ticksForSpinDeg(s.amount), s.spin);
+      else oldForward(c, CarChassis::ticksForDistance(s.amount));
+      runFor(c, 0.5f);   // delay(500)
+    } else {
+      MotionResult res;
+      if (s.spin) {
+        float d = s.amount * (float)M_PI / 180 * 0.5f * CarChassis::TRACK_WIDTH_M;
+        newMove(c, -s.spin, s.spin, d, SPIN_LIM, &res);
+      } else {
+        newMove(c, 1, 1, s.amount, FWD_LIM, &res);
+      }
+      if (verbose) {
+        printf("    result: err L %+.1f mm R %+.1f mm, %.0f ms%s\n", res.err_l_m * 1000, res.err_r_m * 1000,
+               res.time_s * 1000, res.timeout ? " TIMEOUT" : "");
+      }
+    }
+    float t_end = c.t;
+    settle(c);   // measured pose once the wheels are at rest
+    if (verbose) {
+      printf("  %-9s %s %5.1f: %4.0f ms, turned %+6.1f deg\n", profiled ? "profiled" : "old",
+             s.spin ? "spin" : "fwd ", s.spin ? s.spin * s.amount : s.amount * 100, (t_end - t0) * 1000,
+             (c.th - th0) * 180 / (float)M_PI);
+    }
+    c.t = t_end;
+  }
+  *t_out = c.t;
+  return Pose{c.x, c.y, c.th};
+}
+
+int main(int argc, char** argv) {
+  float mismatch = 0.06f;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--mismatch") && i + 1 < argc) mismatch = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--verbose")) verbose = true;
+  }
+  Pose want = ideal();
+  printf("detour (spin L60, 20 cm, spin R60, 20 cm, spin R50), left motor %.0f%% weaker\n", mismatch * 100);
+  float t_old, t_new;
+  Pose p_old = runDetour(false, mismatch, &t_old);
+  Pose p_new = runDetour(true, mismatch, &t_new);
+  auto report = [&](const char* name, const Pose& p, float t) {
+    float pos = hypotf(p.x - want.x, p.y - want.y);
+    float th = fabsf(p.th - want.th) * 180 / (float)M_PI;
+    printf("%-9s %6.0f ms   end position error %5.1f mm, heading error %5.1f deg\n", name, t * 1000, pos * 1000, th);
+    return pos + th * 0.001f;
+  };
+  float e_old = report("old", p_old, t_old);
+  float e_new = report("profiled", p_new, t_new);
+  bool pass = t_new < t_old && e_new < e_old;
+  printf(pass ? "PASS\n" : "FAIL\n");
+  return pass ? 0 : 1;
+}
@@ -0,0 +1,181 @@
+#!/usr/bin/env python3
+"""Broker outage test: loop() timing must not change while MQTT is down.
+
+Runs a local mosquitto (the car's MQTT_BROKER must point at this machine),
+then samples the car's GET /metrics and GET /sched once per second in
+three phases:
+
+  up      broker running, car connected (baseline)
+  down    broker stopped; esp_mqtt keeps retrying every 5 s and telemetry
+          goes to the LittleFS spool (flash writes on the MQTT TX task)
+  back    broker restarted, car reconnects and replays its spool at QoS 1
+
+Fails if the loop period or the control task's lateness in "down" exceeds
+the baseline maximum by more than --slack-ms, if nothing was spooled while
+down, if the spool is not drained within --drain-s after reconnect, or if
+the car does not reconnect. The last line is a one-line summary.
+
+  python3 tools/mqtt_outage_test.py --car http://esp32-car.local --phase 30
+"""
+import argparse
+import json
+import shutil
+import subprocess
+import sys
+import tempfile
+import time
+import urllib.request
+
+
+def get_json(car, path):
+    with urllib.request.urlopen(car.rstrip('/') + path, timeout=3) as r:
+        return json.load(r)
+
+
+def get_metrics(car):
+    return get_json(car, '/metrics')
+
+
+def control_task(car):
+    for t in get_json(car, '/sched')['tasks']:
+        if t['name'] == 'control':
+            return t
+    sys.exit('no control task in /sched')
+
+
+def start_broker(port):
+    exe = shutil.which('mosquitto')
+    if not exe:
+        sys.exit('mosquitto not found in PATH')
+    # mosquitto 2.x only listens on localhost without a config file
+    conf = tempfile.NamedTemporaryFile('w', suffix='.conf', delete=False)
+    conf.write(f'listener {port} 0.0.0.0\nallow_anonymous true\n')
+    conf.close()
+    proc = subprocess.Popen([exe, '-c', conf.name],
+                            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    time.sleep(0.5)
+    if proc.poll() is not None:
+        sys.exit(f'mosquitto failed to start on port {port}')
+    return proc
+
+
+def stop_broker(proc):
+    proc.terminate()
+    try:
+        proc.wait(timeout=5)
+    except subprocess.TimeoutExpired:
+        proc.kill()
+
+
+def wait_connected(car, want, timeout_s):
+    t_end = time.time() + timeout_s
+    while time.time() < t_end:
+        try:
+            if get_metrics(car)['mqtt']['connected'] == want:
+                return True
+        except OSError:
+            pass
+        time.sleep(0.5)
+    return False
+
+
+def sample_phase(car, name, seconds):
+    get_metrics(car)  # reset the loop and scheduler windows
+    control_task(car)
+    worst = 0
+    late = 0
+    overruns = 0
+    avgs = []
+    last = None
+    for _ in range(seconds):
+        time.sleep(1)
+        last = get_metrics(car)
+        loop = last['loop']
+        worst = max(worst, loop['max_us'])
+        if loop['count']:
+            avgs.append(loop['avg_us'])
+        ctl = control_task(car)
+        late = max(late, ctl['late_us_max'])
+        overruns += ctl['overruns']
+    avg = sum(avgs) / len(avgs) if avgs else 0
+    mq = last['mqtt']
+    sp = last['spool']
+    print(f'{name:5s} loop avg {avg / 1000:6.2f} ms  max {worst / 1000:6.2f} ms  '
+          f'control late max {late / 1000:6.2f} ms overruns {overruns} | '
+          f'mqtt connected={mq["connected"]} connects={mq["connects"]} '
+          f'fails={mq["connect_fails"]} connect={mq["connect_ms_last"]} ms '
+          f'publish avg/max={mq["publish_us_avg"]}/{mq["publish_us_max"]} us | '
+          f'spool {sp["depth_records"]} rec replayed={sp["replayed"]} resent={sp["resent"]} '
+          f'dropped={sp["dropped"]}')
+    return {'avg': avg, 'max': worst, 'late': late, 'metrics': last}
+
+
+def wait_drained(car, timeout_s):
+    t_end = time.time() + timeout_s
+    while time.time() < t_end:
+        sp = get_metrics(car)['spool']
+        if sp['depth_records'] == 0 and not sp['inflight']:
+            return True
+        time.sleep(1)
+    return False
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('--car', required=True, help='car base URL, e.g. http://192.168.0.120')
+    ap.add_argument('--port', type=int, default=1883)
+    ap.add_argument('--phase', type=int, default=30, help='seconds per phase')
+    ap.add_argument('--slack-ms', type=float, default=5.0)
+    ap.add_argument('--drain-s', type=int, default=120,
+                    help='max seconds for the spool replay after reconnect')
+    args = ap.parse_args()
+
+    broker = start_broker(args.port)
+    try:
+        if not wait_connected(args.car, True, 30):
+            sys.exit('car did not connect to the local broker')
+        up = sample_phase(args.car, 'up', args.phase)
+
+        stop_broker(broker)
+        broker = None
+        wait_connected(args.car, False, 30)
+        down = sample_phase(args.car, 'down', args.phase)
+
+        broker = start_broker(args.port)
+        ok_back = wait_connected(args.car, True, 30)
+        back = sample_phase(args.car, 'back', args.phase)
+        drained = ok_back and wait_drained(args.car, args.drain_s)
+    finally:
+        if broker:
+            stop_broker(broker)
+
+    failed = False
+    slack_us = args.slack_ms * 1000
+    if down['metrics']['mqtt']['connect_fails'] == 0:
+        print('WARN: no failed connect attempt seen while the broker was down')
+    if down['max'] > up['max'] + slack_us:
+        print(f'FAIL: loop max {down["max"] / 1000:.2f} ms while down > '
+              f'baseline {up["max"] / 1000:.2f} ms + {args.slack_ms} ms')
+        failed = True
+    if down['late'] > up['late'] + slack_us:
+        print(f'FAIL: control late max {down["late"] / 1000:.2f} ms while down > '
+              f'baseline {up["late"] / 1000:.2f} ms + {args.slack_ms} ms')
+        failed = True
+    if down['metrics']['spool']['depth_records'] == 0:
+        print('FAIL: nothing spooled while the broker was down')
+        failed = True
+    if not ok_back:
+        print('FAIL: car did not reconnect')
+        failed = True
+    elif not drained:
+        print(f'FAIL: spool not drained {args.drain_s} s after reconnect')
+        failed = True
+    print('summary: ' + '  '.join(
+        f'{p["name"]} loop avg/max {p["avg"] / 1000:.2f}/{p["max"] / 1000:.2f} ms'
+        for p in (dict(up, name='up'), dict(down, name='down'), dict(back, name='back'))))
+    print('FAIL' if failed else 'PASS')
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Minimal SNTP server: a LAN stand-in for pool.ntp.org when testing sync.
+
+Answers NTPv3/v4 client requests with this host's clock (stratum 2), plus
+an optional fixed offset and a linear drift so the car's drift tracking
+can be checked against a known value: with --drift-ppm 50 the car should
+report drift_ppm ≈ -50 in GET /metrics after two syncs (its clock looks
+slow against a server that runs fast).
+
+Point NTP_SERVER in esp32_car/src/main.cpp (and esp32-cam/src/main.cpp) at
+this machine. Port 123 needs root (or CAP_NET_BIND_SERVICE):
+
+  sudo python3 tools/ntp_server.py --drift-ppm 50
+"""
+import argparse
+import socket
+import struct
+import time
+
+NTP_UNIX_OFFSET = 2208988800
+
+
+def to_ntp(t):
+    sec = int(t)
+    frac = int((t - sec) * (1 << 32)) & 0xFFFFFFFF
+    return ((sec + NTP_UNIX_OFFSET) & 0xFFFFFFFF, frac)
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument('--bind', default='0.0.0.0')
+    ap.add_argument('--port', type=int, default=123)
+    ap.add_argument('--offset-ms', type=float, default=0.0, help='constant offset added to the time served')
+    ap.add_argument('--drift-ppm', type=float, default=0.0, help='served clock runs fast by this much')
+    args = ap.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.bind, args.port))
+    t0 = time.time()
+    print(f'SNTP on {args.bind}:{args.port}, offset {args.offset_ms} ms, drift {args.drift_ppm} ppm')
+
+    def served(now):
+        return now + args.offset_ms / 1000 + (now - t0) * args.drift_ppm / 1e6
+
+    while True:
+        data, addr = sock.recvfrom(512)
+        rx = served(time.time())
+        if len(data) < 48:
+            continue
+        vn = (data[0] >> 3) & 0x7
+        mode = data[0] & 0x7
+        if mode != 3:  # client
+            continue
+        origin = data[40:48]  # client's transmit timestamp
+        ref_s, ref_f = to_ntp(rx - 1)
+        rx_s, rx_f = to_ntp(rx)
+        tx_s, tx_f = to_ntp(served(time.time()))
+        reply = struct.pack('!BBbbII4sII8sIIII',
+                            (0 << 6) | (vn << 3) | 4,  # LI=0, server
+                            2, 6, -20,                 # stratum, poll, precision (~1 µs)
+                            0, 0, b'LOCL',             # root delay / dispersion, ref id
+                            ref_s, ref_f, origin, rx_s, rx_f, tx_s, tx_f)
+        sock.sendto(reply, addr)
+        print(f'{time.strftime("%H:%M:%S")} {addr[0]} v{vn} '
+              f'served {rx:.6f} (offset {(rx - time.time()) * 1000:+.3f} ms)')
+
+
+if __name__ == '__main__':
+    main()
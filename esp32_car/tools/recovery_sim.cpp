@@ -0,0 +1,340 @@
+// Line-loss recovery on simulated tracks: the old timed recovery (pivot on
+// one wheel towards last_seen at 0.3 m/s, given up by the 1.5 s all-off
+// check) against the odometry-guided search in src/line_recovery.cpp.
+//
+// The track is a polyline of black tape; five sensors sit on a bar ahead
+// of the axle. The follower uses the same pattern classes as do_line_loop
+// (soft / hard deviation, 4 on → T, nothing on → lost), steering as a wheel
+// speed difference. Wheels follow their targets with a first-order lag,
+// encoders count whole ticks and take their sign from the target (no
+// direction on the real encoders). Exit from recovery as in the firmware:
+// any sensor on and fewer than 4 (guided: and line_recovery_accept()).
+//
+// Scenarios: sharp corners the follower overshoots at speed, a tight arc,
+// a gap in the tape, and a dead end where the only right answer is to stop
+// close by.
+//
+// Build and run on the host:
+//   g++ -std=c++17 -O2 -Iinclude -o recovery_sim tools/recovery_sim.cpp src/line_recovery.cpp
+//   ./recovery_sim [--verbose]
+// result: OK = reached the end of the track, STOP = stopped (dead end: the
+// expected result), LOST = stopped elsewhere, WRONG = following the line
+// back the way it came. recov: number of searches, time-to-reacquire
+// (mean / max), wander: farthest from the last-seen point.
+// Exit code 1 if the new search does not finish every scenario as expected.
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "chassis.h"
+#include "line_recovery.h"
+
+// ================= Track =================
+const float LINE_HALF_M = 0.012f;       // băng 18 mm + vùng nhìn của TCRT
+const float SENSOR_X_M = 0.07f;         // thanh cảm biến trước trục bánh
+const float SENSOR_Y_M[5] = {0.032f, 0.016f, 0.0f, -0.016f, -0.032f};   // L2 L1 M R1 R2
+
+struct Seg {
+  float ax, ay, bx, by;
+  float s0;                             // route distance at a
+};
+
+struct Track {
+  std::vector<Seg> segs;
+  float x = 0, y = 0, th = 0, s = 0;    // pen
+  bool draw = true;
+
+  void straight(float len) {
+    float bx = x + len * cosf(th), by = y + len * sinf(th);
+    if (draw) segs.push_back({x, y, bx, by, s});
+    x = bx;
+    y = by;
+    s += len;
+  }
+  void turn(float deg) { th += deg * (float)M_PI / 180.0f; }
+  void arc(float r, float deg) {        // + = left
+    int n = (int)(fabsf(deg) / 5.0f) + 1;
+    float dth = deg / n * (float)M_PI / 180.0f;
+    float step = 2.0f * r * sinf(fabsf(dth) / 2.0f);
+    for (int i = 0; i < n; i++) {
+      th += dth / 2;
+      straight(step);
+      th += dth / 2;
+    }
+  }
+  void gap(float len) {
+    draw = false;
+    straight(len);
+    draw = true;
+  }
+};
+
+// Khoảng cách tới line gần nhất; *s_out: vị trí dọc route
+static float lineDist(const Track& t, float px, float py, float* s_out) {
+  float best = 1e9f;
+  for (const Seg& g : t.segs) {
+    float dx = g.bx - g.ax, dy = g.by - g.ay;
+    float len2 = dx * dx + dy * dy;
+    float u = ((px - g.ax) * dx + (py - g.ay) * dy) / len2;
+    u = fminf(fmaxf(u, 0.0f), 1.0f);
+    float ex = g.ax + u * dx - px, ey = g.ay + u * dy - py;
+    float d = sqrtf(ex * ex + ey * ey);
+    if (d < best) {
+      best = d;
+      if (s_out) *s_out = g.s0 + u * sqrtf(len2);
+    }
+  }
+  return best;
+}
+
+struct Scenario {
+  const char* name;
+  float v;
+  int kind;
+  bool dead_end;
+};
+
+static Track buildTrack(int kind) {
+  Track t;
+  t.straight(0.70f);
+  switch (kind) {
+    case 0: t.turn(90); break;
+    case 1: t.turn(-90); break;
+    case 2: t.turn(135); break;
+    case 3: t.arc(0.06f, -120); break;
+    case 4: t.gap(0.06f); break;
+    case 5: return t;                   // dead end
+  }
+  t.straight(0.70f);
+  return t;
+}
+
+static const Scenario SCENARIOS[] = {
+  {"corner 90 L @0.5", 0.5f, 0, false},
+  {"corner 90 R @0.6", 0.6f, 1, false},
+  {"acute 135 L @0.5", 0.5f, 2, false},
+  {"arc r6 120 R @0.6", 0.6f, 3, false},
+  {"gap 6 cm @0.5", 0.5f, 4, false},
+  {"dead end @0.5", 0.5f, 5, true},
+};
+
+// ================= Car =================
+const float SIM_DT = 0.001f;
+const float CTRL_DT = CarChassis::CTRL_DT_MS / 1000.0f;
+const float LOOP_DT = 0.002f;           // do_line_loop (exit check)
+const float TAU_WHEEL = 0.06f;
+const float SIM_T_MAX = 15.0f;
+const float OLD_V_RECOV = 0.3f;
+const float OLD_ALL_OFF_S = 1.5f;       // bad-sample stop in do_line_loop
+static bool verbose = false;
+
+struct Car {
+  float x = -0.06f, y = 0, th = 0;      // axle centre, sensors on the tape
+  float vl = 0, vr = 0;                 // wheel speeds
+  float tl = 0, tr = 0;                 // wheel targets
+  float frac_l = 0, frac_r = 0;
+  long ticks_l = 0, ticks_r = 0;
+};
+
+static void sense(const Track& t, const Car& c, bool on[5]) {
+  for (int i = 0; i < 5; i++) {
+    float sx = c.x + SENSOR_X_M * cosf(c.th) - SENSOR_Y_M[i] * sinf(c.th);
+    float sy = c.y + SENSOR_X_M * sinf(c.th) + SENSOR_Y_M[i] * cosf(c.th);
+    on[i] = lineDist(t, sx, sy, nullptr) < LINE_HALF_M;
+  }
+}
+
+static void physics(Car& c) {
+  c.vl += (c.tl - c.vl) * SIM_DT / TAU_WHEEL;
+  c.vr += (c.tr - c.vr) * SIM_DT / TAU_WHEEL;
+  float dl = c.vl * SIM_DT, dr = c.vr * SIM_DT;
+  float ds = 0.5f * (dl + dr), dth = (dr - dl) / CarChassis::TRACK_WIDTH_M;
+  c.x += ds * cosf(c.th + dth / 2);
+  c.y += ds * sinf(c.th + dth / 2);
+  c.th += dth;
+  c.frac_l += fabsf(dl) * CarChassis::TICKS_PER_M;
+  c.frac_r += fabsf(dr) * CarChassis::TICKS_PER_M;
+  long nl = (long)c.frac_l, nr = (long)c.frac_r;
+  c.frac_l -= nl;
+  c.frac_r -= nr;
+  c.ticks_l += nl;
+  c.ticks_r += nr;
+}
+
+// Pattern → steer như do_line_loop. Trả về: 0 bám line, 1 mất line / T
+static int follow(const bool on[5], float v, int8_t* last_seen, float* tl, float* tr) {
+  bool L2 = on[0], L1 = on[1], M = on[2], R1 = on[3], R2 = on[4];
+  int n = L2 + L1 + M + R1 + R2;
+  float k = 0.0f;
+  if (n == 4) {
+    if (!L2) *last_seen = -1;
+    else if (!R2) *last_seen = 1;
+    return 1;
+  } else if ((L2 && !R2 && !R1) || (L2 && L1 && !R1 && !R2)) {
+    *last_seen = 1;
+    k = 0.6f;
+  } else if ((R2 && !L2 && !L1) || (R2 && R1 && !L1 && !L2)) {
+    *last_seen = -1;
+    k = -0.6f;
+  } else if ((L1 && !R1 && !R2) || (L1 && M && !R1 && !R2)) {
+    *last_seen = 1;
+    k = 0.25f;
+  } else if ((!L1 && !L2 && R1 && !M) || (!L1 && !L2 && M && R1)) {
+    *last_seen = -1;
+    k = -0.25f;
+  } else if ((L1 || L2) && M && (R1 || R2)) {
+    *last_seen = 0;
+  } else if (M) {
+    *last_seen = 0;
+  } else {
+    return 1;
+  }
+  *tl = v * (1.0f - k);
+  *tr = v * (1.0f + k);
+  return 0;
+}
+
+struct Outcome {
+  const char* result;
+  int searches;
+  float t_mean_s, t_max_s;
+  float wander_m;
+};
+
+static Outcome run(const Scenario& sc, bool guided) {
+  Track trk = buildTrack(sc.kind);
+  float s_end = trk.s;
+  Car c;
+  LineRecovery rec;
+  LineRecoveryConfig cfg;
+  line_recovery_defaults(&cfg);
+  line_recovery_init(&rec, cfg);
+
+  bool recovering = false, stopped = false;
+  int8_t last_seen = 0;
+  float t_rec0 = 0, all_off_s = 0;
+  int searches = 0;
+  float t_sum = 0, t_max = 0, wander = 0;
+  float lost_x = 0, lost_y = 0;         // old: điểm thấy line lần cuối (đo wander)
+  float tgt_l = 0, tgt_r = 0;
+  float t = 0, next_ctrl = 0, next_loop = 0;
+  const char* result = nullptr;
+
+  while (t < SIM_T_MAX && !result) {
+    if (t >= next_loop) {
+      next_loop += LOOP_DT;
+      bool on[5];
+      sense(trk, c, on);
+      int n = on[0] + on[1] + on[2] + on[3] + on[4];
+      bool ctrl = t >= next_ctrl;
+      if (ctrl) next_ctrl += CTRL_DT;
+
+      if (!stopped && recovering && n > 0 && n < 4 && (!guided || line_recovery_accept(&rec))) {
+        float dt_rec = t - t_rec0;
+        t_sum += dt_rec;
+        t_max = fmaxf(t_max, dt_rec);
+        if (guided) line_recovery_end(&rec, true);
+        recovering = false;
+        if (verbose) printf("    %.2fs found after %.0f ms\n", t, dt_rec * 1000);
+      }
+      if (!stopped && !recovering) {
+        float tl = 0, tr = 0;
+        if (follow(on, sc.v, &last_seen, &tl, &tr)) {
+          recovering = true;
+          t_rec0 = t;
+          searches++;
+          if (guided) line_recovery_start(&rec, last_seen);
+          if (verbose) printf("    %.2fs lost (last_seen %d)\n", t, last_seen);
+        } else {
+          tgt_l = tl;
+          tgt_r = tr;
+          lost_x = c.x;
+          lost_y = c.y;
+        }
+      }
+      all_off_s = n == 0 ? all_off_s + LOOP_DT : 0;
+
+      if (ctrl && !stopped) {
+        float dl = c.ticks_l * CarChassis::M_PER_TICK * (tgt_l >= 0 ? 1.0f : -1.0f);
+        float dr = c.ticks_r * CarChassis::M_PER_TICK * (tgt_r >= 0 ? 1.0f : -1.0f);
+        c.ticks_l = c.ticks_r = 0;
+        line_recovery_odom(&rec, dl, dr);
+        if (!recovering && n > 0 && n < 4) line_recovery_seen(&rec);
+        if (recovering) {
+          wander = fmaxf(wander, hypotf(c.x - lost_x, c.y - lost_y));
+          if (guided) {
+            if (line_recovery_step(&rec, CTRL_DT) == LREC_FAILED) {
+              line_recovery_end(&rec, false);
+              stopped = true;
+            }
+            tgt_l = rec.vL;
+            tgt_r = rec.vR;
+          } else if (all_off_s >= OLD_ALL_OFF_S) {
+            stopped = true;
+          } else {
+            tgt_l = last_seen < 0 ? OLD_V_RECOV : last_seen > 0 ? 0.0f : OLD_V_RECOV;
+            tgt_r = last_seen > 0 ? OLD_V_RECOV : last_seen < 0 ? 0.0f : OLD_V_RECOV;
+          }
+        }
+        if (stopped) {
+          tgt_l = tgt_r = 0;
+          if (verbose) printf("    %.2fs gave up\n", t);
+        }
+      }
+      c.tl = tgt_l;
+      c.tr = tgt_r;
+
+      // Kết quả
+      float s_at = 0;
+      float d = lineDist(trk, c.x + SENSOR_X_M * cosf(c.th), c.y + SENSOR_X_M * sinf(c.th), &s_at);
+      if (!sc.dead_end && !recovering && !stopped && d < LINE_HALF_M && s_at > s_end - 0.15f) result = "OK";
+      if (stopped && fabsf(c.vl) + fabsf(c.vr) < 0.005f) {
+        result = sc.dead_end && hypotf(c.x - lost_x, c.y - lost_y) < cfg.arc_m + 0.1f ? "STOP" : "LOST";
+      }
+    }
+    physics(c);
+    t += SIM_DT;
+  }
+  if (!result) result = "WRONG";
+  Outcome o;
+  o.result = result;
+  o.searches = searches;
+  int found = guided ? (int)rec.stats.found : searches - (stopped ? 1 : 0);
+  o.t_mean_s = found > 0 ? t_sum / found : 0;
+  o.t_max_s = t_max;
+  o.wander_m = wander;
+  return o;
+}
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--verbose")) verbose = true;
+  }
+  printf("%-20s | %-30s | %-30s\n", "", "old (pivot 0.3 m/s, 1.5 s)", "odometry-guided search");
+  printf("%-20s | %5s %5s %8s %8s | %5s %5s %8s %8s\n", "scenario", "res", "recov", "mean/max", "wander",
+         "res", "recov", "mean/max", "wander");
+  bool pass = true;
+  int ok_old = 0, ok_new = 0;
+  for (const Scenario& s : SCENARIOS) {
+    if (verbose) printf("  %s: old\n", s.name);
+    Outcome o = run(s, false);
+    if (verbose) printf("  %s: guided\n", s.name);
+    Outcome n = run(s, true);
+    const char* want = s.dead_end ? "STOP" : "OK";
+    ok_old += !strcmp(o.result, want);
+    ok_new += !strcmp(n.result, want);
+    printf("%-20s | %5s %5d %3.0f/%4.0f %6.1fcm | %5s %5d %3.0f/%4.0f %6.1fcm\n", s.name, o.result,
+           o.searches, o.t_mean_s * 1000, o.t_max_s * 1000, o.wander_m * 100, n.result, n.searches,
+           n.t_mean_s * 1000, n.t_max_s * 1000, n.wander_m * 100);
+    if (strcmp(n.result, want)) {
+      printf("  ^ FAIL (want %s)\n", want);
+      pass = false;
+    }
+  }
+  int total = sizeof(SCENARIOS) / sizeof(SCENARIOS[0]);
+  printf("success: old %d/%d, guided %d/%d\n", ok_old, total, ok_new, total);
+  printf(pass ? "PASS\n" : "FAIL\n");
+  return pass ? 0 : 1;
+}
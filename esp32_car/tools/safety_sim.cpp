@@ -0,0 +1,392 @@
+// Motor-stop latency with and without the safety supervisor (src/safety.cpp)
+// on a mocked µs clock.
+//
+// Old: every stop is a check inside loop(): obstacle every 10 ms (skipped
+// while loop() is blocked or inside a detour manoeuvre), no link deadman,
+// no watchdog. Supervisor: a task released every period_us (wake-up delay
+// up to --jitter µs, pin writes WRITE_US) polls the echo, steps the
+// supervisor and stops the motors; every writer goes through the gate.
+// loop() keeps its own checks in both cases.
+//
+// Car: 0.5 m/s while the output drives forward, stops at once. HC-SR04:
+// echo every 60 ms, done after the time of flight. Operator (manual):
+// holds forward, the UI repeats the command every 200 ms until the link is
+// lost (the old UI sent it once). Line mode: loop() writes forward every
+// control period.
+//
+// The hazard is judged on the simulation's own truth, independent of what
+// the supervisor measures: the motors still driving after a close echo came
+// back (forward output), after the link has been quiet for the deadman time
+// (manual) or after the control task has not run for the watchdog time.
+// worst: longest such stretch (detection → motors off), "never" = still
+// driving at the end, HIT = the car reached the obstacle.
+//
+// Build and run on the host:
+//   g++ -std=c++17 -O2 -Iinclude -o safety_sim tools/safety_sim.cpp src/safety.cpp
+//   ./safety_sim [--jitter 300] [--soak 120] [--seed 1] [--verbose]
+// Exit code 1 if a supervised run exceeds latency_max_us (truth or measured),
+// trips for the wrong reason, misses an intervention loop() could not make,
+// or touches the obstacle.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+
+#include "safety.h"
+
+// ================= Model =================
+const uint32_t DT_US = 10;
+const uint32_t WRITE_US = 20;            // 6 lần digitalWrite / analogWrite
+const uint32_t CTRL_US = 2000;           // control task
+const uint32_t OBSTACLE_US = 10000;      // taskObstacle
+const uint32_t MOTION_US = 10000;        // motion_run: một chu kỳ PID
+const uint32_t ECHO_PERIOD_US = 60000;
+const uint32_t KEEPALIVE_US = 200000;
+const float V_FWD = 0.5f;
+const float SOUND_MPS = 343.0f;
+const int PWM_FWD = 150;
+
+static std::mt19937 rng(1);
+static uint32_t jitter_us = 300;
+static bool verbose = false;
+
+static float urand(float a, float b) {
+  return std::uniform_real_distribution<float>(a, b)(rng);
+}
+
+// Wake-up delay of the supervisor task: often the full --jitter so the
+// worst case (detection just after a release) is actually exercised
+static uint32_t wakeDelay() {
+  return urand(0, 1) < 0.2f ? jitter_us : (uint32_t)urand(0.0f, (float)jitter_us);
+}
+
+// loop() blocked (nothing runs) or inside a detour manoeuvre (heartbeat
+// and forward output every PID period, no other checks)
+struct Block {
+  float t0_s, t1_s;
+  bool motion;
+};
+
+struct Scenario {
+  const char* name;
+  bool manual;
+  float obs_m;            // obstacle ahead of the start, < 0: none
+  float link_lost_s;      // manual: UI stops sending, < 0: never
+  Block blocks[2];
+  int n_blocks;
+  uint8_t expect;         // SafetyReason bits the supervisor may trip on
+  bool required;          // ... and must: loop() cannot stop the car in time
+  float run_s;
+};
+
+static const Scenario SCENARIOS[] = {
+  {"manual, clear", true, -1.0f, -1.0f, {}, 0, 0, false, 3.0f},
+  {"manual: obstacle", true, 0.55f, -1.0f, {}, 0, SAFETY_OBSTACLE, false, 3.0f},
+  {"manual: obstacle, loop 90ms", true, 0.55f, -1.0f, {{0.89f, 0.98f, false}}, 1, SAFETY_OBSTACLE, true, 3.0f},
+  {"manual: link lost", true, -1.0f, 1.0f, {}, 0, SAFETY_DEADMAN, true, 3.0f},
+  {"line, detour", false, -1.0f, -1.0f, {{0.5f, 2.0f, true}}, 1, 0, false, 3.0f},
+  {"line: obstacle in detour", false, 0.55f, -1.0f, {{0.5f, 2.0f, true}}, 1, SAFETY_OBSTACLE, true, 3.0f},
+  {"line: loop stalled 400ms", false, -1.0f, -1.0f, {{1.0f, 1.4f, false}}, 1, SAFETY_WATCHDOG, true, 3.0f},
+};
+
+struct Sim {
+  const Scenario* sc;
+  bool supervised;
+  Safety sf;
+  uint32_t t = 0;
+  int pwm_l = 0, pwm_r = 0;
+  float x = 0;
+  bool hit = false;
+
+  // HC-SR04
+  uint32_t next_trig = 0, echo_done = 0;
+  bool echo_busy = false;
+  float echo_pending = -1;
+  float echo_d = -1;           // last finished measurement
+  uint32_t echo_t = 0;
+  bool echo_new = false;       // not yet seen by the supervisor
+
+  // Operator / loop()
+  uint32_t next_cmd = 0, last_link = 0;   // last_link 0: nothing sent yet
+  bool holding = false;        // manual: operator's forward still in force
+  bool line_on = true;         // line: loop() writes forward (off once it stopped for an obstacle)
+  bool motion_abort = false;   // detour step refused by the gate
+  uint32_t next_ctrl = 0, next_obst = 0, next_motion = 0, last_hb = 0;
+
+  // Supervisor task
+  uint32_t release = 0, due = 0;
+  bool off_pending = false;
+  uint32_t off_at = 0;
+
+  // Truth
+  bool was_drive = false, was_fwd = false;
+  uint32_t drive_t = 0, fwd_t = 0;
+  bool viol = false;
+  uint32_t viol_since = 0, viol_max = 0;
+  bool never = false;
+};
+
+static bool inBlock(const Sim& s, bool* motion) {
+  float ts = s.t * 1e-6f;
+  for (int i = 0; i < s.sc->n_blocks; i++) {
+    const Block& b = s.sc->blocks[i];
+    if (ts >= b.t0_s && ts < b.t1_s) {
+      *motion = b.motion;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Every motor writer: through the gate when supervised (refused → off)
+static bool write(Sim& s, int l, int r) {
+  if (s.supervised && !safety_allows(&s.sf, l, r)) {
+    s.pwm_l = s.pwm_r = 0;
+    return false;
+  }
+  s.pwm_l = l;
+  s.pwm_r = r;
+  return true;
+}
+
+static void sonarStep(Sim& s) {
+  if (s.echo_busy && s.t >= s.echo_done) {
+    s.echo_busy = false;
+    s.echo_d = s.echo_pending;
+    s.echo_t = s.t;
+    s.echo_new = true;
+  }
+  if (s.echo_busy || s.t < s.next_trig) return;
+  s.next_trig += ECHO_PERIOD_US;
+  float d = s.sc->obs_m >= 0 ? s.sc->obs_m - s.x : -1.0f;
+  if (d >= 0.02f) {
+    s.echo_pending = d + std::normal_distribution<float>(0.0f, 0.003f)(rng);
+    s.echo_done = s.t + (uint32_t)(2.0f * d / SOUND_MPS * 1e6f);
+  } else {
+    s.echo_pending = -1.0f;
+    s.echo_done = s.t + 30000;
+  }
+  s.echo_busy = true;
+}
+
+static void linkStep(Sim& s) {
+  if (!s.sc->manual || s.t < s.next_cmd) return;
+  if (s.sc->link_lost_s >= 0 && s.t * 1e-6f >= s.sc->link_lost_s) return;
+  bool first = s.last_link == 0;
+  s.next_cmd = s.t + KEEPALIVE_US + (uint32_t)urand(0.0f, 50000.0f);   // trễ WiFi
+  s.last_link = s.t;
+  if (!s.supervised && !first) return;   // UI cũ chỉ gửi một lần
+  if (s.supervised) safety_command(&s.sf, s.t);
+  s.holding = true;
+  write(s, PWM_FWD, PWM_FWD);
+}
+
+static void stopFromLoop(Sim& s) {
+  s.pwm_l = s.pwm_r = 0;
+  s.holding = false;
+  s.line_on = false;
+}
+
+static void loopStep(Sim& s) {
+  bool motion = false;
+  if (inBlock(s, &motion)) {
+    if (!motion || s.t < s.next_motion) return;
+    s.next_motion = s.t + MOTION_US;
+    s.last_hb = s.t;
+    if (s.supervised) safety_heartbeat(&s.sf, s.t);
+    if (!s.motion_abort && !write(s, PWM_FWD, PWM_FWD)) s.motion_abort = true;
+    return;
+  }
+  if (s.t >= s.next_ctrl) {
+    s.next_ctrl = s.t + CTRL_US + (uint32_t)urand(0.0f, 200.0f);
+    if (s.supervised && s.holding && (s.sf.tripped & (SAFETY_DEADMAN | SAFETY_WATCHDOG))) {
+      stopFromLoop(s);   // taskControl bỏ lệnh đã bị supervisor cắt
+    }
+    s.last_hb = s.t;
+    if (s.supervised) safety_heartbeat(&s.sf, s.t);
+    if (!s.sc->manual && s.line_on) write(s, PWM_FWD, PWM_FWD);
+  }
+  if (s.t >= s.next_obst) {
+    s.next_obst = s.t + OBSTACLE_US;
+    bool fwd = s.pwm_l + s.pwm_r > 0;
+    if (fwd && s.echo_d >= 0 && s.echo_d < s.sf.cfg.stop_m) stopFromLoop(s);
+  }
+}
+
+static void supervisorStep(Sim& s) {
+  if (s.off_pending && s.t >= s.off_at) {
+    s.off_pending = false;
+    s.pwm_l = s.pwm_r = 0;
+    if (safety_stopped(&s.sf, s.t) && verbose) {
+      printf("    %7.3f s  %s stop, %u us after detection\n", s.t * 1e-6, safety_reasonName(s.sf.ev.reasons),
+             s.sf.ev.latency_us);
+    }
+  }
+  if (s.t < s.due) return;
+  s.release += s.sf.cfg.period_us;
+  s.due = s.release + wakeDelay();
+  if (s.echo_new) {
+    s.echo_new = false;
+    safety_echo(&s.sf, s.t, s.echo_d);
+  }
+  if (safety_step(&s.sf, s.t, s.pwm_l, s.pwm_r, s.sc->manual) && !s.off_pending) {
+    s.off_pending = true;
+    s.off_at = s.t + WRITE_US;
+  }
+}
+
+static void truthStep(Sim& s, const SafetyConfig& c) {
+  bool drive = s.pwm_l != 0 || s.pwm_r != 0;
+  bool fwd = s.pwm_l + s.pwm_r > 0;
+  if (drive && !s.was_drive) s.drive_t = s.t;
+  if (fwd && !s.was_fwd) s.fwd_t = s.t;
+  s.was_drive = drive;
+  s.was_fwd = fwd;
+
+  bool cond = false;
+  uint32_t since = 0;
+  auto add = [&](uint32_t from) {
+    since = cond && since < from ? since : from;
+    cond = true;
+  };
+  if (fwd && s.echo_d >= 0 && s.echo_d < c.stop_m) add(std::max(s.echo_t, s.fwd_t));
+  if (s.sc->manual && drive && s.t - s.last_link >= c.deadman_us) add(std::max(s.last_link + c.deadman_us, s.drive_t));
+  if (drive && s.t - s.last_hb >= c.watchdog_us) add(std::max(s.last_hb + c.watchdog_us, s.drive_t));
+  if (cond && !s.viol) {
+    s.viol = true;
+    s.viol_since = since;
+  } else if (!cond && s.viol) {
+    s.viol = false;
+    s.viol_max = std::max(s.viol_max, s.t - s.viol_since);
+  }
+}
+
+static void run(Sim& s, const Scenario& sc, bool supervised, const SafetyConfig& cfg) {
+  s.sc = &sc;
+  s.supervised = supervised;
+  safety_init(&s.sf, cfg, 0);
+  // Pha ngẫu nhiên: phát hiện rơi vào bất kỳ chỗ nào giữa hai release
+  s.t = DT_US * (uint32_t)urand(1.0f, 100.0f);
+  s.next_cmd = s.t;
+  s.release = (uint32_t)urand(0.0f, (float)cfg.period_us);
+  s.due = s.release + wakeDelay();
+  uint32_t end = (uint32_t)(sc.run_s * 1e6f);
+  for (; s.t < end; s.t += DT_US) {
+    sonarStep(s);
+    if (supervised) supervisorStep(s);
+    linkStep(s);
+    loopStep(s);
+    truthStep(s, cfg);
+    if (s.pwm_l + s.pwm_r > 0 && !s.hit) {
+      s.x += V_FWD * DT_US * 1e-6f;
+      if (sc.obs_m >= 0 && s.x >= sc.obs_m) {
+        s.x = sc.obs_m;
+        s.hit = true;
+      }
+    }
+  }
+  if (s.viol) {
+    s.never = true;
+    s.viol_max = std::max(s.viol_max, s.t - s.viol_since);
+  }
+}
+
+static void worstStr(const Sim& s, char* buf) {
+  if (s.never) snprintf(buf, 24, "never");
+  else if (s.viol_max == 0) snprintf(buf, 24, "-");
+  else snprintf(buf, 24, "%.2fms", s.viol_max / 1000.0f);
+}
+
+static void gapStr(const Sim& s, char* buf) {
+  if (s.sc->obs_m < 0) snprintf(buf, 24, "-");
+  else if (s.hit) snprintf(buf, 24, "HIT");
+  else snprintf(buf, 24, "%.1fcm", (s.sc->obs_m - s.x) * 100);
+}
+
+static uint8_t tripped(const SafetyStats& st) {
+  return (st.obstacle ? SAFETY_OBSTACLE : 0) | (st.deadman ? SAFETY_DEADMAN : 0) |
+         (st.watchdog ? SAFETY_WATCHDOG : 0);
+}
+
+// ================= Soak =================
+// Random 3 s segments: mode, obstacle, link loss, loop blocks and detours
+static bool soak(int seconds, const SafetyConfig& cfg) {
+  uint32_t worst = 0, measured = 0, events = 0, late = 0;
+  int never = 0, hits = 0;
+  verbose = false;
+  for (int i = 0; i < seconds / 3; i++) {
+    Scenario sc{};
+    sc.name = "soak";
+    sc.manual = urand(0, 1) < 0.5f;
+    sc.obs_m = urand(0, 1) < 0.5f ? urand(0.15f, 1.2f) : -1.0f;
+    sc.link_lost_s = sc.manual && urand(0, 1) < 0.5f ? urand(0.2f, 2.5f) : -1.0f;
+    sc.n_blocks = 2;
+    for (int b = 0; b < 2; b++) {
+      float t0 = urand(0.1f, 2.6f);
+      bool motion = !sc.manual && urand(0, 1) < 0.5f;
+      sc.blocks[b] = {t0, t0 + (motion ? urand(0.3f, 1.5f) : urand(0.01f, 0.5f)), motion};
+    }
+    sc.run_s = 3.0f;
+    Sim s;
+    run(s, sc, true, cfg);
+    worst = std::max(worst, s.viol_max);
+    measured = std::max(measured, s.sf.stats.latency_max_us);
+    events += s.sf.stats.events;
+    late += s.sf.stats.late;
+    never += s.never;
+    hits += s.hit;
+  }
+  bool ok = worst <= cfg.latency_max_us && measured <= cfg.latency_max_us && late == 0 && never == 0 && hits == 0;
+  printf("soak %d s: %u interventions, worst %.2f ms (measured %.2f ms), late %u, never %d, HIT %d %s\n", seconds,
+         events, worst / 1000.0f, measured / 1000.0f, late, never, hits, ok ? "" : "FAIL");
+  return ok;
+}
+
+int main(int argc, char** argv) {
+  SafetyConfig cfg;
+  safety_defaults(&cfg);
+  unsigned seed = 1;
+  int soak_s = 120;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--jitter") && i + 1 < argc) jitter_us = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--soak") && i + 1 < argc) soak_s = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--verbose")) verbose = true;
+  }
+  printf("period %u us, wake-up jitter ≤ %u us, bound %u us; stop %.0f cm, deadman %u ms, watchdog %u ms\n",
+         cfg.period_us, jitter_us, cfg.latency_max_us, cfg.stop_m * 100, cfg.deadman_us / 1000,
+         cfg.watchdog_us / 1000);
+  printf("%-30s | %-16s | %-46s\n", "", "old (loop checks)", "supervisor");
+  printf("%-30s | %9s %6s | %9s %6s %9s  %s\n", "scenario", "worst", "gap", "worst", "gap", "measured",
+         "interventions");
+  bool pass = true;
+  for (const Scenario& sc : SCENARIOS) {
+    rng.seed(seed);
+    Sim o;
+    run(o, sc, false, cfg);
+    rng.seed(seed);
+    if (verbose) printf("  %s\n", sc.name);
+    Sim n;
+    run(n, sc, true, cfg);
+    char wo[24], go[24], wn[24], gn[24];
+    worstStr(o, wo);
+    gapStr(o, go);
+    worstStr(n, wn);
+    gapStr(n, gn);
+    const SafetyStats& st = n.sf.stats;
+    printf("%-30s | %9s %6s | %9s %6s %7.2fms  %u %s\n", sc.name, wo, go, wn, gn, st.latency_max_us / 1000.0f,
+           st.events, st.events ? safety_reasonName(tripped(st)) : "");
+    bool ok = !n.never && !n.hit && n.viol_max <= cfg.latency_max_us && st.latency_max_us <= cfg.latency_max_us &&
+              st.late == 0 && (tripped(st) & ~sc.expect) == 0 && (!sc.required || tripped(st) == sc.expect);
+    if (!ok) {
+      printf("  ^ FAIL\n");
+      pass = false;
+    }
+  }
+  rng.seed(seed);
+  if (soak_s > 0) pass = soak(soak_s, cfg) && pass;
+  printf(pass ? "PASS\n" : "FAIL\n");
+  return pass ? 0 : 1;
+}
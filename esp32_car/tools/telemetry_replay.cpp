@@ -0,0 +1,283 @@
+// Replay a telemetry session through the publish policies and compare
+// messages/s, bytes/s and short events missed.
+//
+//   periodic-json   the old behaviour: one JSON message every 5 s
+//   periodic-bin    binary at a fixed rate (--hz)
+//   change-json     change-driven (telemetry_policy), JSON, 4 msg/s cap
+//   change-bin      change-driven, binary, --hz cap
+//
+// "missed" counts discrete states (mode, motion, line mask, obstacle) that
+// came and went without being in any published sample; "lost-line" is the
+// same count for the states with every line sensor off (a 300 ms line loss
+// between two periodic messages).
+//
+// Build on the host (uses the firmware's policy and codec sources):
+//   g++ -std=c++17 -O2 -Iinclude -o telemetry_replay tools/telemetry_replay.cpp src/telemetry_policy.cpp src/telemetry_codec.cpp
+//
+// Input: CSV with a header, one row per sample (>= 20 Hz for a meaningful
+// comparison). Columns by name: uptime_ms, mode, motion, speed_linear,
+// speed_rot, distance_cm, obstacle, line.0 .. line.4 (or line_mask),
+// wifi_rssi. A 20 Hz binary session stored by the backend exports as:
+//   mongoexport -d <db> -c telemetry --type=csv -q '{"device_id":"esp32_car_7E7C3C"}'
+//     -f uptime_ms,mode,motion,speed_linear,speed_rot,distance_cm,obstacle,line.0,line.1,line.2,line.3,line.4,wifi_rssi
+//
+//   ./telemetry_replay session.csv [--hz 20]
+//   ./telemetry_replay --synthetic [--hz 20]     (10 min: parked / line follow / parked)
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "telemetry_codec.h"
+#include "telemetry_policy.h"
+
+static const char* DEVICE_ID = "esp32_car_7E7C3C";
+static const uint32_t PERIODIC_JSON_MS = 5000;
+static const float JSON_RATE_HZ = 4.0f;   // TELEMETRY_JSON_RATE_HZ
+
+// mode / motion strings must outlive the samples (policy compares pointers first)
+static const char* intern(const std::string& s) {
+  static std::set<std::string> pool;
+  return pool.insert(s).first->c_str();
+}
+
+// ================= JSON size (same fields as serializeJsonSample) =================
+static size_t jsonSize(const TelemetrySample& s) {
+  char buf[512];
+  return snprintf(buf, sizeof(buf),
+                  "{\"device_id\":\"%s\",\"mode\":\"%s\",\"motion\":\"%s\",\"speed_linear\":%d,"
+                  "\"speed_rot\":%d,\"distance_cm\":%g,\"obstacle\":%s,"
+                  "\"line\":[%s,%s,%s,%s,%s],\"wifi_rssi\":%d,\"uptime_ms\":%u}",
+                  DEVICE_ID, s.mode, s.motion, s.speed_linear, s.speed_rot,
+                  s.distance_cm > 0 ? s.distance_cm : -1.0f, s.obstacle ? "true" : "false",
+                  s.line[0] ? "true" : "false", s.line[1] ? "true" : "false",
+                  s.line[2] ? "true" : "false", s.line[3] ? "true" : "false",
+                  s.line[4] ? "true" : "false", s.wifi_rssi, (unsigned)s.uptime_ms);
+}
+
+// MQTT 3.1.1 PUBLISH QoS 0 on the wire
+static size_t wireSize(size_t topic_len, size_t payload_len) {
+  size_t remaining = 2 + topic_len + payload_len;
+  return 1 + (remaining < 128 ? 1 : remaining < 16384 ? 2 : 3) + remaining;
+}
+
+// ================= Input =================
+static bool parseBool(const std::string& v) {
+  return v == "true" || v == "1" || v == "True";
+}
+
+static bool loadCsv(const char* path, std::vector<TelemetrySample>* out) {
+  std::ifstream in(path);
+  if (!in) {
+    fprintf(stderr, "cannot open %s\n", path);
+    return false;
+  }
+  std::string line;
+  if (!std::getline(in, line)) return false;
+  std::map<std::string, int> col;
+  {
+    std::stringstream ss(line);
+    std::string name;
+    for (int i = 0; std::getline(ss, name, ','); i++) col[name] = i;
+  }
+  if (!col.count("uptime_ms")) {
+    fprintf(stderr, "CSV needs an uptime_ms column\n");
+    return false;
+  }
+  auto get = [&](const std::vector<std::string>& f, const char* name) -> std::string {
+    auto it = col.find(name);
+    return (it != col.end() && it->second < (int)f.size()) ? f[it->second] : std::string();
+  };
+
+  while (std::getline(in, line)) {
+    std::vector<std::string> f;
+    std::stringstream ss(line);
+    std::string v;
+    while (std::getline(ss, v, ',')) f.push_back(v);
+    if (f.empty()) continue;
+
+    TelemetrySample s = {};
+    s.uptime_ms = strtoul(get(f, "uptime_ms").c_str(), nullptr, 10);
+    s.mode = intern(get(f, "mode"));
+    s.motion = intern(get(f, "motion"));
+    s.speed_linear = atoi(get(f, "speed_linear").c_str());
+    s.speed_rot = atoi(get(f, "speed_rot").c_str());
+    s.distance_cm = atof(get(f, "distance_cm").c_str());
+    s.obstacle = parseBool(get(f, "obstacle"));
+    if (col.count("line_mask")) {
+      int m = atoi(get(f, "line_mask").c_str());
+      for (int i = 0; i < 5; i++) s.line[i] = (m >> i) & 1;
+    } else {
+      for (int i = 0; i < 5; i++) {
+        std::string name = "line." + std::to_string(i);
+        s.line[i] = parseBool(get(f, name.c_str()));
+      }
+    }
+    s.wifi_rssi = atoi(get(f, "wifi_rssi").c_str());
+    out->push_back(s);
+  }
+  return !out->empty();
+}
+
+// 10 minutes at 50 Hz: parked 3 min, line following 4 min, parked 3 min
+static void synthesize(std::vector<TelemetrySample>* out) {
+  uint32_t rng = 12345;
+  auto rnd = [&]() { rng = rng * 1103515245u + 12345u; return (rng >> 16) & 0x7FFF; };
+  auto noise = [&](float amp) { return (rnd() / 32767.0f * 2.0f - 1.0f) * amp; };
+
+  const char* manual = intern("manual");
+  const char* line = intern("line");
+  const char* stop = intern("stop");
+  const char* follow = intern("line_follow");
+
+  for (uint32_t t = 0; t < 600000; t += 20) {
+    TelemetrySample s = {};
+    s.uptime_ms = 100000 + t;
+    s.wifi_rssi = -60 + (int)lroundf(noise(2.0f));
+    bool driving = t >= 180000 && t < 420000;
+    if (!driving) {
+      s.mode = manual;
+      s.motion = stop;
+      s.distance_cm = 80.0f + noise(0.6f);
+      s.line[2] = true;
+    } else {
+      float ph = (t - 180000) / 1000.0f;
+      s.mode = line;
+      s.motion = follow;
+      s.speed_linear = 170 + (int)(25 * sinf(ph * 0.7f));
+      s.speed_rot = (int)(40 * sinf(ph * 2.1f));
+      s.distance_cm = 60.0f + 45.0f * sinf(ph * 0.3f) + noise(0.6f);
+      s.obstacle = s.distance_cm < 15.0f;
+      int center = (int)lroundf(2.0f + 1.4f * sinf(ph * 2.1f));
+      s.line[center < 0 ? 0 : center > 4 ? 4 : center] = true;
+      // mất line 300 ms mỗi ~7 s
+      if (fmodf(ph, 7.0f) < 0.3f) {
+        for (int i = 0; i < 5; i++) s.line[i] = false;
+      }
+    }
+    out->push_back(s);
+  }
+}
+
+// ================= Simulation =================
+struct Result {
+  const char* name;
+  uint32_t msgs = 0;
+  uint64_t payload = 0;
+  uint64_t wire = 0;
+  uint32_t missed = 0;
+  uint32_t states = 0;
+  uint32_t lost_missed = 0;
+  uint32_t lost_states = 0;
+};
+
+static bool lineLost(const TelemetrySample& s) {
+  for (int i = 0; i < 5; i++) {
+    if (s.line[i]) return false;
+  }
+  return true;
+}
+
+static bool sameDiscrete(const TelemetrySample& a, const TelemetrySample& b) {
+  if (strcmp(a.mode, b.mode) || strcmp(a.motion, b.motion) || a.obstacle != b.obstacle) return false;
+  for (int i = 0; i < 5; i++) {
+    if (a.line[i] != b.line[i]) return false;
+  }
+  return true;
+}
+
+// Periodic: one message every interval_ms. Change-driven: telemetry_policy capped at rate_hz.
+static Result run(const char* name, const std::vector<TelemetrySample>& in, bool binary,
+                  bool change_driven, uint32_t interval_ms, float rate_hz) {
+  Result r;
+  r.name = name;
+  std::string topic = std::string("car/") + DEVICE_ID + (binary ? "/telemetry/bin" : "/telemetry");
+
+  TelemetryPolicy policy;
+  TelemetryPolicyConfig cfg;
+  telemetry_policy_defaults(&cfg);
+  cfg.rate_hz = rate_hz;
+  telemetry_policy_init(&policy, cfg, in.front().uptime_ms);
+
+  uint32_t last_pub = 0;
+  bool first = true;
+  bool state_seen = false;
+  for (size_t i = 0; i < in.size(); i++) {
+    const TelemetrySample& s = in[i];
+    if (i == 0 || !sameDiscrete(s, in[i - 1])) {
+      if (i > 0 && !state_seen) {
+        r.missed++;
+        if (lineLost(in[i - 1])) r.lost_missed++;
+      }
+      r.states++;
+      if (lineLost(s)) r.lost_states++;
+      state_seen = false;
+    }
+
+    bool publish;
+    if (change_driven) {
+      publish = telemetry_policy_check(&policy, s, s.uptime_ms) != TLM_REASON_NONE;
+    } else {
+      publish = first || s.uptime_ms - last_pub >= interval_ms;
+    }
+    if (!publish) continue;
+
+    if (change_driven) telemetry_policy_commit(&policy, s, s.uptime_ms);
+    first = false;
+    last_pub = s.uptime_ms;
+    state_seen = true;
+    size_t n = binary ? sizeof(TelemetryBinV2) : jsonSize(s);
+    r.msgs++;
+    r.payload += n;
+    r.wire += wireSize(topic.size(), n);
+  }
+  return r;
+}
+
+int main(int argc, char** argv) {
+  const char* path = nullptr;
+  bool synthetic = false;
+  float hz = 20.0f;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--synthetic")) synthetic = true;
+    else if (!strcmp(argv[i], "--hz") && i + 1 < argc) hz = atof(argv[++i]);
+    else path = argv[i];
+  }
+  if (!synthetic && !path) {
+    fprintf(stderr, "usage: %s session.csv | --synthetic [--hz 20]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<TelemetrySample> in;
+  if (synthetic) {
+    synthesize(&in);
+  } else if (!loadCsv(path, &in)) {
+    return 1;
+  }
+  double span_s = (in.back().uptime_ms - in.front().uptime_ms) / 1000.0;
+  if (span_s <= 0) span_s = 1;
+  printf("%zu samples over %.1f s\n\n", in.size(), span_s);
+
+  Result res[] = {
+    run("periodic-json", in, false, false, PERIODIC_JSON_MS, 0),
+    run("periodic-bin", in, true, false, (uint32_t)(1000 / hz), 0),
+    run("change-json", in, false, true, 0, JSON_RATE_HZ),
+    run("change-bin", in, true, true, 0, hz),
+  };
+
+  printf("%-14s %8s %8s %10s %10s %14s %10s\n", "policy", "msgs", "msg/s", "B/s", "wire B/s",
+         "missed", "lost-line");
+  for (const Result& r : res) {
+    printf("%-14s %8u %8.2f %10.1f %10.1f %8u/%-5u %5u/%u\n", r.name, r.msgs, r.msgs / span_s,
+           r.payload / span_s, r.wire / span_s, r.missed, r.states, r.lost_missed, r.lost_states);
+  }
+  return 0;
+}
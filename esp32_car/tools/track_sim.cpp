@@ -0,0 +1,206 @@
+// Learning lap + fast lap on a simulated circuit, through the firmware's
+// track map code (src/track_map.cpp).
+//
+// The circuit is a list of straights and arcs with crossing lines. The car
+// moves along it with a bounded acceleration; its wheel encoders see the
+// arc length of each wheel with slip (bias + noise) quantised to ticks, and
+// the line classifier reports a CROSS cue while the sensors are over a
+// crossing line. The line is lost when v²·κ exceeds the grip of the
+// reactive follower (the car stops and recovers, 1 s penalty).
+//
+//   1. baseline: constant v_base (what do_line does today)
+//   2. learning lap at v_base → map (closes when the first junction comes back)
+//   3. fast laps from the same start point using the map's speed profile
+//
+// Build and run on the host:
+//   g++ -std=c++17 -O2 -Iinclude -o track_sim tools/track_sim.cpp src/track_map.cpp
+//   ./track_sim [--laps 3] [--v-base 0.5] [--slip 0.01] [--seed 1] [--verbose]
+// Exit code 1 if the fast laps are not faster or lose the line.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "chassis.h"
+#include "track_map.h"
+
+// ================= Circuit =================
+struct Piece {
+  float len_m;
+  float curv;        // 1/m, + = left
+  bool cross;        // crossing line at the start of the piece
+};
+
+// Heading adds up to 360°: hairpin, S-bend, two 90° corners
+static const Piece CIRCUIT[] = {
+  {1.20f, 0.0f, true},
+  {(float)M_PI * 0.35f, 1 / 0.35f, false},        // 180° left, r 35 cm
+  {0.80f, 0.0f, false},
+  {(float)M_PI / 2 * 0.25f, 1 / 0.25f, false},    // 90° left, r 25 cm
+  {(float)M_PI / 2 * 0.20f, -1 / 0.20f, false},   // 90° right, r 20 cm
+  {0.60f, 0.0f, true},
+  {(float)M_PI / 2 * 0.20f, 1 / 0.20f, false},    // 90° left, r 20 cm
+  {0.50f, 0.0f, false},
+  {(float)M_PI / 2 * 0.25f, 1 / 0.25f, false},    // 90° left, r 25 cm
+};
+static const int N_PIECES = sizeof(CIRCUIT) / sizeof(CIRCUIT[0]);
+
+static float lapLength() {
+  float s = 0;
+  for (const Piece& p : CIRCUIT) s += p.len_m;
+  return s;
+}
+
+static const Piece& pieceAt(float s, float* piece_start) {
+  float lap = lapLength();
+  s = fmodf(s, lap);
+  float start = 0;
+  for (int i = 0; i < N_PIECES; i++) {
+    if (s < start + CIRCUIT[i].len_m || i == N_PIECES - 1) {
+      *piece_start = start;
+      return CIRCUIT[i];
+    }
+    start += CIRCUIT[i].len_m;
+  }
+  return CIRCUIT[0];
+}
+
+// ================= Car =================
+const float DT = 0.010f;               // = control period
+const float A_ACC = 1.5f;              // m/s² motor acceleration / braking
+const float A_LAT_GRIP = 2.2f;         // reactive follower loses the line above this
+const float CROSS_WIDTH_M = 0.02f;     // crossing line tape
+const float RECOVER_S = 1.0f;
+
+struct Car {
+  float s = 0, v = 0;
+  float ticks_l = 0, ticks_r = 0;     // fractional, not yet reported
+  int losses = 0;
+  float recover_left = 0;
+};
+
+struct Slip {
+  float bias_l, bias_r, noise;
+  std::mt19937 rng;
+  std::uniform_real_distribution<float> u{-1.0f, 1.0f};
+};
+
+// One control period. Returns ticks and cue like do_line would see them.
+static void stepCar(Car& c, float v_cmd, Slip& slip, long* dl, long* dr, TrackCue* cue) {
+  float piece_start;
+  if (c.recover_left > 0) {
+    c.recover_left -= DT;
+    v_cmd = 0;
+  }
+  float dv = v_cmd - c.v;
+  float lim = A_ACC * DT;
+  c.v += dv > lim ? lim : dv < -lim ? -lim : dv;
+  float ds = c.v * DT;
+  const Piece& p = pieceAt(c.s, &piece_start);
+  if (c.v * c.v * fabsf(p.curv) > A_LAT_GRIP && c.recover_left <= 0) {
+    c.losses++;
+    c.v = 0;
+    c.recover_left = RECOVER_S;
+  }
+
+  float half = 0.5f * CarChassis::TRACK_WIDTH_M * p.curv;
+  c.ticks_l += ds * (1 - half) * (1 + slip.bias_l + slip.noise * slip.u(slip.rng)) * CarChassis::TICKS_PER_M;
+  c.ticks_r += ds * (1 + half) * (1 + slip.bias_r + slip.noise * slip.u(slip.rng)) * CarChassis::TICKS_PER_M;
+  *dl = (long)c.ticks_l;
+  *dr = (long)c.ticks_r;
+  c.ticks_l -= *dl;
+  c.ticks_r -= *dr;
+  c.s += ds;
+
+  const Piece& now = pieceAt(c.s, &piece_start);
+  *cue = (now.cross && c.s - (floorf(c.s / lapLength()) * lapLength() + piece_start) < CROSS_WIDTH_M)
+             ? TRACK_CUE_CROSS : TRACK_CUE_LINE;
+}
+
+// ================= Main =================
+int main(int argc, char** argv) {
+  int laps = 3;
+  float v_base = 0.5f;
+  float slip_bias = 0.01f;
+  unsigned seed = 1;
+  bool verbose = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--laps") && i + 1 < argc) laps = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--v-base") && i + 1 < argc) v_base = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--slip") && i + 1 < argc) slip_bias = atof(argv[++i]);
+    else if (!strcmp(argv[i], "--seed") && i + 1 < argc) seed = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--verbose")) verbose = true;
+  }
+  const float lap = lapLength();
+  const float start_s = 0.40f;   // start mark 40 cm after the first crossing line
+  float origin_s = 0;            // first crossing line after the start = map origin
+  for (int i = 0; i < 5; i++) origin_s += CIRCUIT[i].len_m;
+  Slip slip{slip_bias, -slip_bias / 2, 0.03f, std::mt19937(seed)};
+  long dl, dr;
+  TrackCue cue;
+
+  // 1. Baseline: constant v_base
+  Car base;
+  base.s = start_s;
+  float t_base = 0;
+  while (base.s < start_s + laps * lap) {
+    stepCar(base, v_base, slip, &dl, &dr, &cue);
+    t_base += DT;
+  }
+  printf("circuit %.2f m, %d laps, v_base %.2f m/s, wheel slip %+.1f%% / %+.1f%%\n",
+         lap, laps, v_base, slip.bias_l * 100, slip.bias_r * 100);
+  printf("baseline    %6.2f s  (%.2f s/lap, %d line losses)\n", t_base, t_base / laps, base.losses);
+
+  // 2. Learning lap
+  TrackProfileConfig cfg;
+  track_profile_defaults(&cfg);
+  TrackLearner learner;
+  track_learn_begin(&learner);
+  Car learn;
+  learn.s = start_s;
+  while (learner.active && learn.s < start_s + 3 * lap) {
+    stepCar(learn, v_base, slip, &dl, &dr, &cue);
+    track_learn_step(&learner, dl, dr, cue);
+  }
+  TrackMap map;
+  bool ok = track_learn_finish(&learner, cfg, &map);
+  printf("learning    %s after %.2f m: %u segments, lap %.3f m (true %.3f), start offset %.3f m (true %.3f)\n",
+         ok ? (learner.closed ? "closed" : "stopped") : "FAILED", learn.s - start_s, map.count,
+         map.lap_mm / 1000.0f, lap, map.start_offset_mm / 1000.0f, origin_s - start_s);
+  if (verbose || !ok) {
+    for (uint8_t i = 0; i < map.count; i++) {
+      const TrackSegment& sg = map.seg[i];
+      printf("  seg %2u  %5u mm  curv %+6.2f /m  %-5s  v %.2f  entry %.2f\n", i, sg.len_mm,
+             sg.curv_mpm / 1000.0f, sg.junction == TRACK_JCT_CROSS ? "cross" : sg.junction == TRACK_JCT_T ? "T" : "",
+             sg.v_cms / 100.0f, sg.v_entry_cms / 100.0f);
+    }
+  }
+  if (!ok) return 1;
+
+  // 3. Fast laps from the start mark
+  TrackFollower fol;
+  track_follow_begin(&fol, &map, cfg);
+  Car fast;
+  fast.s = start_s;
+  float t_fast = 0, v_cmd = cfg.v_min, err_max = 0;
+  while (fast.s < start_s + laps * lap) {
+    stepCar(fast, v_cmd, slip, &dl, &dr, &cue);
+    v_cmd = track_follow_step(&fol, dl, dr, cue);
+    t_fast += DT;
+    // Map position vs truth (cyclic)
+    float err = fol.s_m - fmodf(fast.s - origin_s + lap, lap);
+    err = fabsf(err - lap * roundf(err / lap));
+    if (err > err_max) err_max = err;
+  }
+  printf("fast laps   %6.2f s  (%.2f s/lap, %d line losses, %u junction resyncs, position error max %.3f m)\n",
+         t_fast, t_fast / laps, fast.losses, fol.resyncs, err_max);
+  float gain = (t_base - t_fast) / t_base * 100;
+  printf("lap time    %+.1f%%\n", -gain);
+
+  bool pass = fast.losses == 0 && base.losses == 0 && t_fast < t_base;
+  printf(pass ? "PASS\n" : "FAIL\n");
+  return pass ? 0 : 1;
+}